@@ -151,6 +151,12 @@ struct {
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#ifdef NT
+# include <process.h>
+# define getpid _getpid
+#else
+# include <unistd.h>
+#endif
 #include "icc.h"
 #include "numlib.h"
 #include "xicc.h"
@@ -511,6 +517,18 @@ static void dopartialmap1(gammap *s, double *out, double *in);
 static void dopartialmap2(gammap *s, double *out, double *in);
 static gamut *parttransgamut(gammap *s, gamut *src);
 static void invdomap1(gammap *s, double *out, double *in);
+static char *gmc_dir(void);
+static void gmc_hash(ORD64 *h, void *buf, size_t len);
+static void gmc_hash_int(ORD64 *h, int val);
+static ORD64 gmc_key_init(void);
+static void gmc_hash_dbl(ORD64 *h, double val);
+static void gmc_hash_gamut(ORD64 *h, gamut *gam);
+static char *gmc_path(char *dir, ORD64 key, char *ext);
+static char *gmc_tmppath(char *path);
+static int gmc_rename(char *tpath, char *path);
+static gamut *gmc_read_gam(char *path);
+static nearsmth *gmc_read_nsm(char *path, int *npp, datai il, datai ih, datao ol, datao oh);
+static int gmc_write_nsm(char *path, nearsmth *nsm, int npts, datai il, datai ih, datao ol, datao oh);
 #ifdef PLOT_GAMUTS
 static void map_trans(void *cntx, double out[3], double in[3]);
 #endif
@@ -572,6 +590,7 @@ gammap *new_gammap(
 	int ngreyp = 0;		/* Number of grey axis mapping points */
 	int ngamp = 0;		/* Number of gamut mapping points */
 	double xvra = XVRA;	/* Extra ss vertex ratio to src gamut vertex count */
+	char *gmcpath = NULL;	/* Intermediate product cache file path */
 	int j;
 
 #if defined(PLOT_LMAP) || defined(PLOT_GAMUTS) || defined(PLOT_3DKNEES)
@@ -641,14 +660,51 @@ gammap *new_gammap(
 
 		}
 #endif
-		/* Intersect it with the source colorspace gamut in case */
-		/* something strange is going on. (mismatched appearance params ?) */
-		if ((si_gam = new_gamut(0.0, 0, 0)) == NULL) {
-			fprintf(stderr,"gamut map: new_gamut failed\n");
-			free(s);
-			return NULL;
+		/* See if the intersection is in the cache */
+		if (gmc_dir() != NULL) {
+			ORD64 key = gmc_key_init();
+
+			gmc_hash_int(&key, 1);		/* Intersection */
+			gmc_hash_gamut(&key, isi_gam);
+			gmc_hash_gamut(&key, sc_gam);
+			if ((gmcpath = gmc_path(gmc_dir(), key, "gam")) != NULL
+			 && (si_gam = gmc_read_gam(gmcpath)) != NULL && verb)
+				printf("Using cached image gamut intersection '%s'\n",gmcpath);
 		}
-		si_gam->intersect(si_gam, isi_gam, sc_gam);
+
+		if (si_gam == NULL) {
+			/* Intersect it with the source colorspace gamut in case */
+			/* something strange is going on. (mismatched appearance params ?) */
+			if ((si_gam = new_gamut(0.0, 0, 0)) == NULL) {
+				fprintf(stderr,"gamut map: new_gamut failed\n");
+				free(gmcpath);
+				free(s);
+				return NULL;
+			}
+			si_gam->intersect(si_gam, isi_gam, sc_gam);
+
+			/* Save it to the cache, and use what's read back, so that */
+			/* the result is the same as when it's found in the cache. */
+			if (gmcpath != NULL) {
+				gamut *ngam;
+				char *tpath;
+
+				if ((tpath = gmc_tmppath(gmcpath)) != NULL
+				 && si_gam->write_bgam(si_gam, tpath) == 0
+				 && gmc_rename(tpath, gmcpath) == 0
+				 && (ngam = gmc_read_gam(gmcpath)) != NULL) {
+					si_gam->del(si_gam);
+					si_gam = ngam;
+				} else if (verb)
+					printf("Warning: Unable to cache image gamut intersection in '%s'\n",gmcpath);
+				if (tpath != NULL) {
+					remove(tpath);		/* In case write_bgam() failed part way */
+					free(tpath);
+				}
+			}
+		}
+		free(gmcpath);
+		gmcpath = NULL;
 
 		if (src_kbp) {
 			if (si_gam->getwb(si_gam, NULL, NULL, NULL, s_ga_wp, NULL, s_ga_bp)) {
@@ -1296,6 +1352,7 @@ glumknf	= 1.0;
 		double avgdev[MXDO];
 		nearsmth *nsm = NULL;	/* Returned list of near smooth points */
 		int nnsm;				/* Number of near smoothed points */
+		void *cxs[PFOR_MAXTHR];	/* Per thread rspl callback contexts */
 		double brad = 0.0;		/* Black bend radius */
 		gammapweights xpweights[14], xlpweights[14], xsweights[14];
 		                        /* Explicit perceptial, lightnes pp. and sat. weights */
@@ -1501,6 +1558,8 @@ typedef struct {
 		}
 
 		/* Create weights as blend between perceptual, lightness pp. and saturation */
+		/* (Cleared first so that the cache key doesn't depend on padding) */
+		memset((void *)xwh, 0, sizeof(xwh));
 		near_xwblend3(xwh, xpweights, gmi->gampwf, xlpweights, gmi->gamlpwf,
 		                   xsweights, gmi->gamswf);
 		if ((gmi->gampwf + gmi->gamlpwf + gmi->gamswf) > 0.1)
@@ -1511,12 +1570,47 @@ typedef struct {
 			tweak_weights(xwh, dst_cmymap, rel_oride); 
 		}
 
+		/* See if the near point mapping is in the cache */
+		if (gmc_dir() != NULL) {
+			ORD64 key = gmc_key_init();
+
+			gmc_hash_int(&key, 2);		/* near_smooth() points */
+			gmc_hash_gamut(&key, scl_gam);
+			gmc_hash_gamut(&key, sil_gam);
+			gmc_hash_gamut(&key, d_gam);
+			gmc_hash_int(&key, src_kbp);
+			gmc_hash_int(&key, dst_kbp);
+			for (j = 0; j < 3; j++)
+				gmc_hash_dbl(&key, dr_cs_bp[j]);
+			gmc_hash(&key, (void *)xwh, sizeof(xwh));
+			gmc_hash_dbl(&key, gmi->gamcknf);
+			gmc_hash_dbl(&key, gmi->gamxknf);
+			gmc_hash_int(&key, gmi->gamcpf > 1e-6);
+			gmc_hash_int(&key, gmi->gamexf > 1e-6);
+			gmc_hash_dbl(&key, xvra);
+			gmc_hash_int(&key, mapres);
+			gmc_hash_dbl(&key, smooth);
+			gmc_hash_int(&key, surfpnts);
+			if ((gmcpath = gmc_path(gmc_dir(), key, "nsm")) != NULL
+			 && (nsm = gmc_read_nsm(gmcpath, &nnsm, il, ih, ol, oh)) != NULL && verb)
+				printf("Using cached gamut mapping guide vectors '%s'\n",gmcpath);
+		}
+
 		/* Create the near point mapping, which is our fundamental gamut */
 		/* hull to gamut hull mapping. */
-		nsm = near_smooth(verb, &nnsm, scl_gam, sil_gam, d_gam, src_kbp, dst_kbp,
-		                  dr_cs_bp, xwh, gmi->gamcknf, gmi->gamxknf,
-		                  gmi->gamcpf > 1e-6, gmi->gamexf > 1e-6,
-		                  xvra, mapres, smooth, 1.10, surfpnts, il, ih, ol, oh);
+		if (nsm == NULL) {
+			nsm = near_smooth(verb, &nnsm, scl_gam, sil_gam, d_gam, src_kbp, dst_kbp,
+			                  dr_cs_bp, xwh, gmi->gamcknf, gmi->gamxknf,
+			                  gmi->gamcpf > 1e-6, gmi->gamexf > 1e-6,
+			                  xvra, mapres, smooth, 1.10, surfpnts, il, ih, ol, oh);
+
+			if (nsm != NULL && gmcpath != NULL
+			 && gmc_write_nsm(gmcpath, nsm, nnsm, il, ih, ol, oh) != 0 && verb)
+				printf("Warning: Unable to cache gamut mapping guide vectors in '%s'\n",gmcpath);
+		}
+		free(gmcpath);
+		gmcpath = NULL;
+
 		if (nsm == NULL) {
 			fprintf(stderr,"Creating smoothed near points failed\n");
 			s->grey->del(s->grey);
@@ -1752,11 +1846,18 @@ typedef struct {
 			cx.dst = d_gam; 
 			cx.satenh = gmi->satenh; 
 
+			/* adjust_sat_func() only reads cx and queries the frozen */
+			/* destination gamut, so all the threads can share it. */
+			d_gam->freeze(d_gam);
+			for (j = 0; j < PFOR_MAXTHR; j++)
+				cxs[j] = (void *)&cx;
+
 			/* Saturation enhance the output values */
-			s->map->re_set_rspl(
+			s->map->re_set_rspl_mt(
 				s->map,				/* this */
 				0,					/* Combination of flags */
-				(void *)&cx,		/* Opaque function context */
+				PFOR_MAXTHR,		/* Number of contexts */
+				cxs,				/* Per thread opaque function contexts */
 				adjust_sat_func /* Function to set from */
 			);
 		}
@@ -1801,10 +1902,13 @@ typedef struct {
 			icmVecRotMat(cx.mat, a_wp, a_bp, d_mt_wp, d_mt_bp);		/* wp & bp */
 
 			/* Fine tune the 3D->3D mapping */
-			s->map->re_set_rspl(
+			for (j = 0; j < PFOR_MAXTHR; j++)
+				cxs[j] = (void *)&cx;
+			s->map->re_set_rspl_mt(
 				s->map,				/* this */
 				0,					/* Combination of flags */
-				(void *)&cx,		/* Opaque function context */
+				PFOR_MAXTHR,		/* Number of contexts */
+				cxs,				/* Per thread opaque function contexts */
 				adjust_wb_func 		/* Function to set from */
 			);
 
@@ -2648,22 +2752,307 @@ static gamut *parttransgamut(gammap *s, gamut *src) {
 	return dst;
 }
 
+/* ------------------------------------------------------------- */
+/* Optional disk cache of the intermediate products of new_gammap(). */
+/* If ARGYLL_GAMMAP_CACHE_DIR is set to an existing directory, the intersected */
+/* source image gamut and the near_smooth() guide vectors are saved there, */
+/* keyed by a hash of everything they depend on. Re-creating a link from */
+/* the same gamuts and mapping weights (e.g. with only a different clut */
+/* resolution or output curves) then doesn't have to recompute them. */
+
+#define GMC_VERSION 1			/* Bump whenever a change to the code would change what is cached */
+#define GMC_NSM_MAGIC "AGMNSM"	/* near_smooth() cache file identifier, 8 bytes including nul */
+#define GMC_NSM_VERSION 1		/* Layout version */
+#define GMC_BORDER 0x01020304	/* Byte order check value */
+
+/* near_smooth() cache file header */
+typedef struct {
+	char magic[8];				/* GMC_NSM_MAGIC */
+	int version;				/* GMC_NSM_VERSION */
+	int border;					/* GMC_BORDER in the writers byte order */
+	int npts;					/* Number of points that follow */
+	datai il, ih;				/* near_smooth() returned input range */
+	datao ol, oh;				/* near_smooth() returned output range */
+} gmc_nsm_hdr;
+
+/* The public part of a nearsmth point, as it is saved in the cache */
+typedef struct {
+	int uflag, gflag, vflag;
+	double sv[3], sr, drv[3], drr, dv[3], dr, div[3], w1;
+	double sv2[3], dv2[3], div2[3], w2;
+	double sd3[3], w3;
+	double csv[3];
+} gmc_nsm_pnt;
+
+/* Return the cache directory, NULL if caching is not enabled */
+static char *gmc_dir(void) {
+	char *ev;
+
+	if ((ev = getenv("ARGYLL_GAMMAP_CACHE_DIR")) == NULL || ev[0] == '\000')
+		return NULL;
+	return ev;
+}
+
+/* Add some bytes to a 64 bit FNV-1a hash */
+static void gmc_hash(ORD64 *h, void *buf, size_t len) {
+	unsigned char *bp = (unsigned char *)buf;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		*h ^= bp[i];
+		*h *= (ORD64)0x100000001b3;
+	}
+}
+
+static void gmc_hash_int(ORD64 *h, int val) {
+	gmc_hash(h, (void *)&val, sizeof(int));
+}
+
+/* Return the initial cache key. This covers the cache version, */
+/* so that files cached by a different version are never used. */
+static ORD64 gmc_key_init(void) {
+	ORD64 key = (ORD64)0xcbf29ce484222325;
+
+	gmc_hash_int(&key, GMC_VERSION);
+	return key;
+}
+
+static void gmc_hash_dbl(ORD64 *h, double val) {
+	if (val == 0.0)
+		val = 0.0;		/* Don't distinguish -0.0 */
+	gmc_hash(h, (void *)&val, sizeof(double));
+}
+
+/* Add everything about a gamut that the mapping depends on to a hash */
+static void gmc_hash_gamut(ORD64 *h, gamut *gam) {
+	double p[3], wbk[3][3], cusps[6][3];
+	int i, rv;
+
+	gmc_hash_int(h, gam->getisjab(gam));
+	gmc_hash_int(h, gam->getisrast(gam));
+	gmc_hash_dbl(h, gam->getsres(gam));
+
+	for (i = 0;;) {
+		if ((i = gam->getrawvert(gam, p, i)) < 0)
+			break;
+		gmc_hash_dbl(h, p[0]);
+		gmc_hash_dbl(h, p[1]);
+		gmc_hash_dbl(h, p[2]);
+	}
+
+	memset((void *)wbk, 0, sizeof(wbk));
+	rv = gam->getwb(gam, wbk[0], wbk[1], wbk[2], NULL, NULL, NULL);
+	gmc_hash_int(h, rv);
+	gmc_hash(h, (void *)wbk, sizeof(wbk));
+
+	memset((void *)cusps, 0, sizeof(cusps));
+	rv = gam->getcusps(gam, cusps);
+	gmc_hash_int(h, rv);
+	gmc_hash(h, (void *)cusps, sizeof(cusps));
+}
+
+/* Return an allocated cache file path for the given key and extension */
+static char *gmc_path(char *dir, ORD64 key, char *ext) {
+	char *path;
 
+	if ((path = (char *)malloc(strlen(dir) + 30)) == NULL)
+		return NULL;
+	sprintf(path, "%s/gm%08x%08x.%s", dir,
+	        (unsigned int)(key >> 32), (unsigned int)(key & 0xffffffff), ext);
+	return path;
+}
 
+/* Return an allocated temporary path to write a cache file to. */
+/* It's in the same directory, so that it can be renamed into place, */
+/* and unique to this process, so that concurrent writers don't collide. */
+static char *gmc_tmppath(char *path) {
+	char *tpath;
 
+	if ((tpath = (char *)malloc(strlen(path) + 20)) == NULL)
+		return NULL;
+	sprintf(tpath, "%s.%d.tmp", path, (int)getpid());
+	return tpath;
+}
 
+/* Rename a completely written temporary cache file into place, */
+/* so that readers never see a partly written file. */
+/* Return nz on error, with the temporary file removed. */
+static int gmc_rename(char *tpath, char *path) {
+#ifdef NT
+	remove(path);		/* MSWin rename() won't replace an existing file */
+#endif
+	if (rename(tpath, path) != 0) {
+		remove(tpath);
+		return 1;
+	}
+	return 0;
+}
+
+/* Return the gamut in the given cache file, NULL if there isn't one */
+static gamut *gmc_read_gam(char *path) {
+	FILE *fp;
+	gamut *gam;
 
+	if ((fp = fopen(path, "rb")) == NULL)
+		return NULL;
+	fclose(fp);
+
+	if ((gam = new_gamut(0.0, 0, 0)) == NULL)
+		return NULL;
+	if (gam->read_gam(gam, path) != 0) {
+		gam->del(gam);
+		return NULL;
+	}
+	return gam;
+}
 
+/* Return the near_smooth() points in the given cache file, */
+/* NULL if there aren't any. */
+static nearsmth *gmc_read_nsm(
+	char *path,
+	int *npp,				/* Return the number of points */
+	datai il, datai ih,		/* Return input range */
+	datao ol, datao oh		/* Return output range */
+) {
+	FILE *fp;
+	gmc_nsm_hdr h;
+	gmc_nsm_pnt p;
+	nearsmth *nsm;
+	int i;
 
+	if ((fp = fopen(path, "rb")) == NULL)
+		return NULL;
 
+	if (fread((void *)&h, sizeof(gmc_nsm_hdr), 1, fp) != 1
+	 || memcmp(h.magic, GMC_NSM_MAGIC, 7) != 0
+	 || h.version != GMC_NSM_VERSION
+	 || h.border != GMC_BORDER
+	 || h.npts <= 0
+	 || (nsm = (nearsmth *)calloc(h.npts, sizeof(nearsmth))) == NULL) {
+		fclose(fp);
+		return NULL;
+	}
 
+	for (i = 0; i < h.npts; i++) {
+		if (fread((void *)&p, sizeof(gmc_nsm_pnt), 1, fp) != 1)
+			break;
+		nsm[i].uflag = p.uflag;
+		nsm[i].gflag = p.gflag;
+		nsm[i].vflag = p.vflag;
+		icmCpy3(nsm[i].sv, p.sv);
+		nsm[i].sr = p.sr;
+		icmCpy3(nsm[i].drv, p.drv);
+		nsm[i].drr = p.drr;
+		icmCpy3(nsm[i].dv, p.dv);
+		nsm[i].dr = p.dr;
+		icmCpy3(nsm[i].div, p.div);
+		nsm[i].w1 = p.w1;
+		icmCpy3(nsm[i].sv2, p.sv2);
+		icmCpy3(nsm[i].dv2, p.dv2);
+		icmCpy3(nsm[i].div2, p.div2);
+		nsm[i].w2 = p.w2;
+		icmCpy3(nsm[i].sd3, p.sd3);
+		nsm[i].w3 = p.w3;
+		icmCpy3(nsm[i].csv, p.csv);
+	}
+	fclose(fp);
 
+	if (i < h.npts) {
+		free(nsm);
+		return NULL;
+	}
 
+	*npp = h.npts;
+	for (i = 0; i < MXDI; i++) {
+		il[i] = h.il[i];
+		ih[i] = h.ih[i];
+	}
+	for (i = 0; i < MXDO; i++) {
+		ol[i] = h.ol[i];
+		oh[i] = h.oh[i];
+	}
+	return nsm;
+}
 
+/* Save near_smooth() points to the given cache file. */
+/* Return nz on error. */
+static int gmc_write_nsm(
+	char *path,
+	nearsmth *nsm,
+	int npts,
+	datai il, datai ih,
+	datao ol, datao oh
+) {
+	FILE *fp;
+	char *tpath;
+	gmc_nsm_hdr h;
+	gmc_nsm_pnt p;
+	int i;
 
+	memset((void *)&h, 0, sizeof(gmc_nsm_hdr));
+	strcpy(h.magic, GMC_NSM_MAGIC);
+	h.version = GMC_NSM_VERSION;
+	h.border = GMC_BORDER;
+	h.npts = npts;
+	for (i = 0; i < MXDI; i++) {
+		h.il[i] = il[i];
+		h.ih[i] = ih[i];
+	}
+	for (i = 0; i < MXDO; i++) {
+		h.ol[i] = ol[i];
+		h.oh[i] = oh[i];
+	}
 
+	/* Write to a temporary file, and then rename it into place */
+	if ((tpath = gmc_tmppath(path)) == NULL)
+		return 1;
 
+	if ((fp = fopen(tpath, "wb")) == NULL) {
+		free(tpath);
+		return 1;
+	}
 
+	if (fwrite((void *)&h, sizeof(gmc_nsm_hdr), 1, fp) != 1) {
+		fclose(fp);
+		remove(tpath);
+		free(tpath);
+		return 1;
+	}
 
+	memset((void *)&p, 0, sizeof(gmc_nsm_pnt));
+	for (i = 0; i < npts; i++) {
+		p.uflag = nsm[i].uflag;
+		p.gflag = nsm[i].gflag;
+		p.vflag = nsm[i].vflag;
+		icmCpy3(p.sv, nsm[i].sv);
+		p.sr = nsm[i].sr;
+		icmCpy3(p.drv, nsm[i].drv);
+		p.drr = nsm[i].drr;
+		icmCpy3(p.dv, nsm[i].dv);
+		p.dr = nsm[i].dr;
+		icmCpy3(p.div, nsm[i].div);
+		p.w1 = nsm[i].w1;
+		icmCpy3(p.sv2, nsm[i].sv2);
+		icmCpy3(p.dv2, nsm[i].dv2);
+		icmCpy3(p.div2, nsm[i].div2);
+		p.w2 = nsm[i].w2;
+		icmCpy3(p.sd3, nsm[i].sd3);
+		p.w3 = nsm[i].w3;
+		icmCpy3(p.csv, nsm[i].csv);
+		if (fwrite((void *)&p, sizeof(gmc_nsm_pnt), 1, fp) != 1)
+			break;
+	}
 
+	if (fclose(fp) != 0 || i < npts) {
+		remove(tpath);
+		free(tpath);
+		return 1;
+	}
+	if (gmc_rename(tpath, path) != 0) {
+		free(tpath);
+		return 1;
+	}
+	free(tpath);
+	return 0;
+}
 
@@ -65,7 +65,6 @@
 							/* of triangulation (Only on second pass if #define DO_TWOPASS) */
 #undef DEBUG_TRIANG_VRML_STEP	/* Wait for return after each step */
 
-#undef DEBUG_SPLIT_VRML		/* Create diag3 vis for each step of triangle plane split */
 
 #undef TEST_LOOKUP
 #undef TEST_NEAREST
@@ -113,9 +112,6 @@
  *
  *  Need to cleanup error handling. We just exit() at the moment.
  *
- *  Replace BSP tree optmisation with ball tree, to speedup
- *  radial, nearest, and vector search ?
- *
  *  The log surface stuff is a compromise, that ends up with
  *  some dings and nicks, and a not fully detailed/smooth surface.
  *  The fundamental limitation is the use of the Delaunay triangulation
@@ -135,8 +131,10 @@
 #endif
 
 static void triangulate(gamut *s);
+static void init_lu(gamut *s);
 static void del_gamut(gamut *s);
 static gvert *expand_gamut(gamut *s, double in[3]);
+static void expand_gamut_n(gamut *s, double (*in)[3], int n);
 static void set_cs_bp_kp_ovrd(gamut *s, double *bk, double *kp);
 static double getsres(gamut *s);
 static int getisjab(gamut *s);
@@ -153,8 +151,9 @@ static int nverts(gamut *s);
 static int getvert(gamut *s, double *rad, double pos[3], int ix);
 static int nssverts(gamut *s, double xvra);
 static int getssvert(gamut *s, double *rad, double pos[3], double norm[3], int ix);
-static void startnexttri(gamut *s);
-static int getnexttri(gamut *s, int v[3]);
+static void startnexttri(gamut *s, gtriter *it);
+static int getnexttri(gamut *s, gtriter *it, int v[3]);
+static void freeze(gamut *s);
 static double volume(gamut *s);
 static int write_to_vrml(gamut *s, vrml *wrl, double trans, int docusps);	
 static int write_trans_vrml(gamut *s, char *filename, int doaxes, int docusps,
@@ -162,10 +161,16 @@ static int write_trans_vrml(gamut *s, char *filename, int doaxes, int docusps,
 static int write_vrml(gamut *s, char *filename, int doaxes, int docusps);
 static int write_gam(gamut *s, char *filename);
 static int read_gam(gamut *s, char *filename);
+static int write_bgam(gamut *s, char *filename);
 static double radial(gamut *s, double out[3], double in[3]);
 static double nradial(gamut *s, double out[3], double in[3]);
 static void nearest(gamut *s, double out[3], double in[3]);
 static void nearest_tri(gamut *s, double out[3], double in[3], gtri **ctri);
+static void radial_n(gamut *s, double *or, double (*out)[3], double (*in)[3], int n);
+static void nradial_n(gamut *s, double *or, double (*out)[3], double (*in)[3], int n);
+static void nearest_n(gamut *s, double (*out)[3], double (*in)[3], int n);
+static void vector_isect_n(gamut *s, int *rv, double (*p1)[3], double (*p2)[3],
+                           double (*min)[3], double (*max)[3], double *mint, double *maxt, int n);
 static void setwb(gamut *s, double *wp, double *bp, double *kp);
 static int getwb(gamut *s, double *cswp, double *csbp, double *cskp, double *gawp, double *gabp, double *gakp);
 static void setcusps(gamut *s, int flag, double in[3]);
@@ -182,7 +187,8 @@ static int vect_intersect(gamut *s, double *rvp, double *ip, double *p1, double
 static void compgawb(gamut *s);
 
 /* in isecvol.c: */
-extern double isect_volume(gamut *s1, gamut *s2);
+extern double vox_volume(gamut *s, int res, double *err);
+extern double vox_isect_volume(gamut *s1, gamut *s2, int res, double *err);
 
 /* ------------------------------------ */
 
@@ -469,53 +475,6 @@ static int gquad_quadrant(gquad *q, double p[3]) {
 	return i;
 }
 
-/* ------------------------------------ */
-/* Allocate a BSP decision node structure */
-gbspn *new_gbspn(void) {
-	gbspn *t;
-	static int n = 0; 		/* Serial number */
-	if ((t = (gbspn *) calloc(1, sizeof(gbspn))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed - bspn node\n");
-		exit(-1);
-	}
-	t->tag = 1;		/* bspn decision node */
-	t->n = n++;
-
-	return t;
-}
-
-/* Delete a BSP decision node struture */
-void del_gbspn(gbspn *t) {
-	free(t);
-}
-
-/* ------------------------------------ */
-/* Allocate a BSP tree triangle list node structure */
-gbspl *new_gbspl(
-int nt,			/* Number of triangles in the list */
-gtri **t		/* List of triangles to copy into structure */
-) {
-	gbspl *l;
-	int i;
-	static int n = 0; 		/* Serial number */
-	if ((l = (gbspl *) calloc(1, sizeof(gbspl) + nt * sizeof(gtri *))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed - bspl triangle tree node\n");
-		exit(-1);
-	}
-	l->tag = 3;		/* bspl triangle list node */
-	l->n = n++;
-	l->nt = nt;
-	for (i = 0; i < nt; i++)
-		l->t[i] = t[i];
-
-	return l;
-}
-
-/* Delete a BSP tree triangle list structure */
-void del_gbspl(gbspl *l) {
-	free(l);
-}
-
 /* ------------------------------------ */
 /* Allocate a triangle structure */
 gtri *new_gtri(void) {
@@ -525,7 +484,6 @@ gtri *new_gtri(void) {
 		fprintf(stderr,"gamut: malloc failed - gamut surface triangle\n");
 		exit(-1);
 	}
-	t->tag = 2;		/* Triangle */
 	t->n = n++;
 
 	return t;
@@ -630,13 +588,13 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	INIT_LIST(s->edges);		/* Init edge list (?) */
 	s->read_inited = 0;
 	s->lu_inited = 0;
-	s->ne_inited = 0;
 	s->cswbset = 0;
 	s->gawbset = 0;
 
 	/* Setup methods */
 	s->del         = del_gamut;
 	s->expand      = expand_gamut;
+	s->expand_n    = expand_gamut_n;
 	s->set_cs_bp_kp_ovrd = set_cs_bp_kp_ovrd;
 	s->getsres     = getsres;
 	s->getisjab    = getisjab;
@@ -655,8 +613,11 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	s->getvert     = getvert;
 	s->startnexttri = startnexttri;
 	s->getnexttri = getnexttri;
+	s->freeze      = freeze;
 	s->getvert     = getvert;
 	s->volume      = volume;
+	s->vox_volume  = vox_volume;
+	s->vox_isect_volume = vox_isect_volume;
 	s->intersect   = intersect;
 	s->nexpintersect   = nexpintersect;
 	s->expdstbysrcmdst = expdstbysrcmdst;
@@ -664,6 +625,10 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	s->nradial     = nradial;
 	s->nearest     = nearest;
 	s->nearest_tri = nearest_tri;
+	s->radial_n    = radial_n;
+	s->nradial_n   = nradial_n;
+	s->nearest_n   = nearest_n;
+	s->vector_isect_n = vector_isect_n;
 	s->vector_isect = compute_vector_isect;
 	s->vector_isectns = compute_vector_isectns;
 	s->setwb       = setwb;
@@ -674,13 +639,13 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	s->write_vrml  = write_vrml;
 	s->write_trans_vrml = write_trans_vrml;
 	s->write_gam   = write_gam;
+	s->write_bgam  = write_bgam;
 	s->read_gam    = read_gam;
 
 	return s;
 }
 
-static void del_gnn(gnn *p);
-static void del_gbsp(gbsp *n);
+static void del_gbvh(gbvh *b);
 
 /* Free and clear the triangulation structures, */
 /* and clear the triangulation vertex flags. */
@@ -689,12 +654,10 @@ static void del_triang(gamut *s) {
 	gtri *tp;		/* Triangle pointer */
 	gedge *ep;
 
-	/* Recursively free radial lookup acceleration structures */
-	/* Do this before we delete triangles, because there may */
-	/* be triangles in the tree. */
-	if (s->lutree != NULL) {
-		del_gbsp(s->lutree);
-		s->lutree = NULL;
+	/* Free the lookup acceleration structure */
+	if (s->bvh != NULL) {
+		del_gbvh(s->bvh);
+		s->bvh = NULL;
 	}
 
 	if (s->tris != NULL) {
@@ -718,12 +681,6 @@ static void del_triang(gamut *s) {
 	
 	s->lu_inited = 0;
 
-	if (s->nns != NULL) {
-		del_gnn(s->nns);
-		s->nns = NULL;
-	}
-	s->ne_inited = 0;
-
 	/* Reset the vertex flags triangulation changes */
 	for (i = 0; i < s->nv; i++) {
 		s->verts[i]->f &= ~GVERT_TRI;
@@ -772,26 +729,14 @@ del_gamut(gamut *s) {
 
  */
 
-/* Helper function that returns nz if v1 should replace v2 */
-static int smreplace(
+/* Helper function that returns the slot weighted */
+/* radius squared of a point, used to choose the maxima. */
+static double smweight(
 gamut *s,
 int d,			/* Slot number */
-gvert *v1,		/* Candidate vertex */
-gvert *v2		/* Existing vertex */
+double *p		/* Point */
 ) {
-	double xx, w[3], c[3];
-	int j;
-	if (v2 == NULL)
-		return 1;
-
-	/* Filter out any points that are almost identical */
-	/* This can cause numerical problems in the triangle BSP tree creation. */ 
-	for (xx = 0.0, j = 0; j < 3; j++) {
-		double tt = v1->p[j] - v2->p[j];
-		xx += tt * tt;
-	}
-	if (xx < (1e-4 * 1e-4))
-		return 0;
+	double w[3], c[3];
 
 	c[0] = s->cent[0];
 	c[1] = s->cent[1];
@@ -833,12 +778,33 @@ gvert *v2		/* Existing vertex */
 	w[0] *= w[0];		/* Because we're weighting the squares */
 	w[1] *= w[1];
 	w[2] *= w[2];
-	return ( w[0] * (v1->p[0] - c[0]) * (v1->p[0] - c[0])
-	       + w[1] * (v1->p[1] - c[1]) * (v1->p[1] - c[1])
-	       + w[2] * (v1->p[2] - c[2]) * (v1->p[2] - c[2]))
-	     > ( w[0] * (v2->p[0] - c[0]) * (v2->p[0] - c[0])
-	       + w[1] * (v2->p[1] - c[1]) * (v2->p[1] - c[1])
-	       + w[2] * (v2->p[2] - c[2]) * (v2->p[2] - c[2]));
+	return w[0] * (p[0] - c[0]) * (p[0] - c[0])
+	     + w[1] * (p[1] - c[1]) * (p[1] - c[1])
+	     + w[2] * (p[2] - c[2]) * (p[2] - c[2]);
+}
+
+/* Helper function that returns nz if v1 should replace v2 */
+static int smreplace(
+gamut *s,
+int d,			/* Slot number */
+gvert *v1,		/* Candidate vertex */
+gvert *v2		/* Existing vertex */
+) {
+	double xx;
+	int j;
+	if (v2 == NULL)
+		return 1;
+
+	/* Filter out any points that are almost identical */
+	/* This can cause numerical problems in the triangulation. */ 
+	for (xx = 0.0, j = 0; j < 3; j++) {
+		double tt = v1->p[j] - v2->p[j];
+		xx += tt * tt;
+	}
+	if (xx < (1e-4 * 1e-4))
+		return 0;
+
+	return smweight(s, d, v1->p) > smweight(s, d, v2->p);
 }
 
 
@@ -863,7 +829,7 @@ double pp[3]		/* rectangular coordinate of point */
 	double aa;
 	int j;
 
-	if (s->tris != NULL || s->read_inited || s->lu_inited || s->ne_inited) {
+	if (s->tris != NULL || s->read_inited || s->lu_inited) {
 		fprintf(stderr,"Can't add points to gamut now!\n");
 		exit(-1);
 	}
@@ -911,7 +877,7 @@ double pp[3]		/* rectangular coordinate of point */
 	if (s->nofilter) {
 
 		/* Filter out any points that are almost identical. */
-		/* This can cause numerical problems in the triangle BSP tree creation. */ 
+		/* This can cause numerical problems in the triangulation. */ 
 		for (i = 0; i < s->nv; i++) {
 			double xx;
 	
@@ -1065,6 +1031,227 @@ double pp[3]		/* rectangular coordinate of point */
 	return NULL;
 }
 
+/* ------------------------------------ */
+/* Bulk expansion */
+/*
+ * Rather than putting all the points through the segmented maxima
+ * quadtree one at a time, the points are first binned by their
+ * direction from the center, on a cube map grid that is finer than
+ * the finest quadtree segments, and only the points that are the
+ * maximum of one of the direction slots of their bin are kept.
+ * Each thread bins a share of the points, and the thread's bins are
+ * then merged. Ties are resolved by point index, so the result doesn't
+ * depend on the number of threads. The surviving points are then
+ * added to the quadtree in their original order.
+ */
+
+#define GBULK_MAXRES 256	/* Maximum bin resolution along a cube face edge */
+#define GBULK_BLOCK 16384	/* Number of points in each block of work */
+
+/* Bulk expansion context */
+typedef struct {
+	gamut *s;
+	double (*in)[3];	/* Points */
+	int n;				/* Number of points */
+	int res;			/* Bin resolution along each cube face edge */
+	int nbins;			/* Number of bins */
+	int **bins;			/* Per thread [nbins][NSLOTS] point index + 1, 0 if empty */
+	double (*mn)[3];	/* Per thread bounding range of all the points */
+	double (*mx)[3];
+} gbulk;
+
+/* Return the bin index of a point, or -1 if it is at the center */
+static int gbulk_bin(
+gbulk *p,
+double *pp
+) {
+	gamut *s = p->s;
+	int j, mj, f, iu, iv;
+	double vv[3], mx;
+
+	for (mj = 0, mx = -1.0, j = 0; j < 3; j++) {
+		vv[j] = pp[j] - s->cent[j];
+		if (fabs(vv[j]) > mx) {
+			mx = fabs(vv[j]);
+			mj = j;
+		}
+	}
+	if (mx < 1e-6)
+		return -1;
+
+	f = 2 * mj + (vv[mj] < 0.0 ? 1 : 0);
+	iu = (int)(0.5 * (vv[(mj + 1) % 3]/mx + 1.0) * p->res);
+	iv = (int)(0.5 * (vv[(mj + 2) % 3]/mx + 1.0) * p->res);
+	if (iu >= p->res)
+		iu = p->res-1;
+	if (iv >= p->res)
+		iv = p->res-1;
+
+	return (f * p->res + iv) * p->res + iu;
+}
+
+/* Put point i into bin slot b[], if it is the maximum */
+static void gbulk_max(
+gbulk *p,
+int *b,			/* NSLOTS point indexes + 1 */
+int i			/* Point index */
+) {
+	int k;
+
+	for (k = 0; k < NSLOTS; k++) {
+		int oi = b[k] - 1;
+		double w1, w2;
+
+		if (oi < 0) {
+			b[k] = i + 1;
+			continue;
+		}
+		w1 = smweight(p->s, k, p->in[i]);
+		w2 = smweight(p->s, k, p->in[oi]);
+		if (w1 > w2 || (w1 == w2 && i < oi))
+			b[k] = i + 1;
+	}
+}
+
+/* Bin a block of the points */
+static void gbulk_block(void *cntx, int thix, int bix) {
+	gbulk *p = (gbulk *)cntx;
+	int *bins = p->bins[thix];
+	int i, i1, j;
+
+	i = bix * GBULK_BLOCK;
+	i1 = i + GBULK_BLOCK;
+	if (i1 > p->n)
+		i1 = p->n;
+
+	for (; i < i1; i++) {
+		double *pp = p->in[i];
+		int bi;
+
+		for (j = 0; j < 3; j++) {
+			if (pp[j] > p->mx[thix][j])
+				p->mx[thix][j] = pp[j];
+			if (pp[j] < p->mn[thix][j])
+				p->mn[thix][j] = pp[j];
+		}
+
+		if ((bi = gbulk_bin(p, pp)) < 0)
+			continue;
+
+		gbulk_max(p, bins + bi * NSLOTS, i);
+	}
+}
+
+/* Expand the gamut by adding n points. */
+/* This is the same as calling expand() for each point, */
+/* except that most of the points that would be filtered */
+/* out are discarded in parallel first. */
+static void expand_gamut_n(
+gamut *s,
+double (*in)[3],	/* rectangular coordinate of points */
+int n				/* Number of points */
+) {
+	gbulk bb;
+	int nthr, i, j, t;
+	char *keep;
+
+	if (s->tris != NULL || s->read_inited || s->lu_inited) {
+		fprintf(stderr,"Can't add points to gamut now!\n");
+		exit(-1);
+	}
+
+	if (n <= 0)
+		return;
+
+	/* Without filtering, every point will be added anyway */
+	if (s->nofilter) {
+		for (i = 0; i < n; i++)
+			expand_gamut(s, in[i]);
+		return;
+	}
+
+	bb.s = s;
+	bb.in = in;
+	bb.n = n;
+
+	/* The finest quadtree segment is about sres/50 radians for the */
+	/* largest colorspace radius, and a cube face covers PI/2 radians. */
+	/* Aim for 4 bins per finest segment. */
+	bb.res = (int)ceil(4.0 * M_PI/2.0 / (s->sres/50.0));
+	if (bb.res > GBULK_MAXRES)
+		bb.res = GBULK_MAXRES;
+	if (bb.res < 1)
+		bb.res = 1;
+	bb.nbins = 6 * bb.res * bb.res;
+
+	nthr = pfor_nthreads();
+	if (nthr > ((n + GBULK_BLOCK - 1)/GBULK_BLOCK))
+		nthr = (n + GBULK_BLOCK - 1)/GBULK_BLOCK;
+
+	if ((bb.bins = (int **) malloc(nthr * sizeof(int *))) == NULL
+	 || (bb.mn = (double (*)[3]) malloc(nthr * sizeof(double [3]))) == NULL
+	 || (bb.mx = (double (*)[3]) malloc(nthr * sizeof(double [3]))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed - bulk expand\n");
+		exit(-1);
+	}
+	for (t = 0; t < nthr; t++) {
+		if ((bb.bins[t] = (int *) calloc(bb.nbins * NSLOTS, sizeof(int))) == NULL) {
+			fprintf(stderr,"gamut: calloc failed - bulk expand bins (%d)\n",bb.nbins);
+			exit(-1);
+		}
+		for (j = 0; j < 3; j++) {
+			bb.mn[t][j] = 1e38;
+			bb.mx[t][j] = -1e38;
+		}
+	}
+
+	pfor((n + GBULK_BLOCK - 1)/GBULK_BLOCK, nthr, (void *)&bb, gbulk_block);
+
+	/* Merge the other threads bins and ranges into the first */
+	for (t = 1; t < nthr; t++) {
+		for (i = 0; i < (bb.nbins * NSLOTS); i++) {
+			if (bb.bins[t][i] != 0)
+				gbulk_max(&bb, bb.bins[0] + (i/NSLOTS) * NSLOTS, bb.bins[t][i] - 1);
+		}
+		for (j = 0; j < 3; j++) {
+			if (bb.mx[t][j] > bb.mx[0][j])
+				bb.mx[0][j] = bb.mx[t][j];
+			if (bb.mn[t][j] < bb.mn[0][j])
+				bb.mn[0][j] = bb.mn[t][j];
+		}
+	}
+
+	/* Track bounding range of all the points, */
+	/* not just those that get added. */
+	for (j = 0; j < 3; j++) {
+		if (bb.mx[0][j] > s->mx[j])
+			s->mx[j] = bb.mx[0][j];
+		if (bb.mn[0][j] < s->mn[j])
+			s->mn[j] = bb.mn[0][j];
+	}
+
+	/* Mark the survivors, and add them in their original order */
+	if ((keep = (char *) calloc(n, sizeof(char))) == NULL) {
+		fprintf(stderr,"gamut: calloc failed - bulk expand keep (%d)\n",n);
+		exit(-1);
+	}
+	for (i = 0; i < (bb.nbins * NSLOTS); i++) {
+		if (bb.bins[0][i] != 0)
+			keep[bb.bins[0][i] - 1] = 1;
+	}
+	for (i = 0; i < n; i++) {
+		if (keep[i])
+			expand_gamut(s, in[i]);
+	}
+
+	free(keep);
+	for (t = 0; t < nthr; t++)
+		free(bb.bins[t]);
+	free(bb.bins);
+	free(bb.mn);
+	free(bb.mx);
+}
+
 /* ------------------------------------ */
 
 /* intersect implementation */
@@ -1180,10 +1367,12 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 	/* Grab white & black from whichever source has it */
 	if (sb->cswbset)
 		ss = sb;
-	else if (sb->cswbset)
+	else if (sa->cswbset)
 		ss = sa;
+	else
+		ss = NULL;
 
-	if (ss->cswbset) {
+	if (ss != NULL) {
 		for (j = 0; j < 3; j++) {
 			s->cs_wp[j] = ss->cs_wp[j];
 			s->cs_bp[j] = ss->cs_bp[j];
@@ -1826,9 +2015,8 @@ comptriattr(
 gamut *s,
 gtri *t
 ) {
-	int j;
+	int j, k;
 	static double v0[3] = {0.0, 0.0, 0.0};
-	double cp[3];		/* Closest point - not used */
 
 	/* Compute the plane equation for the absolute triangle. */
 	/* This is used for testing if a point is inside the gamut hull. */
@@ -1852,26 +2040,19 @@ gtri *t
 	plane_equation(t->ee[1], v0, t->v[2]->sp, t->v[0]->sp);
 	plane_equation(t->ee[2], v0, t->v[0]->sp, t->v[1]->sp);
 
-	/* Compute the radius range of the triangle to the center */
-	/* Compute the maximum from the vertexes */
-	t->rs1 = -1.0;
+	/* Compute the bounding box of the triangle */
+	for (k = 0; k < 3; k++) {
+		t->mix[0][k] = 1e38;
+		t->mix[1][k] = -1e38;
+	}
 	for (j = 0; j < 3; j++) {
-		int k;
-		double rs, tt;
-		for (rs = 0.0, k = 0;k < 3; k++) { 
-			tt = t->v[j]->p[k] - s->cent[k];
-			rs += tt * tt;
+		for (k = 0; k < 3; k++) {
+			if (t->v[j]->p[k] < t->mix[0][k])
+				t->mix[0][k] = t->v[j]->p[k];
+			if (t->v[j]->p[k] > t->mix[1][k])
+				t->mix[1][k] = t->v[j]->p[k];
 		}
-		if (rs > t->rs1)
-			t->rs1 = rs; 
 	}
-	/* The minimum may be on the plane, an edge or a vertex, */
-	/* so use closest point in triangle function. */
-	t->rs0 = ne_point_on_tri(s, t, cp, s->cent);
-
-	/* Allow a tollerance around the radius squareds */
-	t->rs0 -= 1e-4;
-	t->rs1 += 1e-4;
 
 #ifdef NEVER // ???
 #ifdef ASSERTS
@@ -3298,37 +3479,51 @@ int ix				/* Input index */
 
 
 /* Reset indexing through triangles for getnexttri() */
-static void startnexttri(gamut *s) {
+static void startnexttri(gamut *s, gtriter *it) {
 	if IS_LIST_EMPTY(s->tris)
 		triangulate(s);
 
-	s->nexttri = NULL;
+	it->tp = NULL;
 }
 
 /* Return the next surface triange, nz on no more */
 static int getnexttri(
 gamut *s,
+gtriter *it,	/* Context setup by startnexttri() */
 int v[3]		/* Return indexes for same order as getvert() */
 ) {
 	if IS_LIST_EMPTY(s->tris)
 		triangulate(s);
 
-	if (s->nexttri == NULL) {
-		s->nexttri = s->tris;
-		if (s->nexttri == NULL)
+	if (it->tp == NULL) {
+		it->tp = s->tris;
+		if (it->tp == NULL)
 			return 1;
 	} else {	
-		s->nexttri = NEXT_FWD(s->nexttri);
-		if (s->nexttri == s->tris)
+		it->tp = NEXT_FWD(it->tp);
+		if (it->tp == s->tris)
 			return 1;
 	}
 
-	v[0] = s->nexttri->v[0]->tn;
-	v[1] = s->nexttri->v[1]->tn;
-	v[2] = s->nexttri->v[2]->tn;
+	v[0] = it->tp->v[0]->tn;
+	v[1] = it->tp->v[1]->tn;
+	v[2] = it->tp->v[2]->tn;
 	return 0;
 }
 
+/* Finish building the gamut and setup all the lookup structures, */
+/* so that the query methods then only read the gamut, and can be */
+/* called from more than one thread at once. */
+static void freeze(gamut *s) {
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+
+	if (s->lu_inited == 0)
+		init_lu(s);				/* Init BVH search tree */
+
+	compgawb(s);
+}
+
 /* ===================================================== */
 
 /* Return the total volume of the gamut */
@@ -3388,9 +3583,8 @@ gamut *s
 /* Given a point, */
 /* return the distance to the gamut surface. */
 
-static void init_lu(gamut *s);
-static gtri *radial_point_triang(gamut *s, gbsp *np, double in[3]);
-static double radial_point(gamut *s, gbsp *np, double in[3]);
+static gtri *radial_point_triang(gamut *s, double in[3], gtri *hint);
+static double radial_point(gamut *s, double in[3], gtri **hint);
 
 /* Given a point, return the point in that direction */
 /* that lies on the gamut surface. Return the radial */
@@ -3433,7 +3627,7 @@ double *in		/* input point (absolute)*/
 
 /* Implementation for following two functions: */
 /* Given a point, return the point in that direction */
-/* that lies on the gamut surface. Use the BSP accellerated search. */
+/* that lies on the gamut surface. Use the BVH accellerated search. */
 /* Return the radial length of the input and radial length of result */
 static void
 _radial(
@@ -3441,7 +3635,8 @@ gamut *s,
 double *ir,		/* return input radius (may be NULL) */
 double *or,		/* return output radius (may be NULL) */
 double *out,	/* result point (absolute) (may be NULL) */
-double *in		/* input point (absolute)*/
+double *in,		/* input point (absolute)*/
+gtri **hint		/* If not NULL, triangle to try first, and return triangle used */
 ) {
 	int j;
 	double ss, rv;
@@ -3452,7 +3647,7 @@ double *in		/* input point (absolute)*/
 		
 	/* We have to find out which triangle the point is in */
 	if (s->lu_inited == 0) {
-		init_lu(s);				/* Init BSP search tree */
+		init_lu(s);				/* Init BVH search tree */
 	}
 //if (trace) printf("~1 radial called with %f %f %f\n", in[0], in[1], in[2]);
 
@@ -3471,7 +3666,7 @@ double *in		/* input point (absolute)*/
 	}
 
 //if (trace) printf("~1 Normalised in = %f %f %f\n", nin[0], nin[1], nin[2]);
-	rv = radial_point(s, s->lutree, nin);
+	rv = radial_point(s, nin, hint);
 
 	if (rv < 0.0) {
 		error("gamut: radial internal error - failed to find triangle (rv %f)\n",rv);
@@ -3505,7 +3700,7 @@ double *in		/* input point (absolute)*/
 ) {
 	double ss, rv;
 	
-	_radial(s, &ss, &rv, out, in);
+	_radial(s, &ss, &rv, out, in, NULL);
 	return ss/rv;
 }
 
@@ -3520,361 +3715,337 @@ double *in		/* input point (absolute)*/
 ) {
 	double ss, rv;
 	
-	_radial(s, &ss, &rv, out, in);
+	_radial(s, &ss, &rv, out, in, NULL);
 	return rv;
 }
 
-void lu_split(gamut *s, gbsp **np, int rdepth, gtri **list, int llen);
+/* ===================================================== */
+/* Surface triangle bounding volume hierarchy */
+/*
+ * This accelerates the radial, nearest and vector intersect
+ * searches. Each node has the absolute bounding box of its
+ * triangles for the nearest and vector searches, and a cone
+ * containing the sphere mapped directions of its triangles
+ * for the radial search. The nodes are in a single array
+ * in depth first order, the first child immediately
+ * following its parent, and the leaves index into a single
+ * array of triangle pointers.
+ */
+
+#define BVHTOL 1e-6		/* Absolute bounding box tollerance */
+
+/* Compute the bounding box and direction cone of */
+/* the node n from the triangles t[0..nt-1] */
+static void bvh_bound(
+gbvhn *n,		/* Node to set */
+gtri **t,		/* Triangles in node */
+int nt			/* Number of triangles */
+) {
+	int i, j, k;
+	double ss;
+
+	for (k = 0; k < 3; k++) {
+		n->bb[0][k] = 1e38;
+		n->bb[1][k] = -1e38;
+		n->ca[k] = 0.0;
+	}
+	for (i = 0; i < nt; i++) {
+		for (k = 0; k < 3; k++) {
+			if (t[i]->mix[0][k] < n->bb[0][k])
+				n->bb[0][k] = t[i]->mix[0][k];
+			if (t[i]->mix[1][k] > n->bb[1][k])
+				n->bb[1][k] = t[i]->mix[1][k];
+		}
+		for (j = 0; j < 3; j++) {
+			for (k = 0; k < 3; k++)
+				n->ca[k] += t[i]->v[j]->sp[k];
+		}
+	}
+
+	/* The cone axis is the mean direction, and the */
+	/* angle is that of the furthest vertex from it. */
+	n->cc = -2.0;
+	for (ss = 0.0, k = 0; k < 3; k++)
+		ss += n->ca[k] * n->ca[k];
+	ss = sqrt(ss);
+	if (ss > 1e-9) {
+		for (k = 0; k < 3; k++)
+			n->ca[k] /= ss;
+		n->cc = 1.0;
+		for (i = 0; i < nt; i++) {
+			for (j = 0; j < 3; j++) {
+				double dd;
+				dd = n->ca[0] * t[i]->v[j]->sp[0]
+				   + n->ca[1] * t[i]->v[j]->sp[1]
+				   + n->ca[2] * t[i]->v[j]->sp[2];
+				if (dd < n->cc)
+					n->cc = dd;
+			}
+		}
+		/* A cone wider than a hemisphere isn't convex, so */
+		/* can't be used to exclude the triangles within it. */
+		if (n->cc <= 0.0)
+			n->cc = -2.0;
+	}
+}
+
+/* Triangle direction component in direction u[] */
+#define BVH_TDIR(u, t) (u[0] * (t->v[0]->sp[0] + t->v[1]->sp[0] + t->v[2]->sp[0])	\
+                      + u[1] * (t->v[0]->sp[1] + t->v[1]->sp[1] + t->v[2]->sp[1])	\
+                      + u[2] * (t->v[0]->sp[2] + t->v[1]->sp[2] + t->v[2]->sp[2]))
+
+/* Recursively create the node for the triangles t[0..nt-1]. */
+/* Since the gamut surface is radial about the center, splitting */
+/* the triangles by direction keeps each node compact for all */
+/* the searches. */
+static void bvh_build(
+gbvh *b,		/* BVH being built */
+gtri **t,		/* Triangles for this node */
+int nt,			/* Number of triangles */
+int depth		/* Current depth */
+) {
+	int i, k, e, ix = b->nn++;
+	gbvhn *n = &b->n[ix];
+	double su[3] = { 1.0, 0.0, 0.0 };	/* Split direction */
+	double bext;
+
+	if (depth >= BVHDEPTH) {	/* Oops */
+		fprintf(stderr,"gamut internal error: ran out of recursion depth in BVH\n");
+		exit (-1);
+	}
+
+	bvh_bound(n, t, nt);
+
+	if (nt <= BVHLEAF) {		/* Leaf node */
+		n->ix = t - b->t;
+		n->nt = nt;
+		return;
+	}
+	n->nt = 0;
+
+	/* Choose the direction across the cone axis in which */
+	/* the triangle directions are most spread out. */
+	for (bext = -1.0, e = 0; e < 3; e++) {
+		double uu[3], ss, mn = 1e38, mx = -1e38;
+
+		for (k = 0; k < 3; k++)			/* Axis e orthogonal to cone axis */
+			uu[k] = -n->ca[e] * n->ca[k];
+		uu[e] += 1.0;
+		for (ss = 0.0, k = 0; k < 3; k++)
+			ss += uu[k] * uu[k];
+		if (ss < 1e-12)
+			continue;
+		ss = 1.0/sqrt(ss);
+		for (k = 0; k < 3; k++)
+			uu[k] *= ss;
+
+		for (i = 0; i < nt; i++) {
+			double dd = BVH_TDIR(uu, t[i]);
+			if (dd < mn)
+				mn = dd;
+			if (dd > mx)
+				mx = dd;
+		}
+		if ((mx - mn) > bext) {
+			bext = mx - mn;
+			for (k = 0; k < 3; k++)
+				su[k] = uu[k];
+		}
+	}
+
+	/* Split them at the median, so that each half is */
+	/* the triangles on one side of a plane through the center. */
+#define 	HEAP_COMPARE(A,B) (BVH_TDIR(su, A) < BVH_TDIR(su, B))
+	HEAPSORT(gtri *, t, nt)
+#undef HEAP_COMPARE
+
+	bvh_build(b, t, nt/2, depth+1);
+	n->ix = b->nn;				/* Second child follows the first sub-tree */
+	bvh_build(b, t + nt/2, nt - nt/2, depth+1);
+}
 
-/* Setup the radial lookup function acceleration structure */
+/* Setup the surface lookup acceleration structure */
 static void
 init_lu(
 gamut *s
 ) {
-	static double v0[3] = {0.0, 0.0, 0.0};
-	static 
-	gedge *ep;		/* Edge pointer */
+	gbvh *b;
 	gtri *tp;		/* Triangle pointer */
-	gtri **tlist;
 	int ntris;
 
-//printf("~1 init_lu called\n");
-
-	/* Create mean angle dividing plane equations */
-	ep = s->edges; 
-	FOR_ALL_ITEMS(gedge, ep) {
-		plane_equation(ep->re, v0, ep->v[0]->sp, ep->v[1]->sp);
-	} END_FOR_ALL_ITEMS(ep);
-
-	/* Create the initial triangle list */
-	/* First count them */
+	/* Count the triangles */
 	ntris = 0;
 	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
 		ntris++;
 	} END_FOR_ALL_ITEMS(tp);
 
-	/* Allocate a list */
-	if ((tlist = (gtri **) malloc(ntris * sizeof(gtri *))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed - top level triangle list (%d entries)\n",ntris);
+	if ((s->bvh = b = (gbvh *) calloc(1, sizeof(gbvh))) == NULL) {
+		fprintf(stderr,"gamut: calloc failed - gbvh structure\n");
 		exit(-1);
 	}
 
-	/* Then add them to the list */
-	ntris = 0;
+	/* A binary tree has less than twice as many nodes as leaves */
+	if ((b->t = (gtri **) malloc((ntris + 1) * sizeof(gtri *))) == NULL
+	 || (b->n = (gbvhn *) malloc((2 * ntris + 1) * sizeof(gbvhn))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed - BVH (%d triangles)\n",ntris);
+		exit(-1);
+	}
+
+	b->nt = 0;
 	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
-		tlist[ntris] = tp;
-		ntris++;
+		b->t[b->nt++] = tp;
 	} END_FOR_ALL_ITEMS(tp);
 
-	/* Recursively split them, and add objects to leaves */
-	lu_split(s, &s->lutree, 0, tlist, ntris);
-
-	free(tlist);
+	if (ntris > 0)
+		bvh_build(b, b->t, ntris, 0);
 
-//printf("~1 init_lu done\n");
 	s->lu_inited = 1;
 }
 
-/*
- * BSP accellerator:
- *		This is setup specifically to accellerate finding
- * the radial point on the gamut surface. To do this, all
- * the BSP plains pass through the gamut center, creating
- * wedge shaped sub-division regions.
- * 
- * For accellerating the vector intersect code, this isn't
- * so fabulous, and a general unconstrained BSP tree would
- * be better. To address this, an orthogonal element to the
- * radial BSP's is provided in the radius squared range
- * of each set of elements below a BSP node.
- */
+/* Free the surface lookup acceleration structure */
+static void del_gbvh(gbvh *b) {
+	free(b->t);
+	free(b->n);
+	free(b);
+}
 
-/* Recursive routine to choose a partition plane, */
-/* and then split the triangle list between the */
-/* +ve and -ve sides, or add triangles as leaves. */
-void
-lu_split(
-gamut *s,
-gbsp **np,		/* Address of node pointer to be set */
-int rdepth,		/* Current recursion depth */
-gtri **list,	/* Current triangle list */
-int llen		/* Number of triangles in the list */
+/* Return the square of the distance from the point q */
+/* to the bounding box of a BVH node. */
+static double bvh_bdist(
+gbvhn *n,
+double *q
 ) {
-	double rs0, rs1;	/* Radius squared range of elements */
-	int ii, jj;			/* Progress through edges */
-	int pcount;			/* Current best scored try */
-	int ncount;
-	int bcount;
-	int mcount;
-	double peqs[4] = { 0.0, 0.0, 0.0, 0.0 };
-	gtri **plist, **nlist;	/* New sub-lists */
-	int pix, nix;			/* pos/ned sublist indexes */
-	gbspn *bspn;			/* BSP decision node */
-
-//printf("~1\nlu_split called at depth %d with %d triangles\n",rdepth, llen);
-#ifdef DEBUG
-	if (llen <= 3) {
-		int i;
-		for (i = 0; i < llen; i++) {
-			printf("Triang index %d = %d\n",i, list[i]->n);
-			printf("Triang verts %d %d %d\n", 
-			list[i]->v[0]->tn, list[i]->v[1]->tn, list[i]->v[2]->tn);
-			printf("Vert 0 at %.18f %.18f %.18f\n",list[i]->v[0]->sp[0], list[i]->v[0]->sp[1], list[i]->v[0]->sp[2]);
-			printf("Vert 1 at %.18f %.18f %.18f\n",list[i]->v[1]->sp[0], list[i]->v[1]->sp[1], list[i]->v[1]->sp[2]);
-			printf("Vert 2 at %.18f %.18f %.18f\n",list[i]->v[2]->sp[0], list[i]->v[2]->sp[1], list[i]->v[2]->sp[2]);
-		}
-	}
-#endif /* DEBUG */
-
-	if ((rdepth+1) >= BSPDEPTH) {	/* Oops */
-		printf("gamut internal error: ran out of recursion depth in BSP\n");
-		exit (-1);
-	}
+	int k;
+	double tt, rv = 0.0;
 
-	/* Scan our list or triangles and figure out radius squared range */
-	{
-		int i, j, e;
-		double rs;
-
-		rs0 = 1e120;
-		rs1 = -1.0;
-		for (i = 0; i < llen; i++) {
-			if (list[i]->rs0 < rs0)
-				rs0 = list[i]->rs0; 
-			if (list[i]->rs1 > rs1)
-				rs1 = list[i]->rs1; 
+	for (k = 0; k < 3; k++) {
+		if (q[k] < n->bb[0][k]) {
+			tt = n->bb[0][k] - q[k];
+			rv += tt * tt;
+		} else if (q[k] > n->bb[1][k]) {
+			tt = q[k] - n->bb[1][k];
+			rv += tt * tt;
 		}
-//printf("~1 no triangs %d, rs range %f - %f\n",llen,rs0,rs1);
 	}
+	return rv;
+}
 
-	pcount = ncount = bcount = -1;
-	mcount = 0;
-	/* test every edge in turn */
-	for (ii = jj = 0;ii < llen;) {
-		double eqs[4];
-		int i;
-		gedge *ep;			/* Edge pointer */
-		int pc, nc, bc;		/* Score a try, postive count, negative count, both count */
-		int mc;				/* Minumum count */
-
-		ep = list[ii]->e[jj];
-		eqs[0] = ep->re[0];	/* Use this edge */
-		eqs[1] = ep->re[1];
-		eqs[2] = ep->re[2];
-		eqs[3] = ep->re[3];
-		if (++jj > 2) {
-			jj = 0;
-			ii++;
-		}
+/* Given the line p1 + t * vv, limit the parameter range t0 .. t1 */
+/* to that within the bounding box of a BVH node. */
+/* Return nz if the line misses the box. */
+static int bvh_lrange(
+gbvhn *n,
+double *p1,		/* Absolute line base point */
+double *vv,		/* Line direction */
+double *pt0,	/* Parameter range to limit */
+double *pt1
+) {
+	int k;
+	double t0 = *pt0, t1 = *pt1;
 
-		/* Do the trial split */
-		pc = nc = bc = 0;
-		for (i = 0; i < llen; i++) {
-			int j;
-			int po, ne;
+	for (k = 0; k < 3; k++) {
+		double lo = n->bb[0][k] - BVHTOL;
+		double hi = n->bb[1][k] + BVHTOL;
 
-			/* Compute distance from plane of all verticies in triangle */
-			po = ne = 0;
-			for (j = 0; j < 3; j++) {	/* For triangle verticies */
-				double ds;
-				/* Compute distance to dividing plane of this vertex */
-				ds = eqs[0] * list[i]->v[j]->sp[0]
-				   + eqs[1] * list[i]->v[j]->sp[1]
-	    		   + eqs[2] * list[i]->v[j]->sp[2]
-				   + eqs[3];
-				/* Figure if the verticies are clearly to one side of the plane */
-				if (ds > 1e-10) {
-					po++;
-				} else if (ds < -1e-10) {
-					ne++;
-				}
-			}
-			/* Score this split */
-			if (po) {
-				pc++;
-				if (ne) {
-					nc++;
-					bc++;
-					list[i]->sort = 3;	/* Both */
-				} else {
-					list[i]->sort = 1;	/* +ve */
-				}
-			} else if (ne) {
-				nc++;
-				list[i]->sort = 2;	/* -ve */
-			} else {				/* Hmm. Neither */
-				bc++;
-				list[i]->sort = 3;	/* Assume both */
-			}
-		}
-		mc = pc < nc ? pc : nc;		/* Size of smallest group */
-		mc -= bc;
-//printf("~1 lu_split trial %d, mc %d, pc %d, nc %d, bc %d\n",ii * 3 + jj, mc, pc, nc, bc);
-		if (mc > mcount) {			/* New largest small group */
-			mcount = mc;
-			pcount = pc;
-			ncount = nc;
-			bcount = bc;
-			peqs[0] = eqs[0];
-			peqs[1] = eqs[1];
-			peqs[2] = eqs[2];
-			peqs[3] = eqs[3];
-//printf("~1 new best - plane mc = %d, %f %f %f %f\n",mc, peqs[0], peqs[1], peqs[2], peqs[3]);
-			for (i = 0; i < llen; i++) {
-				list[i]->bsort = list[i]->sort;
+		if (fabs(vv[k]) < 1e-12) {		/* Parallel to slab */
+			if (p1[k] < lo || p1[k] > hi)
+				return 1;
+		} else {
+			double ta, tb;
+			ta = (lo - p1[k])/vv[k];
+			tb = (hi - p1[k])/vv[k];
+			if (ta > tb) {
+				double tt = ta;
+				ta = tb;
+				tb = tt;
 			}
+			if (ta > t0)
+				t0 = ta;
+			if (tb < t1)
+				t1 = tb;
+			if (t0 > t1)
+				return 1;
 		}
 	}
+	*pt0 = t0;
+	*pt1 = t1;
+	return 0;
+}
 
-#ifdef DEBUG_SPLIT_VRML
-	write_split_diag_vrml(s, list, llen);	/* diag3.wrl/xdom/x3dom */
-	printf("Waiting for return key after diag3%s:\n",vrml_ext());
-	getchar();
-#endif /* DEBUG_SPLIT_VRML */
+/* Return nz if the normalised center relative */
+/* direction lies within the triangle. */
+static int radial_in_tri(
+gtri *t,
+double *nin		/* Normalised center relative point */
+) {
+	int j;
 
-	if (ii >= llen && bcount < 0) {	/* We failed to find a split plane. */
-		/* This is usually a result of the list being 2 or more triangles */
-		/* that do not share any edges (disconected from each other), and */
-		/* lying so that any split plane formed from an edge of one, */
-		/* intersects one of the others. */
-		/* In theory we could solve this by picking some */
-		/* other radial split plane ? */
+	for (j = 0; j < 3; j++) {
+		double ds;
+		ds = t->ee[j][0] * nin[0]
+		   + t->ee[j][1] * nin[1]
+	       + t->ee[j][2] * nin[2]
+		   + t->ee[j][3];
+		if (ds > 1e-10)
+			return 0;			/* Not within triangle */
+	}
+	return 1;
+}
 
-		/* Instead leave our list of triangles as the leaf node, */
-		/* and let the search algorithms deal with this. */
+/* Given a point, return the triangle it lies in. */
+/* Return NULL if it wasn't in any triangle (shouldn't happen with a closed gamut ?). */
+static gtri *radial_point_triang(
+gamut *s,
+double *nin,	/* Normalised center relative point */
+gtri *hint		/* If not NULL, triangle to try first */
+) {
+	gbvh *b = s->bvh;
+	int stack[BVHDEPTH+1], sp = 0;	/* Nodes still to be searched */
+	int i;
 
-		*np = (gbsp *)new_gbspl(llen, list);
-		(*np)->rs0 = rs0;		/* Radius squared range */
-		(*np)->rs1 = rs1;
-//printf("~1 lu_split returning with a non split list of %d triangles\n",llen);
-		return;
-	}
+	if (hint != NULL && radial_in_tri(hint, nin))
+		return hint;
 
-	/* Divide the triangles into two lists */
-	bspn = new_gbspn();				/* Next node */
-	*np = (gbsp *)bspn;				/* Put it in place */
-	bspn->rs0 = rs0;				/* Radius squared range */
-	bspn->rs1 = rs1;
-	bspn->pe[0] = peqs[0];			/* Plane equation */
-	bspn->pe[1] = peqs[1];
-	bspn->pe[2] = peqs[2];
-	bspn->pe[3] = peqs[3];
+	if (b->nn <= 0)
+		return NULL;
 
-	/* Allocate the sub lists */
-	if ((plist = (gtri **) malloc(pcount * sizeof(gtri *))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed - pos sub-list\n");
-		exit(-1);
-	}
-	if ((nlist = (gtri **) malloc(ncount * sizeof(gtri *))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed - neg sub-list\n");
-		exit(-1);
-	}
-
-	/* Fill them in */
-	for (pix = nix = ii = 0; ii < llen; ii++) {
-		if (list[ii]->bsort & 1) {	/* Positive */
-			plist[pix] = list[ii];
-			pix++;
-		}
-		if (list[ii]->bsort & 2) {	/* Negative */
-			nlist[nix] = list[ii];
-			nix++;
-		}
-	}
-
-	/* Recurse if there are more triangles to split */
-	if (pix == 1) {
-		bspn->po = (gbsp *)plist[0];			/* leaf node */ 
-//printf("~1 pos leaf with triangle %d\n",plist[0]->n);
-	} else if (pix > 1) {
-//printf("~1 About to recurse on positive with list of %d\n",pix);
-		lu_split(s, &bspn->po, rdepth+1, plist, pix);
-	}
-
-	if (nix == 1) {
-//printf("~1 neg leaf with triangle %d\n",nlist[0]->n);
-		bspn->ne = (gbsp *)nlist[0];			/* leaf node */ 
-	} else if (nix > 1) {
-//printf("~1 About to recurse on negative with list of %d\n",nix);
-		lu_split(s, &bspn->ne, rdepth+1, nlist, nix);
-	}
-
-	free(plist);
-	free(nlist);
-//printf("~1 lu_split returning\n");
-}
-
-/* Given a point and a node in the BSP tree, recurse down */
-/* the tree, or return the triangle it lies in. */
-/* Return NULL if it wasn't in any triangle (shouldn't happen with a closed gamut ?). */
-static gtri *radial_point_triang(
-gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
-double *nin		/* Normalised center relative point */
-) {
-	gtri *rv;
-//if (trace) printf("~1 rad_pnt_tri: BSP 0x%x tag = %d, point %f %f %f\n", np,np->tag,nin[0],nin[1],nin[2]);
-	if (np->tag == 1) {		/* It's a BSP node */
-		gbspn *n = (gbspn *)np;
-		double ds;
-
-		ds = n->pe[0] * nin[0]
-		   + n->pe[1] * nin[1]
-	       + n->pe[2] * nin[2]
-		   + n->pe[3];
+	stack[sp++] = 0;
+	while (sp > 0) {
+		gbvhn *n = &b->n[stack[--sp]];
 
-//if (trace) printf("~1 checking against BSP plane, ds = %e\n",ds);
-		/* Recurse down both sides it might be in */
-		if (ds > -1e-12) {
-			if ((rv = radial_point_triang(s, n->po, nin)) != NULL)
-				return rv;
-		}
-		if (ds <  1e-12) {
-			if ((rv = radial_point_triang(s, n->ne, nin)) != NULL)
-				return rv;
-		}
-		return NULL;		/* Hmm */
+		/* Skip the node if the direction is outside its cone */
+		if (n->cc > -1.0
+		 && (n->ca[0] * nin[0] + n->ca[1] * nin[1] + n->ca[2] * nin[2]) < (n->cc - 1e-8))
+			continue;
 
-	} else {			/* It's a triangle or list of triangles */
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
+		if (n->nt == 0) {		/* Decision node */
+			int ix1 = (int)(n - b->n) + 1, ix2 = n->ix;
+			gbvhn *n1 = &b->n[ix1], *n2 = &b->n[ix2];
 
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = (gtri **)&np;
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
+			/* Search the child with the closest cone axis first */
+			if ((n1->ca[0] * nin[0] + n1->ca[1] * nin[1] + n1->ca[2] * nin[2])
+			 >= (n2->ca[0] * nin[0] + n2->ca[1] * nin[1] + n2->ca[2] * nin[2])) {
+				stack[sp++] = ix2;
+				stack[sp++] = ix1;
+			} else {
+				stack[sp++] = ix1;
+				stack[sp++] = ix2;
+			}
+			continue;
 		}
 
-		/* Go through the list and stop at the first triangle */
+		/* Go through the leaf list and stop at the first triangle */
 		/* that the node lies in. */
-		for (i = 0; i < nt; i++, tpp++) {
-			gtri *t = *tpp;
+		for (i = 0; i < n->nt; i++) {
+			gtri *t = b->t[n->ix + i];
 
-			/* Check if the point is within this triangle */
-			for (j = 0; j < 3; j++) {
-				double ds;
-				ds = t->ee[j][0] * nin[0]
-				   + t->ee[j][1] * nin[1]
-			       + t->ee[j][2] * nin[2]
-				   + t->ee[j][3];
-				if (ds > 1e-10)
-					break;			/* Not within triangle */
-			}
-			if (j >= 3) {
-//if (trace) printf("~1 located triangle from list that we're in %d\n",n->t[i]->n);
+			if (radial_in_tri(t, nin))
 				return t;
-			}
 		}
-		/* Hmm. */
 	}
 
-//if (trace) printf("~1 failed to find a triangle\n");
 	return NULL;
 }
 
@@ -3884,21 +4055,21 @@ double *nin		/* Normalised center relative point */
 /* the gamut surface. Return < 0.0 on fail. */
 static double radial_point(
 gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
-double *nin		/* Normalised center relative point */
+double *nin,	/* Normalised center relative point */
+gtri **hint		/* If not NULL, triangle to try first, and return triangle used */
 ) {
 	gtri *t;
 	double rv, num, denom;
 
-//if (trace) printf("~1 radial_point: BSP 0x%x tag = %d, point %f %f %f\n", np,np->tag,nin[0],nin[1],nin[2]);
-
-	t = radial_point_triang(s, np, nin);
+	t = radial_point_triang(s, nin, hint != NULL ? *hint : NULL);
 
 	/* If we failed to find a triangle, or the result was incorrect, do a */
 	/* brute force search to be sure of the result. */
 	if (t == NULL) {
 		error("rspl.radial: failed to find radial triangle\n");
 	}
+	if (hint != NULL)
+		*hint = t;
 
 	/* Compute the intersection of the input vector with the triangle plane */
 	/* (Since nin[] is already relative, we don't need to subtract cent[] from it) */
@@ -3949,34 +4120,10 @@ double *nin		/* Normalised center relative point */
 	return rv;
 }
 
-/* Recursively free a gbsp node and all its children */
-static void del_gbsp(gbsp *n) {
-	int tag = n->tag;
-
-	if (tag == 1) {				/* Another decision node */
-		gbspn *dn = (gbspn *)n;
-		del_gbsp(dn->po);		/* Delete children */
-		del_gbsp(dn->ne);
-		del_gbspn(dn);			/* And itself */
-
-	} else if (tag == 3) {		/* If a triangle list */
-		gbspl *dl = (gbspl *)n;
-		del_gbspl(dl);			/* Delete itself */
-	}
-
-	/* Don't delete triangles (tag == 2) since they */
-	/* have their own linked list, and may have already been deleted. */
-	/* Note we need to be called _before_ triangles are deleted though, */
-	/* since we access them to get the tag. */
-}
-
 /* =================================== */
 /* Given a point, */
 /* return the nearest point on the gamut surface. */
 
-#define GNN_INF 1e307
-static void init_ne(gamut *s);
-
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
 /* Use a brute force search */
@@ -4010,276 +4157,99 @@ double *q		/* Target point (absolute) */
 	} END_FOR_ALL_ITEMS(tp);
 }
 
-/* Using nearest neighbourhood accelleration structure: */
+/* Using the BVH accelleration structure: */
 
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
 static void
-nearest_tri(
+_nearest_tri(
 gamut *s,
 double *rout,	/* result point (absolute) */
 double *q,		/* Target point (absolute) */
-gtri **ctri		/* If not NULL, return pointer to nearest triangle */
+gtri **ctri,	/* If not NULL, return pointer to nearest triangle */
+gtri *hint		/* If not NULL, triangle likely to be close, to start with */
 ) {
-	gnn *p;				/* Pointer to nearest neighbor structure */
-	int e, i;
+	gbvh *b;
+	int stack[BVHDEPTH+1], sp = 0;	/* Nodes still to be searched */
 	double r[3] = {0.0, 0.0, 0.0 };		/* Possible solution point */
 	double out[3] = {0.0, 0.0, 0.0};	/* Current best output value */
-	int wex[3 * 2];		/* Current window edge indexes */
-	double wed[3 * 2];	/* Current window edge distances */
-						/* Indexes are axis * 2 +0 for lower edge, */
-						/* +1 for upper edge of search box. */
-						/* We are comparing lower edge of search box */
-						/* with upper edge of bounding box etc. */ 
-
-//printf("~1 nearest called\n");
+	double bdist = 1e308;	/* Best distance squared so far */
+	gtri *bobj = NULL;
+	int i;
+
 	if IS_LIST_EMPTY(s->tris)
 		triangulate(s);
 
-	/* We have to find out which triangle the point will be nearest */
-	if (s->ne_inited == 0) {
-		init_ne(s);				/* Init nn structure */
-	}
-	p = s->nns;
-
-	if ((p->tbase + 3) < p->tbase) {	/* Overflow of touch count */
-		for (i = 0; i < p->n; i++)
-			p->sax[0][i]->touch = 0;		/* reset it in all the objects */
-		p->tbase = 0;
-	}
-	p->ttarget = p->tbase + 3;		/* Target touch value */
-
-//printf("\n");
-//printf("Query point is %f %f %f\n",q[0], q[1], q[2]);
-
-	/* Find starting indexes within axis arrays */
-	for (e = 0; e < (2 * 3); e++) {	/* For all axes min & max */
-		int f = e/2;			/* Axis */
-		int mm = (e ^ 1) & 1;	/* Min/Max index used for edges */
-		int i0, i1, i2;
-		double v0, v1, v2;
-		double qf, ww;
-
-		/* Binary search this edge */
-		qf = q[f]; 		/* strength reduced q[f] */
-
-//printf("\n");
-//printf("isearching axis %d %s for %f\n",f, e & 1 ? "max" : "min", qf);
-		i0 = 0;
-		i2 = p->n - 1;
-		v0 = p->sax[e][i0]->mix[mm][f];
-		v2 = p->sax[e][i2]->mix[mm][f];
-//printf("start points %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-
-		if (qf <= v0) {
-			i2 = i0;
-			v2 = v0;
-		} else if (qf >= v2) {
-			i0 = i2;
-			v0 = v2;
-		} else {
-			do {
-				i1 = (i2 + i0)/2;		/* Trial point */
-				v1 = p->sax[e][i1]->mix[mm][f];	/* Value at trial */
-				if (v1 < qf) {
-					i0 = i1;			/* Take top half */
-					v0 = v1;
-				} else {
-					i2 = i1;			/* Take bottom half */
-					v2 = v1;
-				}
-//printf("current point %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-			} while ((i2 - i0) > 1);
-		}
-
-		if (e & 1) {			/* Max side of window */
-			int tc;				/* total object count */
-
-			ww = v2 - qf;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i2;
-
-			/* Check that min and max together will cover at least p->n objects */
-			tc = p->n - i2 + wex[e ^ 1] + 1;
-//printf("got %d, expected %d\n",tc, p->n);
-
-			/* (I don't really understand why this works!) */
-			if (tc < p->n) {		/* We haven't accounted for all the objects */
-				int el = e ^ 1;		/* Low side sax */
-				int ti0, ti2;
-				double tv0, tv2;
-
-				ti0 = wex[el];
-				ti2 = i2;
-//printf("We have straddling objects, initial indexes are %d - %d\n",ti0, ti2);
-
-				/* While straddling objects remain undiscovered: */
-				while (tc < p->n) {
-					tv0 =  GNN_INF;		/* Guard values */
-					tv2 = -GNN_INF;
-
-					/* Increment low side until we find a straddler */
-					while (ti0 < (p->n-1)) {
-						ww = p->sax[el][++ti0]->mix[0][f];	/* Position of the other end */
-						if (ww < qf) {
-//printf("found low object %d at index %d that straddles\n",p->sax[el][ti0]->n,ti0);
-							tv0 = qf - p->sax[el][ti0]->mix[1][f];
-							break;
-						}
-					}
+	if (s->lu_inited == 0)
+		init_lu(s);				/* Init BVH search tree */
+	b = s->bvh;
 
-					/* Decrement high side until we find a straddler */
-					while (ti2 > 0) {
-						ww = p->sax[e][--ti2]->mix[1][f];	/* Position of the other end */
-						if (ww > qf) {
-//printf("found high object %d at index %d that straddles\n",p->sax[e][ti2]->n,ti2);
-							tv2 = p->sax[e][ti2]->mix[0][f] - qf;
-							break;
-						}
-					}
-					/* Choose the closest */
-					if (tv0 > tv2) {
-						wed[el] = fabs(tv0) * tv0;
-						wex[el] = ti0;
-						tc++;
-					} else {
-						wed[e] = fabs(tv2) * tv2;
-						wex[e] = ti2;
-						tc++;
-					}
-				}
-//printf("After correction we have %d - %d\n",wex[e^1], wex[e]);
-			}
-		} else {				/* Min side of window */
-			ww = q[f] - v0;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i0;
-		}
+	if (hint != NULL) {		/* Start with the hint as the best so far */
+		bobj = hint;
+		bdist = ne_point_on_tri(s, hint, out, q);
 	}
 
-	/* Expand a 3 dimenstional cube centered on the target point, */
-	/* jumping to the next nearest point on any axis, discovering */
-	/* any bounding boxes that are within the expanding window */
-	/* by checking their touch count. */
-
-	/* The first point found establishes the initial best distance. */
-	/* When the window expands beyond the point where it can improve */
-	/* the best distance, stop */
-
-	{
-		double bw = 0.0;		/* Current window distance */
-		double bdist = 1e308;	/* Best possible distance to an object outside the window */
-		gtri *bobj = NULL;
-		int ptested = 0;		/* Stats */
-		int pcalced = 0;		/* Stats */
-
-		/* Until we're done */
-		for (;;ptested++) {
-			int ee;				/* Axis & expanding box edge */
-			int ff;				/* Axis */
-			int ii;				/* Index of chosen point */
-			gtri *ob;			/* Current object */
-			unsigned int ctv;	/* Current touch value */
-//printf("\n");
-//printf("wwidth = %f, bdist = %f, window = %d-%d, %d-%d, %d-%d\n",
-//bw, bobj == NULL ? 0.0 : bdist, wex[0], wex[1], wex[2], wex[3], wex[4], wex[5]);
-//printf("window edge distances are = %f-%f, %f-%f, %f-%f\n",
-//wed[0], wed[1], wed[2], wed[3], wed[4], wed[5]);
-
-			/* find next (smallest) window increment axis and direction */
-			ee = 0;
-			ii = wex[ee];
-			bw = wed[ee];
-			for (e = 1; e < (2 * 3); e++) {
-				if (wed[e] < bw) {
-					ee = e;
-					ii = wex[e];
-					bw = wed[e];
-				}
-			}
-//printf("Next best is axisdir %d, object %d, axis index %d, best possible dist %f\n",
-//ee, p->sax[ee][ii]->n, ii, bw);
-
-			if (bw == GNN_INF || bw > bdist) {
-				break;		/* Can't got any further, or further points will be worse */
-			}
-
-#ifdef ASSERTS
-			if (ii < 0 || ii >= p->n) {
-				printf("Assert: went out of bounds of sorted axis array\n");
-				exit(0);
-			}
-#endif
-			/* Chosen point on ee axis/direction, index ii */
-			ff = ee / 2;			/* Axis only */
-
-			ob = p->sax[ee][ii];
-
-			/* Touch value of current object */
-			ctv = ob->touch;
-
-			if (ctv < p->ttarget) {		/* Not been dealt with before */
-
-				/* Touch this new window boundary point */
-				ob->touch = ctv = ((ctv < p->tbase) ? p->tbase : ctv) + 1;
+	if (b->nn > 0)
+		stack[sp++] = 0;
 
-//printf("New touch count on %d is %d, target %d\n", ob->n, p->sax[ee][ii]->touch, p->ttarget);
+	/* Search the nodes depth first, closest child first, */
+	/* skipping any that can't contain a closer point. */
+	while (sp > 0) {
+		gbvhn *n = &b->n[stack[--sp]];
 
-				/* Check the point out */
-				if (ctv == (p->tbase + 3)) {	/* Is within window on all axes */
-					double tdist;
-
-					pcalced++;		/* Stats */
-
-					/* Compute distance from query point to this object */
-					tdist = ne_point_on_tri(s, ob, r, q);
+		if (bvh_bdist(n, q) >= bdist)
+			continue;
 
-//printf("Got new best point %d, dist %f\n",i,tdist);
-					if (tdist < bdist) {	/* New best point */
-						bobj = ob;
-						bdist = tdist;
-						out[0] = r[0];
-						out[1] = r[1];
-						out[2] = r[2];
-					}
-				}
-			}
+		if (n->nt == 0) {		/* Decision node */
+			int ix1 = (int)(n - b->n) + 1, ix2 = n->ix;
 
-			/* Increment next window edge candidate, and figure new edge distance */
-			if (ee & 1) {					/* Top */
-				if (++wex[ee] >= p->n) {
-					wed[ee] = GNN_INF;
-					wex[ee]--;
-				} else {
-					double ww = p->sax[ee][wex[ee]]->mix[0][ff] - q[ff];
-					wed[ee] = fabs(ww) * ww;
-				}
+			if (bvh_bdist(&b->n[ix1], q) <= bvh_bdist(&b->n[ix2], q)) {
+				stack[sp++] = ix2;
+				stack[sp++] = ix1;
 			} else {
-				if (--wex[ee] < 0) {
-					wed[ee] = GNN_INF;
-					wex[ee]++;
-				} else {
-					double ww = q[ff] - p->sax[ee][wex[ee]]->mix[1][ff];
-					wed[ee] = fabs(ww) * ww;
-				}
+				stack[sp++] = ix1;
+				stack[sp++] = ix2;
 			}
+			continue;
 		}
 
-//printf("Searched %d points out of %d = %f%%\n",ptested, p->n, 100.0 * ptested/p->n);
+		for (i = 0; i < n->nt; i++) {
+			gtri *ob = b->t[n->ix + i];
+			double tdist;
 
-		p->tbase += 3;		/* Next touch */
+			/* Compute distance from query point to this object */
+			tdist = ne_point_on_tri(s, ob, r, q);
 
-		if (rout != NULL) {
-			rout[0] = out[0];	/* Copy results to output */
-			rout[1] = out[1];
-			rout[2] = out[2];
+			if (tdist < bdist) {	/* New best point */
+				bobj = ob;
+				bdist = tdist;
+				out[0] = r[0];
+				out[1] = r[1];
+				out[2] = r[2];
+			}
 		}
+	}
 
-		if (ctri != NULL)
-			*ctri = bobj;
-
-		return;
+	if (rout != NULL) {
+		rout[0] = out[0];	/* Copy results to output */
+		rout[1] = out[1];
+		rout[2] = out[2];
 	}
+
+	if (ctri != NULL)
+		*ctri = bobj;
+}
+
+/* Given an absolute point, return the point on the gamut */
+/* surface that is closest to it, and the triangle it is in. */
+static void
+nearest_tri(
+gamut *s,
+double *rout,	/* result point (absolute) */
+double *q,		/* Target point (absolute) */
+gtri **ctri		/* If not NULL, return pointer to nearest triangle */
+) {
+	_nearest_tri(s, rout, q, ctri, NULL);
 }
 
 /* Given an absolute point, return the point on the gamut */
@@ -4290,113 +4260,254 @@ gamut *s,
 double *rout,	/* result point (absolute) */
 double *q		/* Target point (absolute) */
 ) {
-	nearest_tri(s, rout, q, NULL);
+	_nearest_tri(s, rout, q, NULL, NULL);
 }
 
-/* Perturb the containment points to avoid */
-/* numerical co-incidence */
-double perturb[21] = {
-	8.9919295344233395e-283, 1.1639766020018968e+224, 1.2554893023590904e+232,
-	2.3898157055642966e+190, 1.5697612415774029e-076, 6.6912978722191457e+281,
-	1.2369092402930559e+277, 1.4430907501246712e-153, 3.0017439193018232e+238,
-	1.2978311824382444e+161, 5.5068703318775818e-311, 7.7791723264448801e-260,
-	4.4296571592384350e+281, 8.9481529920968425e+165, 1.2845894914769635e-153,
-	2.0835868791190880e-076, 5.4310198502711138e+241, 4.8689849775675438e+275,
-	9.2709981544886391e+122, 3.7958270103353899e-153, 7.1366083837501666e-154
-};
+/* ===================================================== */
+/* Batched surface queries */
+/*
+ * The queries are done in order of their direction from the gamut
+ * center, so that successive queries tend to be in the same part of
+ * the surface, and the triangle found by one radial or nearest query
+ * can be tried first by the next. The sorted queries are done in fixed
+ * size blocks that are shared out between threads. Each block starts
+ * without a hint, so the results don't depend on the number of threads.
+ */
 
-/* Setup the nearest function acceleration structure */
-static void
-init_ne(
-gamut *s
-) {
-	gnn *p;
-	int i, k;
-	gtri *tp;		/* Triangle pointer */
-	int ntris;
-	double psf;
+#define GBAT_BLOCK 64		/* Number of queries in a block */
+#define GBAT_QRES 16		/* Direction sort resolution on each cube face */
+#define GBAT_NKEYS (6 * GBAT_QRES * GBAT_QRES)	/* Number of sort keys */
 
-//printf("~1 init_ne called\n");
+/* Batch query types */
+typedef enum {
+	gbat_radial  = 0,
+	gbat_nradial = 1,
+	gbat_nearest = 2,
+	gbat_visect  = 3
+} gbat_op;
 
-	/* Allocate the nearest neighbor acceleration structure */
-	if ((s->nns = p = (gnn *) calloc(1, sizeof(gnn))) == NULL) {
-		fprintf(stderr,"gamut: calloc failed - gnn structure\n");
-		exit(-1);
+/* Batch query context */
+typedef struct {
+	gamut *s;
+	gbat_op op;
+	int n;				/* Number of queries */
+	int *ord;			/* Index of each query in sorted order */
+	double (*in)[3];	/* Input points, or vector first points */
+	double (*in2)[3];	/* Vector second points */
+	double *or;			/* Radius or normalised radius results (may be NULL) */
+	double (*out)[3];	/* Surface points or vector min points (may be NULL) */
+	double (*out2)[3];	/* Vector max points (may be NULL) */
+	double *mint;		/* Vector min parameter values (may be NULL) */
+	double *maxt;		/* Vector max parameter values (may be NULL) */
+	int *rv;			/* Vector intersect return values (may be NULL) */
+} gbatch;
+
+/* Return a sort key 0 .. GBAT_NKEYS-1 for the direction of a point */
+/* from the gamut center, by cube face, then by a grid on the face. */
+static int gbat_key(
+gamut *s,
+double *in		/* Absolute point */
+) {
+	int j, mj;
+	double vv[3], mx;
+	int f, iu, iv;
+
+	for (mj = 0, mx = -1.0, j = 0; j < 3; j++) {
+		vv[j] = in[j] - s->cent[j];
+		if (fabs(vv[j]) > mx) {
+			mx = fabs(vv[j]);
+			mj = j;
+		}
 	}
+	if (mx < 1e-9)
+		return 0;
 
-	/* Count triangles */
-	ntris = 0;
-	tp = s->tris; 
-	FOR_ALL_ITEMS(gtri, tp) {
-		ntris++;
-	} END_FOR_ALL_ITEMS(tp);
+	f = 2 * mj + (vv[mj] < 0.0 ? 1 : 0);
+	iu = (int)(0.5 * (vv[(mj + 1) % 3]/mx + 1.0) * (GBAT_QRES - 1) + 0.5);
+	iv = (int)(0.5 * (vv[(mj + 2) % 3]/mx + 1.0) * (GBAT_QRES - 1) + 0.5);
 
-	p->n = ntris;
-	p->tbase = 0;		/* Initialse touch flag */
+	/* Go back and forth along the rows, so that neighbours stay close */
+	if (iv & 1)
+		iu = GBAT_QRES - 1 - iu;
 
-	/* Allocate the arrays spaces */
-	for (k = 0; k < (3 * 2); k++) {
-		if ((p->sax[k] = (gtri **)malloc(sizeof(gtri *) * ntris)) == NULL)
-			error("Failed to allocate sorted index array");
-	}
+	return (f * GBAT_QRES + iv) * GBAT_QRES + iu;
+}
 
-	/* Compute pertbation factor */
-	for (psf = 0.0, i = 1; i < 21; i++)
-		psf += perturb[i];
-	psf *= perturb[0];
+/* Do one block of sorted queries */
+static void gbat_block(void *cntx, int thix, int bix) {
+	gbatch *p = (gbatch *)cntx;
+	gamut *s = p->s;
+	gtri *hint = NULL;		/* Triangle found by the last query */
+	int i, i1;
+
+	i = bix * GBAT_BLOCK;
+	i1 = i + GBAT_BLOCK;
+	if (i1 > p->n)
+		i1 = p->n;
+
+	for (; i < i1; i++) {
+		int ix = p->ord[i];
+
+		switch (p->op) {
+			case gbat_radial:
+			case gbat_nradial: {
+				double ir, or;
+
+				_radial(s, &ir, &or, p->out != NULL ? p->out[ix] : NULL, p->in[ix], &hint);
+				if (p->or != NULL)
+					p->or[ix] = p->op == gbat_nradial ? ir/or : or;
+				break;
+			}
+			case gbat_nearest:
+				_nearest_tri(s, p->out[ix], p->in[ix], &hint, hint);
+				break;
 
-	/* For each triangle, create the triangle bounding box values, */
-	/* and add them to the axis lists. */
-	tp = s->tris; 
-	i = 0;
-	FOR_ALL_ITEMS(gtri, tp) {
-		int j;
-		for (j = 0; j < 3; j++) {	/* Init */
-			tp->mix[0][j] = 1e38;
-			tp->mix[1][j] = -1e38;
-		}
-		for (k = 0; k < 3; k++) {
-			for (j = 0; j < 3; j++) {
-				if (tp->v[k]->p[j] < tp->mix[0][j])		/* New min */
-					tp->mix[0][j] = psf * tp->v[k]->p[j];
-				if (tp->v[k]->p[j] > tp->mix[1][j])		/* New max */
-					tp->mix[1][j] = psf * tp->v[k]->p[j];
+			case gbat_visect: {
+				int rv;
+
+				rv = compute_vector_isect(s, p->in[ix], p->in2[ix],
+				                          p->out != NULL ? p->out[ix] : NULL,
+				                          p->out2 != NULL ? p->out2[ix] : NULL,
+				                          p->mint != NULL ? &p->mint[ix] : NULL,
+				                          p->maxt != NULL ? &p->maxt[ix] : NULL,
+				                          NULL, NULL);
+				if (p->rv != NULL)
+					p->rv[ix] = rv;
+				break;
 			}
-			p->sax[k * 2 + 0][i] = tp;
-			p->sax[k * 2 + 1][i] = tp;
 		}
-//printf("~1 tri %d has bb %f - %f, %f - %f, %f - %f\n", i, tp->mix[0][0], tp->mix[1][0], tp->mix[0][1], tp->mix[1][1], tp->mix[0][2], tp->mix[1][2]);
-		i++;
-	} END_FOR_ALL_ITEMS(tp);
+	}
+}
 
+/* Sort the queries by direction, and do them in parallel */
+static void gbat_do(
+gbatch *p
+) {
+	gamut *s = p->s;
+	int i, *key, cnt[GBAT_NKEYS+1];
 
-	/* Sort the axis arrays */
-	for (k = 0; k < 3; k++) {
+	if (p->n <= 0)
+		return;
 
-			/* Sort upper edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[1][k] < B->mix[1][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 0][0], ntris)
-#undef HEAP_COMPARE
+	/* Setup the search structures before any threads use them */
+	freeze(s);
 
-			/* Sort lower edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[0][k] < B->mix[0][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 1][0], ntris)
-#undef HEAP_COMPARE
+	if ((p->ord = (int *) malloc(p->n * sizeof(int))) == NULL
+	 || (key = (int *) malloc(p->n * sizeof(int))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed - batch query order (%d)\n",p->n);
+		exit(-1);
+	}
+
+	/* Counting sort by key, keeping the original order within a key */
+	for (i = 0; i <= GBAT_NKEYS; i++)
+		cnt[i] = 0;
+	for (i = 0; i < p->n; i++) {
+		key[i] = gbat_key(s, p->in[i]);
+		cnt[key[i] + 1]++;
 	}
-	s->ne_inited = 1;
+	for (i = 0; i < GBAT_NKEYS; i++)
+		cnt[i+1] += cnt[i];
+	for (i = 0; i < p->n; i++)
+		p->ord[cnt[key[i]]++] = i;
+	free(key);
 
-//printf("~1 init_ne done\n");
+	pfor((p->n + GBAT_BLOCK - 1)/GBAT_BLOCK, 0, (void *)p, gbat_block);
+
+	free(p->ord);
 }
 
-/* Free everything */
-static void del_gnn(gnn *p) {
-	int k;
+/* Given n points, return the points in the same radial directions */
+/* that lie on the gamut surface, and their radial radius. */
+static void
+radial_n(
+gamut *s,
+double *or,				/* Return radial radius of each result (may be NULL) */
+double (*out)[3],		/* Result points (absolute) (may be NULL) */
+double (*in)[3],		/* Input points (absolute) */
+int n					/* Number of points */
+) {
+	gbatch bb;
+
+	memset((void *)&bb, 0, sizeof(gbatch));
+	bb.s = s;
+	bb.op = gbat_radial;
+	bb.n = n;
+	bb.in = in;
+	bb.or = or;
+	bb.out = out;
+	gbat_do(&bb);
+}
 
-	for (k = 0; k < (3 * 2); k++) {
-		free (p->sax[k]);
-	}
+/* Given n points, return the points in the same radial directions */
+/* that lie on the gamut surface, and their normalised radial radius. */
+static void
+nradial_n(
+gamut *s,
+double *or,				/* Return normalised radial radius of each (may be NULL) */
+double (*out)[3],		/* Result points (absolute) (may be NULL) */
+double (*in)[3],		/* Input points (absolute) */
+int n					/* Number of points */
+) {
+	gbatch bb;
+
+	memset((void *)&bb, 0, sizeof(gbatch));
+	bb.s = s;
+	bb.op = gbat_nradial;
+	bb.n = n;
+	bb.in = in;
+	bb.or = or;
+	bb.out = out;
+	gbat_do(&bb);
+}
+
+/* Given n points, return the points on the gamut surface */
+/* closest to each. */
+static void
+nearest_n(
+gamut *s,
+double (*out)[3],		/* Result points (absolute) */
+double (*in)[3],		/* Target points (absolute) */
+int n					/* Number of points */
+) {
+	gbatch bb;
+
+	memset((void *)&bb, 0, sizeof(gbatch));
+	bb.s = s;
+	bb.op = gbat_nearest;
+	bb.n = n;
+	bb.in = in;
+	bb.out = out;
+	gbat_do(&bb);
+}
 
-	free(p);
+/* Given n vectors, find the two extreme intersections of each */
+/* with the gamut surface. */
+static void
+vector_isect_n(
+gamut *s,
+int *rv,				/* Return 0 if no intersection, 1 if there is (may be NULL) */
+double (*p1)[3],		/* First points (ie param value 0.0) */
+double (*p2)[3],		/* Second points (ie param value 1.0) */
+double (*omin)[3],		/* Return gamut surface points, min = closest to p1 (may be NULL) */
+double (*omax)[3],		/* max = farthest from p1 (may be NULL) */
+double *omnt,			/* Return parameter values (may be NULL) */
+double *omxt,
+int n					/* Number of vectors */
+) {
+	gbatch bb;
+
+	memset((void *)&bb, 0, sizeof(gbatch));
+	bb.s = s;
+	bb.op = gbat_visect;
+	bb.n = n;
+	bb.in = p1;
+	bb.in2 = p2;
+	bb.out = omin;
+	bb.out2 = omax;
+	bb.mint = omnt;
+	bb.maxt = omxt;
+	bb.rv = rv;
+	gbat_do(&bb);
 }
 
 /* ===================================================== */
@@ -4792,435 +4903,190 @@ gtri **omxtri
 
 #define ISDBG(xxx) if (deb_insect) printf xxx
 
-int deb_insect = 1;		/* Do vrml plot */
+int deb_insect = 1;		/* Do debug trace */
+
+#else	/* !INTERSECT_DEBUG */
+# define ISDBG(xxx)
+#endif	/* !INTERSECT_DEBUG */
 
-/* Debug - given a BSP node, add all the triangles vertexes indexes */
-/* below this node to the diagnosti wrl */
-static void debug_bsp_triangl_wrl(
+/* Intersect the vector with a triangle, and add any intersection to the list */
+static void vector_isect_tri(
 gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
-vrml *wrl		/* Diagnostic plot */
+gtri  *t,		/* Triangle to test */
+double *vb,		/* Center relative base point of vector */
+double *vv,		/* Vector direction from base */
+gispnt *lp,		/* List to set intersections in. */
+int    ll,		/* Size of list. 0 == 2, min and max only */
+int   *lu		/* Number used in list */
 ) {
-	if (np->tag == 1) {		/* It's a BSP node */
-		gbspn *n = (gbspn *)np;
+	double den;			/* Intersection denominator */
+	double ti;			/* Intersection parameter value */
+	double ip[3];		/* Intersection point */
+	double bds;
+	int j;
 
-		debug_bsp_triangl_wrl(s, n->po, wrl);
-		debug_bsp_triangl_wrl(s, n->ne, wrl);
+	ISDBG(("triangle no %d\n",t->n));
 
-	} else {
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
+	den = t->pe[0] * vv[0] + t->pe[1] * vv[1] + t->pe[2] * vv[2];
+	if (fabs(den) < 1e-12) {
+		ISDBG(("segment is tangent to triangle\n"));
+		return;
+	}
 
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = &((gtri *)np);
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
-		}
-		/* Go through the list of triangles and intersect with vector */
-		for (i = 0; i < nt; i++, tpp++) {
-			gtri *t = *tpp;
-			int ix[3];
+	/* Compute the intersection of vector with the triangle plane */
+	ti = -(t->pe[0] * (vb[0] + s->cent[0]) 
+	     + t->pe[1] * (vb[1] + s->cent[1])
+	     + t->pe[2] * (vb[2] + s->cent[2])
+	     + t->pe[3])/den;
+	ISDBG(("segment intersects at %f\n",ti));
 
-			ix[0] = t->v[0]->tn;
-			ix[1] = t->v[1]->tn;
-			ix[2] = t->v[2]->tn;
+	/* Compute the actual (center relative) intersection point */
+	ip[0] = vb[0] + ti * vv[0];
+	ip[1] = vb[1] + ti * vv[1];
+	ip[2] = vb[2] + ti * vv[2];
+	ISDBG(("triangle intersection point %f %f %f\n",ip[0]+s->cent[0],ip[1]+s->cent[1],ip[2]+s->cent[2]));
 
-			wrl->add_triangle(wrl, 0, ix);
+	/* Check if the intersection point is within the triangle */
+	bds = -1e6;
+	for (j = 0; j < 3; j++) {
+		double ds;
+		ds = t->ee[j][0] * ip[0]
+		   + t->ee[j][1] * ip[1]
+	       + t->ee[j][2] * ip[2]
+		   + t->ee[j][3];
+		if (ds > 1e-8)
+			break;			/* Not within triangle */
+		if (ds > bds)
+			bds = ds;
+	}
+	if (j < 3) {
+		ISDBG(("intersection not within triangle\n"));
+		return;				/* Not within triangle, so ignore */
+	}
+
+	/* Add intersection to list */
+	if (ll > 0) {		/* List of all */
+		if (*lu < ll) {
+			lp[*lu].pv = ti;
+			icmAdd3(lp[*lu].ip,ip,s->cent);		/* Abs. intersection point */
+			lp[*lu].dir = den > 0.0 ? 1 : 0;
+			lp[*lu].edge = bds > 0.0 ? 1 : 0;
+			lp[*lu].tri = t;
+			ISDBG(("new isect %d: pv %f, dir %d, edge %d\n",*lu,ti,lp[*lu].dir,lp[*lu].edge));
+			(*lu)++;
+		} else {
+			ISDBG(("new isect %d: List Too Short %d!!!\n",*lu,ll));
+		}
+	} else {			/* Bigest/smallest list of 2 */
+		if (ti < lp[0].pv) {
+			ISDBG(("new min %f\n",ti));
+			lp[0].pv = ti;
+			icmAdd3(lp[0].ip,ip,s->cent);		/* Abs. intersection point */
+			lp[0].dir = den > 0.0 ? 1 : 0;
+			lp[0].edge = bds > 0.0 ? 1 : 0;
+			lp[0].tri = t;
+		}
+		if (ti > lp[1].pv) {
+			ISDBG(("new max %f\n",ti));
+			lp[1].pv = ti;
+			icmAdd3(lp[1].ip,ip,s->cent);		/* Abs. intersection point */
+			lp[1].dir = den > 0.0 ? 1 : 0;
+			lp[1].edge = bds > 0.0 ? 1 : 0;
+			lp[1].tri = t;
 		}
 	}
 }
-#else	/* !INTERSECT_DEBUG */
-# define ISDBG(xxx)
-#endif	/* !INTERSECT_DEBUG */
 
-/* Recursive vector intersect using BSP accelleration. */
-static void vector_isect_rec(
+/* Vector intersect using BVH accelleration. */
+static void vector_isect_bvh(
 gamut *s,
-gbsp  *np,		/* BSP node pointer we're at */
 double *vb,		/* Center relative base point of vector */
 double *vv,		/* Vector direction from base */
 double t0,		/* Start parameter value of line */
-double rs0,		/* line start point radius squared */ 
 double t1,		/* End parameter value of line */
-double rs1,		/* line end point radius squared */ 
-double tc,		/* Parameter value of closest point on line to center */
-double rsc,		/* Radius squared of closest point on line to center */
-double rse0,	/* Effective radius squared minimum */
-double rse1,	/* Effective radius squared maximum */
 gispnt *lp,		/* List to set intersections in. */
 int    ll,		/* Size of list. 0 == 2, min and max only */
 int   *lu		/* Number used in list */
 ) {
-	double den;			/* Intersection denominator */
-	double ti;			/* Intersection parameter value */
-	double rsi;			/* Radius squared of intersection point */
-	double ip[3];		/* Intersection point */
+	gbvh *b = s->bvh;
+	int stack[BVHDEPTH+1], sp = 0;	/* Nodes still to be searched */
+	double p1[3];		/* Absolute base point */
+	int i;
 
-#ifdef INTERSECT_DEBUG
-	if (ll == 0)
-		printf("\nvector_isect_rec got seg %f - %f (%e), best %f, %f\n",t0,t1,t1-t0,lp[0].pv,lp[1].pv);
-	else
-		printf("\nvector_isect_rec got seg %f - %f (%e), no isects %d\n",t0,t1,t1-t0,*lu);
-	printf("     rs %f, %f, tc %f, rsc %f, rse0 %f, rse1 %f, BSP rs %f - %f\n",rs0, rs1, tc, rsc, rse0, rse1, np->rs0, np->rs1);
-#endif
-#ifdef INTERSECT_DEBUG
-	if (deb_insect) {
-		char isect[20] = "isect";
-		char isect2[20] = "isect2";
-		vrml *wrl = NULL;
-		double cc[3] = { 1.0, 1.0, 0.0 };
-		double red[3] = { 1.0, 0.0, 0.0 };
-		double green[3] = { 0.0, 1.0, 0.0 };
-		double blue[3] = { 0.0, 0.0, 1.0 };
-		double p1[3], p2[3];
-		int i;
+	p1[0] = vb[0] + s->cent[0];
+	p1[1] = vb[1] + s->cent[1];
+	p1[2] = vb[2] + s->cent[2];
 
-		strcat(isect2, vrml_ext());
-		strcat(isect, vrml_ext());
+	if (b->nn > 0)
+		stack[sp++] = 0;
 
-	    unlink(isect2);
-    	rename(isect, isect2);
+	while (sp > 0) {
+		gbvhn *n = &b->n[stack[--sp]];
+		double nt0 = t0, nt1 = t1;
 
-		if ((wrl = new_vrml("isect", 0, vrml_lab)) == NULL)
-			error("New vrml failed");
+		/* Skip nodes the line doesn't pass through */
+		if (bvh_lrange(n, p1, vv, &nt0, &nt1))
+			continue;
 
-		/* The triangles below the BSP */
-		for (i = 0; i < s->nv; i++) {
-			if (!(s->verts[i]->f & GVERT_TRI))
-				continue;
-			wrl->add_vertex(wrl, 0, s->verts[i]->p);
-		}
-		debug_bsp_triangl_wrl(s, np, wrl);
-		wrl->make_triangles(wrl, 0, 0.0, cc);
+		/* or that can't improve either min or max. */
+		if (ll == 0 && nt0 >= lp[0].pv && nt1 <= lp[1].pv)
+			continue;
 
-		/* The segment. The vrml browser can go crazy if the line */
-		/* is too long, so limit it to +/- 100 */
-		{
-			double vbl = icmNorm3(vb);
-			double tt0 = t0, tt1 = t1;
-			if (tt0 > 0.0) {
-				if ((tt0 * vbl) > 100.0)
-					tt0 = 100.0/vbl;
-			} else {
-				if ((tt0 * vbl) < -100.0)
-					tt0 = -100.0/vbl;
-			}
-			if (tt1 > 0.0) {
-				if ((tt1 * vbl) > 100.0)
-					tt1 = 100.0/vbl;
-			} else {
-				if ((tt1 * vbl) < -100.0)
-					tt1 = -100.0/vbl;
-			}
-			for (i = 0; i < 3; i++) {
-				p1[i] = s->cent[i] + vb[i] + tt0 * vv[i];
-				p2[i] = s->cent[i] + vb[i] + tt1 * vv[i];
-			}
+		if (n->nt == 0) {		/* Decision node */
+			stack[sp++] = n->ix;
+			stack[sp++] = (int)(n - b->n) + 1;
+			continue;
 		}
-		wrl->add_col_vertex(wrl, 1, p1, red);
-		wrl->add_col_vertex(wrl, 1, p2, red);
-		wrl->make_lines(wrl, 1, 2);
 
-		/* Add two initial points */
-		for (i = 0; i < 3; i++) {
-			p1[i] = s->cent[i] + vb[i] + 0.0 * vv[i];
-			p2[i] = s->cent[i] + vb[i] + 1.0 * vv[i];
-		}
-		wrl->add_marker(wrl, p1, green, 0.5);
-		wrl->add_marker(wrl, p2, blue, 0.5);
+		ISDBG(("vector_isect_bvh at %d triangle(s)\n",n->nt));
+		for (i = 0; i < n->nt; i++)
+			vector_isect_tri(s, b->t[n->ix + i], vb, vv, lp, ll, lu);
+	}
+}
 
-		wrl->del(wrl);
-		printf("Waiting for input after writing '%s':\n", isect);
-		getchar();
+/* Re-evaluate the intersections with an offset */
+static void reevaluate_isectns(
+gamut  *s,
+gispnt *lp,		/* List to set intersections in. */
+int    n,		/* Number to re-evaluate */
+double offset,	/* Amount to offset vector */
+double *ivb,	/* Center relative base point of vector */
+double *vv		/* Vector direction from base */
+) {
+	double vb[3];	/* Offset vb */
+	double sv;
+	int sj, j, i;
+
+	/* Decide which way to offset base */
+	sv = -1e20;
+	for (j = 0; j < 3; j++) {
+		if (fabs(vv[j]) > sv) {		/* Locate largest direction */
+			sv = fabs(vv[j]);
+			sj = j;
+		}
 	}
-#endif
 
-	if (np->tag == 1) {		/* It's a BSP node */
-		int j;
-		gbspn *n = (gbspn *)np;
-		double ds;
-		gbsp *n1, *n2;		/* next bsp to recurse to */
-		double ti1, ti2;	/* Intersection parameters for recursion */
-		double rse1_0, rse1_1, rse2_0, rse2_1;
+	/* Apply the offset to other than largest */
+	for (j = 0; j < 3; j++) {
+		vb[j] = ivb[j];
+		if (j == sj)
+			continue;	
+		vb[j] += offset;
+	}
 
-		ISDBG(("vector_isect_rec at bsp node %d\n"));
+	for (i = 0; i < n; i++) {
+		double den, ti, ip[3], bds;
+		gtri *t = lp[i].tri;
 
-		/* Try and compute intersection with BSP */
-
-		den = n->pe[0] * vv[0] + n->pe[1] * vv[1] + n->pe[2] * vv[2];
-		if (fabs(den) > 1e-12) {
-			/* Compute the intersection point */
-			ti = -(n->pe[0] * vb[0] + n->pe[1] * vb[1] + n->pe[2] * vb[2] + n->pe[3])/den;
-			ISDBG(("intersects BSP plane at ti %f\n",ti));
-		} 
-		if (fabs(den) < 1e-12 || ti < (t0 - 1e-6) || ti > (t1 + 1e-6)) {	/* Doesn't intersect */
-			double ds;									/* or intersects outside segment */
-
-			ISDBG(("doesn't intersect BSP plane within segment\n"));
-			/* Figure which side of the BSP segment is on */
-			ds = n->pe[0] * (vb[0] + 0.5 * (t0 + t1) * vv[0])
-			   + n->pe[1] * (vb[1] + 0.5 * (t0 + t1) * vv[1])
-		       + n->pe[2] * (vb[2] + 0.5 * (t0 + t1) * vv[2])
-			   + n->pe[3];
-
-			ISDBG(("recursing down side that segment is on\n"));
-			/* And recurse approproately if it can be improved */
-			/* ???? Shouldn't we recurse down both if ds ~= 0.0 ? */
-			if (ds >= 0.0) {
-				if (rse0 <= n->po->rs1
-			     && rse1 >= n->po->rs0
-			     && (ll > 0 || t0 < lp[0].pv || t1 > lp[1].pv))
-					vector_isect_rec(s, n->po, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-					lp, ll, lu);
-			} else {
-				if (rse0 <= n->ne->rs1
-			     && rse1 >= n->ne->rs0
-			     && (ll > 0 || t0 < lp[0].pv || t1 > lp[1].pv))
-					vector_isect_rec(s, n->ne, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-					lp, ll, lu);
-			}
-			ISDBG(("vector_isect_rec returning\n"));
-			return;
-		}
-
-		/* Compute radius squared to center point at split point */
-		for (rsi = 0.0, j = 0; j < 3; j++) {
-			den = vb[j] + ti * vv[j];
-			rsi += den * den;
-		}
-
-		/* Compute the effective radius squared range for each segment */
-		rse1_0 = rs0;
-		rse1_1 = rs0;
-		if (rsi < rse1_0)
-			rse1_0 = rsi;
-		if (rsi > rse1_1)
-			rse1_1 = rsi;
-		if (tc >= t0 && tc <= ti) {	/* Closest point is within segment */
-			if (rsc < rse1_0)
-				rse1_0 = rsc;
-			if (rsc > rse1_1)
-				rse1_1 = rsc;
-		}
-	
-		rse2_0 = rsi;
-		rse2_1 = rsi;
-		if (rs1 < rse2_0)
-			rse2_0 = rs1;
-		if (rs1 > rse2_1)
-			rse2_1 = rs1;
-		if (tc >= ti && tc <= t1) {	/* Closest point is within segment */
-			if (rsc < rse2_0)
-				rse2_0 = rsc;
-			if (rsc > rse2_1)
-				rse2_1 = rsc;
-		}
-
-		/* Test t0-1.0 to see what side of the BSP t0..ti is. */
-		ip[0] = vb[0] + (t0-1.0) * vv[0];
-		ip[1] = vb[1] + (t0-1.0) * vv[1];
-		ip[2] = vb[2] + (t0-1.0) * vv[2];
-
-		ds = n->pe[0] * ip[0]
-		   + n->pe[1] * ip[1]
-	       + n->pe[2] * ip[2]
-		   + n->pe[3];
-		
-		/* Because we're intersecting a line segment, we don't */
-		/* have to recurse down both sides of the BSP tree ? */
-		if (ds >= 0.0) {
-			n1 = n->po;
-			n2 = n->ne;
-		} else {
-			n1 = n->ne;
-			n2 = n->po;
-		}
-
-		/* Make sure that touching segments get properly tested */
-		ti1 = ti + 1e-7;
-		ti2 = ti - 1e-7;
-
-		/* Split the line into two segments and recurse for each. */
-		/* Don't recurse if the line can't improve either min or max. */
-		if (rse1_0 <= n1->rs1
-		 && rse1_1 >= n1->rs0
-		 && (ll > 0 || t0 < lp[0].pv || ti1 > lp[1].pv)) {
-			ISDBG(("recursing segment 1/2 %f .. %f\n",t0,ti1));
-			vector_isect_rec(s, n1, vb, vv, t0, rs0, ti1, rsi, tc, rsc, rse1_0, rse1_1,
-			                                                    lp, ll, lu);
-		}
-#ifdef INTERSECT_DEBUG
-		else if (deb_insect) {
-			printf("Skipped seg 1/2 because rse1_0 %f > n1->rs1 %f ? || rse1_1 %f < n1->rs0 %f\n",rse1_0,n1->rs1,rse1_1, n1->rs0);
-			if (ll == 0)
-				printf("|| ti1 %f <= t0 %f ? || ti1 %f <= omxt %f && t0 %f <= omnt %f ?\n",ti1,t0,ti1,lp[1].pv,t0,lp[0].pv);
-			else
-				printf("|| ti1 %f <= t0 %f ?\n",ti1,t0);
-		}
-#endif
-		if (rse2_0 <= n2->rs1
-		 && rse2_1 >= n2->rs0
-		 && (ll > 0 || ti2 < lp[0].pv || t1 > lp[1].pv)) {
-			ISDBG(("recursing segment 2/2 %f .. %f\n",ti2,t1));
-			vector_isect_rec(s, n2, vb, vv, ti2, rsi, t1, rs1, tc, rsc, rse2_0, rse2_1,
-			                                                    lp, ll, lu);
-		}
-#ifdef INTERSECT_DEBUG
-		else if (deb_insect) {
-			printf("Skipped seg 2/2 because rse2_0 %f > n2->rs1 %f ? || rse2_1 %f < n2->rs0 %f\n",rse2_0,n2->rs1,rse2_1, n2->rs0);
-			if (ll == 0)
-				printf("|| t1 %f <= ti2 %f ? || t1 %f <= omxt %f && ti2 %f <= omnt %f ?\n",t1,ti2,t1,lp[1].pv,ti2,lp[0].pv);
-			else
-				printf("|| t1 %f <= ti2 %f ?\n",t1,ti2);
-		}
-#endif
-
-		ISDBG(("vector_isect_rec returning\n"));
-		return;
-
-	/* It's a list of triangles */
-	} else {
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
-
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = (gtri **)&np;
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
-		}
-		ISDBG(("vector_isect_rec at triangle(s) %d\n",nt));
-		/* Go through the list of triangles and intersect with vector */
-		for (i = 0; i < nt; i++, tpp++) {
-			double bds;
-			gtri *t = *tpp;
-
-			ISDBG(("triangle no %d\n",t->n));
-
-			den = t->pe[0] * vv[0] + t->pe[1] * vv[1] + t->pe[2] * vv[2];
-			if (fabs(den) < 1e-12) {
-				ISDBG(("segment is tangent to triangle\n"));
-				continue;
-			}
-
-			/* Compute the intersection of vector with the BSP plane */
-			ti = -(t->pe[0] * (vb[0] + s->cent[0]) 
-			     + t->pe[1] * (vb[1] + s->cent[1])
-			     + t->pe[2] * (vb[2] + s->cent[2])
-			     + t->pe[3])/den;
-			ISDBG(("segment intersects at %f\n",ti));
-
-			/* Compute the actual (center relative) intersection point */
-			ip[0] = vb[0] + ti * vv[0];
-			ip[1] = vb[1] + ti * vv[1];
-			ip[2] = vb[2] + ti * vv[2];
-			ISDBG(("triangle intersection point %f %f %f\n",ip[0]+s->cent[0],ip[1]+s->cent[1],ip[2]+s->cent[2]));
-
-			/* Check if the intersection point is within the triangle */
-			bds = -1e6;
-			for (j = 0; j < 3; j++) {
-				double ds;
-				ds = t->ee[j][0] * ip[0]
-				   + t->ee[j][1] * ip[1]
-			       + t->ee[j][2] * ip[2]
-				   + t->ee[j][3];
-				if (ds > 1e-8)
-					break;			/* Not within triangle */
-				if (ds > bds)
-					bds = ds;
-			}
-			if (j < 3) {
-				ISDBG(("intersection not within triangle\n"));
-				continue;			/* Not within triangle, so ignore */
-			}
-
-			/* Add intersection to list */
-			if (ll > 0) {		/* List of all */
-				if (*lu < ll) {
-					lp[*lu].pv = ti;
-					icmAdd3(lp[*lu].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[*lu].dir = den > 0.0 ? 1 : 0;
-					lp[*lu].edge = bds > 0.0 ? 1 : 0;
-					lp[*lu].tri = t;
-					ISDBG(("new isect %d: pv %f, dir %d, edge %d\n",*lu,ti,lp[*lu].dir,lp[*lu].edge));
-					(*lu)++;
-				} else {
-					ISDBG(("new isect %d: List Too Short %d!!!\n",*lu,ll));
-				}
-			} else {			/* Bigest/smallest list of 2 */
-				if (ti < lp[0].pv) {
-					ISDBG(("new min %f\n",ti));
-					lp[0].pv = ti;
-					icmAdd3(lp[0].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[0].dir = den > 0.0 ? 1 : 0;
-					lp[0].edge = bds > 0.0 ? 1 : 0;
-					lp[0].tri = t;
-				}
-				if (ti > lp[1].pv) {
-					ISDBG(("new max %f\n",ti));
-					lp[1].pv = ti;
-					icmAdd3(lp[1].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[1].dir = den > 0.0 ? 1 : 0;
-					lp[1].edge = bds > 0.0 ? 1 : 0;
-					lp[1].tri = t;
-				}
-			}
-		}
-		ISDBG(("vector_isect_rec returning\n"));
-		return;
-	}
-}
-
-/* Re-evaluate the intersections with an offset */
-static void reevaluate_isectns(
-gamut  *s,
-gispnt *lp,		/* List to set intersections in. */
-int    n,		/* Number to re-evaluate */
-double offset,	/* Amount to offset vector */
-double *ivb,	/* Center relative base point of vector */
-double *vv		/* Vector direction from base */
-) {
-	double vb[3];	/* Offset vb */
-	double sv;
-	int sj, j, i;
-
-	/* Decide which way to offset base */
-	sv = -1e20;
-	for (j = 0; j < 3; j++) {
-		if (fabs(vv[j]) > sv) {		/* Locate largest direction */
-			sv = fabs(vv[j]);
-			sj = j;
-		}
-	}
-
-	/* Apply the offset to other than largest */
-	for (j = 0; j < 3; j++) {
-		vb[j] = ivb[j];
-		if (j == sj)
-			continue;	
-		vb[j] += offset;
-	}
-
-	for (i = 0; i < n; i++) {
-		double den, ti, ip[3], bds;
-		gtri *t = lp[i].tri;
-
-		lp[i].dir = 0;
-		lp[i].edge = 2;		/* Assume no intersect */
+		lp[i].dir = 0;
+		lp[i].edge = 2;		/* Assume no intersect */
 
 		den = t->pe[0] * vv[0] + t->pe[1] * vv[1] + t->pe[2] * vv[2];
 		if (fabs(den) < 1e-12) {
 			continue;
 		}
 
-		/* Compute the intersection of vector with the BSP plane */
+		/* Compute the intersection of vector with the triangle plane */
 		ti = -(t->pe[0] * (vb[0] + s->cent[0]) 
 		     + t->pe[1] * (vb[1] + s->cent[1])
 		     + t->pe[2] * (vb[2] + s->cent[2])
@@ -5261,7 +5127,7 @@ double *vv		/* Vector direction from base */
 
 /* Given a vector, find the two extreme intersection with */
 /* the gamut surface. */
-/* BSP accellerated version */
+/* BVH accellerated version */
 /* Return 0 if there is no intersection */
 static int compute_vector_isect(
 gamut *s,
@@ -5274,10 +5140,8 @@ double *omxt,	/* and 1 being at p2 */
 gtri **omntri,	/* Return the intersection triangles */
 gtri **omxtri
 ) {
-	gtri *tp;
 	double vb[3], vv[3];	/* Center relative base of vector, vector of vector */
-	double tt, t0, rs0, t1, rs1, tc, rsc;	
-	double rse0, rse1;		/* Effective radius squared min & max */
+	double tt, t0, t1;
 	gispnt islist[2];		/* min and max result */
 	int lu = 0, j;
 	int rv = 0;
@@ -5286,7 +5150,7 @@ gtri **omxtri
 		triangulate(s);
 
 	if (s->lu_inited == 0)
-		init_lu(s);				/* Init BSP search tree */
+		init_lu(s);				/* Init BVH search tree */
 
 	/* Convert twp points to center relative base + vector direction */
 	for (tt = 0.0, j = 0; j < 3; j++) {
@@ -5304,50 +5168,7 @@ gtri **omxtri
 	t0 = -1e6;
 	t1 =  1e6;
 
-	/* Compute radius range of segment */
-	for (rs0 = rs1 = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + t0 * vv[j];
-		rs0 += tt * tt;
-		tt = vb[j] + t1 * vv[j];
-		rs1 += tt * tt;
-	}
-
-	/* Compute the point closest to the center */
-	tc = -(vv[0] * vb[0] + vv[1] * vb[1] + vv[2] * vb[2])
-	    / (vv[0] * vv[0] + vv[1] * vv[1] + vv[2] * vv[2]);
-
-#ifdef INTERSECT_VERIFY
-	/* Check that this is correct */
-	for (tt = 0.0, j = 0; j < 3; j++) {
-		double pp;
-		pp = vb[j] + tc * vv[j];
-		tt += pp * vv[j];
-	}
-	if (fabs(tt) > 1e-5)
-		error("Failed to locate closest point on vector");
-#endif	/* INTERSECT_VERIFY */
-
-	for (rsc = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + tc * vv[j];
-		rsc += tt * tt;
-	}
-
-	/* Compute the effective min/max radius squared */
-	rse0 = rs0;
-	rse1 = rs0;
-	if (rs1 < rse0)
-		rse0 = rs1;
-	if (rs1 > rse1)
-		rse1 = rs1;
-	if (tc >= t0 && tc <= t1) {	/* Closest point is within segment */
-		if (rsc < rse0)
-			rse0 = rsc;
-		if (rsc > rse1)
-			rse1 = rsc;
-	}
-
-	vector_isect_rec(s, s->lutree, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-	                                                  islist, 0, &lu);   
+	vector_isect_bvh(s, vb, vv, t0, t1, islist, 0, &lu);   
 
 	/* If we failed to locate a requested intersection */
 	if (((omin != NULL || omnt != NULL || omntri != NULL) && islist[0].pv == 1e68)
@@ -5493,10 +5314,8 @@ double *p2,		/* Second point (ie param value 1.0) */
 gispnt *lp,		/* List to return in/out intersection pairs */
 int     ll 		/* Size of list. */
 ) {
-	gtri *tp;
 	double vb[3], vv[3];	/* Center relative base of vector, vector of vector */
-	double tt, t0, rs0, t1, rs1, tc, rsc, vscale;	
-	double rse0, rse1;		/* Effective radius squared min & max */
+	double tt, t0, t1, vscale;	
 	int lu = 0, i, j, k, m, pdir;
 	int rv = 0;
 
@@ -5507,7 +5326,7 @@ int     ll 		/* Size of list. */
 		triangulate(s);
 
 	if (s->lu_inited == 0)
-		init_lu(s);				/* Init BSP search tree */
+		init_lu(s);				/* Init BVH search tree */
 
 	/* Convert twp points to relative base + vector direction */
 	for (tt = 0.0, j = 0; j < 3; j++) {
@@ -5529,51 +5348,8 @@ int     ll 		/* Size of list. */
 	t0 = -1e6 * vscale;		/* Set the parameter search space */
 	t1 =  1e6 * vscale;
 
-	/* Compute radius range of segment */
-	for (rs0 = rs1 = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + t0 * vv[j];
-		rs0 += tt * tt;
-		tt = vb[j] + t1 * vv[j];
-		rs1 += tt * tt;
-	}
-
-	/* Compute the point closest to the center */
-	tc = -(vv[0] * vb[0] + vv[1] * vb[1] + vv[2] * vb[2])
-	    / (vv[0] * vv[0] + vv[1] * vv[1] + vv[2] * vv[2]);
-
-#ifdef INTERSECT_DEBUG
-	/* Check that this is correct */
-	for (tt = 0.0, j = 0; j < 3; j++) {
-		double pp;
-		pp = vb[j] + tc * vv[j];
-		tt += pp * vv[j];
-	}
-	if (fabs(tt) > 1e-5)
-		error("Failed to locate closest point on vector");
-#endif	/* INTERSECT_DEBUG */
-
-	for (rsc = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + tc * vv[j];
-		rsc += tt * tt;
-	}
-
-	/* Compute the effective min/max radius squared */
-	rse0 = rs0;
-	rse1 = rs0;
-	if (rs1 < rse0)
-		rse0 = rs1;
-	if (rs1 > rse1)
-		rse1 = rs1;
-	if (tc >= t0 && tc <= t1) {	/* Closest point is within segment */
-		if (rsc < rse0)
-			rse0 = rsc;
-		if (rsc > rse1)
-			rse1 = rsc;
-	}
-
-	/* Recursively locate all the triangle intersections using BSP */
-	vector_isect_rec(s, s->lutree, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-	                                                  lp, ll, &lu);   
+	/* Locate all the triangle intersections using the BVH */
+	vector_isect_bvh(s, vb, vv, t0, t1, lp, ll, &lu);   
 
 	if (lu <= 1) {
 #ifdef INTERSECT_DEBUG
@@ -6177,6 +5953,151 @@ char *filename
 	return 0;
 }
 
+/* ----------------------------------- */
+/* Binary .gam file */
+/*
+ * This holds the same information as the CGATS .gam file, plus the
+ * surface lookup BVH, so that it can be loaded without parsing,
+ * matching up the triangle edges or building the BVH. It is in
+ * native byte order, and each section is 8 byte aligned, so that
+ * it can be read (or memory mapped) as a single block:
+ *
+ *   bgam_hdr                    Header
+ *   double vert[nverts][3]      Vertex locations
+ *   gbvhn  node[nnodes]         BVH nodes
+ *   int    tri[ntris][3]        Triangle vertex indexes, in BVH leaf order
+ */
+
+#define BGAM_MAGIC "AGAMBIN"	/* File identifier, 8 bytes including nul */
+#define BGAM_VERSION 1			/* Layout version */
+#define BGAM_BORDER 0x01020304	/* Byte order check value */
+
+/* Binary .gam file header */
+typedef struct {
+	char magic[8];			/* BGAM_MAGIC */
+	int version;			/* BGAM_VERSION */
+	int border;				/* BGAM_BORDER in the writers byte order */
+	int isJab, isRast;		/* Colorspace and surface type */
+	int cswbset, gawbset;	/* Flags, white and black points are valid */
+	int cu_inited;			/* Flag, cusps are valid */
+	int nverts;				/* Number of verticies */
+	int ntris;				/* Number of triangles */
+	int nnodes;				/* Number of BVH nodes */
+	double cent[3];			/* Gamut center the BVH was built with */
+	double cs_wp[3], cs_bp[3], cs_kp[3];	/* Colorspace white, black and K only black */
+	double ga_wp[3], ga_bp[3], ga_kp[3];	/* Gamut white, black and K only black */
+	double cusps[6][3];
+} bgam_hdr;
+
+static int read_bgam(gamut *s, FILE *fp, char *filename);
+
+/* ----------------------------------- */
+/* Create the edges between the triangles read from a file. */
+/* Return non-zero on error */
+static int connect_edges(
+gamut *s
+) {
+	int i;
+	gtri *tp;
+	int *vti;		/* Index into vt[] of the triangles using each vertex, [ntv+1] */
+	int *vtn;		/* Number of triangles added to vt[] for each vertex */
+	gtri **vt;		/* Triangles using each vertex, in triangle list order */
+
+	/* Make a list of the triangles using each vertex, */
+	/* so that each edges other triangle can be found quickly. */
+	if ((vti = (int *)calloc(s->ntv + 1, sizeof(int))) == NULL
+	 || (vtn = (int *)calloc(s->ntv + 1, sizeof(int))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on vertex triangle index\n");
+		return 2;
+	}
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		for (i = 0; i < 3; i++)
+			vti[tp->v[i]->tn + 1]++;
+	} END_FOR_ALL_ITEMS(tp);
+	for (i = 0; i < s->ntv; i++)
+		vti[i+1] += vti[i];
+	if ((vt = (gtri **)malloc((vti[s->ntv] + 1) * sizeof(gtri *))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on vertex triangle list\n");
+		return 2;
+	}
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		for (i = 0; i < 3; i++) {
+			int vn = tp->v[i]->tn;
+			vt[vti[vn] + vtn[vn]++] = tp;
+		}
+	} END_FOR_ALL_ITEMS(tp);
+
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		int en;
+
+		for (en = 0; en < 3; en++) {	/* For each edge */
+			gedge *e;
+			gvert *v0, *v1;				/* The two verticies of the edge */
+			gtri *tp2 = NULL;			/* The other triangle */
+			int em = 0;					/* The other edge */
+			gvert *w0, *w1;				/* The other verticies */
+			
+			v0 = tp->v[en];
+			v1 = tp->v[en < 2 ? en+1 : 0];
+		
+			if (v0->n > v1->n)
+				continue;				/* Skip every other edge */
+
+			/* Find the corresponding edge of the other triangle */
+			w0 = w1 = NULL;
+			for (i = vti[v1->tn]; i < vti[v1->tn+1]; i++) {
+				tp2 = vt[i];
+				for (em = 0; em < 3; em++) {	/* For each edge */
+					w0 = tp2->v[em];
+					w1 = tp2->v[em < 2 ? em+1 : 0];
+					if (v0 == w1 && v1 == w0)	/* Found it */
+						break;
+				}
+				if (em < 3)
+					break;
+			}
+			if (i >= vti[v1->tn+1]) {
+				/* Should clean up ? */
+				fprintf(stderr,".gam file triangle data is not consistent\n");
+				free(vt); free(vtn); free(vti);
+				return 1;
+			}
+
+			if (tp->e[en] != NULL
+			 || tp2->e[em] != NULL) {
+				fprintf(stderr,".gam file triangle data is not consistent\n");
+				fprintf(stderr,"tp1->e[%d] = 0x%p, tp2->e[%d]= 0x%p\n",en,
+						(void *)tp->e[en],em,(void *)tp2->e[em]);
+				free(vt); free(vtn); free(vti);
+				return 1;
+			}
+
+			/* Creat the edge structure */
+			e = new_gedge();
+			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
+			tp->e[en] = e;			/* This edge */
+			tp->ei[en] = 0;			/* 0th triangle in edge */
+			e->t[0] = tp;			/* 0th triangle is tp */
+			e->ti[0] = en;			/* 0th triangles en edge */
+			tp2->e[em] = e;			/* This edge */
+			tp2->ei[em] = 1;		/* 1st triangle in edge */
+			e->t[1] = tp2;			/* 1st triangle is tp2 */
+			e->ti[1] = em;			/* 1st triangles em edge */
+			e->v[0] = v0;			/* The two verticies */
+			e->v[1] = v1;
+		}
+	} END_FOR_ALL_ITEMS(tp);
+
+	free(vt);
+	free(vtn);
+	free(vti);
+
+	return 0;
+}
+
 /* ----------------------------------- */
 /* Read from a CGATS .gam file */
 /* Return non-zero on error */
@@ -6186,7 +6107,6 @@ char *filename
 ) {
 	int i;
 	cgats *gam;
-	gtri *tp;
 	int nverts;
 	int ntris;
 	int Lf, af, bf;			/* Fields holding L, a & b data */
@@ -6194,11 +6114,24 @@ char *filename
 	int cw, cb;				/* Colorspace white, black keyword indexes */
 	int gw, gb;				/* Gamut white, black keyword indexes */
 
-	if (s->tris != NULL || s->read_inited || s->lu_inited || s->ne_inited) {
+	if (s->tris != NULL || s->read_inited || s->lu_inited) {
 		fprintf(stderr,"Can't add read into gamut after it is initialised!\n");
 		return 1;
 	}
 
+	/* See if it's a binary .gam file */
+	{
+		FILE *fp;
+		char magic[8];
+
+		if ((fp = fopen(filename, "rb")) != NULL) {
+			if (fread((void *)magic, 1, 8, fp) == 8
+			 && memcmp(magic, BGAM_MAGIC, 8) == 0)
+				return read_bgam(s, fp, filename);
+			fclose(fp);
+		}
+	}
+
 	gam = new_cgats();	/* Create a CGATS structure */
 
 	gam->add_other(gam, "GAMUT");		/* Setup to cope with a gamut file */
@@ -6411,68 +6344,299 @@ char *filename
 	}
 
 	/* Connect edge information */
-	tp = s->tris; 
-	FOR_ALL_ITEMS(gtri, tp) {
-		int en;
+	if (connect_edges(s))
+		return 1;
 
-		for (en = 0; en < 3; en++) {	/* For each edge */
-			gedge *e;
-			gvert *v0, *v1;				/* The two verticies of the edge */
-			gtri *tp2;					/* The other triangle */
-			int em;						/* The other edge */
-			gvert *w0, *w1;				/* The other verticies */
-			
-			v0 = tp->v[en];
-			v1 = tp->v[en < 2 ? en+1 : 0];
-		
-			if (v0->n > v1->n)
-				continue;				/* Skip every other edge */
+	gam->del(gam);			/* Clean up */
 
-			/* Find the corresponding edge of the other triangle */
-			w0 = w1 = NULL;
-			tp2 = s->tris; 
-			FOR_ALL_ITEMS(gtri, tp2) {
-				for (em = 0; em < 3; em++) {	/* For each edge */
-					w0 = tp2->v[em];
-					w1 = tp2->v[em < 2 ? em+1 : 0];
-					if (v0 == w1 && v1 == w0)	/* Found it */
-						break;
-				}
-				if (em < 3)
-					break;
-			} END_FOR_ALL_ITEMS(tp2);
-			if (w0 == NULL) {
-				/* Should clean up ? */
-				fprintf(stderr,".gam file triangle data is not consistent\n");
-				return 1;
-			}
+	s->read_inited = 1;			/* It's now valid */
 
-			if (tp->e[en] != NULL
-			 || tp2->e[em] != NULL) {
-				fprintf(stderr,".gam file triangle data is not consistent\n");
-				fprintf(stderr,"tp1->e[%d] = 0x%p, tp2->e[%d]= 0x%p\n",en,
-						(void *)tp->e[en],em,(void *)tp2->e[em]);
-				return 1;
-			}
+#ifdef ASSERTS
+	check_triangulation(s, 1);	/* Check out our work */
+#endif
 
-			/* Creat the edge structure */
-			e = new_gedge();
-			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
-			tp->e[en] = e;			/* This edge */
-			tp->ei[en] = 0;			/* 0th triangle in edge */
-			e->t[0] = tp;			/* 0th triangle is tp */
-			e->ti[0] = en;			/* 0th triangles en edge */
-			tp2->e[em] = e;			/* This edge */
-			tp2->ei[em] = 1;		/* 1st triangle in edge */
-			e->t[1] = tp2;			/* 1st triangle is tp2 */
-			e->ti[1] = em;			/* 1st triangles em edge */
-			e->v[0] = v0;			/* The two verticies */
-			e->v[1] = v1;
+	return 0;
+}
+
+/* Write to a binary .gam file */
+/* Return non-zero on error */
+static int write_bgam(
+gamut *s,
+char *filename
+) {
+	FILE *fp;
+	bgam_hdr h;
+	gbvh *b;
+	double (*vp)[3];
+	int (*tv)[3];
+	int i, j;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+
+	if (s->lu_inited == 0)
+		init_lu(s);
+	b = s->bvh;
+
+	memset((void *)&h, 0, sizeof(bgam_hdr));
+	strcpy(h.magic, BGAM_MAGIC);
+	h.version = BGAM_VERSION;
+	h.border = BGAM_BORDER;
+	h.isJab = s->isJab;
+	h.isRast = s->isRast;
+	h.nverts = s->ntv;
+	h.ntris = b->nt;
+	h.nnodes = b->nn;
+	icmCpy3(h.cent, s->cent);
+
+	if (s->cswbset) {
+		compgawb(s);		/* make sure we have gamut white/black available */
+		h.cswbset = h.gawbset = 1;
+		icmCpy3(h.cs_wp, s->cs_wp);
+		icmCpy3(h.cs_bp, s->cs_bp);
+		icmCpy3(h.cs_kp, s->cs_kp);
+		icmCpy3(h.ga_wp, s->ga_wp);
+		icmCpy3(h.ga_bp, s->ga_bp);
+		icmCpy3(h.ga_kp, s->ga_kp);
+	}
+
+	if (s->cu_inited != 0) {
+		h.cu_inited = 1;
+		for (i = 0; i < 6; i++)
+			icmCpy3(h.cusps[i], s->cusps[i]);
+	}
+
+	if ((vp = (double (*)[3])malloc((h.nverts + 1) * sizeof(double [3]))) == NULL
+	 || (tv = (int (*)[3])malloc((h.ntris + 1) * sizeof(int [3]))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on binary .gam write\n");
+		return 2;
+	}
+	for (i = 0; i < s->nv; i++) {
+		if (!(s->verts[i]->f & GVERT_TRI))
+			continue;
+		icmCpy3(vp[s->verts[i]->tn], s->verts[i]->p);
+	}
+	for (i = 0; i < h.ntris; i++) {
+		for (j = 0; j < 3; j++)
+			tv[i][j] = b->t[i]->v[j]->tn;
+	}
+
+	if ((fp = fopen(filename, "wb")) == NULL) {
+		fprintf(stderr,"Error opening file '%s' for writing\n",filename);
+		free(vp);
+		free(tv);
+		return 2;
+	}
+	if (fwrite((void *)&h, sizeof(bgam_hdr), 1, fp) != 1
+	 || fwrite((void *)vp, sizeof(double [3]), h.nverts, fp) != h.nverts
+	 || fwrite((void *)b->n, sizeof(gbvhn), h.nnodes, fp) != h.nnodes
+	 || fwrite((void *)tv, sizeof(int [3]), h.ntris, fp) != h.ntris
+	 || fclose(fp) != 0) {
+		fprintf(stderr,"Error writing to file '%s'\n",filename);
+		free(vp);
+		free(tv);
+		return 2;
+	}
+
+	free(vp);
+	free(tv);
+	return 0;
+}
+
+/* Read from a binary .gam file, that has been opened */
+/* and had its magic number checked. */
+/* Return non-zero on error */
+static int read_bgam(
+gamut *s,
+FILE *fp,
+char *filename
+) {
+	bgam_hdr h;
+	char *buf;
+	double (*vp)[3];
+	gbvhn *np;
+	int (*tv)[3];
+	long size;
+	gbvh *b;
+	int *depth;
+	int i, j;
+
+	/* Read the whole file in one go */
+	if (fseek(fp, 0, SEEK_END) != 0
+	 || (size = ftell(fp)) < (long)sizeof(bgam_hdr)
+	 || fseek(fp, 0, SEEK_SET) != 0) {
+		fprintf(stderr,"Input file '%s' is too short\n",filename);
+		fclose(fp);
+		return 1;
+	}
+	if ((buf = (char *)malloc(size)) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on binary .gam read\n");
+		fclose(fp);
+		return 2;
+	}
+	if (fread((void *)buf, 1, size, fp) != size) {
+		fprintf(stderr,"Error reading file '%s'\n",filename);
+		free(buf);
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+
+	memcpy((void *)&h, buf, sizeof(bgam_hdr));
+	if (h.border != BGAM_BORDER) {
+		fprintf(stderr,"Input file '%s' has the wrong byte order\n",filename);
+		free(buf);
+		return 1;
+	}
+	if (h.version != BGAM_VERSION) {
+		fprintf(stderr,"Input file '%s' is an unknown version %d\n",filename,h.version);
+		free(buf);
+		return 1;
+	}
+	if (h.nverts <= 0 || h.ntris <= 0 || h.nnodes <= 0
+	 || size != (long)(sizeof(bgam_hdr) + h.nverts * sizeof(double [3])
+	                 + h.nnodes * sizeof(gbvhn) + h.ntris * sizeof(int [3]))) {
+		fprintf(stderr,"Input file '%s' is the wrong size\n",filename);
+		free(buf);
+		return 1;
+	}
+	vp = (double (*)[3])(buf + sizeof(bgam_hdr));
+	np = (gbvhn *)(buf + sizeof(bgam_hdr) + h.nverts * sizeof(double [3]));
+	tv = (int (*)[3])(buf + sizeof(bgam_hdr) + h.nverts * sizeof(double [3])
+	                      + h.nnodes * sizeof(gbvhn));
+
+	/* Check the indexes, so that a bad file can't crash us */
+	for (i = 0; i < h.ntris; i++) {
+		for (j = 0; j < 3; j++) {
+			if (tv[i][j] < 0 || tv[i][j] >= h.nverts)
+				break;
 		}
-	} END_FOR_ALL_ITEMS(tp);
+		if (j < 3)
+			break;
+	}
+	if (i < h.ntris) {
+		fprintf(stderr,"Input file '%s' triangle data is not consistent\n",filename);
+		free(buf);
+		return 1;
+	}
+	/* Children always follow their parent, so the depth of each node */
+	/* is known by the time we get to it. The searches assume the tree */
+	/* is no deeper than BVHDEPTH. */
+	if ((depth = (int *)calloc(h.nnodes, sizeof(int))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on binary .gam read\n");
+		free(buf);
+		return 2;
+	}
+	for (i = 0; i < h.nnodes; i++) {
+		if (np[i].nt < 0 || np[i].ix < 0
+		 || (np[i].nt > 0 && (np[i].ix + np[i].nt) > h.ntris)
+		 || (np[i].nt == 0 && (np[i].ix <= i || np[i].ix >= h.nnodes || (i+1) >= h.nnodes))
+		 || depth[i] >= BVHDEPTH)
+			break;
+		if (np[i].nt == 0) {
+			if (depth[i+1] < (depth[i] + 1))
+				depth[i+1] = depth[i] + 1;
+			if (depth[np[i].ix] < (depth[i] + 1))
+				depth[np[i].ix] = depth[i] + 1;
+		}
+	}
+	free(depth);
+	if (i < h.nnodes) {
+		fprintf(stderr,"Input file '%s' BVH data is not consistent\n",filename);
+		free(buf);
+		return 1;
+	}
 
-	gam->del(gam);			/* Clean up */
+	/* Set the basic colorspace information */
+	s->isJab = h.isJab;
+	s->isRast = h.isRast;
+	if (s->isRast) {
+		s->logpow = RAST_LOG_POW;	/* Wrap the surface more closely */
+		s->no2pass = 1;				/* Only do one pass */
+	} else {
+		s->logpow = NORM_LOG_POW;	/* Convex hull compression power */
+		s->no2pass = 0;				/* Do two passes */
+	}
+
+	/* The BVH is only valid for the center it was made with */
+	icmCpy3(s->cent, h.cent);
+
+	if (h.cswbset) {
+		icmCpy3(s->cs_wp, h.cs_wp);
+		icmCpy3(s->cs_bp, h.cs_bp);
+		icmCpy3(s->cs_kp, h.cs_kp);
+		s->cswbset = 1;
+	}
+	if (h.gawbset) {
+		icmCpy3(s->ga_wp, h.ga_wp);
+		icmCpy3(s->ga_bp, h.ga_bp);
+		icmCpy3(s->ga_kp, h.ga_kp);
+		s->gawbset = 1;
+	}
+	if (h.cu_inited) {
+		for (i = 0; i < 6; i++)
+			icmCpy3(s->cusps[i], h.cusps[i]);
+		s->cu_inited = 1;
+	}
+
+	/* Allocate an array to point at the verts */
+	if ((s->verts = (gvert **)malloc(h.nverts * sizeof(gvert *))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on gvert pointer\n");
+		free(buf);
+		return 2;
+	}
+	s->nv = s->na = h.nverts;
+	
+	for (i = 0; i < h.nverts; i++) {
+		gvert *v;
 
+		/* Allocate and fill in each verticies basic information */
+		if ((v = (gvert *)calloc(1, sizeof(gvert))) == NULL) {
+			fprintf(stderr,"gamut: malloc failed on gvert object\n");
+			free(buf);
+			return 2;
+		}
+		s->verts[i] = v;
+		v->tag = 1;
+		v->tn = v->n = i;
+		v->f = GVERT_SET | GVERT_TRI;		/* Will be part of the triangulation */
+		icmCpy3(v->p, vp[i]);
+	}
+	s->ntv = i;
+
+	/* Compute the other vertex values */
+	compute_vertex_coords(s);
+
+	/* Setup the BVH, and create all the triangles in leaf order */
+	if ((s->bvh = b = (gbvh *) calloc(1, sizeof(gbvh))) == NULL
+	 || (b->t = (gtri **) malloc((h.ntris + 1) * sizeof(gtri *))) == NULL
+	 || (b->n = (gbvhn *) malloc(h.nnodes * sizeof(gbvhn))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed - BVH (%d triangles)\n",h.ntris);
+		free(buf);
+		return 2;
+	}
+	b->nn = h.nnodes;
+	memcpy((void *)b->n, (void *)np, h.nnodes * sizeof(gbvhn));
+
+	for (b->nt = 0; b->nt < h.ntris; b->nt++) {
+		gtri *t;
+
+		t = new_gtri();
+		ADD_ITEM_TO_BOT(s->tris, t);	/* Append to triangulation list */
+		b->t[b->nt] = t;
+
+		for (j = 0; j < 3; j++)
+			t->v[j] = s->verts[tv[b->nt][j]];
+
+		comptriattr(s, t);		/* Compute triangle attributes */
+	}
+	free(buf);
+
+	/* Connect edge information */
+	if (connect_edges(s))
+		return 1;
+
+	s->lu_inited = 1;
 	s->read_inited = 1;			/* It's now valid */
 
 #ifdef ASSERTS
@@ -6660,80 +6824,6 @@ gtri *hl			/* Edge hit list (may be NULL) */
 #endif /* DEBUG_TRIANG_VRML */
 
 
-#ifdef DEBUG_SPLIT_VRML
-
-/* Write a triangle split diagnostic .wrl/.x3d/.x3dom file */
-static int write_split_diag_vrml(
-gamut *s,
-gtri **list,	/* Triangle list */
-int llen		/* Number of triangles in the list */
-) {
-	int i, j;
-	int doaxes = 0;
-	vrml *wrl;
-
-	if ((wrl = new_vrml("diag3", doaxes, vrml_lab)) == NULL) {
-		fprintf(stderr,"Error creating %s object '%s%s'\n",vrml_format(),filename,vrml_ext());
-		return 2;
-	}
-
-	wrl->start_line_set(wrl, 0);
-
-	/* Spit out the vertex values, in order. */
-	for (i = 0; i < llen; i++) {
-		double pos[3];
-
-		for (j = 0; j < 3; j++) {
-	
-			pos[0] = 100.0 * list[i]->v[j]->sp[0];
-			pos[1] = 100.0 * list[i]->v[j]->sp[1];
-			pos[2] = 100.0 * list[i]->v[j]->sp[2];
-
-			wrl->add_vertex(wrl, 0, pos);
-		}
-	}
-
-	/* Triangle faces and colors */
-	for (i = 0; i < llen; i++) {
-		int ix[3];
-		double rgb[3];
-
-		ix[0] = i * 3 + 0;
-		ix[1] = i * 3 + 1;
-		ix[2] = i * 3 + 2;
-
-		if (list[i]->bsort == 1) {	/* Positive */
-			rgb[0]= 1.0; rgb[1] = 0.3; rgb[2] = 0.3;		/* Red */
-		} else if (list[i]->bsort == 2) {	/* Negative */
-			rgb[0]= 0.3; rgb[1] = 1.0; rgb[2] = 0.3;		/* Green */
-		} else if (list[i]->bsort == 3) {	/* Both */
-			rgb[0]= 1.0; rgb[1] = 1.0; rgb[2] = 0.3;		/* Yellow */
-		} else {	/* Neither */
-			rgb[0]= 0.3; rgb[1] = 0.3; rgb[2] = 1.0;		/* Blue */
-		}
-		wrl->add_col_triangle(wrl, 0, ix, rgb);
-	}
-
-	wrl->make_triangles_vc(wrl, 0, 0.0);
-
-	/* center of gamut */
-	{
-		double pos[3] = { 0.0, 0.0, 0.0 };
-		double rgb[3] = { 1.0, 1.0, 0.0 };	/* Yellow */
-
-		wrl->add_marker(wrl, pos, rgb, 5.0);
-	}
-
-	if (wrl->flush(wrl) != 0) {
-		fprintf(stderr,"Error closing output file '%s%s'\n",filename,vrml_ext());
-		return 2;
-	}
-	wrl->del(wrl);
-
-	return 0;
-}
-
-#endif /* DEBUG_SPLIT_VRML */
 
 
 
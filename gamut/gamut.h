@@ -27,7 +27,8 @@
 
 #include "../h/llist.h"
 
-#define BSPDEPTH 100		/* Maximum BSP tree depth */
+#define BVHDEPTH 64			/* Maximum BVH tree depth */
+#define BVHLEAF 4			/* Maximum triangles in a BVH leaf node */
 
 #define PFARNDIST  0.1			/* Positive (inwards) far "near" distance */
 #define NFARNDIST -200.0		/* Negative (outwards) far "near" distance */
@@ -99,41 +100,29 @@ struct _gquad {
 
 /* ------------------------------------ */
 
-/* Common base class of BSP nodes */
-#define BSP_STRUCT																			\
-	int tag;		/* Type of node, 1 = bsp node, 2 = triangle, 3 = list */				\
-	double rs0, rs1;	/* min/max radius squared from origin of all contained triangles */ 
-
-struct _gbsp {
-	BSP_STRUCT
-}; typedef struct _gbsp gbsp;
-
-/* ------------------------------------ */
-
-/* A BSP tree decision node */
-struct _gbspn {
-	BSP_STRUCT
-	int n;					/* Serial number */
-	double pe[4];			/* Plane equation values (center relative) */
-	struct _gbsp  *po;		/* Positive branch */
-	struct _gbsp  *ne;		/* Negative branch */
-}; typedef struct _gbspn gbspn;
-
-/* ------------------------------------ */
-
-/* A BSP tree triangle list node */
-struct _gbspl {
-	BSP_STRUCT
-	int n;					/* Serial number */
-	int nt;					/* Number of triangles in the list */
-	struct _gtri  *t[];	/* List of triangles - allocated with struct */
-}; typedef struct _gbspl gbspl;
+/* A node of the flattened bounding volume hierarchy */
+/* over the surface triangles. */
+struct _gbvhn {
+	double bb[2][3];		/* Absolute bounding box min and max of all contained triangles */
+	double ca[3];			/* Unit axis of the cone of sphere mapped directions */
+	double cc;				/* Cosine of the cone half angle, < -1.0 if no useful cone */
+	int ix;					/* Leaf: index of first triangle in t[], */
+							/* else index of second child (first child follows) */
+	int nt;					/* Leaf: number of triangles, 0 if not a leaf */
+}; typedef struct _gbvhn gbvhn;
+
+/* Surface triangle bounding volume hierarchy */
+struct _gbvh {
+	int nn;					/* Number of nodes used */
+	gbvhn *n;				/* Nodes in depth first order, n[0] is the root */
+	int nt;					/* Number of triangles */
+	struct _gtri **t;		/* Triangles in leaf order */
+}; typedef struct _gbvh gbvh;
 
 /* ------------------------------------ */
 
 /* A triangle in the surface mesh */
 struct _gtri {
-	BSP_STRUCT
 	int n;			/* Serial number */
 	struct _gvert *v[3];		/* Verticies in cw order */
 	struct _gedge *e[3];		/* Edges v[n] - v[n+1] */
@@ -146,11 +135,7 @@ struct _gtri {
 	double spe[4];		/* sphere mapped triangle plane equation (relative) */
 	double ee[3][4];	/* sphere sp[] Edge triangle plane equations for opposite edge (relative) */
 
-	int sort;			/* lookup: Plane sorting result for each try */
-	int bsort;			/* lookup: Current best tries sort */
-
-	unsigned int touch;	/* nn: Per value touch count */
-	double mix[2][3];	/* nn: Bounding box min and max */
+	double mix[2][3];	/* Bounding box min and max (absolute) */
 
 	double area;		/* Area - computed by nssverts() */
 	int    ssverts;		/* Number of stratified sampling verts needed - computed by nssverts() */
@@ -158,6 +143,12 @@ struct _gtri {
 	LINKSTRUCT(struct _gtri);	/* Linked list structure */
 }; typedef struct _gtri gtri;
 
+/* Caller provided context for startnexttri()/getnexttri(), so that */
+/* more than one pass through the triangles can be in progress at once. */
+struct _gtriter {
+	gtri *tp;			/* Last triangle returned, NULL if none */
+}; typedef struct _gtriter gtriter;
+
 /* ------------------------------------ */
 
 /* An edge shared by two triangle in the mesh */
@@ -166,7 +157,6 @@ struct _gedge {
 	struct _gvert *v[2];	/* Verticies of edge */
 	struct _gtri  *t[2];	/* Triangles edge is part of */
 	int           ti[2];	/* record of indexes of edge within the triangles [0..2]*/
-	double        re[4];	/* Radial edge plane equation (relative) */
 
 	int as;				/* Assert checking flag */
 
@@ -175,17 +165,6 @@ struct _gedge {
 
 /* ------------------------------------ */
 
-/* The gamut nearest neighbor search structure */
-struct _gnn {
-	struct _gamut *s;		/* Base gamut object */
-	int n;					/* Number of points stored */
-	gtri **sax[3 * 2];		/* Sorted axis pointers, one for each direction */
-	unsigned int tbase;		/* Touch base value for this pass */
-	unsigned int ttarget;	/* Touch target value for this pass */
-}; typedef struct _gnn gnn; 
-
-/* ------------------------------------ */
-
 /* A vector intersction point */
 struct _gispnt {
 	double ip[3];			/* Intersecion Point */
@@ -213,8 +192,7 @@ struct _gamut {
 	int ntv;			/* Number of verticies used in triangulation */
 	gvert **verts;		/* Pointers to allocated verticies */
 	int read_inited;	/* Flag set if gamut was initialised from a read */
-	int lu_inited;		/* Flag set if radial surface lookup is inited */
-	int ne_inited;		/* Flag set if nearest lookup is inited */
+	int lu_inited;		/* Flag set if surface lookup BVH is inited */
 	int cu_inited;		/* Flag set if cusp values inited and trustworthy */
 	int nofilter;		/* Flag, skip segmented maxima filtering */
 	int no2pass;		/* Flag, do only one pass of convex hull */
@@ -227,8 +205,7 @@ struct _gamut {
 	gtri *tris;			/* Surface triangles linked list */
 	gedge *edges;		/* Edges between the triangles linked list */
 
-	gbsp  *lutree;		/* Lookup function BSP tree root */
-	gnn   *nns;			/* nearest neighbor acceleration structure */
+	gbvh  *bvh;			/* Surface lookup bounding volume hierarchy */
 
 	int cswbset;		/* Flag to indicate that the cs white & black points are set */
 	double cs_wp[3];	/* Color spaces white point */
@@ -251,7 +228,7 @@ struct _gamut {
 	int	   ssvertn;		/* Number of verts created for current triangle */
 	sobol *ss;			/* Sibol ss generator currently being used */
 
-	gtri *nexttri;		/* Context for getnexttri() */
+	gtri *nexttri;		/* Context for getssvert() */
 
 /* Public: */
 	/* Methods */
@@ -259,6 +236,12 @@ struct _gamut {
 
 	gvert *(*expand)(struct _gamut *s, double in[3]);		/* Expand the gamut surface */
 
+	void (*expand_n)(struct _gamut *s, double (*in)[3], int n);
+							/* Expand the gamut surface with in[0..n-1]. This is faster */
+							/* than calling expand() for each point for large numbers of */
+							/* points, since most of the points that would be filtered */
+							/* out are discarded in parallel first. */
+
 	void (*set_cs_bp_kp_ovrd)(struct _gamut *s, double *bk, double *kp);	/* Override cs black points */
 
 	int (*getisjab)(struct _gamut *s);	/* Return the isJab flag value */
@@ -301,16 +284,41 @@ struct _gamut {
 								/* location and radius. nssverts() sets vpua */
 								/* norm will contain the normal of the triangle */
 								/* the point originates from. */
+								/* (nssverts() and getssvert() keep their state in */
+								/*  the gamut, and so are not thread safe.) */
 
-	void (*startnexttri)(struct _gamut *s); /* Reset indexing through triangles for getnexttri() */
+	void (*startnexttri)(struct _gamut *s, gtriter *it);
+								/* Reset indexing through triangles for getnexttri() */
 
-	int (*getnexttri)(struct _gamut *s, int v[3]);
+	int (*getnexttri)(struct _gamut *s, gtriter *it, int v[3]);
 								/* Return the next surface triange, nz on no more */
 								/* Index v[] corresponds to order of getvert() */ 
 
+	void (*freeze)(struct _gamut *s);
+								/* Finish building the gamut, and setup the surface */
+								/* and lookup structures. After this, the surface */
+								/* query methods below, getvert(), startnexttri(), */
+								/* getnexttri(), getwb() and getcusps() don't modify */
+								/* the gamut, and may be called from multiple threads */
+								/* at once. (Otherwise the first query does this setup.) */
+								/* Modifying the gamut returns it to the build phase. */
+
 	double (*volume)(struct _gamut *s);
 								/* Return the total volume enclosed by the gamut */
 
+	double (*vox_volume)(struct _gamut *s, int res, double *err);
+								/* Return an estimate of the volume enclosed by the gamut, */
+								/* made by rasterising it into a grid of cubic cells with */
+								/* res (2 .. 2048) cells along its longest side. If err is */
+								/* not NULL, return an estimate of the absolute error. */
+								/* Return -1.0 on error. */
+
+	double (*vox_isect_volume)(struct _gamut *s, struct _gamut *s2, int res, double *err);
+								/* Return an estimate of the volume of the intersection of */
+								/* this and the given gamut, made in the same way as */
+								/* vox_volume(). Return -1.0 if the gamuts are not in the */
+								/* same colorspace, or on error. */
+
 	int (*intersect)(struct _gamut *s, struct _gamut *s1, struct _gamut *s2);
 								/* Initialise this gamut with the intersection of the */
 								/* the two given gamuts. */
@@ -361,6 +369,28 @@ struct _gamut {
 							/* Return the number of intersections set in list. Will be even. */
 							/* These will all be in then out pairs in direction p1->p2. */
 
+	/* Batched versions of the above surface queries, for n points at a time. */
+	/* These are faster than one point at a time for large numbers of points, */
+	/* and make use of multiple threads. */
+
+	void (*radial_n)(struct _gamut *s, double *or, double (*out)[3], double (*in)[3], int n);
+							/* radial() for in[0..n-1], returning radii in or[] and */
+							/* surface points in out[]. or[] and out[] may be NULL */
+
+	void (*nradial_n)(struct _gamut *s, double *or, double (*out)[3], double (*in)[3], int n);
+							/* nradial() for in[0..n-1], returning normalised radii */
+							/* in or[] and surface points in out[]. or[] and out[] may be NULL */
+
+	void (*nearest_n)(struct _gamut *s, double (*out)[3], double (*in)[3], int n);
+							/* nearest() for in[0..n-1], returning points in out[] */
+
+	void (*vector_isect_n)(struct _gamut *s, int *rv, double (*p1)[3], double (*p2)[3],
+	                       double (*min)[3], double (*max)[3], double *mint, double *maxt,
+	                       int n);
+							/* vector_isect() for p1[0..n-1]->p2[0..n-1], returning */
+							/* the results in rv[], min[], max[], mint[] and maxt[], */
+							/* any of which may be NULL */
+
 	void (*setwb)(struct _gamut *s, double *wp, double *bp, double *kp);
 							/* Define the colorspaces white, black and K only black points. */
 							/* May be NULL if unknown, and will be set to a default. */
@@ -388,7 +418,9 @@ struct _gamut {
 	int (*write_vrml)(struct _gamut *s, char *filename,
 	                              int doaxes, int docusps); /* Write to a VRML .wrl/.x3d file */
 	int (*write_gam)(struct _gamut *s, char *filename);		/* Write to a CGATS .gam file */
-	int (*read_gam)(struct _gamut *s, char *filename);		/* Read from a CGATS .gam file */
+	int (*read_gam)(struct _gamut *s, char *filename);		/* Read from a CGATS or binary .gam file */
+	int (*write_bgam)(struct _gamut *s, char *filename);	/* Write to a binary .gam file, */
+							/* that includes the lookup structure, so it is fast to read */
 
 	int (*write_trans_vrml)(struct _gamut *s, char *filename, /* Write transformed VRML/X3D .wrl */
 		int doaxes, int docusps, void (*transform)(void *cntx, double out[3], double in[3]), /* with xform */
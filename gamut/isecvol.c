@@ -1,6 +1,7 @@
 
 /* 
  * Compute the intersection volume of two gamuts. 
+ * Also voxel based estimates of gamut and intersection volume.
  *
  * Author:  Graeme W. Gill
  * Date:    2008/1/7
@@ -28,6 +29,8 @@
 #include "numlib.h"
 #include "gamut.h"
 
+#ifdef NEVER	/* Triangle intersection volume - unfinished and not used */
+
 /* Compute a triangles area */
 static double tri_area(
 double v1[3],
@@ -127,10 +130,8 @@ gamut *s2
 	if (s1->compatible(s1, s2) == 0)
 		return -1.0;
 
-	if IS_LIST_EMPTY(s1->tris)
-		s1->triangulate(s1);
-	if IS_LIST_EMPTY(s2->tris)
-		s2->triangulate(s2);
+	s1->freeze(s1);
+	s2->freeze(s2);
 
 	vol = 0.0;
 
@@ -317,4 +318,331 @@ printf("~1 final volume = %f\n",vol);
 	return vol;
 }
 
+#endif /* NEVER */
+
+/* ===================================================== */
+/* Voxel based volume estimates.                          */
+/* Each gamut is rasterised into a bitset grid, one row of */
+/* bits per a*b* column, by intersecting a vector along the */
+/* L* axis through each column center with the gamut surface. */
+/* A cell is in the gamut if its center is. The volume is the */
+/* number of cells set, and the intersection volume the number */
+/* set in both grids. This is robust with detailed or non-convex */
+/* (i.e. image) gamuts, and takes time proportional to res^2. */
+
+#define VOX_MAXRES 2048			/* Maximum resolution */
+#define VOX_MAXISECT 256		/* Maximum surface crossings in a column */
+
+/* Voxel grid */
+typedef struct {
+	double lo[3];		/* Low corner of the grid */
+	double cw;			/* Cell width */
+	int n[3];			/* Number of cells in L, a, b */
+	int nw;				/* Number of 64 bit words per column */
+	ORD64 *b;			/* Bits [n[1]][n[2]][nw], L is the bit index */
+} voxgrid;
+
+/* Context for filling a voxgrid */
+typedef struct {
+	gamut *s;			/* Gamut being rasterised */
+	voxgrid *g;			/* Grid being filled */
+} voxfill;
+
+/* Return the bounding box of the gamut surface in min[] and max[] */
+static void vox_bbox(gamut *s, double min[3], double max[3]) {
+	int i, j;
+
+	for (j = 0; j < 3; j++) {
+		min[j] = 1e38;
+		max[j] = -1e38;
+	}
+	for (i = 0; i < s->nv; i++) {
+		if (!(s->verts[i]->f & GVERT_TRI))
+			continue;
+		for (j = 0; j < 3; j++) {
+			if (s->verts[i]->p[j] < min[j])
+				min[j] = s->verts[i]->p[j];
+			if (s->verts[i]->p[j] > max[j])
+				max[j] = s->verts[i]->p[j];
+		}
+	}
+}
+
+/* Setup a grid of cubic cells, with res cells along the longest */
+/* side of the given box. Return nz on error. */
+static int vox_init(voxgrid *g, double min[3], double max[3], int res) {
+	double ext = 0.0;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if ((max[j] - min[j]) > ext)
+			ext = max[j] - min[j];
+	}
+	g->cw = ext/res;
+	if (g->cw <= 0.0)
+		g->cw = 1.0;
+	for (j = 0; j < 3; j++) {
+		g->lo[j] = min[j];
+		g->n[j] = (int)ceil((max[j] - min[j])/g->cw - 1e-9);
+		if (g->n[j] < 1)
+			g->n[j] = 1;
+	}
+	g->nw = (g->n[0] + 63)/64;
+	if ((g->b = (ORD64 *)calloc((size_t)g->n[1] * g->n[2] * g->nw, sizeof(ORD64))) == NULL)
+		return 1;
+	return 0;
+}
+
+/* Set the bits for the cells of a column with centers between lin and lout */
+static void vox_set_cells(voxgrid *g, ORD64 *bp, double lin, double lout) {
+	int j, c0, c1;
+
+	c0 = (int)ceil((lin - g->lo[0])/g->cw - 0.5);
+	c1 = (int)ceil((lout - g->lo[0])/g->cw - 0.5);		/* Exclusive */
+	if (c0 < 0)
+		c0 = 0;
+	if (c1 > g->n[0])
+		c1 = g->n[0];
+
+	/* Set bits c0 .. c1-1 a word at a time */
+	for (j = c0; j < c1;) {
+		int w = j >> 6, sb = j & 63;
+		int nb = 64 - sb;
+		ORD64 m;
+
+		if (nb > (c1 - j))
+			nb = c1 - j;
+		m = (nb == 64) ? ~(ORD64)0 : ((((ORD64)1) << nb) - 1) << sb;
+		bp[w] |= m;
+		j += nb;
+	}
+}
+
+/* Set the bits for the cells in the column whose centers are in the gamut. */
+/* Called by pfor() for each a* row of columns. */
+static void vox_fill_row(void *cntx, int thix, int ia) {
+	voxfill *p = (voxfill *)cntx;
+	voxgrid *g = p->g;
+	gispnt slp[VOX_MAXISECT], *lp = slp;
+	int ll = VOX_MAXISECT;
+	double p1[3], p2[3], len, eps;
+	int ib, i, nisect;
+
+	p1[0] = g->lo[0] - g->cw;
+	p2[0] = g->lo[0] + (g->n[0] + 1) * g->cw;
+	len = p2[0] - p1[0];
+	eps = 1e-6 * g->cw/len;		/* Coincident crossing tollerance in pv */
+	p1[1] = p2[1] = g->lo[1] + (ia + 0.5) * g->cw;
+
+	for (ib = 0; ib < g->n[2]; ib++) {
+		ORD64 *bp = g->b + ((size_t)ia * g->n[2] + ib) * g->nw;
+		double lin = 0.0, lout = 0.0;
+		double ppv = -1e38;		/* Previous accepted crossing */
+		int pdir = 0;			/* Previous accepted direction, 0 = out */
+		int pend = 0;			/* nz if lin..lout is a segment yet to be set */
+
+		p1[2] = p2[2] = g->lo[2] + (ib + 0.5) * g->cw;
+
+		/* vector_isectns() silently drops crossings that don't fit the list, */
+		/* and merges coincident ones, so a list that came back more than */
+		/* half full may have been truncated. Retry with a bigger list. */
+		for (;;) {
+			nisect = p->s->vector_isectns(p->s, p1, p2, lp, ll);
+			if (nisect <= ll/2)
+				break;
+			if (ll >= (VOX_MAXISECT << 8))
+				error("vox_fill_row: more than %d surface crossings in a column",ll/2);
+			if (lp != slp)
+				free(lp);
+			ll *= 2;
+			if ((lp = (gispnt *)malloc(ll * sizeof(gispnt))) == NULL)
+				error("vox_fill_row: malloc of %d crossings failed",ll);
+		}
+
+		/* Pair each entry into the gamut with the following exit. */
+		/* Coincident crossings in the same direction are dropped, */
+		/* and an exit immediately followed by an entry at the same */
+		/* place (i.e. two touching lobes) joins the two segments. */
+		for (i = 0; i < nisect; i++) {
+			double lv = p1[0] + lp[i].pv * len;
+
+			if (lp[i].dir == pdir)			/* Not a change of state */
+				continue;
+			if (lp[i].dir) {				/* Entry */
+				if (pend && (lp[i].pv - ppv) < eps) {
+					pend = 0;				/* Continue the previous segment */
+				} else {
+					if (pend)
+						vox_set_cells(g, bp, lin, lout);
+					pend = 0;
+					lin = lv;
+				}
+			} else {						/* Exit */
+				lout = lv;
+				pend = 1;
+			}
+			ppv = lp[i].pv;
+			pdir = lp[i].dir;
+		}
+		if (pend)
+			vox_set_cells(g, bp, lin, lout);
+	}
+	if (lp != slp)
+		free(lp);
+}
+
+/* Rasterise the gamut into the grid. */
+static void vox_fill(gamut *s, voxgrid *g) {
+	voxfill fc;
+
+	s->freeze(s);		/* Setup the lookup structures before any threads use them */
+	fc.s = s;
+	fc.g = g;
+	pfor(g->n[1], 0, (void *)&fc, vox_fill_row);
+}
+
+/* Count the set bits in a word, 64 at a time (SWAR popcount) */
+static int vox_popcount(ORD64 x) {
+	x = x - ((x >> 1) & (ORD64)0x5555555555555555);
+	x = (x & (ORD64)0x3333333333333333) + ((x >> 2) & (ORD64)0x3333333333333333);
+	x = (x + (x >> 4)) & (ORD64)0x0f0f0f0f0f0f0f0f;
+	return (int)((x * (ORD64)0x0101010101010101) >> 56);
+}
+
+/* Return the volume of the set cells in the grid, and an error */
+/* estimate if err != NULL. Only the cells on the surface (set cells */
+/* with a clear neighbour) are in error, each by up to half a cell, */
+/* and these errors largely cancel out. The estimate is the error */
+/* for a random walk over the surface cells, which is about three */
+/* standard deviations. */
+static double vox_count(voxgrid *g, double *err) {
+	ORD64 *b = g->b;
+	int na = g->n[1], nb = g->n[2], nw = g->nw;
+	double cnt = 0.0, bcnt = 0.0;
+	int ia, ib, w;
+
+	for (ia = 0; ia < na; ia++) {
+		for (ib = 0; ib < nb; ib++) {
+			ORD64 *bp = b + ((size_t)ia * nb + ib) * nw;
+			ORD64 *am = ia > 0        ? bp - (size_t)nb * nw : NULL;
+			ORD64 *ap = ia < (na-1)   ? bp + (size_t)nb * nw : NULL;
+			ORD64 *bm = ib > 0        ? bp - nw : NULL;
+			ORD64 *bq = ib < (nb-1)   ? bp + nw : NULL;
+
+			for (w = 0; w < nw; w++) {
+				ORD64 x = bp[w], in;
+
+				if (x == 0)
+					continue;
+				cnt += vox_popcount(x);
+
+				if (err == NULL)
+					continue;
+
+				/* Cells whose 6 neighbours are all set */
+				in = x;
+				in &= (x << 1) | (w > 0 ? bp[w-1] >> 63 : 0);
+				in &= (x >> 1) | (w < (nw-1) ? bp[w+1] << 63 : 0);
+				in &= am != NULL ? am[w] : 0;
+				in &= ap != NULL ? ap[w] : 0;
+				in &= bm != NULL ? bm[w] : 0;
+				in &= bq != NULL ? bq[w] : 0;
+				bcnt += vox_popcount(x & ~in);
+			}
+		}
+	}
+
+	if (err != NULL)
+		*err = sqrt(bcnt) * g->cw * g->cw * g->cw;
+	return cnt * g->cw * g->cw * g->cw;
+}
+
+/* Return the volume of the gamut, estimated using a voxel grid with */
+/* res cells along its longest side, and an estimate of the absolute */
+/* error in *err if err != NULL. Return -1.0 on error. */
+double vox_volume(
+gamut *s,
+int res,
+double *err
+) {
+	double min[3], max[3], vol;
+	voxgrid g;
+
+	if (res < 2 || res > VOX_MAXRES)
+		return -1.0;
+
+	s->freeze(s);
+	vox_bbox(s, min, max);
+	if (min[0] > max[0]) {			/* Empty gamut */
+		if (err != NULL)
+			*err = 0.0;
+		return 0.0;
+	}
+	if (vox_init(&g, min, max, res))
+		return -1.0;
+
+	vox_fill(s, &g);
+	vol = vox_count(&g, err);
+
+	free(g.b);
+	return vol;
+}
+
+/* Return the volume of the intersection of the two gamuts, estimated using */
+/* a voxel grid with res cells along the longest side of the overlap of their */
+/* bounding boxes, and an estimate of the absolute error in *err if */
+/* err != NULL. Return -1.0 if the gamuts are incompatible or on error. */
+double vox_isect_volume(
+gamut *s1,
+gamut *s2,
+int res,
+double *err
+) {
+	double min[3], max[3], min2[3], max2[3], vol;
+	voxgrid g1, g2;
+	size_t i, nt;
+	int j;
+
+	if (res < 2 || res > VOX_MAXRES
+	 || s1->getisjab(s1) != s2->getisjab(s2))
+		return -1.0;
+
+	s1->freeze(s1);
+	s2->freeze(s2);
+	vox_bbox(s1, min, max);
+	vox_bbox(s2, min2, max2);
+
+	/* Only the overlap of the bounding boxes can be in both */
+	for (j = 0; j < 3; j++) {
+		if (min2[j] > min[j])
+			min[j] = min2[j];
+		if (max2[j] < max[j])
+			max[j] = max2[j];
+		if (min[j] >= max[j])
+			break;
+	}
+	if (j < 3) {					/* No overlap */
+		if (err != NULL)
+			*err = 0.0;
+		return 0.0;
+	}
 
+	if (vox_init(&g1, min, max, res))
+		return -1.0;
+	if (vox_init(&g2, min, max, res)) {
+		free(g1.b);
+		return -1.0;
+	}
+
+	vox_fill(s1, &g1);
+	vox_fill(s2, &g2);
+
+	nt = (size_t)g1.n[1] * g1.n[2] * g1.nw;
+	for (i = 0; i < nt; i++)
+		g1.b[i] &= g2.b[i];
+	vol = vox_count(&g1, err);
+
+	free(g1.b);
+	free(g2.b);
+	return vol;
+}
@@ -81,6 +81,9 @@
 #define DARK_L  5.0		/* "dark" L/J value */
 #define NEUTRAL_C  20.0	/* "neutral" C value */
 #define NO_TRIALS 6		/* [6] Number of random trials */
+#define NO_AGREE 3		/* [3] Stop trials once this many have found the best point */
+#define AGREE_DIST 0.1	/* [0.1] 2D distance within which trial results agree */
+#define GRAD_DEL 0.05	/* [0.05] Forward difference step of the error gradient */
 #define VECADJPASSES 8	/* [8] Vector smoothing and adjust passes. */
 #define RSPLPASSES 4	/* [4] Number of rspl smoothing & adjustment passes */
 #define RSPLSCALE 1.8	/* [1.8] Offset within gamut for rspl smoothing to aim for */
@@ -308,6 +311,9 @@ struct _smthopt {
 	int useexp;				/* Flag indicating whether expansion is permitted */
 	double *wn;				/* Target of weighted nearest */
 	gamut *wngam;			/* for optfunc1 and optfunc1a */
+	double (*efunc)(void *fdata, double tp[]);	/* Error function for optcfunc() & optdfunc() */
+	int lbvalid;			/* Flag, lbv[] and lbf are valid */
+	double lbv[2], lbf;		/* Lowest point evaluated by conjgrad() since the last gradient */
 
 	/* Setup state */
 	int isJab;				/* Flag indicating Jab rather than Lab space */
@@ -1799,6 +1805,369 @@ int near_smooth_np(
 }
 
 
+/* ============================================ */
+/* Parallel optimisation of the points. */
+
+/* Context for optimising all the points of one pass */
+typedef struct {
+	smthopt *opts;		/* Common optimisation setup, copied for each point */
+	nearsmth *smp;		/* Points being optimised */
+	gamut *shgam;		/* Shrunk destination gamut (third pass) */
+	cow *gpnts;			/* Returned rspl setup points (third pass) */
+	char *fail;			/* Per point flag, NZ if the optimisation failed */
+} optpass;
+
+/* Return a pseudo random number in the range min .. max that depends */
+/* only on the seed, so that restart points are the same no matter */
+/* what order or thread the points are optimised in. */
+static double seed_rand(unsigned int seed, double min, double max) {
+	seed ^= seed >> 16;
+	seed *= 0x7feb352d;
+	seed ^= seed >> 15;
+	seed *= 0x846ca68b;
+	seed ^= seed >> 16;
+	return min + (max - min) * (seed/4294967295.0);
+}
+
+/* Error function for conjgrad(). This notes the lowest point */
+/* evaluated, since conjgrad() asks for the gradient at the */
+/* minimum its line search has just found. */
+static double optcfunc(
+void *fdata,
+double *tp			/* 2D point being evaluated */
+) {
+	smthopt *s = (smthopt *)fdata;	
+	double rv;
+
+	rv = s->efunc(fdata, tp);
+	if (!s->lbvalid || rv < s->lbf) {
+		s->lbv[0] = tp[0];
+		s->lbv[1] = tp[1];
+		s->lbf = rv;
+		s->lbvalid = 1;
+	}
+	return rv;
+}
+
+/* Gradient function for conjgrad(). The error functions evaluate */
+/* the point mapped onto a triangulated gamut surface, and optfunc2() */
+/* also includes the depth along the mapping vector, so the gradient */
+/* is computed using forward differences rather than analytically. */
+/* The value at tp is re-used from optcfunc() if it has it. */
+static double optdfunc(
+void *fdata,
+double *dp,			/* Return gradient */
+double *tp			/* 2D point being evaluated */
+) {
+	smthopt *s = (smthopt *)fdata;	
+	double rv, ttp[2];
+	int k;
+
+	if (s->lbvalid && tp[0] == s->lbv[0] && tp[1] == s->lbv[1])
+		rv = s->lbf;
+	else
+		rv = s->efunc(fdata, tp);
+	s->lbvalid = 0;
+
+	for (k = 0; k < 2; k++) {
+		ttp[0] = tp[0];
+		ttp[1] = tp[1];
+		ttp[k] += GRAD_DEL;
+		dp[k] = (s->efunc(fdata, ttp) - rv)/GRAD_DEL;
+	}
+	return rv;
+}
+
+/* Do several trials from different starting points to avoid */
+/* any local minima, particularly with nearest mapping. */
+/* Each trial uses conjgrad(), falling back on powell() if it fails. */
+/* Stop early once NO_AGREE trials have found the best point. */
+/* Return NZ if all the trials failed. */
+static int opt_trials(
+smthopt *s,			/* Context for this point */
+int pass,			/* Which pass, 1 .. 3 */
+double bnv[2],		/* Return best 2D value */
+double iv[2],		/* Initial 2D start value */
+double (*func)(void *fdata, double tp[])
+) {
+	double sa[2] = { 20.0, 20.0 };		/* 2D search area */
+	double nv[2];						/* 2D New value */
+	double brv;							/* Best return value */
+	unsigned int seed;
+	int trial, nagree = 0;
+
+	s->efunc = func;
+
+	nv[0] = iv[0];
+	nv[1] = iv[1];
+	brv = 1e38;
+	for (trial = 0; trial < NO_TRIALS; trial++) {
+		double snv[2];		/* Start value */
+		double rv;			/* Temporary */
+
+		/* Optimise the point */
+		snv[0] = nv[0];
+		snv[1] = nv[1];
+		s->lbvalid = 0;
+		if (conjgrad(&rv, 2, nv, sa, 0.01, 1000, optcfunc, optdfunc, (void *)s, NULL, NULL) != 0) {
+			nv[0] = snv[0];
+			nv[1] = snv[1];
+			if (powell(&rv, 2, nv, sa, 0.01, 1000, func, (void *)s, NULL, NULL) != 0)
+				rv = 1e38;
+		}
+		if (rv < 1e38) {
+			/* See if this agrees with the best so far */
+			if (brv < 1e38
+			 && fabs(nv[0] - bnv[0]) < AGREE_DIST
+			 && fabs(nv[1] - bnv[1]) < AGREE_DIST) {
+				nagree++;
+				if (rv < brv) {
+					brv = rv;
+					bnv[0] = nv[0];
+					bnv[1] = nv[1];
+				}
+			} else if (rv < brv) {
+				nagree = 1;
+				brv = rv;
+				bnv[0] = nv[0];
+				bnv[1] = nv[1];
+			}
+		}
+		if (nagree >= NO_AGREE)
+			break;
+
+		/* Adjust the starting point with a random offset to avoid local minima */
+		seed = ((s->ix * NO_TRIALS + trial) * 4 + pass) * 2;
+		nv[0] = iv[0] + seed_rand(seed, -20.0, 20.0);
+		nv[1] = iv[1] + seed_rand(seed + 1, -20.0, 20.0);
+	}
+	if (brv == 1e38) {		/* We failed to get a result */
+#ifdef DEBUG_POWELL_FAILS
+		/* Optimise the point with debug on */
+		s->debug = 1;
+		nv[0] = iv[0];
+		nv[1] = iv[1];
+		powell(NULL, 2, nv, sa, 0.01, 1000, func, (void *)s, NULL, NULL);
+		s->debug = 0;
+#endif
+		return 1;
+	}
+	return 0;
+}
+
+/* First pass: locate the weighted nearest point of point i */
+static void opt_pnt1(void *cntx, int thix, int i) {
+	optpass *op = (optpass *)cntx;
+	nearsmth *p = &op->smp[i];
+	smthopt opts = *op->opts;		/* Our own copy of the context */
+	double iv[3];					/* Initial start value */
+	double bnv[2];					/* Best 2d value */
+	double tp[3];					/* Resultint value */
+
+	opts.pass = 0;		/* Itteration pass */
+	opts.ix = i;		/* Point to optimise */
+	opts.p = p;
+
+	/* If the img point is within the destination, then we're */
+	/* expanding, so temporarily swap src and radial dest. */
+	/* (??? should we use the cvect() direction to determine swap, */
+	/*      rather than radial ???) */
+	p->swap = 0;
+	if (opts.useexp && p->dr > (p->sr + 1e-9)) {
+		gamut *tt;
+
+		p->swap = 1;
+		tt = p->dgam; p->dgam = p->sgam; p->sgam = tt;
+
+		p->dr = p->sr;
+		p->dv[0] = p->sv[0];
+		p->dv[1] = p->sv[1];
+		p->dv[2] = p->sv[2];
+
+		p->sr = p->drr;
+		p->sv[0] = p->drv[0];
+		p->sv[1] = p->drv[1];
+		p->sv[2] = p->drv[2];
+	}
+	opts.wngam = p->dgam;		/* Nearest to dgam */ 
+	opts.wn = p->sv;			/* minimize optfunc1 sv -> dgam */
+	
+	/* Convert our start value from 3D to 2D for speed. */
+	icmMul3By3x4(iv, p->m2d, p->dv);
+	iv[0] = iv[1];
+	iv[1] = iv[2];
+
+	if (opt_trials(&opts, 1, bnv, iv, optfunc1)) {
+		op->fail[i] = 1;
+		return;
+	}
+
+	/* Convert best result 2D -> 3D */
+	tp[2] = bnv[1];
+	tp[1] = bnv[0];
+	tp[0] = 50.0;
+	icmMul3By3x4(tp, p->m3d, tp);
+
+	/* Remap it to the destinaton gamut surface */
+	p->dgam->radial(p->dgam, tp, tp);
+	icmCpy3(p->aodv, tp);
+
+	/* Undo any swap */
+	if (p->swap) {
+		gamut *tt;
+
+		tt = p->dgam; p->dgam = p->sgam; p->sgam = tt;
+
+		/* We get the point on the real src gamut out when swap */
+		p->_sv[0] = p->aodv[0];
+		p->_sv[1] = p->aodv[1];
+		p->_sv[2] = p->aodv[2];
+
+		/* So we need to compute cusp mapped sv */
+		comp_ce(&opts, p->sv, p->_sv, &p->wt);
+		p->sr = icmNorm33(p->sv, p->sgam->cent);
+
+		VB(("Exp Src %d = %f %f %f\n",i,p->_sv[0],p->_sv[1],p->_sv[2]));
+		p->aodv[0] = p->drv[0];
+		p->aodv[1] = p->drv[1];
+		p->aodv[2] = p->drv[2];
+	}
+}
+
+/* Second pass: locate the optimized overall weighted point of point i */
+static void opt_pnt2(void *cntx, int thix, int i) {
+	optpass *op = (optpass *)cntx;
+	nearsmth *p = &op->smp[i];
+	smthopt opts = *op->opts;		/* Our own copy of the context */
+	double iv[3];					/* Initial start value */
+	double bnv[2];					/* Best 2d value */
+	double tp[3];					/* Resultint value */
+
+	opts.pass = 0;		/* Itteration pass */
+	opts.ix = i;		/* Point to optimise */
+	opts.p = p;
+
+	/* Convert our start value from 3D to 2D for speed. */
+	icmMul3By3x4(iv, p->m2d, p->aodv);
+	iv[0] = iv[1];
+	iv[1] = iv[2];
+
+	if (opt_trials(&opts, 2, bnv, iv, optfunc2)) {
+		op->fail[i] = 1;
+		return;
+	}
+
+	/* Convert best result 3D -> 2D */
+	tp[2] = bnv[1];
+	tp[1] = bnv[0];
+	tp[0] = 50.0;
+	icmMul3By3x4(tp, p->m3d, tp);
+
+	/* Remap it to the destinaton gamut surface */
+	p->dgam->radial(p->dgam, tp, tp);
+
+	icmCpy3(p->dv, tp);			/* Default current solution */
+	icmCpy3(p->nrdv, tp);		/* Non smoothed result */
+	icmCpy3(p->anv, tp);		/* Starting point for smoothing */
+	p->dr = icmNorm33(p->dv, p->dgam->cent);
+}
+
+/* Third pass: locate the closest point on the shrunken gamut to point i, */
+/* and set it up for creating the fine tuning correction rspl. */
+static void opt_pnt3(void *cntx, int thix, int i) {
+	optpass *op = (optpass *)cntx;
+	nearsmth *p = &op->smp[i];
+	smthopt opts = *op->opts;		/* Our own copy of the context */
+	gtri *ctri = NULL;
+	double tmp[3];
+	double iv[3];					/* Initial start value */
+	double bnv[2];					/* Best 2d value */
+	double tp[3];					/* Resultint value */
+
+	opts.pass = 0;		/* Itteration pass */
+	opts.ix = i;		/* Point to optimise */
+	opts.p = p;
+	opts.wngam = op->shgam;
+	opts.wn = p->dv;		/* minimize optfunc1a dv -> shgam */
+
+	/* Convert our start value from 3D to 2D for speed. */
+	icmMul3By3x4(iv, p->m2d, p->nrdv);
+	iv[0] = iv[1];
+	iv[1] = iv[2];
+
+	if (opt_trials(&opts, 3, bnv, iv, optfunc1a)) {
+		op->fail[i] = 1;
+		return;
+	}
+
+	/* Convert best result 2D -> 3D */
+	tp[2] = bnv[1];
+	tp[1] = bnv[0];
+	tp[0] = 50.0;
+	icmMul3By3x4(tp, p->m3d, tp);
+
+	/* Remap it to the destinaton gamut surface */
+	op->shgam->radial(op->shgam, tp, tp);
+
+	/* Compute mapping vector from dst to shdst */
+	icmSub3(p->temp, tp, p->nrdv);
+
+	/* In case shrunk vector is very short, add a small part */
+	/* of the nearest normal.  */
+	p->dgam->nearest_tri(p->dgam, NULL, p->nrdv, &ctri);
+	icmScale3(tmp, ctri->pe, 0.1);		/* Scale to small inwards */
+	icmAdd3(p->temp, p->temp, tmp);
+
+	/* evector */
+	icmNormalize3(p->temp, p->temp, 1.0);
+
+	/* Place it in rspl setup array */
+	icmCpy3(op->gpnts[i].p, p->nrdv);
+	icmCpy3(op->gpnts[i].v, p->temp);
+	op->gpnts[i].w = 1.0;
+}
+
+/* Optimise all the points of a pass using func(), in parallel. */
+/* Return NZ if any of the points failed. */
+static int opt_pass(
+int verb,			/* Verbose flag */
+optpass *op,		/* Pass context */
+int nmpts,			/* Number of points */
+int pass,			/* Pass number 1 .. 3 */
+char *desc,			/* Description of the pass for verbose output */
+void (*func)(void *cntx, int thix, int ix)
+) {
+	double stime;
+	int i, nthr;
+
+	if ((op->fail = (char *)calloc(nmpts, sizeof(char))) == NULL) { 
+		fprintf(stderr,"gamut map: Malloc of near smooth fail flags failed\n");
+		return 1;
+	}
+
+	stime = pfor_time();
+	nthr = pfor(nmpts, 0, (void *)op, func);
+
+	/* Report a failure deterministically */
+	for (i = 0; i < nmpts; i++) {
+		if (op->fail[i])
+			break;
+	}
+	free(op->fail);
+	op->fail = NULL;
+
+	if (i < nmpts) {
+		fprintf(stderr, "multiple powells failed to get a result (%d)\n",pass);
+		return 1;
+	}
+
+	if (verb)
+		printf(" %s took %.1f seconds using %d thread%s\n",desc,
+		       pfor_time() - stime, nthr, nthr > 1 ? "s" : "");
+
+	return 0;
+}
+
 /* ============================================ */
 /* Return a list of points. Free list after use */
 /* Return NULL on error */
@@ -1827,6 +2196,7 @@ datao map_ol,		/* Return expanded output range */
 datao map_oh 
 ) {
 	smthopt opts;	/* optimisation and cusp mapping context */
+	optpass op;		/* Parallel point optimisation context */
 	int ix, i, j, k;
 	gamut *p_gam;	/* Gamut used for points == either source colorspace or image */
 	gamut *src_gam;	/* Intersection of src and img gamut gamut */
@@ -2379,213 +2749,41 @@ datao map_oh
 	/* Optimise the location of the source to destination mapping. */
 	if (verb) printf("Optimizing source to destination mapping...\n");
 
+	/* The points are optimised in parallel, so make sure the */
+	/* gamuts are ready to be queried from multiple threads. */
+	src_gam->freeze(src_gam);
+	dst_gam->freeze(dst_gam);
+
+	op.opts = &opts;
+	op.smp = smp;
+	op.shgam = NULL;
+	op.gpnts = NULL;
+	op.fail = NULL;
+
 	VA(("Doing first pass to locate the nearest point\n"));
 	/* First pass to locate the weighted nearest point, to use in subsequent passes */
-	{
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-
-			/* If the img point is within the destination, then we're */
-			/* expanding, so temporarily swap src and radial dest. */
-			/* (??? should we use the cvect() direction to determine swap, */
-			/*      rather than radial ???) */
-			smp[i].swap = 0;
-			if (useexp && smp[i].dr > (smp[i].sr + 1e-9)) {
-				gamut *tt;
-				double dd;
-
-				smp[i].swap = 1;
-				tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
-
-				smp[i].dr = smp[i].sr;
-				smp[i].dv[0] = smp[i].sv[0];
-				smp[i].dv[1] = smp[i].sv[1];
-				smp[i].dv[2] = smp[i].sv[2];
-
-				smp[i].sr = smp[i].drr;
-				smp[i].sv[0] = smp[i].drv[0];
-				smp[i].sv[1] = smp[i].drv[1];
-				smp[i].sv[2] = smp[i].drv[2];
-			}
-			opts.wngam = smp[i].dgam;		/* Nearest to dgam */ 
-			opts.wn = smp[i].sv;			/* minimize optfunc1 sv -> dgam */
-			
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-//printf("~1 point %d, trial %d, new best %f\n",i,trial,sqrt(rv));
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-//else printf("~1 powell failed with rv = %f\n",rv);
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (1)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc1, (void *)(&opts), NULL, NULL);
-#endif
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 2D -> 3D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			smp[i].dgam->radial(smp[i].dgam, tp, tp);
-			icmCpy3(smp[i].aodv, tp);
-
-			/* Undo any swap */
-			if (smp[i].swap) {
-				gamut *tt;
-				double dd;
-
-				tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
-
-				/* We get the point on the real src gamut out when swap */
-				smp[i]._sv[0] = smp[i].aodv[0];
-				smp[i]._sv[1] = smp[i].aodv[1];
-				smp[i]._sv[2] = smp[i].aodv[2];
-
-				/* So we need to compute cusp mapped sv */
-				comp_ce(&opts, smp[i].sv, smp[i]._sv, &smp[i].wt);
-				smp[i].sr = icmNorm33(smp[i].sv, smp[i].sgam->cent);
-
-				VB(("Exp Src %d = %f %f %f\n",i,smp[i]._sv[0],smp[i]._sv[1],smp[i]._sv[2]));
-				smp[i].aodv[0] = smp[i].drv[0];
-				smp[i].aodv[1] = smp[i].drv[1];
-				smp[i].aodv[2] = smp[i].drv[2];
-			}
-		}
+	if (opt_pass(verb, &op, nmpts, 1, "Nearest point pass", opt_pnt1)) {
+		if (src_gam != sc_gam)
+			src_gam->del(src_gam);
+		if (dst_gam != src_gam && dst_gam != dc_gam)
+			dst_gam->del(dst_gam);
+		free_nearsmth(smp, nmpts);
+		*npp = 0;
+		return NULL;
 	}
 
 	VA(("Locating weighted mapping vectors without smoothing\n"));
 
 	/* Second pass to locate the optimized overall weighted point nrdv[], */
 	/* which is a balance of absolute error, radial error, depth room weighting */
-	{
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-
-//printf("~1 point %d, sv %f %f %f\n",i,smp[i].sv[0],smp[i].sv[1],smp[i].sv[2]);
-
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].aodv);
-
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-//printf("~1 point %d, iv %f %f %f, 2D %f %f\n",i, smp[i].aodv[0], smp[i].aodv[1], smp[i].aodv[2], iv[0], iv[1]);
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc2, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-//printf("~1 point %d, trial %d, new best %f at xy %f %f\n",i,trial,sqrt(rv), nv[0],nv[1]);
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-//else printf("~1 powell failed with rv = %f\n",rv);
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (2)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc2, (void *)(&opts), NULL, NULL);
-#endif
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 3D -> 2D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			smp[i].dgam->radial(smp[i].dgam, tp, tp);
-
-			icmCpy3(smp[i].dv, tp);			/* Default current solution */
-			icmCpy3(smp[i].nrdv, tp);		/* Non smoothed result */
-			icmCpy3(smp[i].anv, tp);		/* Starting point for smoothing */
-			smp[i].dr = icmNorm33(smp[i].dv, smp[i].dgam->cent);
-//printf("~1 %d: dv %f %f %f\n", i, smp[i].dv[0], smp[i].dv[1], smp[i].dv[2]);
-
-		}
+	if (opt_pass(verb, &op, nmpts, 2, "Weighted point pass", opt_pnt2)) {
+		if (src_gam != sc_gam)
+			src_gam->del(src_gam);
+		if (dst_gam != src_gam && dst_gam != dc_gam)
+			dst_gam->del(dst_gam);
+		free_nearsmth(smp, nmpts);
+		*npp = 0;
+		return NULL;
 	}
 
 	/* Make sure the input and output ranges encompas the points */ 
@@ -2668,13 +2866,6 @@ datao map_oh
 		double p[3], p2[3], rad;
 		int i;
 
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
 		cow *gpnts = NULL;	/* Mapping points to create 3D -> 3D mapping */
 		datai il, ih;
 		datao ol, oh;
@@ -2737,88 +2928,22 @@ datao map_oh
 
 		/* Now locate the closest points on the shrunken gamut */
 		/* and set them up for creating a rspl */
-		opts.wngam = shgam;
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			gtri *ctri = NULL;
-			double tmp[3];
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-			opts.wn = smp[i].dv;		/* minimize optfunc1a dv -> shgam */
-
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].nrdv);
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (3)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].nrdv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL);
-#endif
-				shgam->del(shgam);		/* Done with this */
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 2D -> 3D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			shgam->radial(shgam, tp, tp);
-
-			/* Compute mapping vector from dst to shdst */
-			icmSub3(smp[i].temp, tp, smp[i].nrdv);
-
-			/* In case shrunk vector is very short, add a small part */
-			/* of the nearest normal.  */
-			smp[i].dgam->nearest_tri(smp[i].dgam, NULL, smp[i].nrdv, &ctri);
-			icmScale3(tmp, ctri->pe, 0.1);		/* Scale to small inwards */
-			icmAdd3(smp[i].temp, smp[i].temp, tmp);
-
-			/* evector */
-			icmNormalize3(smp[i].temp, smp[i].temp, 1.0);
-
-			/* Place it in rspl setup array */
-			icmCpy3(gpnts[i].p, smp[i].nrdv);
-			icmCpy3(gpnts[i].v, smp[i].temp);
-			gpnts[i].w = 1.0;
+		shgam->freeze(shgam);
+		op.shgam = shgam;
+		op.gpnts = gpnts;
+		if (opt_pass(verb, &op, nmpts, 3, "Correction direction pass", opt_pnt3)) {
+			free(gpnts);
+			shgam->del(shgam);		/* Done with this */
+			if (src_gam != sc_gam)
+				src_gam->del(src_gam);
+			if (dst_gam != src_gam && dst_gam != dc_gam)
+				dst_gam->del(dst_gam);
+			free_nearsmth(smp, nmpts);
+			*npp = 0;
+			return NULL;
 		}
+		op.shgam = NULL;
+		op.gpnts = NULL;
 
 		for (j = 0; j < 3; j++) {		/* Set resolution for all axes */
 			gres[j] = mapres;			/* Full resolution */
@@ -3838,7 +3963,7 @@ if (smp[i].nscale[0] > 1.5 || smp[i].nscale[0] < 0.01
 					int notrials = NO_TRIALS;
 					double bnv[3];					/* Best 3d value */
 					double brv;						/* Best return value */
-					int trial;
+					int trial, nagree = 0;
 					double mv;
 
 					/* Determine the parameter weighting at this location */
@@ -3856,8 +3981,10 @@ if (smp[i].nscale[0] > 1.5 || smp[i].nscale[0] < 0.01
 
 					/* Do several trials from different starting points to avoid */
 					/* any local minima, particularly with nearest mapping. */
+					opts.efunc = optfunc1a;
 					brv = 1e38;
 					for (trial = 0; trial < notrials; trial++) {
+						double snv[2];		/* Start value */
 						double rv;			/* Temporary */
 
 						/* Setup the 3D -> 2D tangent conversion and inverse for our start point */
@@ -3875,22 +4002,44 @@ if (smp[i].nscale[0] > 1.5 || smp[i].nscale[0] < 0.01
 							nv[1] += d_rand(-20.0, 20.0);
 						}
 
-						/* Optimise the point */
-						if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL) == 0
-						    && rv < brv) {
-							brv = rv;
-//printf("~1 point %d, trial %d, new best %f\n",i,trial,rv);
+						/* Optimise the point, falling back on powell() */
+						snv[0] = nv[0];
+						snv[1] = nv[1];
+						opts.lbvalid = 0;
+						if (conjgrad(&rv, 2, nv, s, 0.01, 1000, optcfunc, optdfunc, (void *)(&opts), NULL, NULL) != 0) {
+							nv[0] = snv[0];
+							nv[1] = snv[1];
+							if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL) != 0)
+								rv = 1e38;
+						}
+						if (rv < 1e38) {
+							double rp[3];
 
-							/* Convert best result 2D -> 3D */
+							/* Convert result 2D -> 3D */
 							tp[2] = nv[1];
 							tp[1] = nv[0];
 							tp[0] = 50.0;
 							icmMul3By3x4(tp, smp[nmpts].m3d, tp);
 				
 							/* Remap it to the source gamut surface */
-							sc_gam->radial(sc_gam, bnv, tp);
+							sc_gam->radial(sc_gam, rp, tp);
+
+							/* See if this agrees with the best so far */
+							if (brv < 1e38 && icmNorm33(rp, bnv) < AGREE_DIST) {
+								nagree++;
+								if (rv < brv) {
+									brv = rv;
+									icmCpy3(bnv, rp);
+								}
+							} else if (rv < brv) {
+//printf("~1 point %d, trial %d, new best %f\n",i,trial,rv);
+								nagree = 1;
+								brv = rv;
+								icmCpy3(bnv, rp);
+							}
 						}
-//else printf("~1 powell failed with rv = %f\n",rv);
+						if (nagree >= NO_AGREE)
+							break;
 					}
 					if (brv == 1e38) {		/* We failed to get a result */
 						fprintf(stderr, "multiple powells failed to get a result (4)\n");
@@ -4003,6 +4152,7 @@ static void create_influence_plot(nearsmth *smp, int nmpts, int mapres) {
 	double grey[3] = { 0.5, 0.5, 0.5 };		/* Grey */
 	double max, min;
 	int ix;
+	gtriter it;
 
 	if (src)
 		gam = smp->sgam;
@@ -4086,10 +4236,10 @@ static void create_influence_plot(nearsmth *smp, int nmpts, int mapres) {
 		icmClip3(pp.v, pp.v);
 		wrl->add_col_vertex(wrl, 0, pp.p, pp.v);
 	}
-	gam->startnexttri(gam);
+	gam->startnexttri(gam, &it);
 	for (;;) {
 		int vix[3];
-		if (gam->getnexttri(gam, vix))
+		if (gam->getnexttri(gam, &it, vix))
 			break;
 		wrl->add_triangle(wrl, 0, vix);
 	}
@@ -67,6 +67,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -k             Add markers for prim. & sec. \"cusp\" points\n");
 	fprintf(stderr," -i             Compute and print intersecting volume of first 2 gamuts\n");
 	fprintf(stderr," -I isect.gam   Same as -i, but save intersection gamut to isect.gam\n");
+	fprintf(stderr," -r res         With -i, estimate volumes using a voxel grid of resolution res\n");
 	fprintf(stderr,"                (Set env. ARGYLL_3D_DISP_FORMAT to VRML, X3D or X3DOM to change format)\n");
 	fprintf(stderr," outfile        Base name of output %s file\n",vrml_ext());
 	fprintf(stderr,"\n");
@@ -172,6 +173,7 @@ main(int argc, char *argv[]) {
 	int doaxes = 1;
 	int docusps = 0;
 	int isect = 0;
+	int vres = 0;			/* Voxel volume resolution, 0 for exact */
 	vrml *wrl;
 	char out_name[MAXNAMEL+1+10];
 	char iout_name[MAXNAMEL+1] = "\000";;
@@ -294,6 +296,15 @@ main(int argc, char *argv[]) {
 				}
 			}
 
+			/* Voxel volume resolution */
+			else if (argv[fa][1] == 'r' || argv[fa][1] == 'R') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument after flag -r");
+				vres = atoi(na);
+				if (vres < 2 || vres > 2048)
+					usage("Voxel resolution %d out of range 2 .. 2048",vres);
+			}
+
 			else 
 				usage("Unknown flag '%c'",argv[fa][1]);
 
@@ -501,12 +512,27 @@ main(int argc, char *argv[]) {
 		if (s2->read_gam(s2, gds[1].in_name))
 			error("Input file '%s' read failed",gds[n].in_name[1]);
 
-		v1 = s1->volume(s1);
-		v2 = s2->volume(s2);
+		if (vres > 0) {
+			double e1, e2, ei;
+
+			if ((v1 = s1->vox_volume(s1, vres, &e1)) < 0.0
+			 || (v2 = s2->vox_volume(s2, vres, &e2)) < 0.0)
+				error("Voxel volume failed");
+			if ((vi = s1->vox_isect_volume(s1, s2, vres, &ei)) < 0.0)
+				error("Gamuts are not compatible! (Colorspace ?)");
 
-		if (s->intersect(s, s1, s2))
-			error("Gamuts are not compatible! (Colorspace, gamut center ?)");
-		vi = s->volume(s);
+			printf("Voxel volume estimate errors are %.1f, %.1f and %.1f cubic units\n",e1,e2,ei);
+		} else {
+			v1 = s1->volume(s1);
+			v2 = s2->volume(s2);
+		}
+
+		if (vres <= 0 || iout_name[0] != '\000') {
+			if (s->intersect(s, s1, s2))
+				error("Gamuts are not compatible! (Colorspace, gamut center ?)");
+			if (vres <= 0)
+				vi = s->volume(s);
+		}
 
 		if (iout_name[0] != '\000') {
 			if (s->write_gam(s, iout_name))
@@ -14,5 +14,6 @@
 #include "rand.h"		/* Random number generators */
 #include "sobol.h"		/* Sub-random vector generators */
 #include "aatree.h"		/* Anderson balanced binary tree */
+#include "pfor.h"		/* Parallel for loop support */
 
 #endif /* NUMLIB_H */
@@ -0,0 +1,266 @@
+
+/***************************************************/
+/* Simple parallel for loop support                */
+/***************************************************/
+
+/*
+ * Author: Argyll CMS contributors
+ * Date:   18/10/2026
+ *
+ * Copyright 2026 Argyll CMS contributors
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * This is a minimal fork/join helper for the compute heavy
+ * loops in rspl, gamut and xicc. A set of worker threads is
+ * created for each call, each of which takes the next unprocessed
+ * loop index until they are all done. Thread creation cost is small
+ * compared to the loops this is intended for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined (NT)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#ifdef UNIX
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+#include "numsup.h"
+#include "pfor.h"
+
+#if defined(NT)
+# define PFOR_TLS __declspec(thread)
+#else
+# define PFOR_TLS __thread
+#endif
+
+static PFOR_TLS int in_pfor = 0;	/* nz if this thread is a pfor() worker */
+
+/* Shared loop state */
+typedef struct {
+	int n;					/* Number of iterations */
+	int next;				/* Next index to hand out */
+	void *cntx;
+	void (*func)(void *cntx, int thix, int ix);
+#if defined(NT)
+	CRITICAL_SECTION lock;
+#endif
+#ifdef UNIX
+	pthread_mutex_t lock;
+#endif
+} pfor_ctx;
+
+/* Per worker state */
+typedef struct {
+	pfor_ctx *p;
+	int thix;
+#if defined(NT)
+	HANDLE th;
+#endif
+#ifdef UNIX
+	pthread_t th;
+#endif
+} pfor_wk;
+
+/* Return the next index to process, or -1 if done */
+static int pfor_next(pfor_ctx *p) {
+	int ix = -1;
+#if defined(NT)
+	EnterCriticalSection(&p->lock);
+#endif
+#ifdef UNIX
+	pthread_mutex_lock(&p->lock);
+#endif
+	if (p->next < p->n)
+		ix = p->next++;
+#if defined(NT)
+	LeaveCriticalSection(&p->lock);
+#endif
+#ifdef UNIX
+	pthread_mutex_unlock(&p->lock);
+#endif
+	return ix;
+}
+
+/* Worker loop */
+static void pfor_work(pfor_wk *w) {
+	pfor_ctx *p = w->p;
+	int oin = in_pfor, ix;
+
+	in_pfor = 1;
+	while ((ix = pfor_next(p)) >= 0)
+		p->func(p->cntx, w->thix, ix);
+	in_pfor = oin;
+}
+
+#if defined(NT)
+static DWORD WINAPI pfor_thread(LPVOID pp) {
+	pfor_work((pfor_wk *)pp);
+	return 0;
+}
+#endif
+#ifdef UNIX
+static void *pfor_thread(void *pp) {
+	pfor_work((pfor_wk *)pp);
+	return NULL;
+}
+#endif
+
+/* Return the default number of threads to use */
+int pfor_nthreads(void) {
+	static int nthr = 0;
+	char *ev;
+
+	if (in_pfor)
+		return 1;
+
+	if (nthr == 0) {
+		int nn = 1;
+
+		if ((ev = getenv("ARGYLL_NTHREADS")) != NULL) {
+			nn = atoi(ev);
+		} else {
+#if defined(NT)
+			SYSTEM_INFO si;
+			GetSystemInfo(&si);
+			nn = si.dwNumberOfProcessors;
+#endif
+#if defined(UNIX) && defined(_SC_NPROCESSORS_ONLN)
+			nn = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		}
+		if (nn < 1)
+			nn = 1;
+		else if (nn > PFOR_MAXTHR)
+			nn = PFOR_MAXTHR;
+		nthr = nn;
+	}
+	return nthr;
+}
+
+/* Execute func() for ix = 0 .. n-1 in parallel. */
+/* Returns the number of threads used */
+int pfor(
+	int n,				/* Number of loop iterations */
+	int nthr,			/* Maximum number of threads, <= 0 for default */
+	void *cntx,			/* Context passed to func */
+	void (*func)(void *cntx, int thix, int ix)
+) {
+	pfor_ctx p;
+	pfor_wk wk[PFOR_MAXTHR];
+	int i, nst;			/* Number of threads started */
+
+	if (nthr <= 0 || in_pfor)
+		nthr = pfor_nthreads();
+	if (nthr > PFOR_MAXTHR)
+		nthr = PFOR_MAXTHR;
+	if (nthr > n)
+		nthr = n;
+
+	/* Not worth threading */
+	if (nthr <= 1) {
+		for (i = 0; i < n; i++)
+			func(cntx, 0, i);
+		return 1;
+	}
+
+	p.n = n;
+	p.next = 0;
+	p.cntx = cntx;
+	p.func = func;
+#if defined(NT)
+	InitializeCriticalSection(&p.lock);
+#endif
+#ifdef UNIX
+	pthread_mutex_init(&p.lock, NULL);
+#endif
+
+	/* Start the helper threads. We do worker 0 ourselves. */
+	for (nst = 1; nst < nthr; nst++) {
+		wk[nst].p = &p;
+		wk[nst].thix = nst;
+#if defined(NT)
+		if ((wk[nst].th = CreateThread(NULL, 0, pfor_thread, (LPVOID)&wk[nst], 0, NULL)) == NULL)
+			break;
+#endif
+#ifdef UNIX
+		if (pthread_create(&wk[nst].th, NULL, pfor_thread, (void *)&wk[nst]) != 0)
+			break;
+#endif
+	}
+
+	wk[0].p = &p;
+	wk[0].thix = 0;
+	pfor_work(&wk[0]);
+
+	/* Wait for the helpers to finish */
+	for (i = 1; i < nst; i++) {
+#if defined(NT)
+		WaitForSingleObject(wk[i].th, INFINITE);
+		CloseHandle(wk[i].th);
+#endif
+#ifdef UNIX
+		pthread_join(wk[i].th, NULL);
+#endif
+	}
+
+#if defined(NT)
+	DeleteCriticalSection(&p.lock);
+#endif
+#ifdef UNIX
+	pthread_mutex_destroy(&p.lock);
+#endif
+
+	return nst;
+}
+
+/* Global lock for the little shared state used by pfor() workers */
+#if defined(NT)
+static SRWLOCK pfor_glock = SRWLOCK_INIT;
+#endif
+#ifdef UNIX
+static pthread_mutex_t pfor_glock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void pfor_lock(void) {
+#if defined(NT)
+	AcquireSRWLockExclusive(&pfor_glock);
+#endif
+#ifdef UNIX
+	pthread_mutex_lock(&pfor_glock);
+#endif
+}
+
+void pfor_unlock(void) {
+#if defined(NT)
+	ReleaseSRWLockExclusive(&pfor_glock);
+#endif
+#ifdef UNIX
+	pthread_mutex_unlock(&pfor_glock);
+#endif
+}
+
+/* Return a wall clock time in seconds */
+double pfor_time(void) {
+#if defined(NT)
+	LARGE_INTEGER cnt, frq;
+
+	if (QueryPerformanceFrequency(&frq) && QueryPerformanceCounter(&cnt))
+		return (double)cnt.QuadPart/(double)frq.QuadPart;
+	return GetTickCount()/1000.0;
+#endif
+#ifdef UNIX
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+#endif
+}
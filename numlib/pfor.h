@@ -0,0 +1,56 @@
+#ifndef PFOR_H
+#define PFOR_H
+
+/*
+ * Simple parallel for loop support.
+ *
+ * Author: Argyll CMS contributors
+ * Date:   18/10/2026
+ *
+ * Copyright 2026 Argyll CMS contributors
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+#define PFOR_MAXTHR 64		/* Maximum number of threads used */
+
+/* Return the default number of threads to use for parallel loops. */
+/* This is the number of processors, unless overridden by the */
+/* ARGYLL_NTHREADS environment variable. Will be 1 if called from */
+/* within a pfor() worker, to avoid nested parallelism. */
+int pfor_nthreads(void);
+
+/* Call func(cntx, thix, ix) for each ix = 0 .. n-1, using up to nthr */
+/* threads (nthr <= 0 for the pfor_nthreads() default). thix is the */
+/* worker index 0 .. nthr-1, and can be used to index per-thread context. */
+/* Indexes are handed out in ascending order, but may complete in any order, */
+/* so func() should write its results to a per ix location, and any */
+/* reduction should be done in ix order after pfor() returns. */
+/* Returns the number of threads actually used. */
+int pfor(
+	int n,				/* Number of loop iterations */
+	int nthr,			/* Maximum number of threads, <= 0 for default */
+	void *cntx,			/* Context passed to func */
+	void (*func)(void *cntx, int thix, int ix)
+);
+
+/* Lock and unlock a single global (non-recursive) lock, used to protect */
+/* the few pieces of global state, such as memory accounting, that */
+/* may be touched by code running in several pfor() workers at once. */
+void pfor_lock(void);
+void pfor_unlock(void);
+
+/* Return a wall clock time in seconds, for timing parallel loops. */
+/* (clock() returns the CPU time summed over all the threads.) */
+double pfor_time(void);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* PFOR_H */
@@ -1055,6 +1055,7 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 for natural color */
 ) {
 	int i, nverts, ix;
 	int v[3];
+	gtriter it;
 
 	nverts = g->nverts(g);
 
@@ -1070,8 +1071,8 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 for natural color */
 		s->add_vertex(s, 9, out);
 	}
 
-	g->startnexttri(g);
-	while (g->getnexttri(g, v) == 0) {
+	g->startnexttri(g, &it);
+	while (g->getnexttri(g, &it, v) == 0) {
 		if (wire) {
 			int ix[2];
 			/* Only output 1 wire of two on an edge */
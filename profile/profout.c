@@ -511,6 +511,168 @@ void out_b2a_output(void *cntx, double out[4], double in[4]) {
 	DBG(("out_b2a_output returning DEV %s\n",icmPdv(p->ochan,out)))
 }
 
+/* --------------------------------------------------------- */
+/* Multi-threaded B2A clut setting. */
+/* icmSetMultiLutTables() calls the clut function for one grid */
+/* point at a time, so it is run twice. The first time the PCS' */
+/* values the clut function is given are just recorded. They are */
+/* then inverted in parallel, each thread having its own A2B */
+/* icxLuLut (since the reverse lookup caches can't be shared), */
+/* and the second time the results are returned in the same order. */
+
+#define B2A_MT_CHUNK 32		/* Number of successive grid points each thread does at a time */
+
+typedef struct {
+	int nthr;				/* Number of threads */
+	out_b2a_callback *tcx;	/* [nthr] Per thread copies of the context */
+	int replay;				/* nz if returning results rather than recording */
+	int npts, apts;			/* Number of points, number allocated */
+	int nunder;				/* Number of filter radius values under each result */
+	int stride;				/* Number of doubles per result */
+	double (*in)[3];		/* [apts] Recorded PCS' values */
+	double *out;			/* [apts * stride] Dev' results */
+	int base, nbpts;		/* Points being done by this pass of pfor() */
+	int ix;					/* Next point to return */
+} out_b2a_mt;
+
+/* Record or replay clut values */
+static void out_b2a_mt_clut(void *cntx, double *out, double in[3]) {
+	out_b2a_mt *p = (out_b2a_mt *)cntx;
+	out_b2a_callback *cx = &p->tcx[0];
+	double *rp;
+	int i;
+
+	if (!p->replay) {
+		if (p->npts >= p->apts) {
+			p->apts = p->apts == 0 ? 4096 : 2 * p->apts;
+			if ((p->in = (double (*)[3])realloc(p->in, p->apts * sizeof(double [3]))) == NULL)
+				error("Malloc of B2A grid points failed");
+		}
+		p->in[p->npts][0] = in[0];
+		p->in[p->npts][1] = in[1];
+		p->in[p->npts][2] = in[2];
+		p->npts++;
+
+		for (i = 0; i < (cx->ntables * cx->ochan); i++)
+			out[i] = 0.0;
+		for (i = 0; i < p->nunder; i++)
+			out[-1-i] = 0.0;
+		return;
+	}
+
+	if (p->ix >= p->npts
+	 || in[0] != p->in[p->ix][0] || in[1] != p->in[p->ix][1] || in[2] != p->in[p->ix][2])
+		error("B2A clut point %d doesn't match the recorded value",p->ix);
+
+	rp = p->out + p->ix * p->stride + p->nunder;
+	for (i = 0; i < (cx->ntables * cx->ochan); i++)
+		out[i] = rp[i];
+	for (i = 0; i < p->nunder; i++)
+		out[-1-i] = rp[-1-i];
+	p->ix++;
+}
+
+static void out_b2a_mt_input(void *cntx, double out[3], double in[3]) {
+	out_b2a_input((void *)&((out_b2a_mt *)cntx)->tcx[0], out, in);
+}
+
+static void out_b2a_mt_output(void *cntx, double out[4], double in[4]) {
+	out_b2a_output((void *)&((out_b2a_mt *)cntx)->tcx[0], out, in);
+}
+
+/* Invert a chunk of recorded points. Called by pfor() */
+static void out_b2a_mt_chunk(void *cntx, int thix, int ix) {
+	out_b2a_mt *p = (out_b2a_mt *)cntx;
+	int i, ie;
+
+	i = p->base + ix * B2A_MT_CHUNK;
+	if ((ie = i + B2A_MT_CHUNK) > (p->base + p->nbpts))
+		ie = p->base + p->nbpts;
+	for (; i < ie; i++)
+		out_b2a_clut((void *)&p->tcx[thix], p->out + i * p->stride + p->nunder, p->in[i]);
+}
+
+/* Set the B2A tables, inverting the clut values in parallel. */
+/* cx->x is used by the first thread, and clones of it by the others. */
+/* Return the icmSetMultiLutTables() result. */
+static int out_b2a_set_mt(
+	out_b2a_callback *cx,
+	int nthr,				/* Number of threads */
+	icmLut **wo,			/* Tables to set */
+	int flags				/* icmSetMultiLutTables() flags */
+) {
+	out_b2a_mt mt;
+	int i, rv, nbatch;
+
+	memset((void *)&mt, 0, sizeof(out_b2a_mt));
+	mt.nthr = nthr;
+	if ((mt.tcx = (out_b2a_callback *)malloc(nthr * sizeof(out_b2a_callback))) == NULL)
+		error("Malloc of B2A thread contexts failed");
+	for (i = 0; i < nthr; i++) {
+		mt.tcx[i] = *cx;			/* Structure copy */
+		mt.tcx[i].verb = 0;			/* Progress is reported here */
+	}
+	mt.nunder = cx->filter ? cx->ntables : 0;
+	mt.stride = mt.nunder + cx->ntables * cx->ochan;
+
+	/* Record the grid points */
+	if ((rv = icmSetMultiLutTables(cx->ntables, wo, flags, (void *)&mt,
+	                               cx->pcsspace, cx->devspace,
+	                               out_b2a_mt_input, NULL, NULL,
+	                               out_b2a_mt_clut, NULL, NULL,
+	                               out_b2a_mt_output, NULL, NULL)) != 0) {
+		free(mt.in);
+		free(mt.tcx);
+		return rv;
+	}
+
+	if ((mt.out = (double *)malloc(mt.npts * mt.stride * sizeof(double))) == NULL)
+		error("Malloc of B2A grid results failed");
+
+	/* The reverse lookup structures are created on first use, */
+	/* so do that before cloning, so that the clones share them. */
+	out_b2a_clut((void *)&mt.tcx[0], mt.out + mt.nunder, mt.in[0]);
+	for (i = 1; i < nthr; i++) {
+		if ((mt.tcx[i].x = (icxLuLut *)cx->x->clone((icxLuBase *)cx->x)) == NULL)
+			error("Cloning A2B lookup failed: %d, %s",cx->x->pp->errc,cx->x->pp->err);
+	}
+
+	/* Invert the points in batches, so that progress can be reported */
+	nbatch = nthr * B2A_MT_CHUNK * 16;
+	for (mt.base = 0; mt.base < mt.npts; mt.base += mt.nbpts) {
+		if ((mt.nbpts = mt.npts - mt.base) > nbatch)
+			mt.nbpts = nbatch;
+
+		pfor((mt.nbpts + B2A_MT_CHUNK - 1)/B2A_MT_CHUNK, nthr, (void *)&mt, out_b2a_mt_chunk);
+
+		if (cx->verb) {		/* Output percent intervals */
+			int pc;
+			cx->count += mt.nbpts;
+			pc = (int)(cx->count * 100.0/cx->total + 0.5);
+			if (pc != cx->last) {
+				printf("%c%2d%%",cr_char,pc); fflush(stdout);
+				cx->last = pc;
+			}
+		}
+	}
+
+	/* Set the tables from the results */
+	mt.replay = 1;
+	rv = icmSetMultiLutTables(cx->ntables, wo, flags, (void *)&mt,
+	                          cx->pcsspace, cx->devspace,
+	                          out_b2a_mt_input, NULL, NULL,
+	                          out_b2a_mt_clut, NULL, NULL,
+	                          out_b2a_mt_output, NULL, NULL);
+
+	for (i = 1; i < nthr; i++)
+		mt.tcx[i].x->del((icxLuBase *)mt.tcx[i].x);
+	free(mt.out);
+	free(mt.in);
+	free(mt.tcx);
+
+	return rv;
+}
+
 /* --------------------------------------------------------- */
 
 /* PCS' -> distance to gamut boundary */
@@ -2048,9 +2210,12 @@ make_output_icc(
 			icc *abs_icc[3] = { NULL, NULL, NULL };
 			xicc *abs_xicc[3] = { NULL, NULL, NULL };
 			icmLut *wo[3];
+			int nthr;					/* Number of threads inverting the grid */
 
 			out_b2a_callback cx;
 
+			nthr = pfor_nthreads();
+
 			if (verb)
 				printf("Setting up B to A table lookup\n");
 
@@ -2743,7 +2908,17 @@ make_output_icc(
 #ifndef USE_LEASTSQUARES_APROX
 			fprintf(stderr,"!!!!! profile/profout: USE_LEASTSQUARES_APROX undef !!!!!\n");
 #endif
-			if (icmSetMultiLutTables(
+			if (nthr > 1) {
+				if (out_b2a_set_mt(&cx, nthr, wo,
+#ifdef USE_LEASTSQUARES_APROX
+					ICM_CLUT_SET_APXLS | 
+#endif
+#ifdef FILTER_B2ACLIP
+					ICM_CLUT_SET_FILTER | 
+#endif
+					0) != 0)
+					error("Setting 16 bit PCS->Device Lut failed: %d, %s",wr_icco->errc,wr_icco->err);
+			} else if (icmSetMultiLutTables(
 			        cx.ntables,
 			        wo,
 #ifdef USE_LEASTSQUARES_APROX
@@ -120,7 +120,7 @@
 /* Do an arbitrary printf */
 #define DBGI(text) printf text ;
 
-#define DEBUG1
+#undef DEBUG1
 #undef DBG
 #undef DBGV
 #undef DBGM
@@ -160,6 +160,7 @@
  */
 
 #define	EPS (1e-10)			/* Allowance for numeric error */
+#define SVJSIZE 1024		/* Grid points per surface vertex job */
 
 /* ====================================================== */
 /* Support functions */
@@ -322,6 +323,126 @@ rvert **onodes	/* Space for up to 3^MXDI-1 output nodes */
 	return 0;
 }
 
+/* ====================================================== */
+/* Parallel surface vertex value computation */
+
+/* Context for computing grid surface point output values */
+typedef struct {
+	rspl *s;
+	int pass;			/* 0 = count surface points, 1 = compute values */
+	int *jcount;		/* Surface points in each job, then index of the first */
+	void **cntxfs;		/* Per thread outf contexts */
+} svjob;
+
+/* Return NZ if a grid point is a vertex of one of the surface cells */
+/* of the grid, ie. it's within one grid step of the surface. */
+/* (These are the points that the surface tracing examines) */
+static int surf_gpoint(rspl *s, float *fg) {
+	int e;
+
+	for (e = 0; e < s->di; e++) {
+		if ((G_FL(fg, e) & 3) <= 1)
+			return 1;
+	}
+	return 0;
+}
+
+/* Count or compute the surface points of one block of the grid */
+static void svjob_func(void *cntx, int thix, int ix) {
+	svjob *p = (svjob *)cntx;
+	rspl *s = p->s;
+	int f, fdi = s->fdi;
+	int gix, egix, k;
+
+	gix = ix * SVJSIZE;
+	if ((egix = gix + SVJSIZE) > s->g.no)
+		egix = s->g.no;
+
+	if (p->pass == 0) {
+		for (k = 0; gix < egix; gix++) {
+			if (surf_gpoint(s, s->g.a + gix * s->g.pss))
+				k++;
+		}
+		p->jcount[ix] = k;
+		return;
+	}
+
+	for (k = p->jcount[ix]; gix < egix; gix++) {
+		float *fg = s->g.a + gix * s->g.pss;
+		double *v;
+
+		if (!surf_gpoint(s, fg)) {
+			s->gam.gvix[gix] = -1;
+			continue;
+		}
+		s->gam.gvix[gix] = k;
+		v = s->gam.gv + k * (fdi + 1);
+		for (f = 0; f < fdi; f++)
+			v[f] = (double)fg[f];
+		if (s->gam.outf != NULL)
+			s->gam.outf(p->cntxfs[thix], v, v);	/* Apply output lookup */
+		radcoord(s, v + fdi, v);				/* Compute radial coordinate */
+		k++;
+	}
+}
+
+/* Compute the output values and radial coordinates of all the */
+/* grid surface cell points in parallel, so that get_vert() doesn't */
+/* need to call outf() serially as the gamut surface is traced. */
+/* (Any other vertices are still computed on demand.) */
+/* Does nothing if there is only one thread available. */
+static void comp_surf_verts(
+rspl *s,
+int nctxf,			/* Number of outf contexts */
+void **cntxfs		/* Per thread outf contexts */
+) {
+	svjob j;
+	int i, nthr, njobs, nsv;
+
+	nthr = pfor_nthreads();
+	if (s->gam.outf != NULL && nctxf < nthr)
+		nthr = nctxf;
+	if (nthr <= 1)
+		return;
+
+	njobs = (s->g.no + SVJSIZE - 1)/SVJSIZE;
+
+	j.s = s;
+	j.cntxfs = cntxfs;
+	if ((j.jcount = (int *)malloc(sizeof(int) * njobs)) == NULL)
+		error("rspl_gam: malloc failed - jcount");
+
+	/* Count the surface points in each job */
+	j.pass = 0;
+	pfor(njobs, nthr, (void *)&j, svjob_func);
+
+	/* Turn the counts into start indexes */
+	for (nsv = i = 0; i < njobs; i++) {
+		int k = j.jcount[i];
+		j.jcount[i] = nsv;
+		nsv += k;
+	}
+
+	if ((s->gam.gvix = (int *)malloc(sizeof(int) * s->g.no)) == NULL)
+		error("rspl_gam: malloc failed - gvix");
+	if ((s->gam.gv = (double *)malloc(sizeof(double) * nsv * (s->fdi + 1))) == NULL)
+		error("rspl_gam: malloc failed - gv");
+
+	/* Compute the values */
+	j.pass = 1;
+	pfor(njobs, nthr, (void *)&j, svjob_func);
+
+	free(j.jcount);
+}
+
+/* Free any precomputed surface point values */
+static void free_surf_verts(rspl *s) {
+	free(s->gam.gvix);
+	s->gam.gvix = NULL;
+	free(s->gam.gv);
+	s->gam.gv = NULL;
+}
+
 /* ====================================================== */
 /* Search for an existing vertex, and return it. */
 /* If there is no existing edge, create it. */
@@ -344,6 +465,7 @@ static rvert *get_vert(rspl *s, int gix) {
 	}
 	if (vp == NULL) {	/* No such vertex */
 		float *fg;
+		int k;
 
 		if ((vp = calloc(1, sizeof(rvert))) == NULL)
 			error("rspl_gam: get_vert calloc failed");
@@ -352,12 +474,20 @@ static rvert *get_vert(rspl *s, int gix) {
 		vp->n = s->gam.rvert_no++;		/* serial number */
 		vp->fg = fg;					/* Pointer to node float data */
 		vp->gix = gix;					/* grid index */
-		for (f = 0; f < fdi; f++)		/* Node output value */
-			vp->v[f] = (double)fg[f];
-		if (s->gam.outf != NULL)
-			s->gam.outf(s->gam.cntxf, vp->v, vp->v);	/* Apply output lookup */
 
-		radcoord(s, vp->r, vp->v);	/* Compute radial coordinate */
+		if (s->gam.gvix != NULL && (k = s->gam.gvix[gix]) >= 0) {
+			double *v = s->gam.gv + k * (fdi + 1);	/* Precomputed values */
+			for (f = 0; f < fdi; f++)
+				vp->v[f] = v[f];
+			vp->r[0] = v[fdi];
+		} else {
+			for (f = 0; f < fdi; f++)		/* Node output value */
+				vp->v[f] = (double)fg[f];
+			if (s->gam.outf != NULL)
+				s->gam.outf(s->gam.cntxf, vp->v, vp->v);	/* Apply output lookup */
+
+			radcoord(s, vp->r, vp->v);	/* Compute radial coordinate */
+		}
 
 		/* Add vertex to hash */
 		vp->next = s->gam.verts[hash];
@@ -425,7 +555,7 @@ static redge *get_edge(rspl *s, rvert **_vv) {
 		ep->n = s->gam.redge_no++;		/* serial number */
 		for (i = 0; i < (fdi-1); i++)
 			ep->v[i] = vv[i];			/* Vertex */
-printf("~1 new edge %d with nodes = %d %d\n", ep->n, ep->v[0]->gix, ep->v[1]->gix);
+DBG(("~1 new edge %d with nodes = %d %d\n", ep->n, ep->v[0]->gix, ep->v[1]->gix))
 
 		/* Compute plane equation to center of gamut, so */
 		/* that we can quickly determine which side a triangle lies on. */
@@ -473,7 +603,7 @@ printf("~1 new edge %d with nodes = %d %d\n", ep->n, ep->v[0]->gix, ep->v[1]->gi
 		}
 	}
 
-printf("~1 returning edge no %d\n",ep->n);
+DBG(("~1 returning edge no %d\n",ep->n))
 	return ep;
 }
 
@@ -534,7 +664,7 @@ static rtri *make_tri(rspl *s, redge *ep, rvert *_vv, int inv) {
 	int gix, hash;
 	rtri *tp = NULL;
 
-printf("~1 make_tri called\n");
+DBG(("~1 make_tri called\n"))
 
 	/* Copy edge verticies from edge */
 	for (i = 0; i < (fdi-1); i++)
@@ -557,7 +687,7 @@ printf("~1 make_tri called\n");
 
 	/* See if it is in our hash list */
 	hash = gix % s->gam.thsize;
-printf("~1 make tri gix = %d, hash = %d\n", gix, hash);
+DBG(("~1 make tri gix = %d, hash = %d\n", gix, hash))
 
 	for (tp = s->gam.tris[hash]; tp != NULL; tp = tp->next) {
 		for (i = 0; i < fdi; i++) {
@@ -586,7 +716,7 @@ printf("~1 make tri gix = %d, hash = %d\n", gix, hash);
 			tp->v[i] = vv[i];
 
 		/* Link all the triangles edges to this triangle */
-		printf("~1 triangle nodes = %d %d %d\n", tp->v[0]->gix, tp->v[1]->gix, tp->v[2]->gix);
+		DBG(("~1 triangle nodes = %d %d %d\n", tp->v[0]->gix, tp->v[1]->gix, tp->v[2]->gix))
 //printf("~2 triangle vert 0 = %f %f %f\n", tp->v[0]->v[0], tp->f[0]->v[1], tp->f[0]->v[2]);
 //printf("~2 triangle vert 1 = %f %f %f\n", tp->v[1]->v[0], tp->f[1]->v[1], tp->f[1]->v[2]);
 //printf("~2 triangle vert 2 = %f %f %f\n", tp->v[2]->v[0], tp->f[2]->v[1], tp->f[2]->v[2]);
@@ -641,17 +771,24 @@ printf("~1 make tri gix = %d, hash = %d\n", gix, hash);
 	optional function instead of default radial distance function
 	option use sub set of output dimensions (ie allow for CMYK->LabK etc. ? )
 */
+/* The grid surface vertex values are computed using up to */
+/* nctxf threads, with outf() being called with cntxfs[thread index]. */
+/* Tracing the surface triangles is serial. */
 static int
-gam_comp_gamut(
+gam_comp_gamut_mt(
 rspl *s,
 double *cent,		/* Optional center of gamut [fdi], default center of out range */
 double *scale,		/* Optional Scale of output values in vector to center [fdi], def. 1.0 */
 void (*outf)(void *cntxf, double *out, double *in),	/* Optional rspl val -> output value */
-void *cntxf,					/* Context for function */
+int nctxf,						/* Number of per thread contexts for function, >= 1 */
+void **cntxfs,					/* Per thread contexts for function */
 void (*outb)(void *cntxb, double *out, double *in),	/* Optional output value -> rspl val */
 void *cntxb						/* Context for function */
 ) {
-	int e, f, di = s->di, fdi = s->fdi;
+	int f, di = s->di, fdi = s->fdi;
+#if defined(DEBUG) || defined(VRML_TRACE)
+	int e;
+#endif
 	int i, j, ssdi;
 	int maxp[MXDO];			/* Grid indexes of maxium function values */
 	rvert *fedge[MXDO-1];	/* The first "edge" containing fdi-1 verticies */
@@ -668,9 +805,12 @@ void *cntxb						/* Context for function */
 		return 2;
 	}
 
+	if (nctxf < 1 || cntxfs == NULL)
+		error("rspl_gam: comp_gamut needs at least one context");
+
 	/* Save output value conversion functions */
 	s->gam.outf = outf;
-	s->gam.cntxf = cntxf;
+	s->gam.cntxf = cntxfs[0];
 	s->gam.outb = outb;
 	s->gam.cntxb = cntxb;
 
@@ -689,7 +829,7 @@ void *cntxb						/* Context for function */
 		for (f = 0; f < fdi; f++)
 			s->gam.cent[f] = cent[f];
 	}
-	DBGVI("Gamut center is ", fdi, "%f ", s->gam.cent, "\n")
+	DBGV(("Gamut center is ", fdi, "%f ", s->gam.cent, "\n"))
 
 	if (scale == NULL) {
 		for (f = 0; f < fdi; f++)
@@ -698,7 +838,7 @@ void *cntxb						/* Context for function */
 		for (f = 0; f < fdi; f++)
 			s->gam.scale[f] = scale[f];
 	}
-	DBGVI("Gamut scale is ", fdi, "%f ", s->gam.scale, "\n")
+	DBGV(("Gamut scale is ", fdi, "%f ", s->gam.scale, "\n"))
 
 	for (ssdi = 1; ssdi <= fdi-1; ssdi++) {
 		int i, j;
@@ -755,6 +895,9 @@ void *cntxb						/* Context for function */
 	}
 	s->gam.thsize = THASHSIZE;
 
+	/* Compute the grid surface vertex values in parallel */
+	comp_surf_verts(s, nctxf, cntxfs);
+
 	/* Get a starting gid point for surface */
 	// ~~99 this isn't right if the point we get is over the ink limit!!!. */
 	s->get_out_range_points(s, NULL, maxp);		/* Maximum */
@@ -781,9 +924,11 @@ void *cntxb						/* Context for function */
 		if (nonodes == 0)
 			error("rspl_gam: get_ssimplex_nodes fatal error - retrurned no nodes?");
 
+#ifdef DEBUG
 printf("~1 get_ssimplex_nodes returned %d nodes\n",nonodes);
 for(i = 0; i < nonodes; i++)
 printf(" ~1 %d: %d\n",i,onodes[i]->gix);
+#endif
 
 		/* Evaluate the choice of verticies to choose the one that */
 		/* will best enclose the gamut. (We use a really dumb criteria - maximum radius) */
@@ -793,13 +938,13 @@ printf(" ~1 %d: %d\n",i,onodes[i]->gix);
 			b = norm33sq(onodes[i]->v, fedge[0]->v);
 			c = norm33sq(fedge[0]->v, s->gam.cent);
 			tt = acos((b + c - a)/(2.0 * sqrt(b * c)));
-printf("~1 node %d angle = %f\n",onodes[i]->gix,tt);
+DBG(("~1 node %d angle = %f\n",onodes[i]->gix,tt))
 			if (tt > ba) {
 				ba = tt;
 				fedge[1] = onodes[i];	/* Use candidate with largest gamut as next base */
 			}
 		}
-printf("~1 chosen node %d\n",fedge[1]->gix);
+DBG(("~1 chosen node %d\n",fedge[1]->gix))
 
 	} else if (fdi > 3) {		/* General case */
 		/* This isn't a correct approach ... */
@@ -815,9 +960,11 @@ printf("~1 chosen node %d\n",fedge[1]->gix);
 			if (nonodes == 0)
 				error("rspl_gam: get_ssimplex_nodes fatal error - retrurned no nodes?");
 
+#ifdef DEBUG
 printf("~1 get_ssimplex_nodes returned %d nodes\n",nonodes);
 for(i = 0; i < nonodes; i++)
 printf(" ~1 %d: %d\n",i,onodes[i]->gix);
+#endif
 
 			/* Evaluate the choice of verticies to choose the one that */
 			/* will best enclose the gamut. (We use a really dumb criteria - maximum radius) */
@@ -829,14 +976,14 @@ printf(" ~1 %d: %d\n",i,onodes[i]->gix);
 					fedge[ssdi] = onodes[i];	/* Use candidate with largest gamut as next base */
 				}
 			}
-printf("~1 chosen node %d\n",fedge[ssdi]->gix);
+DBG(("~1 chosen node %d\n",fedge[ssdi]->gix))
 		}
 	}
 
 	/* Creat the initial "edge" */
 	get_edge(s, fedge);
 
-printf("~1 Created initial edge\n");
+DBG(("~1 Created initial edge\n"))
 
 	{
 		redge *ep;
@@ -856,9 +1003,9 @@ printf("~1 Created initial edge\n");
 		/* Loop until there are no "edges" with less than two associated "triangles". */
 		for (ep = s->gam.etop; ep != NULL; ep = ep->list) {
 
-printf("~1 expanding from edge no %d\n",ep->n);
-printf("~1 edge v1 = %d = %f %f %f\n", ep->v[0]->gix, ep->v[0]->v[0], ep->v[0]->v[1], ep->v[0]->v[2]);
-printf("~1 edge v2 = %d = %f %f %f\n", ep->v[1]->gix, ep->v[1]->v[0], ep->v[1]->v[1], ep->v[1]->v[2]);
+DBG(("~1 expanding from edge no %d\n",ep->n))
+DBG(("~1 edge v1 = %d = %f %f %f\n", ep->v[0]->gix, ep->v[0]->v[0], ep->v[0]->v[1], ep->v[0]->v[2]))
+DBG(("~1 edge v2 = %d = %f %f %f\n", ep->v[1]->gix, ep->v[1]->v[0], ep->v[1]->v[1], ep->v[1]->v[2]))
 
 //			if (ep->npt < 1 || ep->nnt < 1)
 			{
@@ -874,7 +1021,7 @@ printf("~1 edge v2 = %d = %f %f %f\n", ep->v[1]->gix, ep->v[1]->v[0], ep->v[1]->
 					double tt;
 					tt = gvprad(s, onodes[i]->v);		/* Compute radius */
 					ss = eside(s, ep, onodes[i]->v);	/* Side */
-printf("~1 node gix %d has rad %f side %d to edge %d %d\n", onodes[i]->gix, tt, ss, ep->v[0]->gix, ep->v[1]->gix);
+DBG(("~1 node gix %d has rad %f side %d to edge %d %d\n", onodes[i]->gix, tt, ss, ep->v[0]->gix, ep->v[1]->gix))
 
 #ifdef NEVER	/* This messes things up ? */
 					/* Check if this node is already in a triangle with this edge, */
@@ -903,7 +1050,7 @@ printf("~1 node gix %d has rad %f side %d to edge %d %d\n", onodes[i]->gix, tt,
 					}
 				}
 
-// ~~1
+#ifdef DEBUG
 for (ss = 0; ss < 2; ss++) {		/* Negative side then positive */
 	if (ss == 0)
 		printf("~1 -ve nodes:\n");
@@ -913,6 +1060,7 @@ for (ss = 0; ss < 2; ss++) {		/* Negative side then positive */
 		printf("~1 node %d, rad %f\n",cnodes[ss][i]->gix,rcnodes[ss][i]);
 	}
 }
+#endif
 
 #ifdef VRML_TRACE
 {
@@ -1018,11 +1166,11 @@ for (ss = 0; ss < 2; ss++) {		/* Negative side then positive */
 					rvert **nods;
 					double rip;		/* Row interchange parity */
 
-printf("~1 direction = %d\n",ss);
+DBG(("~1 direction = %d\n",ss))
 #ifdef NEVER
 					if (( ss && ep->npt >= 1) 		/* Not looking for a positive node */
 					 || (!ss && ep->nnt >= 1)) {  	/* Not looking for a negative node */
-printf("~1 no need to look for node in this direction\n");
+DBG(("~1 no need to look for node in this direction\n"))
 						continue;
 					}
 #endif
@@ -1033,7 +1181,7 @@ printf("~1 no need to look for node in this direction\n");
 						end = ncnodes[si];	/* End and least radius node */
 						inc = 1;			/* Increment */
 						nods = cnodes[si];	/* +ve nodes */
-printf("~1 Looking for biggest angle, inc = %d\n",inc);
+DBG(("~1 Looking for biggest angle, inc = %d\n",inc))
 #ifdef NEVER		/* Convex tracing ? */
 					} else if (ncnodes[1-ss] > 0) {	/* There are opposited direction nodes */
 						si = 1-ss;				/* use opposite direction nodes */
@@ -1041,10 +1189,10 @@ printf("~1 Looking for biggest angle, inc = %d\n",inc);
 						end = -1;			/* end and max radius node */
 						inc = -1;			/* Decrement */
 						nods = cnodes[si];
-printf("~1 Looking for smallest angle, inc = %d\n",-1);
+DBG(("~1 Looking for smallest angle, inc = %d\n",-1))
 #endif	/* NEVER */
 					} else {
-printf("~1 No points to search\n");
+DBG(("~1 No points to search\n"))
 						continue;
 					}
 					ii = 0;
@@ -1052,7 +1200,7 @@ printf("~1 No points to search\n");
 						/* Go through each candidate in the most likely order */
 						for (ii = sta; ii != end; ii += inc) {
 							
-printf("~1 Candidate %d: node %d\n",ii,nods[ii]->gix);
+DBG(("~1 Candidate %d: node %d\n",ii,nods[ii]->gix))
 							/* Create the baricentric conversion for this candidate */
 							for (f = 0; f < fdi; f++)		/* The center point */
 								A[f][0] = s->gam.cent[f] - nods[ii]->v[f];
@@ -1062,17 +1210,17 @@ printf("~1 Candidate %d: node %d\n",ii,nods[ii]->gix);
 							}
 							
 							if (lu_decomp(A, fdi, pivx, &rip)) {
-printf("~1 lu_decomp failed\n");
+DBG(("~1 lu_decomp failed\n"))
 for (f = 0; f < fdi; f++)		/* The center point */
 	A[f][0] = s->gam.cent[f] - nods[ii]->v[f];
 for (j = 0; j < (fdi-1); j++) {		/* The edge points */
 	for (f = 0; f < fdi; f++)
 		A[f][j+1] = ep->v[j]->v[f] - nods[ii]->v[f];
 }
-printf("~1 A = \n");
-printf("~1    %f %f %f\n", A[0][0], A[0][1], A[0][2]);
-printf("~1    %f %f %f\n", A[1][0], A[1][1], A[1][2]);
-printf("~1    %f %f %f\n", A[2][0], A[2][1], A[2][2]);
+DBG(("~1 A = \n"))
+DBG(("~1    %f %f %f\n", A[0][0], A[0][1], A[0][2]))
+DBG(("~1    %f %f %f\n", A[1][0], A[1][1], A[1][2]))
+DBG(("~1    %f %f %f\n", A[2][0], A[2][1], A[2][2]))
 								warning("lu_decomp failed");
 								continue;
 							}
@@ -1082,13 +1230,13 @@ printf("~1    %f %f %f\n", A[2][0], A[2][1], A[2][2]);
 								if (i == ii)
 									continue;
 
-printf("~1 Test %d: node %d\n",i,nods[i]->gix);
+DBG(("~1 Test %d: node %d\n",i,nods[i]->gix))
 								for (f = 0; f < fdi; f++)			/* The candidate point */
 									B[f] = nods[i]->v[f] - nods[ii]->v[f];
 								lu_backsub(A, fdi, pivx, B);
 
 #ifdef NEVER
-printf("~1 baricentric = %f %f %f %f\n",B[0],B[1],B[2],1.0-B[0]-B[1]-B[2]);
+DBG(("~1 baricentric = %f %f %f %f\n",B[0],B[1],B[2],1.0-B[0]-B[1]-B[2]))
 {
 double tt[3], B3;
 /* Check baricentric */
@@ -1103,29 +1251,29 @@ for (f = 0; f < fdi; f++)
 	tt[f] += B[2] * ep->v[1]->v[f];
 for (f = 0; f < fdi; f++)
 	tt[f] += B3 * nods[ii]->v[f];
-printf("~1 target point %f %f %f\n", (double)nods[i][0], (double)nods[i][1], (double)nods[i][2]);
-printf("~1 barice check %f %f %f\n", tt[0],tt[1],tt[2]);
+DBG(("~1 target point %f %f %f\n", (double)nods[i][0], (double)nods[i][1], (double)nods[i][2]))
+DBG(("~1 barice check %f %f %f\n", tt[0],tt[1],tt[2]))
 }
 #endif /* NEVER */
 								if ((inc == 1 && B[0] < -EPS)   /* other point is at higher angle */
 								 || (inc == -1 && B[0] > EPS)) { /* other point is at lower angle */
-printf("~1 candidate isn't best\n");
+DBG(("~1 candidate isn't best\n"))
 									break;
 								}
 							}
 							if (i == end) {
-printf("~1 candidate IS the best\n");
+DBG(("~1 candidate IS the best\n"))
 								break;				/* Candidate is at highest angle */
 							}
 						}
 						if (ii == end) {
-printf("~1Inconsistent candidate ordering\n");
+DBG(("~1Inconsistent candidate ordering\n"))
 							error("Inconsistent candidate ordering");
 						}
 					} else {
-printf("~1 there are only %d nodes, so don't search them\n",ncnodes[si]);
+DBG(("~1 there are only %d nodes, so don't search them\n",ncnodes[si]))
 					}
-printf("~1 Making triangle with %d: node %d\n",ii,nods[ii]->gix);
+DBG(("~1 Making triangle with %d: node %d\n",ii,nods[ii]->gix))
 					make_tri(s, ep, nods[ii], inc == -1);
 				}
 				if (ep->npt < 1 || ep->nnt < 1) {
@@ -1144,12 +1292,28 @@ printf("~1 Making triangle with %d: node %d\n",ii,nods[ii]->gix);
 		/* Dump out the edges */
 		for (ep = s->gam.etop; ep != NULL; ep = ep->list) {
 
-printf("~1 edge no %d, npt = %d, nnt = %d\n",ep->n, ep->npt, ep->nnt);
+DBG(("~1 edge no %d, npt = %d, nnt = %d\n",ep->n, ep->npt, ep->nnt))
 		}
 	}
+	free_surf_verts(s);
+
 	return 0;
 }
 
+/* Single threaded outf context version of the above */
+static int
+gam_comp_gamut(
+rspl *s,
+double *cent,		/* Optional center of gamut [fdi], default center of out range */
+double *scale,		/* Optional Scale of output values in vector to center [fdi], def. 1.0 */
+void (*outf)(void *cntxf, double *out, double *in),	/* Optional rspl val -> output value */
+void *cntxf,					/* Context for function */
+void (*outb)(void *cntxb, double *out, double *in),	/* Optional output value -> rspl val */
+void *cntxb						/* Context for function */
+) {
+	return gam_comp_gamut_mt(s, cent, scale, outf, 1, &cntxf, outb, cntxb);
+}
+
 /* ====================================================== */
 /* Gamut rspl setup functions                           */
 
@@ -1159,6 +1323,7 @@ init_gam(rspl *s) {
 
 	/* Methods */
 	s->comp_gamut = gam_comp_gamut;
+	s->comp_gamut_mt = gam_comp_gamut_mt;
 }
 
 /* Free up all the gamut info */
@@ -1171,29 +1336,39 @@ rspl *s		/* Pointer to rspl grid */
 	redge *ep, *nep;
 	rtri *tp, *ntp;
 
-	for (ssdi = 1; ssdi <= s->fdi-1; ssdi++)
-		rspl_free_ssimplex_info(s, &s->gam.ssi[ssdi]);
+	for (ssdi = 1; ssdi <= s->fdi-1; ssdi++) {
+		if (s->gam.ssi[ssdi].spxi != NULL)
+			rspl_free_ssimplex_info(s, &s->gam.ssi[ssdi]);
+	}
+
+	free_surf_verts(s);
 
 	/* Free the verticies */
 	for (vp = s->gam.vtop; vp != NULL; vp = nvp) {
 		nvp = vp->list;
 		free(vp);
 	}
+	s->gam.vtop = s->gam.vbot = NULL;
 	free(s->gam.verts);
+	s->gam.verts = NULL;
 
 	/* Free the edges */
 	for (ep = s->gam.etop; ep != NULL; ep = nep) {
 		nep = ep->list;
 		free(ep);
 	}
+	s->gam.etop = s->gam.ebot = NULL;
 	free(s->gam.edges);
+	s->gam.edges = NULL;
 
 	/* Free the triangles */
 	for (tp = s->gam.ttop; tp != NULL; tp = ntp) {
 		ntp = tp->list;
 		free(tp);
 	}
+	s->gam.ttop = NULL;
 	free(s->gam.tris);
+	s->gam.tris = NULL;
 }
 
 
@@ -93,6 +93,11 @@ struct _gam_struct {
 	void (*outb)(void *cntxb, double *out, double *in);	/* Optional output value -> rspl val */
 	void *cntxb;					/* Context for function */
 
+	int *gvix;			/* Index of each grid point into gv[], -1 if not precomputed, */
+						/* NULL if there are no precomputed values. */
+	double *gv;			/* Precomputed output value and radius of grid surface cell points */
+						/* [fdi+1] each. (Valid while computing the gamut) */
+
 	ssxinfo ssi[MXDO-1];	/* Sub-simplex information for sdi from 0..fdi-1 */
 
 	int rvert_no;		/* Number of rverts allocated */
@@ -1,5 +1,5 @@
 
-/* 
+/*
  * Argyll Color Correction System
  *
  * Scattered Data Interpolation with multilevel B-splines library.
@@ -21,11 +21,16 @@
  * by Seungyong Lee, George Wolberg and Sung Yong Shin,
  * IEEE Transactions on Visualisation and Computer Graphics
  * Vol. 3, No. 3, July-September 1997, pp 228.
+ *
+ * We use the multilevel B-spline approximation without latice
+ * refinement: each level approximates the residual of the levels
+ * below it, and the levels are summed at lookup. The control
+ * latices are sparse, so that memory is proportional to the
+ * number of data points rather than res ^ di, which lets
+ * this be used for input dimensions beyond MXRI.
  */
 
 /* TTBD:
- *
- * Figure out why the results are rubbish ?
  *
  * Can this be adapted to be adaptive in it smoothness,
  * like the non-linear regularized spline stuff that Don Bone used ?
@@ -49,6 +54,8 @@
 void error(char *fmt, ...), warning(char *fmt, ...);
 #endif
 
+#define INITHBITS 10		/* Initial log2 hash table size */
+
 static void delete_mlbs(mlbs *p);
 static int lookup_mlbs(mlbs *p, co *c);
 
@@ -60,14 +67,20 @@ int res,	/* Target resolution */
 double smf	/* Smoothing factor */
 ) {
 	mlbs *p;
-	if ((p = (mlbs *)malloc(sizeof(mlbs))) == NULL)
+
+	if (di < 1 || di > MXDI)
+		error("mlbs: di %d out of range",di);
+	if (fdi < 1 || fdi > MXDO)
+		error("mlbs: fdi %d out of range",fdi);
+
+	if ((p = (mlbs *)calloc(1, sizeof(mlbs))) == NULL)
 		error("Malloc mlbs failed");
 
 	p->di = di;
 	p->fdi = fdi;
 	p->tres = res;
 	p->smf = smf;
-	p->s = NULL;
+	p->nlev = 0;
 
 	p->lookup = lookup_mlbs;
 	p->del =    delete_mlbs;
@@ -80,7 +93,9 @@ static void delete_slbs(slbs *s);
 static void delete_mlbs(mlbs *p) {
 
 	if (p != NULL) {
-		delete_slbs(p->s);
+		int i;
+		for (i = 0; i < p->nlev; i++)
+			delete_slbs(p->s[i]);
 		free(p);
 	}
 }
@@ -91,35 +106,38 @@ mlbs *p,	/* Parent mlbs */
 int res		/* Resolution of this slbs */
 ) {
 	slbs *s;
-	int e, f;
-	double *_lat, *lat;	/* Latice base address */
+	int e;
 	int ix, oe, oo[MXDI];	/* Neighborhood offset index, counter */
 
-	if ((s = (slbs *)malloc(sizeof(slbs))) == NULL)
+	if ((s = (slbs *)calloc(1, sizeof(slbs))) == NULL)
 		error("Malloc slbs failed");
 
 	s->p = p;
 	s->res = res;
 
-	for (s->lsize = p->fdi, s->nsize = 1, e = 0; e < p->di; e++) {
-		s->coi[e] = s->lsize;		/* (double) increment in this input dimension */
-		s->lsize *= (res + 2);		/* Latice in 1D +/- 1 */
+	/* Latice keys are the index into a notional res+2 ^ di latice, */
+	/* so that the latice extends from -1 .. res in each dimension. */
+	for (s->lsize = 1.0, s->nsize = 1, e = 0; e < p->di; e++) {
+		s->kinc[e] = (INR64)s->lsize;
+		s->lsize *= (res + 2.0);
 		s->nsize *= 4;				/* Neighborhood of 4 */
-	} 
-
-	if ((s->_lat = (double *)malloc(s->lsize * sizeof(double))) == NULL)
-		error("Malloc slbs latice failed");
-
-	/* Compute the base address */
-	for (s->loff = 0, e = 0; e < p->di; e++) {
-		s->loff += s->coi[e];		/* Offset by 1 in each input dimension */
 	}
-	s->lat = s->_lat + s->loff;
+	if (s->lsize >= 4e18)
+		error("mlbs: resolution %d is too high for di %d",res,p->di);
+
+	/* Start with a small hash table, and grow it as needed */
+	s->hbits = INITHBITS;
+	s->hsize = 1 << s->hbits;
+	s->nent = 0;
+	if ((s->key = (ORD64 *)calloc(s->hsize, sizeof(ORD64))) == NULL)
+		error("Malloc slbs keys failed");
+	if ((s->lat = (double *)calloc(s->hsize * p->fdi, sizeof(double))) == NULL)
+		error("Malloc slbs latice failed");
 
 	/* Figure the cell width */
 	for (e = 0; e < p->di; e++)
 		s->w[e] = (p->h[e] - p->l[e])/(res-1.0);
-	
+
 	/* Setup neighborhood cache info */
 	if ((s->n = (neigh *)malloc(s->nsize * sizeof(neigh))) == NULL)
 		error("Malloc slbs neighborhood failed");
@@ -128,13 +146,12 @@ int res		/* Resolution of this slbs */
 		oo[oe] = 0;
 
 	for(ix = oe = 0; oe < p->di; ix++) {
-		int xo;
+		INR64 xo;
 		for (xo = e = 0; e < p->di; e++) {
 			s->n[ix].c[e] = oo[e];
-			xo += s->coi[e] * oo[e];	/* Accumulate latice offset */
+			xo += s->kinc[e] * oo[e];	/* Accumulate latice key offset */
 		}
 		s->n[ix].xo = xo;
-		s->n[ix].w = 0.0;
 
 		/* Increment destination offset counter */
 		for (oe = 0; oe < p->di; oe++) {
@@ -150,294 +167,335 @@ int res		/* Resolution of this slbs */
 /* Destroy a slbs */
 static void delete_slbs(slbs *s) {
 	if (s != NULL) {
-		free(s->_lat);
+		free(s->key);
+		free(s->lat);
 		free(s->n);
 		free(s);
 	}
 }
 
-/* Dump the 2D -> 1D contents of an slbs */
-static void dump_slbs(slbs *s) {
-	int e, f;
-	int ce, co[MXDI];	/* latice counter */
-	mlbs *p = s->p;		/* Parent object */
+/* Return the hash table slot to start looking for a key */
+static int hash_slbs(slbs *s, ORD64 key) {
+	return (int)((key * (ORD64)0x9E3779B97F4A7C15) >> (64 - s->hbits));
+}
 
-	/* Init the counter */
-	for (ce = 0; ce < p->di; ce++)
-		co[ce] = -1;
-	ce = 0;
+/* Return the hash table slot holding the given latice key, */
+/* or -1 if it's not allocated. */
+static int find_slbs(slbs *s, INR64 key) {
+	ORD64 k1 = (ORD64)key + 1;
+	int ix;
 
-	f = 0;
-	while(ce < p->di) {
-		double v;
-		int off = 0;				/* Latice offset */
-		for (e = 0; e < p->di; e++) {
-			off += co[e] * s->coi[e];		/* Accumulate latice offset */
-		}
-		v = s->lat[off + f];				/* Value of this latice point */
+	if (s->dense)
+		return (int)key;
 
-		printf("Latice at [%d][%d] = %f\n",co[1],co[0],v);
+	for (ix = hash_slbs(s, (ORD64)key);; ix = (ix + 1) & (s->hsize-1)) {
+		if (s->key[ix] == k1)
+			return ix;
+		if (s->key[ix] == 0)
+			return -1;
+	}
+}
 
-		/* Increment the latice counter */
-		for (ce = 0; ce < p->di; ce++) {
-			if (++co[ce] <= s->res)		/* Counting from -1 ... s->res */
-				break;
-			co[ce] = -1;
-		}
+/* Double the size of the hash table */
+static void grow_slbs(slbs *s) {
+	int fdi = s->p->fdi;
+	int i, ohsize = s->hsize;
+	ORD64 *okey = s->key;
+	double *olat = s->lat;
+
+	s->hbits++;
+	s->hsize = 1 << s->hbits;
+	if ((s->key = (ORD64 *)calloc(s->hsize, sizeof(ORD64))) == NULL)
+		error("Malloc slbs keys failed");
+	if ((s->lat = (double *)calloc(s->hsize * fdi, sizeof(double))) == NULL)
+		error("Malloc slbs latice failed");
+
+	for (i = 0; i < ohsize; i++) {
+		int f, ix;
+		if (okey[i] == 0)
+			continue;
+		for (ix = hash_slbs(s, okey[i]-1); s->key[ix] != 0; ix = (ix + 1) & (s->hsize-1))
+			;
+		s->key[ix] = okey[i];
+		for (f = 0; f < fdi; f++)
+			s->lat[ix * fdi + f] = olat[i * fdi + f];
 	}
+	free(okey);
+	free(olat);
 }
 
-/* Initialise an slbs with a linear approximation to the scattered data */
-static void linear_slbs(
-slbs *s
+/* Make sure the given latice point is allocated, */
+/* and return its hash table slot. */
+static int add_slbs(slbs *s, INR64 key) {
+	int ix;
+
+	if ((ix = find_slbs(s, key)) >= 0)
+		return ix;
+
+	/* Keep the table at most half full */
+	if (2 * (s->nent + 1) > s->hsize)
+		grow_slbs(s);
+
+	for (ix = hash_slbs(s, (ORD64)key); s->key[ix] != 0; ix = (ix + 1) & (s->hsize-1))
+		;
+	s->key[ix] = (ORD64)key + 1;
+	s->nent++;
+
+	return ix;
+}
+
+/* If the full latice would be no bigger than the hash table, */
+/* convert to a plain array indexed by key, to speed up lookup. */
+static void densify_slbs(slbs *s) {
+	int fdi = s->p->fdi;
+	int i, lsize;
+	double *olat = s->lat;
+
+	if (s->lsize > (double)s->hsize)
+		return;
+
+	lsize = (int)s->lsize;
+	if ((s->lat = (double *)calloc(lsize * fdi, sizeof(double))) == NULL)
+		error("Malloc slbs latice failed");
+
+	for (i = 0; i < s->hsize; i++) {
+		int f, ix;
+		if (s->key[i] == 0)
+			continue;
+		ix = (int)(s->key[i] - 1);
+		for (f = 0; f < fdi; f++)
+			s->lat[ix * fdi + f] = olat[i * fdi + f];
+	}
+	free(olat);
+	free(s->key);
+	s->key = NULL;
+	s->dense = 1;
+}
+
+/* Compute the Cubic B-spline weightings for a given t */
+static void basis(double b[4], double t) {
+	double t2, t3, it;
+
+	t2 = t * t;
+	t3 = t2 * t;
+	it = 1.0 - t;
+
+	b[0] = it * it * it/6.0;
+	b[1] = (3.0 * t3 - 6.0 * t2 + 4.0)/6.0;
+	b[2] = (-3.0 * t3 + 3.0 * t2 + 3.0 * t + 1.0)/6.0;
+	b[3] = t3/6.0;
+}
+
+/* Figure out the latice key of the base of the neighborhood */
+/* of a point, and the B-spline basis factors for each dimension. */
+/* The point is clipped to the latice range. */
+static INR64 base_slbs(
+slbs *s,
+double *pp,			/* Input point */
+double b[MXDI][4]	/* Return basis factors */
+) {
+	mlbs *p = s->p;
+	int e;
+	INR64 kb;
+
+	for (kb = 0, e = 0; e < p->di; e++) {
+		int x;
+		double t, sp, fp;
+		sp = (pp[e] - p->l[e])/s->w[e];	/* Scaled position */
+		if (sp < 0.0)
+			sp = 0.0;
+		else if (sp > (s->res - 1.0))
+			sp = s->res - 1.0;
+		fp = floor(sp);
+		if (fp > (s->res - 2.0))		/* Keep top edge in last cell */
+			fp = s->res - 2.0;
+		x = (int)fp;					/* Grid coordinate - 1 + 1 */
+		kb += s->kinc[e] * x;			/* Accume latice key */
+		t = sp - fp;					/* Spline parameter */
+		basis(b[e], t);					/* Compute basis function values */
+	}
+	return kb;
+}
+
+/* Add the value of an slbs at a point to v[] */
+static void eval_slbs(
+slbs *s,
+double *pp,		/* Input point */
+double *v		/* Output values to add to */
+) {
+	mlbs *p = s->p;
+	int e, f, nn;
+	double b[MXDI][4];
+	INR64 kb;
+
+	kb = base_slbs(s, pp, b);
+
+	for (nn = 0; nn < s->nsize; nn++) {
+		double w, *lp;
+		int ix;
+
+		if ((ix = find_slbs(s, kb + s->n[nn].xo)) < 0)
+			continue;			/* Unallocated latice points are zero */
+		for (w = 1.0, e = 0; e < p->di; e++)
+			w *= b[e][s->n[nn].c[e]];
+		lp = s->lat + ix * p->fdi;
+		for (f = 0; f < p->fdi; f++)
+			v[f] += w * lp[f];
+	}
+}
+
+/* Set the linear base function to the weighted */
+/* least squares linear approximation to the scattered data. */
+static void linear_mlbs(
+mlbs *p
 ) {
 	int i, e, f;
-	mlbs *p = s->p;		/* Parent object */
 	double **A;			/* A matrix holding scattered data points */
 	double *B;			/* B matrix holding RHS & solution */
+	int nr = p->npts;
+
+	/* Need at least di+1 rows for SVD */
+	if (nr < (p->di+1))
+		nr = p->di+1;
 
 	/* Allocate the matricies */
-	B = dvector(0, p->npts-1);
-	A = dmatrix(0, p->npts-1, 0, p->di);
+	B = dvector(0, nr-1);
+	A = dmatrix(0, nr-1, 0, p->di);
 
 	/* For each output dimension, solve the linear equation coeficients */
 	for (f = 0; f < p->fdi; f++) {
-		int ce, co[MXDI];	/* latice counter */
 
 		/* Init A[][] with the scattered data points positions */
 		/* Also init B[] with the value for this output dimension */
 		for (i = 0; i < p->npts; i++) {
+			double sw = sqrt(p->pts[i].w[f]);
 			for (e = 0; e < p->di; e++)
-				A[i][e] = p->pts[i].p[e];
-			A[i][e] = 1.0;
-			B[i] = p->pts[i].v[f];
+				A[i][e] = sw * p->pts[i].p[e];
+			A[i][e] = sw;
+			B[i] = sw * p->pts[i].v[f];
+		}
+		for (; i < nr; i++) {
+			for (e = 0; e <= p->di; e++)
+				A[i][e] = 0.0;
+			B[i] = 0.0;
 		}
 
 		/* Solve the equation A.x = b using SVD */
 		/* (The w[] values are thresholded for best accuracy) */
 		/* Return non-zero if no solution found */
-		if (svdsolve(A, B, p->npts, p->di+1) != 0)
+		if (svdsolve(A, B, nr, p->di+1) != 0)
 			error("SVD least squares failed");
 		/* A[][] will have been changed, and B[] holds the p->di+1 coefficients */
 
-		/* Use the coefficients to initialise the slbs values */
-		for (ce = 0; ce < p->di; ce++)
-			co[ce] = -1;
-		ce = 0;
-
-		while(ce < p->di) {
-			double v = B[p->di];		/* Constant */
-			int off = 0;				/* Latice offset */
-			for (e = 0; e < p->di; e++) {
-				double lv;
-				lv = p->l[e] + s->w[e] * co[e];		/* Input value for this latice location */
-				v += B[e] * lv;
-				off += co[e] * s->coi[e];			/* Accumulate latice offset */
-			}
-			s->lat[off + f] = v;					/* Value of this latice point */
-
-			/* Increment the latice counter */
-			for (ce = 0; ce < p->di; ce++) {
-				if (++co[ce] <= s->res)		/* Counting from -1 ... s->res */
-					break;
-				co[ce] = -1;
-			}
-		}
+		for (e = 0; e <= p->di; e++)
+			p->lin[f][e] = B[e];
 	}
-	free_dmatrix(A, 0, p->npts-1, 0, p->di);
-	free_dvector(B, 0, p->npts-1);
-}
-
-/* Do a latice refinement - upsample the current */
-/* source latice to the destination latice. */
-static void refine_slbs(
-slbs *ds,		/* Destination slbs */
-slbs *ss		/* Source slbs */
-) {
-	mlbs *p = ss->p;	/* Parent object */
-	int ce, co[MXDI];	/* Source coordinate counter */
-	int six;			/* Source index */
-	int dix;			/* destination index */
-	static double _wt[5] = { 1.0/8.0, 4.0/8.0, 6.0/8.0, 4.0/8.0, 1.0/8.0 };	
-	static double *wt = &_wt[2];	/* 1D Distribution weighting */
-
-	/* Zero the destination latice before accumulating values */
-	for (dix = 0; dix < ds->lsize; dix++)
-		ds->_lat[dix] = 0.0;
-
-	/* Now for each source latice entry, add weighted portions */
-	/* to the associated destination points */
-
-	/* Init the source coordinate counter */
-	for (ce = 0; ce < p->di; ce++)
-		co[ce] = -1;
-	ce = 0;
-	six = -ss->loff;
-
-	while(ce < p->di) {
-		int oe, oo[MXDI];	/* Destination offset counter */
-
-//printf("Source coord %d %d, offset %d, value %f\n",co[0], co[1], six, ss->lat[six]);
-		/* calc destination index, and init offest counter */
-		for (dix = oe = 0; oe < p->di; oe++) {
-			oo[oe] = -2;
-			dix += co[oe] * 2 * ds->coi[oe];	/* Accumulate dest offset */
-		}
-		oe = 0;
-
-//printf("Dest coord %d %d\n",co[0] * 2, co[1] * 2);
-		/* For all the offsets from the destination point */
-		while(oe < p->di) {
-			int e, f, dixo;		/* Destination index offset */
-			double w = 1.0;		/* Weighting */
-
-//printf("dest offset %d %d\n",oo[0], oo[1]);
-			/* Compute dest index offset, and check that we are not outside the destination */
-			for (dixo = e = 0; e < p->di; e++) {
-				int x = co[e] * 2 + oo[e];		/* dest coord */
-				dixo += oo[e] * ds->coi[e];		/* Accumulate dest offset */
-//printf("x[%d] = %d\n",e, x);
-				w *= wt[oo[e]];					/* Compute distribution weighting */
-				if (x < -1 || x > ds->res)
-					break;						/* No good */
-			}
-			if (e >= p->di) {		/* We are within the destination latice */
-//if ((co[0] * 2 + oo[0]) == 0 && (co[1] * 2 + oo[1]) == 0) {
-//printf("Source coord %d %d, offset %d, value %f\n",co[0], co[1], six, ss->lat[six]);
-//printf("Dest coord %d %d ix %d, weight %f\n",co[0] * 2 + oo[0], co[1] * 2 + oo[1], dix+dixo, w);
-//}
-			
-				for (f = 0; f < p->fdi; f++) {		/* Distribute weighted values */
-					double v = ss->lat[six + f];
-//if ((co[0] * 2 + oo[0]) == 0 && (co[1] * 2 + oo[1]) == 0)
-//printf("Value being dist %f, weighted value %f\n", v, v * w);
-					ds->lat[dix + dixo + f] += v * w;
-				}
-			}
-
-			/* Increment destination offset counter */
-			for (oe = 0; oe < p->di; oe++) {
-				if (++oo[oe] <= 2)		/* Counting from -2 ... +2 */
-					break;
-				oo[oe] = -2;
-			}
-		}
+	free_dmatrix(A, 0, nr-1, 0, p->di);
+	free_dvector(B, 0, nr-1);
 
-		/* Increment the source index and coordinat counter */
-		six += p->fdi;
-		for (ce = 0; ce < p->di; ce++) {
-			if (++co[ce] <= ss->res)		/* Counting from -1 ... ss->res */
-				break;
-			co[ce] = -1;
+	/* Set the initial residuals */
+	for (i = 0; i < p->npts; i++) {
+		for (f = 0; f < p->fdi; f++) {
+			double v = p->lin[f][p->di];
+			for (e = 0; e < p->di; e++)
+				v += p->lin[f][e] * p->pts[i].p[e];
+			p->r[i * p->fdi + f] = p->pts[i].v[f] - v;
 		}
 	}
 }
 
-/* Compute the Cubic B-spline weightings for a given t */
-void basis(double b[4], double t) {
-	double _t3, _t2, _t1, _3t3, _3t2, _3t1, _6t2;
-
-	_t1  = t/6.0;
-	_t2  = _t1 * _t1;
-	_t3  = _t2 * _t1;
-	_3t1 = 3.0 * _t1;
-	_3t2 = 3.0 * _t2;
-	_3t3 = 3.0 * _t3; 
-	_6t2 = 6.0 * _t2;
-
-	b[0] = - _t3 + _3t2 - _3t1 + 1.0/6.0;
-	b[1] =  _3t3 - _6t2        + 4.0/6.0;
-	b[2] = -_3t3 + _3t2 + _3t1 + 1.0/6.0;
-	b[3] =   _t3;
-}
-
-
-/* Improve an slbs to make it closer to the scattered data */
+/* Fit an slbs to the current residuals, */
+/* and then update the residuals. */
 static void improve_slbs(
 slbs *s
 ) {
 	int i, e, f;
 	mlbs *p = s->p;		/* Parent object */
+	int fdi = p->fdi;
 	double *delta;		/* Delta accumulation */
 	double *omega;		/* Omega accumulation */
+	double *nw;			/* Neighborhood weights */
+
+	/* Allocate all the latice points in the neighborhood of the data */
+	for (i = 0; i < p->npts; i++) {
+		double b[MXDI][4];
+		int nn;
+		INR64 kb;
+
+		kb = base_slbs(s, p->pts[i].p, b);
+		for (nn = 0; nn < s->nsize; nn++)
+			add_slbs(s, kb + s->n[nn].xo);
+	}
 
 	/* Allocate temporary accumulation arrays */
-	if ((delta = (double *)calloc(sizeof(double), s->lsize)) == NULL)
+	if ((delta = (double *)calloc(s->hsize * fdi, sizeof(double))) == NULL)
 		error("Malloc slbs temp latice failed");
-	delta += s->loff;
-	if ((omega = (double *)calloc(sizeof(double), s->lsize)) == NULL)
+	if ((omega = (double *)calloc(s->hsize * fdi, sizeof(double))) == NULL)
 		error("Malloc slbs temp latice failed");
-	omega += s->loff;
+	if ((nw = (double *)malloc(s->nsize * sizeof(double))) == NULL)
+		error("Malloc slbs neighborhood weights failed");
 
 	/* For each scattered data point */
 	for (i = 0; i < p->npts; i++) {
-		int    ix;			/* Latice index of base of neighborhood */
 		double b[MXDI][4];	/* B-spline basis factors for each dimension */
 		double sws;			/* Sum of all the basis factors squared */
-		double ve[MXDO];	/* Current output value error */
+		double *ve = p->r + i * fdi;	/* Current output value error */
 		int    nn;			/* Neighbor counter */
+		INR64  kb;
 
-		/* Figure out our neighborhood */
-		for (ix = e = 0; e < p->di; e++) {
-			int x;
-			double t, sp, fp;
-			sp = (p->pts[i].p[e] - p->l[e])/s->w[e];	/* Scaled position */
-			fp = floor(sp);
-			x = (int)(fp - 1.0);		/* Grid coordinate */
-			ix += s->coi[e] * x;		/* Accume latice offset */
-			t = sp - fp;				/* Spline parameter */
-			basis(b[e], t);				/* Compute basis function values */
-		}
+		kb = base_slbs(s, p->pts[i].p, b);
 
 		/* Compute the grid basis weight functions, */
-		/* the sum of the weights squared, and the current */
-		/* output value estimate. */
-		for (f = 0; f < p->fdi; f++)
-			ve[f] = p->pts[i].v[f];			/* Target output value */
+		/* and the sum of the weights squared. */
 		for (sws = 0.0, nn = 0; nn < s->nsize; nn++) {
 			double w;
 			for (w = 1.0, e = 0; e < p->di; e++)
 				w *= b[e][s->n[nn].c[e]];
-			s->n[nn].w = w;		/* cache weighting */
+			nw[nn] = w;
 			sws += w * w;
-			for (f = 0; f < p->fdi; f++)
-				ve[f] -= w * s->lat[ix + s->n[nn].xo + f];	/* Subtract current aprox value */
 		}
-//printf("Error at point %d = %f\n",i,ve[0]);
-		
+
 		/* Accumulate the delta and omega factors */
 		/* for this resolutions improvement. */
 		for (nn = 0; nn < s->nsize; nn++) {
-			double ws, ww, w = s->n[nn].w;
-			int xo = ix + s->n[nn].xo;		/* Latice offset */
+			double ws, ww, w = nw[nn];
+			int xo = find_slbs(s, kb + s->n[nn].xo) * fdi;
+
 			ww = w * w;
 			ws = ww * w/sws;				/* Scale factor for delta */
-			omega[xo] += ww;				/* Accumulate omega */
-			for (f = 0; f < p->fdi; f++)
-				delta[xo + f] += ws * ve[f];	/* Accumulate delta */
-//printf("Distributing omega %f to %d %d\n",ww,s->n[nn].c[0],s->n[nn].c[1]);
-//printf("Distributing delta %f to %d %d\n",ws * ve[0],s->n[nn].c[0],s->n[nn].c[1]);
+			for (f = 0; f < fdi; f++) {
+				double k = p->pts[i].w[f];
+				omega[xo + f] += k * ww;		/* Accumulate omega */
+				delta[xo + f] += k * ws * ve[f];	/* Accumulate delta */
+			}
 		}
 	}
 
-	omega -= s->loff;	/* Base them back to -1 corner */
-	delta -= s->loff;
-
 	/* Go through the delta and omega arrays, */
-	/* compute and add the refinements to the current */
-	/* B-spline control latice. */
-	for (i = 0; i < s->lsize; i++) {
+	/* and compute the B-spline control latice. */
+	for (i = 0; i < (s->hsize * fdi); i++) {
 		double om = omega[i];
-		if (om != 0.0) {
-			for (f = 0; f < p->fdi; f++)
-				s->_lat[i] += delta[i + f]/om;
-//printf("Adjusting latice index %d by %f to give %f\n",i, delta[i]/om, s->_lat[i]);
-		}
+		if (om != 0.0)
+			s->lat[i] = delta[i]/om;
 	}
 
 	/* Done with temporary arrays */
+	free(nw);
 	free(omega);
 	free(delta);
+
+	densify_slbs(s);
+
+	/* Update the residuals */
+	for (i = 0; i < p->npts; i++) {
+		double v[MXDO];
+
+		for (f = 0; f < fdi; f++)
+			v[f] = 0.0;
+		eval_slbs(s, p->pts[i].p, v);
+		for (f = 0; f < fdi; f++)
+			p->r[i * fdi + f] -= v[f];
+	}
 }
 
 /* Return the interpolated value for a given point */
@@ -446,38 +504,26 @@ static int lookup_mlbs(
 mlbs *p,
 co *c		/* Point to interpolate */
 ) {
-	slbs   *s = p->s;
-	int    e, f;
-	int    ix;			/* Latice index of base of neighborhood */
-	double b[MXDI][4];	/* B-spline basis factors for each dimension */
-	int    nn;			/* Neighbor counter */
-
-	/* Figure out our neighborhood */
-	for (ix = e = 0; e < p->di; e++) {
-		int x;
-		double t, sp, fp;
-		sp = c->p[e];
-		if (sp < p->l[e] || sp > p->h[e])
+	int    e, f, i;
+
+	for (e = 0; e < p->di; e++) {
+		double tol = 1e-9 * (p->h[e] - p->l[e]);
+		if (c->p[e] < (p->l[e] - tol) || c->p[e] > (p->h[e] + tol))
 			return 1;
-		sp = (sp - p->l[e])/s->w[e];	/* Scaled position */
-		fp = floor(sp);
-		x = (int)(fp - 1.0);		/* Grid coordinate */
-		ix += s->coi[e] * x;		/* Accume latice offset */
-		t = sp - fp;				/* Spline parameter */
-		basis(b[e], t);				/* Compute basis function values */
 	}
 
-	/* Compute the the current output value. */
-	for (f = 0; f < p->fdi; f++)
-		c->v[f] = 0.0;
-	for (nn = 0; nn < s->nsize; nn++) {
-		double w;
-		for (w = 1.0, e = 0; e < p->di; e++)
-			w *= b[e][s->n[nn].c[e]];
-		for (f = 0; f < p->fdi; f++)
-			c->v[f] += w * s->lat[ix + s->n[nn].xo + f];	/* Accume spline value */
+	/* Linear base function */
+	for (f = 0; f < p->fdi; f++) {
+		double v = p->lin[f][p->di];
+		for (e = 0; e < p->di; e++)
+			v += p->lin[f][e] * c->p[e];
+		c->v[f] = v;
 	}
-		
+
+	/* Add each level of residual correction */
+	for (i = 0; i < p->nlev; i++)
+		eval_slbs(p->s[i], c->p, c->v);
+
 	return 0;
 }
 
@@ -485,14 +531,14 @@ co *c		/* Point to interpolate */
 /* and setup the mlbs. */
 static void set_mlbs(
 mlbs *p,		/* mlbs to set up */
-dpnts  *pts,		/* scattered data points and weights */
+coww *pts,		/* scattered data points and weights */
 int  npts,		/* number of scattered data points */
 double *l,		/* Input data range, low  (May be NULL) */
 double *h		/* Input data range, high (May be NULL) */
 ) {
 	int res;
-	int i, e, f;
-	slbs *s0 = NULL, *s1;
+	int i, e;
+	slbs *s;
 
 	/* Establish the input data range */
 	for (e = 0; e < p->di; e++) {
@@ -513,51 +559,51 @@ double *h		/* Input data range, high (May be NULL) */
 				p->h[e] = pts[i].p[e];
 		}
 	}
+	for (e = 0; e < p->di; e++) {
+		if (p->h[e] <= p->l[e])
+			p->h[e] = p->l[e] + 1.0;
+	}
 
 	/* Make point data available during init */
 	p->pts  = pts;
 	p->npts = npts;
+	if ((p->r = (double *)malloc(npts * p->fdi * sizeof(double))) == NULL)
+		error("Malloc mlbs residuals failed");
 
-	/* Create an initial slbs */
-	res = 2;
-	if ((s1 = new_slbs(p, 2)) == NULL) 
-		error("new_slbs failed");
-
-	/* Set it up with a linear first approximation */
-	linear_slbs(s1);
-//dump_slbs(s1);
-
-	/* Build up the resolution */
-	for (; res < p->tres;) {  
+	/* Start with a linear first approximation */
+	linear_mlbs(p);
 
-		res = 2 * res -1;
+	/* Build up the resolution, fitting each level */
+	/* to the residual of the levels below it. */
+	for (res = 2;; res = 2 * res - 1) {
 
-printf("~1 doing resolution %d\n",res);
-		delete_slbs(s0);
-		s0 = s1;
-		if ((s1 = new_slbs(p, res)) == NULL) 
+		if (p->nlev >= MLBS_MXLEV)
+			error("mlbs: too many levels");
+		if ((s = new_slbs(p, res)) == NULL)
 			error("new_slbs failed");
+		p->s[p->nlev++] = s;
 
-		refine_slbs(s1, s0);
-//dump_slbs(s1);
-		improve_slbs(s1);
-	}
+		improve_slbs(s);
+		p->nent += s->nent;
 
-	delete_slbs(s0);
-	p->s = s1;		/* Final resolution */
+		if (res >= p->tres)
+			break;
+	}
 
 	/* We can't assume point data will stick around */
+	free(p->r);
+	p->r = NULL;
 	p->pts  = NULL;
 	p->npts = 0;
 }
 
 
-/* Create a new empty mlbs */
+/* Create a new mlbs fitted to the scattered data */
 mlbs *new_mlbs(
 int di,		/* Input dimensionality */
 int fdi,	/* Output dimesionality */
 int res,	/* Minimum final resolution */
-dpnts  *pts,	/* scattered data points and weights */
+coww *pts,	/* scattered data points and per output weights */
 int  npts,	/* number of scattered data points */
 double *l,	/* Input data range, low  (May be NULL) */
 double *h,	/* Input data range, high (May be NULL) */
@@ -602,4 +648,3 @@ warning(char *fmt, ...)
 }
 
 #endif /* NUMSUP_H */
-
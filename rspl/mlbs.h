@@ -1,5 +1,5 @@
 
-/* 
+/*
  * Argyll Color Correction System
  *
  * Scattered Data Interpolation with multilevel B-splines library.
@@ -25,22 +25,30 @@
 
 #include "rspl.h"		/* Define some common elements */
 
+#define MLBS_MXLEV 20	/* Maximum number of B-spline levels */
+
 /* Neighborhood latice cache data */
 typedef struct {
-	int c[MXDI];		/* Coordinate */
-	int xo;				/* Offset into slbs latice */
-	double w;			/* B-spline basis weight */
+	int c[MXDI];		/* Coordinate offset 0..3 */
+	INR64 xo;			/* Key offset of this neighbor from the base */
 } neigh;
 
-/* Structure that represents a resolution level of B-splines */
+/* Structure that represents a resolution level of B-splines. */
+/* The control latice is sparse - only the latice points that */
+/* support the scattered data are allocated, and they are found */
+/* using an open addressed hash table keyed by latice index. */
 struct _slbs {
 	struct _mlbs *p;		/* Parent structure */
 	int res;				/* Basic resolution */
-	int coi[MXDI];			/* Double increment for each input dimension into latice */
-	double *lat;			/* Control latice, extending from +/- 1 from 0..res-1 */
-	double *_lat;			/* Allocation base of lat */
-	int lsize, loff;		/* Number of doubles in _lat, offset of lat from _lat */
 	double w[MXDI];			/* Input data cell width */
+	INR64 kinc[MXDI];		/* Key increment for each input dimension */
+	double lsize;			/* Number of points in the full latice */
+	int dense;				/* NZ if lat[] has been converted to be indexed by key */
+	int hbits;				/* log2 of hash table size */
+	int hsize;				/* Hash table size */
+	int nent;				/* Number of latice points in use */
+	ORD64 *key;				/* Latice key + 1 of each hash slot, 0 if empty */
+	double *lat;			/* Control latice values, [hsize][fdi] */
 	neigh *n;				/* Neighborhood latice cache */
 	int nsize;				/* Number of n entries */
 }; typedef struct _slbs slbs;
@@ -50,28 +58,35 @@ struct _mlbs {
 	int di;		/* Input dimensions */
 	int fdi;	/* Output dimensions */
 	int tres;	/* Target resolution */
-	double smf;	/* Smoothing factor */
+	double smf;	/* Smoothing factor (not currently used) */
 	int npts;	/* Number of data points */
-	dpnts *pts;	/* Coordinate points and weights (valid while creating) */
-	double l[MXDI], h[MXDI];	/* Input data range, cell width */
-	slbs *s;	/* Current B-spline latice */
+	coww *pts;	/* Coordinate points and weights (valid while creating) */
+	double *r;	/* Residual at each point [npts][fdi] (valid while creating) */
+	double l[MXDI], h[MXDI];	/* Input data range */
+	double lin[MXDO][MXDI+1];	/* Linear base function coefficients */
+	int nlev;	/* Number of B-spline levels */
+	slbs *s[MLBS_MXLEV];	/* Residual B-spline latice for each level */
+	int nent;	/* Total number of latice points allocated */
 
+	/* Return the interpolated value for c->p[] in c->v[]. */
+	/* Return NZ if input point is out of range. */
+	/* This is thread safe. */
 	int (*lookup)(struct _mlbs *p, co *c);
 
 	void (*del)(struct _mlbs *p);
-	
+
 }; typedef struct _mlbs mlbs;
 
 
-/* Create a new empty mlbs */
+/* Create a new mlbs fitted to the scattered data */
 mlbs *new_mlbs(
 int di,		/* Input dimensionality */
 int fdi,	/* Output dimesionality */
 int res,	/* Minimum final resolution */
-dpnts  *pts,	/* scattered data points and weights */
+coww *pts,	/* scattered data points and per output weights */
 int  npts,	/* number of scattered data points */
 double *l,	/* Input data range, low  (May be NULL) */
 double *h,	/* Input data range, high (May be NULL) */
 double smf	/* Smoothing factor */
-); 
+);
 
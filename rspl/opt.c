@@ -96,7 +96,8 @@ struct _omgtp {
 
 	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw);
 					/* Optimisation function */
-	void *fdata;	/* Pointer to opaque data needed by callback function */
+	int nfdata;		/* Number of per thread callback contexts */
+	void **fdatas;	/* Pointers to opaque data needed by callback function */
 
 	struct {
 		double cw[MXDI];	/* Curvature weight factor for each dimension */
@@ -133,7 +134,7 @@ struct _omgtp {
 /* ================================================= */
 static omgtp *new_omgtp(rspl *s, int tdi, int adi, int mxres,
 	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
-	void *fdata);
+	int nfdata, void **fdatas);
 static void free_omgtp(omgtp *m);
 static void solve_gres(omgtp *m, double tol);
 static void init_soln(omgtp  *m1, omgtp  *m2);
@@ -153,9 +154,15 @@ static void init_fsoln(omgtp *m, double **vdata);
  *	
  *	Returns value is the "error" for this point.
  */
+/* Grid points are optimised in 2^di passes, each pass doing the points */
+/* with one combination of odd/even coordinates. None of the points */
+/* in a pass is within the 3x3 surrounders of another, so each */
+/* pass can be done in parallel, by up to nfdata threads with */
+/* func() being called with fdatas[thread index]. The result */
+/* doesn't depend on the number of threads used. */
 
 int
-opt_rspl_imp(
+opt_rspl_mt_imp(
 	rspl *s,		/* this */
 	int flags,		/* Combination of flags */
 	int tdi,		/* Dimensionality of target data */
@@ -165,7 +172,8 @@ opt_rspl_imp(
 					/* dimension changing most rapidly. */
 	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
 					/* Optimisation function */
-	void *fdata,	/* Opaque data needed by function */
+	int nfdata,		/* Number of per thread function contexts */
+	void **fdatas,	/* Opaque data needed by function for each thread */
 	datai glow,		/* Grid low scale - NULL = default 0.0 */
 	datai ghigh,	/* Grid high scale - NULL = default 1.0 */
 	int gres[MXDI],	/* Spline grid resolution for each dimension */
@@ -196,6 +204,9 @@ opt_rspl_imp(
 	if (adi >= (2 * MXDI))
 		error("rspl, opt: adi %d > 2 * MXDI %d",adi,2 * MXDI);
 
+	if (nfdata < 1 || fdatas == NULL)
+		error("rspl, opt: need at least one function context");
+
 	/* transfer desired grid range to structure */
 	s->g.mres = 1.0;
 	s->g.bres = 0;
@@ -262,7 +273,7 @@ opt_rspl_imp(
 
 		/* Do each grid resolution in turn */
 		for (fres = (double)sres, res = sres;;) {
-			m = new_omgtp(s, tdi, adi, res, func, fdata);
+			m = new_omgtp(s, tdi, adi, res, func, nfdata, fdatas);
 
 			if (om == NULL) {
 				init_fsoln(m, vdata);	/* Set the initial targets & values from corners */
@@ -272,13 +283,13 @@ opt_rspl_imp(
 			}
 			solve_gres(m, TOL * s->g.mres/res);	/* Use itterative */
 
-			if (res >= s->g.mres)
+			if (res >= s->g.bres)
 				break;	/* Done */
 
 			fres *= gratio;
 			res = (int)(fres + 0.5);
-			if ((res + 1) >= s->g.mres)	/* If close enough */
-				res = (int)s->g.mres;
+			if ((res + 1) >= s->g.bres)	/* If close enough */
+				res = s->g.bres;
 			om = m;
 		}
 
@@ -296,6 +307,28 @@ opt_rspl_imp(
 	return is_mono(s);
 }
 
+/* Single threaded version of the above */
+int
+opt_rspl_imp(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	int tdi,		/* Dimensionality of target data */
+	int adi,		/* Additional per grid point data allocation */
+	double **vdata,	/* di^2 array of function, target and additional values to init */
+					/* array corners with. */
+	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
+					/* Optimisation function */
+	void *fdata,	/* Opaque data needed by function */
+	datai glow,		/* Grid low scale - NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - NULL = default 1.0 */
+	int gres[MXDI],	/* Spline grid resolution for each dimension */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+) {
+	return opt_rspl_mt_imp(s, flags, tdi, adi, vdata, func, 1, &fdata,
+	                       glow, ghigh, gres, vlow, vhigh);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - -*/
 /* omgtp routines */
 
@@ -308,7 +341,8 @@ static omgtp *new_omgtp(
 	int mxres,		/* maximum resolution to create */
 	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
 					/* Optimisation function */
-	void *fdata		/* Opaque data needed by function */
+	int nfdata,		/* Number of per thread function contexts */
+	void **fdatas	/* Opaque data needed by function for each thread */
 ) {
 	omgtp *m;
 	int di = s->di, fdi = s->fdi;
@@ -336,7 +370,8 @@ static omgtp *new_omgtp(
 	m->tdi = tdi;
 	m->adi = adi;
 	m->func = func;
-	m->fdata = fdata;
+	m->nfdata = nfdata;
+	m->fdatas = fdatas;
 
 	/* Grid related */
 	m->g.mres = 1.0;
@@ -368,6 +403,7 @@ static omgtp *new_omgtp(
 
 	/* Compute index coordinate increments into linear grid for each dimension */
 	/* ie. 1, gres, gres^2, gres^3 */
+	m->g.fci[0] = m->g.pss;
 	for (m->g.ci[0] = 1, e = 1; e < di; e++) {
 		m->g.ci[e] = m->g.ci[e-1] * m->g.res[e-1];	/* In grid points */
 		m->g.fci[e] = m->g.ci[e] * m->g.pss;		/* In doubles */
@@ -425,7 +461,6 @@ double **vdata		/* di^2 array of function and target values to init array corner
 ) {
 	rspl *s = m->s;
 	int di  = s->di;
-	int fdi = s->fdi;
 	int gno = m->g.no;
 	int gres_1[MXDI];
 	int e, n;
@@ -448,9 +483,8 @@ double **vdata		/* di^2 array of function and target values to init array corner
 	for (n = 0, gp = m->g.a; n < gno; n++, gp += m->g.pss) {
 		double we[MXDI];		/* 1.0 - Weight in each dimension */
 		
-		/* Figure out the pointer to the grid data and its weighting */
+		/* Figure out the grid point weighting */
 		{
-			gp = m->g.a;					/* Base of output array */
 			for (e = 0; e < di; e++)
 				we[e] = (double)gc[e]/gres_1[e]; /* 1.0 - weight */
 		}
@@ -479,7 +513,7 @@ double **vdata		/* di^2 array of function and target values to init array corner
 			for (i = 1; i < (1 << di); i++) {	/* For all other corners of cube */
 				w = gw[i];						/* Strength reduce */
 				d = vdata[i];
-				for (f = 0; f < fdi; f++)
+				for (f = 0; f < m->g.pss; f++)
 					gp[f] += w * d[f];
 			}
 		
@@ -608,118 +642,172 @@ double tol
 	}
 }
 
-/* Optimise the points values and (optionally) targets */
-/* Use Red/Black order, return total error after this itteration. */
-/* Return the total optimisation error */
-static double
-one_itter(
+/* Context for optimising the points of one parity pass */
+typedef struct {
+	omgtp *m;
+	int first;		/* Flag, NZ if this is the first pass at this resolution */
+	int par[MXDI];	/* Parity of the coordinates in each dimension */
+	int pres[MXDI];	/* Number of coordinates of this parity in each dimension */
+	int sdi;		/* Number of dimensions traversed within each job, */
+					/* the remaining dimensions are the job index. */
+	int njobs;		/* Number of jobs */
+	double *jerr;	/* Total error for each job */
+} optjob;
+
+/* Optimise one grid point, and return its error */
+static double opt_point(
 omgtp *m,
+int *gc,		/* Grid coordinate */
+void *fdata,	/* Function context to use */
 int first		/* Flag, NZ if this is the first pass at this resolution */
 ) {
 	int di = m->s->di, fdi = m->s->fdi;
 	int tdi = m->tdi;
 	int i, e, f;
-	int gc[MXDI];
 	int *gres = m->g.res;
-	int gres_1[MXDI];
 	DCOUNT(cc, MXDIDO, di, -1, -1, 2);	/* Surrounding cube counter */
 	double *gpp;				/* Current grid point pointer */
 	double ssum[MXDO+MXDI+2*MXDI];	/* Pointer to surrounding average values */
 	double *surav;				/* Surrounding average values */
 	double awt;					/* Average weight */
-	double terr = 0.0;			/* Total error */
 	int surf;					/* This point is on the surface */
 
+	/* See if we are on the surface */
+	surf = 0;
+	gpp = m->g.a;
 	for (e = 0; e < di; e++) {
-		gc[e] = 0;	/* init coords */
-		gres_1[e] = gres[e] - 1;
+		gpp += m->g.fci[e] * gc[e];	/* Compute pointer to current point */
+
+		if (gc[e] == 0 || gc[e] == (gres[e]-1))
+			surf = 1;
 	}
 
-	/* Until done */
-	for (;;) {
+	surav = NULL;
+	if (!surf) {
 
-		/* See if we are on the surface */
-		surf = 0;
-		gpp = m->g.a;
-		for (e = 0; e < di; e++) {
-			gpp += m->g.fci[e] * gc[e];	/* Compute pointer to current point */
+		for (f = 0; f < (fdi + tdi); f++)
+			ssum[f] = 0.0;
+		awt = 0.0;
 
-			if (gc[e] == 0 || gc[e] == gres_1[e])
-				surf = 1;
-		}
+		/* Average the 3x3 surrounders */
+		DC_INIT(cc)
+		for (i = 0; !DC_DONE(cc); i++ ) {
+			double *gp = m->g.a;
 
-		surav = NULL;
-		if (!surf) {
-
-			for (f = 0; f < (fdi + tdi); f++)
-				ssum[f] = 0.0;
-			awt = 0.0;
- 
-			/* Average the 3x3 surrounders */
-			DC_INIT(cc)
-			for (i = 0; !DC_DONE(cc); i++ ) {
-				double *gp = m->g.a;
-
-				for (e = 0; e < di; e++) {
-					int j;
-					j = gc[e] + cc[e];
-					if (j < 0 && j > gres_1[e]) {	/* outside */
-						break;
-					}
-					gp += m->g.fci[e] * j;	/* Compute pointer to surrounder */
-				}
-				if (e >= di) {	/* We have a valid point */
-					for (f = 0; f < (fdi + tdi); f++)
-						ssum[f] += gp[f];
-					awt += 1.0;
+			for (e = 0; e < di; e++) {
+				int j;
+				j = gc[e] + cc[e];
+				if (j < 0 || j >= gres[e]) {	/* outside */
+					break;
 				}
-				DC_INC(cc);
+				gp += m->g.fci[e] * j;	/* Compute pointer to surrounder */
 			}
-			if (awt > 0.0) {	/* Compute the average */
+			if (e >= di) {	/* We have a valid point */
 				for (f = 0; f < (fdi + tdi); f++)
-					ssum[f] /= awt;
-				surav = ssum;
+					ssum[f] += gp[f];
+				awt += 1.0;
 			}
+			DC_INC(cc);
 		}
-		
-		/* Call optimisation function */
-		terr += m->func(m->fdata, gpp, surav, first, m->sf.cw);
-
-		/* Increment index in red/black order */
-		for (e = 0; e < di; e++) {
-			if (e == 0) {
-				gc[0] += 2;	/* Inc coordinate by 2 */
-			} else {
-				gc[e] += 1;		/* Inc coordinate */
-			}
-			if (gc[e] < gres[e])
-				break;	/* No carry */
-			gc[e] -= gres[e];			/* Reset coord */
-
-			if ((gres[e] & 1) == 0) {	/* Compensate for odd grid */
-				gc[0] ^= 1; 			/* XOR lsb */
-			}
+		if (awt > 0.0) {	/* Compute the average */
+			for (f = 0; f < (fdi + tdi); f++)
+				ssum[f] /= awt;
+			surav = ssum;
 		}
-		/* Stop on reaching 0 */
-		for(e = 0; e < di; e++)
-			if (gc[e] != 0)
-				break;
-		if (e == di)
-			break;		/* Finished */
 	}
 
-	return terr;
+	/* Call optimisation function */
+	return m->func(fdata, gpp, surav, first, m->sf.cw);
 }
 
+/* Optimise the points of one job of a parity pass. */
+/* Each job is a block of the grid, traversed in memory order. */
+static void opt_job(void *cntx, int thix, int ix) {
+	optjob *p = (optjob *)cntx;
+	omgtp *m = p->m;
+	int di = m->s->di;
+	int e, jx = ix;
+	int kc[MXDI];		/* Coordinate index within this parity */
+	int gc[MXDI];		/* Grid coordinate */
+	double terr = 0.0;
+
+	for (e = 0; e < p->sdi; e++)
+		kc[e] = 0;
+	for (; e < di; e++) {
+		kc[e] = jx % p->pres[e];
+		jx /= p->pres[e];
+	}
 
+	for (;;) {
+		for (e = 0; e < di; e++)
+			gc[e] = p->par[e] + 2 * kc[e];
 
+		terr += opt_point(m, gc, m->fdatas[thix], p->first);
 
+		/* Increment index within the job */
+		for (e = 0; e < p->sdi; e++) {
+			if (++kc[e] < p->pres[e])
+				break;	/* No carry */
+			kc[e] = 0;
+		}
+		if (e >= p->sdi)
+			break;		/* Finished */
+	}
+	p->jerr[ix] = terr;
+}
 
+/* Optimise the points values and (optionally) targets */
+/* Do each odd/even coordinate combination in turn, so that */
+/* the points within a pass are independent. */
+/* Return the total optimisation error */
+static double
+one_itter(
+omgtp *m,
+int first		/* Flag, NZ if this is the first pass at this resolution */
+) {
+	int di = m->s->di;
+	int e, i, par;
+	int nthr, mxjobs;
+	double terr = 0.0;			/* Total error */
+	optjob job;
+
+	nthr = pfor_nthreads();
+	if (m->nfdata < nthr)
+		nthr = m->nfdata;
+
+	job.m = m;
+	job.first = first;
+
+	/* Decide how many outer dimensions to split into jobs, */
+	/* aiming for a few jobs per thread. */
+	job.sdi = di;
+	mxjobs = 1;
+	if (nthr > 1) {
+		while (job.sdi > 0 && mxjobs < (4 * nthr)) {
+			job.sdi--;
+			mxjobs *= (m->g.res[job.sdi] + 1)/2;
+		}
+	}
+	if ((job.jerr = (double *)malloc(sizeof(double) * mxjobs)) == NULL)
+		error("rspl, opt: malloc failed - jerr[]");
 
+	for (par = 0; par < (1 << di); par++) {
 
+		job.njobs = 1;
+		for (e = 0; e < di; e++) {
+			job.par[e] = (par >> e) & 1;
+			job.pres[e] = (m->g.res[e] - job.par[e] + 1)/2;
+			if (e >= job.sdi)
+				job.njobs *= job.pres[e];
+		}
 
+		pfor(job.njobs, nthr, (void *)&job, opt_job);
 
+		/* Sum the error in a fixed order */
+		for (i = 0; i < job.njobs; i++)
+			terr += job.jerr[i];
+	}
+	free(job.jerr);
 
-
-
-
+	return terr;
+}
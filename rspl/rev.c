@@ -224,11 +224,20 @@ static char *pcellorange(cell *c);
 
 static void make_rev(rspl *s);
 static void init_revaccell(rspl *s);
+static void add_rev_instance(rspl *s);
+static void get_revaccell(rspl *s);
+static int rev_save_accel_rspl(rspl *s, char *fname);
+static int rev_load_accel_rspl(rspl *s, char *fname);
+static void rev_get_stats_rspl(rspl *s, rev_stats *st);
+static void rev_reset_stats_rspl(rspl *s);
+static void rev_print_stats_rspl(rspl *s, FILE *fp);
 
 static cell *get_rcell(schbase *b, int ix, int force);
 static void uncache_rcell(revcache *r, cell *cp);
 #define unget_rcell(r, cp) uncache_rcell(r, cp)		/* These are the same */
 static void invalidate_revaccell(rspl *s);
+static void revacc_free_lists(rspl *s, int **lists);
+static void invalidate_revcache(revcache *rc);
 static int decrease_revcache(revcache *rc);
 
 /* ====================================================== */
@@ -252,6 +261,7 @@ static int *next_line_cell(line *l);
 static void search_list(schbase *b, int *rip, unsigned int tcount);
 
 static void clear_limitv(rspl *s);
+static void fill_limitv(rspl *s);
 
 static double get_limitv(schbase *b, int ix,	float *fcb, double *p);
 
@@ -265,18 +275,75 @@ static char *opnames[6] = { "exact", "clipv", "clipn", "auxil", "locus" };
 /* Globals that track overall usage of reverse cache to aportion memory */
 /* This is incremented for rspl with di > 1 when rev.rev_valid != 0 */
 size_t g_avail_ram = 0;			/* Total maximum memory to be used */
+size_t g_dflt_avail_ram = 0;	/* Default g_avail_ram computed from system RAM */
+size_t g_rev_cache_max = 0;		/* Runtime override of g_avail_ram, 0 if not set */
 size_t g_test_ram = 0;			/* Amount of memory that has been tested to be allocatable */
 int g_no_rev_cache_instances = 0;
 rev_struct *g_rev_instances = NULL;
 
+/* Aportion the available memory amongst the instances, */
+/* and reduce any caches that are over their new limit. */
+/* (Instances that may be in use by another thread are left */
+/*  to reduce their own cache on their next allocation.) */
+/* Must be called with pfor_lock() held. */
+static void rev_apportion_ram(void) {
+	rev_struct *rsi;
+	size_t ram_portion = g_avail_ram;
+
+	if (g_no_rev_cache_instances > 1)
+		ram_portion /= g_no_rev_cache_instances; 
+	for (rsi = g_rev_instances; rsi != NULL; rsi = rsi->next) {
+		revcache *rc = rsi->cache;
+
+		rsi->max_sz = ram_portion;
+		if (rsi->concur)
+			continue;
+		while (rc->nunlocked > 0 && rsi->sz > rsi->max_sz) {
+			if (decrease_revcache(rc) == 0)
+				break;
+		}
+	}
+}
+
+/* Set the maximum total memory to be used by all rspl reverse caches. */
+/* maxsz = 0 restores the default. */
+void rspl_set_rev_cache_max(size_t maxsz) {
+
+	pfor_lock();
+	g_rev_cache_max = maxsz;
+
+	if (maxsz != 0)
+		g_avail_ram = maxsz;
+	else if (g_dflt_avail_ram != 0)
+		g_avail_ram = g_dflt_avail_ram;
+	else {
+		pfor_unlock();
+		return;			/* Will be computed when first needed */
+	}
+
+	rev_apportion_ram();
+	pfor_unlock();
+}
+
+/* Return the current maximum total memory to be used by the reverse caches */
+size_t rspl_get_rev_cache_max(void) {
+	if (g_rev_cache_max != 0)
+		return g_rev_cache_max;
+	return g_avail_ram;
+}
+
 /* ------------------------------------------------------ */
 /* Retry allocation routines - if the malloc fails,       */
 /* try reducing the cache size and trying again */
 /* (This won't catch the problem if it occurs in a malloc outside rev) */
 
+/* (The global accounting is protected by pfor_lock(), */
+/*  so that dup()'d rspls can be used from several threads.) */
+
 /* When a malloc fails, reduce the maximum cache to */
 /* it's current allocation minus the given size. */
-static void rev_reduce_cache(size_t size) {
+/* Must be called with pfor_lock() held. */
+static void rev_reduce_cache(rspl *s, size_t size) {
 	rev_struct *rsi;
 	size_t ram;
 
@@ -298,6 +365,8 @@ static void rev_reduce_cache(size_t size) {
 		revcache *rc = rsi->cache;
 
 		rsi->max_sz = ram;
+		if (rsi->concur && rsi != &s->rev)
+			continue;
 		while (rc->nunlocked > 0 && rsi->sz > rsi->max_sz) {
 			if (decrease_revcache(rc) == 0)
 				break;
@@ -316,7 +385,8 @@ static void rev_reduce_cache(size_t size) {
 /* can be allocated, and if not, reduce the rev-cache limit. */
 /* This is so as to detect running out of VM before */
 /* we actually run out and (on OS X) avoid emitting a warning. */
-static void rev_test_vram(size_t size) {
+/* Must be called with pfor_lock() held. */
+static void rev_test_vram(rspl *s, size_t size) {
 	char *a1;
 #ifdef __APPLE__
 	int old_stderr, new_stderr;
@@ -330,7 +400,7 @@ static void rev_test_vram(size_t size) {
 #endif
 	size += 20 * 1024 * 1024;	/* This depends on the VM region allocation size */
 	if ((a1 = malloc(size)) == NULL) {
-		rev_reduce_cache(size);
+		rev_reduce_cache(s, size);
 	} else {
 		free(a1);
 	}
@@ -346,14 +416,16 @@ static void rev_test_vram(size_t size) {
 static void *rev_malloc(rspl *s, size_t size) {
 	void *rv;
 
+	pfor_lock();
 	if ((size + 1 * 1024 * 1204) > g_test_ram)
-		rev_test_vram(size);
+		rev_test_vram(s, size);
 	if ((rv = malloc(size)) == NULL) {
-		rev_reduce_cache(size);
+		rev_reduce_cache(s, size);
 		rv = malloc(size);
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	pfor_unlock();
 
 	return rv;
 }
@@ -361,14 +433,16 @@ static void *rev_malloc(rspl *s, size_t size) {
 static void *rev_calloc(rspl *s, size_t num, size_t size) {
 	void *rv;
 
+	pfor_lock();
 	if (((num * size) + 1 * 1024 * 1204) > g_test_ram)
-		rev_test_vram(size);
+		rev_test_vram(s, size);
 	if ((rv = calloc(num, size)) == NULL) {
-		rev_reduce_cache(num * size);
+		rev_reduce_cache(s, num * size);
 		rv = calloc(num, size);
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	pfor_unlock();
 
 	return rv;
 }
@@ -376,14 +450,16 @@ static void *rev_calloc(rspl *s, size_t num, size_t size) {
 static void *rev_realloc(rspl *s, void *ptr, size_t size) {
 	void *rv;
 
+	pfor_lock();
 	if ((size + 1 * 1024 * 1204) > g_test_ram)
-		rev_test_vram(size);
+		rev_test_vram(s, size);
 	if ((rv = realloc(ptr, size)) == NULL) {
-		rev_reduce_cache(size);		/* approximation */
+		rev_reduce_cache(s, size);		/* approximation */
 		rv = realloc(ptr, size);
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	pfor_unlock();
 
 	return rv;
 }
@@ -517,6 +593,7 @@ rev_interp_rspl(
 #ifdef STATS
 				s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+				s->rev.cnt.searchcalls++;
 			} else
 				set_lsearch(s, e);		/* Reset locus search for next auxiliary */
 
@@ -566,6 +643,7 @@ rev_interp_rspl(
 #ifdef STATS
 			s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+			s->rev.cnt.searchcalls++;
 		if (rip != NULL) {
 			/* Setup, sort and search the list */
 			search_list(b, rip, s->get_next_touch(s));
@@ -582,6 +660,7 @@ rev_interp_rspl(
 #ifdef STATS
 			s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+			s->rev.cnt.searchcalls++;
 			/* Candidate cell list should be the same */
 			if (rip != NULL) {
 				/* Setup, sort and search the list */
@@ -600,6 +679,7 @@ rev_interp_rspl(
 #ifdef STATS
 		s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+		s->rev.cnt.searchcalls++;
 
 		/* We get returned a list of cube base indexes of all cubes that have */
 		/* the closest valid vertex value to the target value. */
@@ -636,6 +716,7 @@ rev_interp_rspl(
 #ifdef STATS
 		s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+		s->rev.cnt.searchcalls++;
 		init_line_eq(b, b->v, cdir);				/* Init the implicit line equation */
 		rip = init_line(s, &ln, cpp[0].v, cdir);	/* Init the line cell dda */
 //~~1 HACK!!! should be <= 1.0 !!!
@@ -681,6 +762,7 @@ rev_interp_rspl(
 #ifdef STATS
 		s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+		s->rev.cnt.searchcalls++;
 		if (rip != NULL) {
 			/* Setup, sort and search the list */
 			search_list(b, rip, s->get_next_touch(s));
@@ -697,6 +779,7 @@ rev_interp_rspl(
 #ifdef STATS
 			s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+			s->rev.cnt.searchcalls++;
 			/* Candidate cell list should be the same */
 			if (rip != NULL) {
 				/* Setup, sort and search the list */
@@ -732,6 +815,149 @@ rev_interp_rspl(
 	return b->nsoln | didclip;
 }
 
+/* ------------------------------------------------------------------------------------ */
+
+#define REVN_MAXBITS 16		/* Maximum bits per output dimension for locality key */
+
+/* Convert fdi quantized coordinates into a Hilbert curve index, */
+/* using J. Skilling's transpose algorithm ("Programming the Hilbert curve", */
+/* AIP Conf. Proc. 707, 2004). */
+static ORD64 revn_hilbert_key(
+unsigned int *x,	/* Coordinates [n], destroyed */
+int b,				/* Bits per coordinate */
+int n				/* Number of coordinates */
+) {
+	unsigned int M = 1 << (b-1), P, Q, t;
+	int i, j;
+	ORD64 key = 0;
+
+	/* Inverse undo */
+	for (Q = M; Q > 1; Q >>= 1) {
+		P = Q - 1;
+		for (i = 0; i < n; i++) {
+			if (x[i] & Q) {
+				x[0] ^= P;
+			} else {
+				t = (x[0] ^ x[i]) & P;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+
+	/* Gray encode */
+	for (i = 1; i < n; i++)
+		x[i] ^= x[i-1];
+	t = 0;
+	for (Q = M; Q > 1; Q >>= 1) {
+		if (x[n-1] & Q)
+			t ^= Q-1;
+	}
+	for (i = 0; i < n; i++)
+		x[i] ^= t;
+
+	/* Interleave the transposed bits into the key */
+	for (j = b-1; j >= 0; j--) {
+		for (i = 0; i < n; i++)
+			key = (key << 1) | ((x[i] >> j) & 1);
+	}
+	return key;
+}
+
+/* Locality sort element */
+typedef struct {
+	ORD64 key;
+	int ix;
+} revn_ord;
+
+/* Do reverse interpolation of a set of targets, in an order that */
+/* improves the locality of successive searches. This is the same as */
+/* calling rev_interp() for each target, but the targets are processed */
+/* in Hilbert curve order in the output space, so that the cell cache */
+/* hit rate is higher, and each search starts with the cell that the */
+/* previous (nearby) search found its solution in. */
+static void
+rev_interp_n_rspl(
+	rspl *s,		/* this */
+	int flags,		/* Hint flag */
+	int mxsoln,		/* Maximum number of solutions allowed for each target */
+	int *auxm,		/* Array of di mask flags, !=0 for valid auxliaries (NULL if no auxiliaries) */
+	double (*cdir)[MXRO],	/* Array of npts clip vectors, NULL if not used */
+	int npts,		/* Number of targets */
+	co *cpp,		/* Array of npts * mxsoln, targets in cpp[i * mxsoln] */
+	int *rvs		/* Return rev_interp() return value for each target */
+) {
+	int i, f, fdi = s->fdi;
+	int b;						/* Bits per coordinate */
+	double min[MXRO], max[MXRO];
+	revn_ord *ord;
+
+	/* This is a restricted size function */
+	if (s->di > MXRI)
+		error("rspl: rev_interp_n can't handle di = %d",s->di);
+	if (fdi > MXRO)
+		error("rspl: rev_interp_n can't handle fdi = %d",fdi);
+
+	mxsoln &= RSPL_NOSOLNS;		/* Prevent silliness */
+	if (mxsoln < 1)
+		mxsoln = 1;
+
+	if (npts <= 0)
+		return;
+
+	if ((ord = (revn_ord *) malloc(npts * sizeof(revn_ord))) == NULL)
+		error("rspl malloc failed - rev_interp_n order list");
+
+	/* Bounding box of the targets */
+	for (f = 0; f < fdi; f++) {
+		min[f] = 1e38;
+		max[f] = -1e38;
+	}
+	for (i = 0; i < npts; i++) {
+		double *v = cpp[i * mxsoln].v;
+		for (f = 0; f < fdi; f++) {
+			if (v[f] < min[f])
+				min[f] = v[f];
+			if (v[f] > max[f])
+				max[f] = v[f];
+		}
+	}
+
+	/* Use as many bits per coordinate as will fit in the key */
+	if ((b = 64/fdi) > REVN_MAXBITS)
+		b = REVN_MAXBITS;
+
+	/* Compute the locality key for each target */
+	for (i = 0; i < npts; i++) {
+		double *v = cpp[i * mxsoln].v;
+		unsigned int x[MXRO];
+
+		for (f = 0; f < fdi; f++) {
+			double tt = 0.0;
+			if (max[f] > min[f])
+				tt = (v[f] - min[f])/(max[f] - min[f]);
+			x[f] = (unsigned int)(tt * ((1 << b) - 1) + 0.5);
+		}
+		ord[i].key = revn_hilbert_key(x, b, fdi);
+		ord[i].ix = i;
+	}
+
+#define HEAP_COMPARE(A,B) ((A).key < (B).key)
+	HEAPSORT(revn_ord, ord, npts);
+#undef HEAP_COMPARE
+
+	/* Do the lookups in locality order. */
+	/* (The previous solution cells are retained in the */
+	/*  search base structure between calls.) */
+	for (i = 0; i < npts; i++) {
+		int ix = ord[i].ix;
+		rvs[ix] = rev_interp_rspl(s, flags, mxsoln, auxm,
+		                          cdir != NULL ? cdir[ix] : NULL, cpp + ix * mxsoln);
+	}
+
+	free(ord);
+}
+
 /* ------------------------------------------------------------------------------------ */
 /* Do reverse search for the auxiliary min/max ranges of the solution locus for the */
 /* given target output values. */
@@ -905,6 +1131,7 @@ printf("\n");
 #ifdef STATS
 	s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
+	s->rev.cnt.searchcalls++;
 	if (rv) {
 		for (six = 0; six < rv; six++) {
 			DBG(("rev locus returning:\n"));
@@ -987,6 +1214,7 @@ alloc_sb(rspl *s) {
 
 	b->s     = s;				/* rsp */
 	b->pauxcell =				/* Previous solution cell indexes */
+	b->pclipcell =
 	b->plmaxcell = 
 	b->plmincell = -1;
 
@@ -1339,7 +1567,7 @@ calc_fwd_cell_list(
 	int rgres_1 = s->rev.res - 1;
 
 	if (s->rev.rev_valid == 0)
-		init_revaccell(s);
+		get_revaccell(s);
 		
 	for (rpp = s->rev.rev, f = 0; f < fdi; f++) {
 		int mi;
@@ -1427,7 +1655,7 @@ unsigned int tcount		/* grid touch count for this operation */
 			float *fcb = s->g.a + ix * s->g.pss;	/* Pointer to base float of fwd cell */
 			cell *c;
 
-			if (TOUCHF(fcb) >= tcount) {	/* If we have visited this cell before */
+			if (TOUCHFI(s, fcb, ix) >= tcount) {	/* If we have visited this cell before */
 				DBG((" Already touched cell index %d\n",ix));
 				continue;
 			}
@@ -1439,6 +1667,7 @@ unsigned int tcount		/* grid touch count for this operation */
 					warned = 1;
 				}
 				DBG(("revcache is exausted, do search in chunks\n"));
+				s->rev.cnt.chunked++;
 				if (nilist == 0) {
 					/* This should never happen, because nz force should prevent it */
 					revcache *rc = s->rev.cache;
@@ -1458,7 +1687,7 @@ unsigned int tcount		/* grid touch count for this operation */
 			}
 
 			DBG(("checking out cell %d range %s\n",ix,pcellorange(c)));
-			TOUCHF(fcb) = tcount;			/* Touch it */
+			TOUCHFI(s, fcb, ix) = tcount;			/* Touch it */
 
 			/* Check mandatory conditions, and compute search key */
 			if (!b->setsort(b, c)) {
@@ -1902,7 +2131,7 @@ calc_fwd_nn_cell_list(
 	int mi[MXDO];
 
 	if (s->rev.rev_valid == 0)
-		init_revaccell(s);
+		get_revaccell(s);
 
 	for (ix = 0, f = 0; f < fdi; f++) {
 		double t = (v[f] - s->rev.gl[f])/s->rev.gw[f];
@@ -2566,6 +2795,11 @@ static int clipn_setsort(schbase *b, cell *c) {
 
 	c->sort = ss;		/* May be -ve if beyond clip target point ? */
 
+	/* Put previous calls solution cell at top of sort list, so that */
+	/* a good clip distance to beat is established quickly. */
+	if (c->ix == b->pclipcell && ss < b->cdist)
+		c->sort = -1.0;
+
 	DBG(("Cell is accepted\n"));
 	return 1;
 }
@@ -2621,6 +2855,7 @@ static int clipn_compute(schbase *b, simplex *x) {
 		b->cpp[0].v[f] = v[f];
 	b->cdist = err;
 	b->nsoln = 1;
+	b->pclipcell = x->ix;			/* Save solution cell for next time */
 	if (wsrv == 2)					/* Is above (disabled) ink limit */
 		b->iclip = 1;
 
@@ -3207,6 +3442,35 @@ rspl *s
 	}
 }
 
+/* Utility to make sure that all the ink limit values */
+/* cached in the main rspl array have been computed. */
+static void fill_limitv(
+rspl *s
+) {
+	int i, e, di = s->di;
+	float *gp;		/* Grid point pointer */
+
+	if (s->rev.sb != NULL && s->limiten) {
+		ECOUNT(gc, MXDIDO, s->di, 0, s->g.res, 0);    /* coordinates */
+		double iv[MXDI];				/* Input value corresponding to grid */
+
+		DBG(("Looking up fwd vertex ink limit values\n"));
+		/* Calling the limit function for each fwd vertex could be bad */
+		/* if the limit function is slow. Maybe an octree type algorithm */
+		/* could be used if this is a problem ? */
+		EC_INIT(gc);
+		for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
+			if (gp[-1] == L_UNINIT) {
+				for (e = 0; e < di; e++)
+					iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
+				gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
+			}
+			EC_INC(gc);
+		}
+		s->g.limitv_cached = 1;
+	}
+}
+
 /* Cell code */
 
 static void free_cell_contents(cell *c);
@@ -3533,6 +3797,7 @@ int nsdi			/* Non limited sub simplex dimensionality */
 #ifdef STATS
 		s->rev.st[b->op].sinited++;
 #endif /* STATS */
+		s->rev.cnt.sinited1++;
 
 		sdi = nsdi;
 		efdi = fdi;
@@ -4066,6 +4331,7 @@ add_lu_svd(simplex *x) {
 #ifdef STATS
 			x->s->rev.st[x->s->rev.sb->op].sinited2a++;
 #endif /* STATS */
+			x->s->rev.cnt.sinited2++;
 			if (lu_decomp(x->d_u, sdi, (int *)x->d_w, &rip)) {
 				x->flags |= SPLX_FLAG_2F;	/* Failed */
 				return 1;
@@ -4076,6 +4342,7 @@ add_lu_svd(simplex *x) {
 #ifdef STATS
 			x->s->rev.st[x->s->rev.sb->op].sinited2b++;
 #endif /* STATS */
+			x->s->rev.cnt.sinited2++;
 			if (svdecomp(x->d_u, x->d_w, x->d_v, efdi, sdi)) {
 				x->flags |= SPLX_FLAG_2F;	/* Failed */
 				return 1;
@@ -4138,6 +4405,7 @@ simplex *x
 #ifdef STATS
 	x->s->rev.st[x->s->rev.sb->op].sinited4++;
 #endif /* STATS */
+	x->s->rev.cnt.sinited4++;
 	/* Use output of svdcmp() to solve overspecified and/or */
 	/* singular equation A.x = b */
 
@@ -4242,8 +4510,8 @@ simplex *x
 				mem += naux * dof * sizeof(double);
 
 				/* Allocate pointers and ints */
-				x->d_u = (double **)mem, mem += naux * sizeof(double *);
-				x->d_w = (double *)mem, mem += dof * sizeof(int);
+				x->ax_u = (double **)mem, mem += naux * sizeof(double *);
+				x->ax_w = (double *)mem, mem += dof * sizeof(int);
 
 #ifdef DEBUG
 				if (mem != (x->aloc5 + asize))
@@ -4253,7 +4521,7 @@ simplex *x
 				/* Reset and allocate matrix doubles */
 				mem = x->aloc5;
 				for (i = 0; i < naux; i++)
-					x->d_u[i] = (double *)mem,	mem += dof * sizeof(double);
+					x->ax_u[i] = (double *)mem,	mem += dof * sizeof(double);
 			} else {
 				int i;
 				char *mem;
@@ -4310,6 +4578,7 @@ simplex *x
 #ifdef STATS
 			x->s->rev.st[x->s->rev.sb->op].sinited5a++;
 #endif /* STATS */
+			x->s->rev.cnt.sinited5++;
 			if (lu_decomp(x->ax_u, dof, (int *)x->ax_w, &rip)) {
 				x->flags |= SPLX_FLAG_5F;
 				return 1;
@@ -4320,6 +4589,7 @@ simplex *x
 #ifdef STATS
 			x->s->rev.st[x->s->rev.sb->op].sinited5b++;
 #endif /* STATS */
+			x->s->rev.cnt.sinited5++;
 			if (svdecomp(x->ax_u, x->ax_w, x->ax_v, naux, dof)) {
 				x->flags |= SPLX_FLAG_5F;
 				return 1;
@@ -4741,6 +5011,7 @@ int force			/* if nz, force memory allocation, so that we have at least one cell
 #ifdef STATS
 			rc->s->rev.st[rc->s->rev.sb->op].chits++;
 #endif /* STATS */
+			rc->s->rev.cnt.chits++;
 			break;
 		}
 	}
@@ -4809,6 +5080,7 @@ int force			/* if nz, force memory allocation, so that we have at least one cell
 #ifdef STATS
 		rc->s->rev.st[rc->s->rev.sb->op].cmiss++;
 #endif /* STATS */
+		rc->s->rev.cnt.cmiss++;
 
 		/* Add this cell to hash index */
 		cp->hlink = rc->hashtop[hash];
@@ -4856,6 +5128,55 @@ cell *cp
 		warning("rspl cell cache assert: refcount overdecremented!");
 }
 
+/* ====================================================== */
+/* Reverse cache counters                                 */
+
+/* Return a copy of the reverse cache counters and memory usage */
+static void rev_get_stats_rspl(
+rspl *s,			/* this */
+rev_stats *st		/* Return the counters */
+) {
+	*st = s->rev.cnt;
+	st->sz = s->rev.sz;
+	st->max_sz = s->rev.max_sz;
+	st->avail_ram = g_avail_ram;
+	st->ninst = g_no_rev_cache_instances;
+}
+
+/* Reset the reverse cache counters */
+static void rev_reset_stats_rspl(
+rspl *s				/* this */
+) {
+	memset((void *)&s->rev.cnt, 0, sizeof(rev_stats));
+}
+
+/* Print the reverse cache counters and memory usage */
+static void rev_print_stats_rspl(
+rspl *s,			/* this */
+FILE *fp			/* Where to print to */
+) {
+	rev_stats st;
+	ORD64 ctot;
+
+	rev_get_stats_rspl(s, &st);
+	ctot = st.chits + st.cmiss;
+
+	fprintf(fp,"Rev cache stats for di = %d, fdi = %d:\n",s->di, s->fdi);
+	fprintf(fp,"  Search calls          = %llu\n",(unsigned long long)st.searchcalls);
+	fprintf(fp,"  Cell hits/misses      = %llu/%llu",
+	           (unsigned long long)st.chits, (unsigned long long)st.cmiss);
+	if (ctot > 0)
+		fprintf(fp," (%.1f%% hit rate)",100.0 * (double)st.chits/(double)ctot);
+	fprintf(fp,"\n");
+	fprintf(fp,"  Simplex inits 1/2/4/5 = %llu/%llu/%llu/%llu\n",
+	           (unsigned long long)st.sinited1, (unsigned long long)st.sinited2,
+	           (unsigned long long)st.sinited4, (unsigned long long)st.sinited5);
+	fprintf(fp,"  Chunked searches      = %llu\n",(unsigned long long)st.chunked);
+	fprintf(fp,"  Memory used/limit     = %lu/%lu Mbytes (%d instance%s sharing %lu Mbytes)\n",
+	           (unsigned long)st.sz/1000000, (unsigned long)st.max_sz/1000000,
+	           st.ninst, st.ninst == 1 ? "" : "s", (unsigned long)st.avail_ram/1000000);
+}
+
 /* ====================================================== */
 /* Reverse rspl setup functions                           */
 
@@ -4886,8 +5207,14 @@ init_rev(rspl *s) {
 	s->rev_set_limit   = rev_set_limit_rspl;
 	s->rev_get_limit   = rev_get_limit_rspl;
 	s->rev_interp      = rev_interp_rspl;
+	s->rev_interp_n    = rev_interp_n_rspl;
 	s->rev_locus       = rev_locus_rspl;
 	s->rev_locus_segs  = rev_locus_segs_rspl;
+	s->rev_save_accel  = rev_save_accel_rspl;
+	s->rev_load_accel  = rev_load_accel_rspl;
+	s->rev_get_stats   = rev_get_stats_rspl;
+	s->rev_reset_stats = rev_reset_stats_rspl;
+	s->rev_print_stats = rev_print_stats_rspl;
 }
 
 /* Free up all the reverse interpolation info */
@@ -4934,6 +5261,9 @@ rspl *s		/* Pointer to rspl grid */
 	}
 #endif /* STATS */
 
+	if (s->rev.inited != 0 && getenv("ARGYLL_REV_CACHE_STATS") != NULL)
+		rev_print_stats_rspl(s, stdout);
+
 	/* Free up Fourth section */
 	if (s->rev.sb != NULL) {
 		free_search(s->rev.sb);
@@ -4962,7 +5292,10 @@ rspl *s		/* Pointer to rspl grid */
 
 	if (di > 1 && s->rev.rev_valid) {
 		rev_struct *rsi, **rsp;
-		size_t ram_portion = g_avail_ram;
+		size_t ram_portion;
+
+		pfor_lock();
+		ram_portion = g_avail_ram;
 
 		/* Remove it from the linked list */
 		for (rsp = &g_rev_instances; *rsp != NULL; rsp = &((*rsp)->next)) {
@@ -4987,6 +5320,7 @@ rspl *s		/* Pointer to rspl grid */
 								g_no_rev_cache_instances > 1 ? "s" : "",
 			                    (unsigned long)ram_portion/1000000);
 		}
+		pfor_unlock();
 	}
 
 	s->rev.rev_valid = 0;
@@ -5019,6 +5353,45 @@ rspl *s		/* Pointer to rspl grid */
 	DBG(("rev allocation left after free = %d bytes\n",s->rev.sz));
 }
 
+/* Setup the reverse information of a dup() d of s. */
+/* Since the grid is shared, all the ink limit values cached in it */
+/* are computed now, so that neither will write to it during a search. */
+void rev_dup(
+rspl *d,	/* Duplicate that shares the grid of s */
+rspl *s		/* Original */
+) {
+	int i;
+
+	d->rev.fastsetup = s->rev.fastsetup;
+
+	if (s->rev.sb != NULL) {		/* Ink limit has been set */
+		fill_limitv(s);
+		set_search_limit(d, s->limitf, s->lcntx, s->limitv/INKSCALE);
+		d->limiten = s->limiten;
+		d->g.limitv_cached = s->g.limitv_cached;
+	}
+
+	/* Share any valid acceleration lists rather than re-computing them. */
+	/* (Fast setup fills nnrev[] lists on demand, so they can't be shared.) */
+	if (s->rev.rev_valid && !s->rev.fastsetup) {
+		make_rev(d);
+
+		if (d->rev.no == s->rev.no && d->rev.res == s->rev.res) {
+			for (i = 0; i < s->rev.no; i++) {
+				if ((d->rev.rev[i] = s->rev.rev[i]) != NULL)
+					d->rev.rev[i][2]++;		/* Increase reference count */
+				if ((d->rev.nnrev[i] = s->rev.nnrev[i]) != NULL)
+					d->rev.nnrev[i][2]++;
+			}
+			add_rev_instance(d);
+			d->rev.rev_valid = 1;
+		}
+	}
+
+	/* From now on the two may be used from different threads */
+	s->rev.concur = d->rev.concur = 1;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 #ifdef NEVER	/* Test code */
@@ -5175,25 +5548,7 @@ rspl *s
 
 	/* We won't include any fwd cells that are over the ink limit, */
 	/* so makes sure that the fwd cell nodes all have an ink limit value. */ 
-	if (b != NULL && s->limiten) {
-		ECOUNT(gc, MXDIDO, s->di, 0, s->g.res, 0);    /* coordinates */
-		double iv[MXDI];				/* Input value corresponding to grid */
-
-		DBG(("Looking up fwd vertex ink limit values\n"));
-		/* Calling the limit function for each fwd vertex could be bad */
-		/* if the limit function is slow. Maybe an octree type algorithm */
-		/* could be used if this is a problem ? */
-		EC_INIT(gc);
-		for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
-			if (gp[-1] == L_UNINIT) {
-				for (e = 0; e < di; e++)
-					iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
-				gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
-			}
-			EC_INC(gc);
-		}
-		s->g.limitv_cached = 1;
-	}
+	fill_limitv(s);
 
 	/* We then fill in the in-gamut reverse grid lookups, */
 	/* and identify nnrev prime seed verticies */
@@ -5917,11 +6272,11 @@ for (i = 0; i < rgno; i++) {		/* For all the verticies */
 						int ix = *nrp;			/* Fwd cell index */
 						float *fcb = s->g.a + ix * s->g.pss; /* Pntr to base float of fwd cell */
 
-						if (TOUCHF(fcb) >= tcount) {	/* If we seen visited this fwd cell before */
+						if (TOUCHFI(s, fcb, ix) >= tcount) {	/* If we seen visited this fwd cell before */
 //if (fdi > 1) printf("~1 skipping cell %d because we alread have it\n",ix);
 							continue;
 						}
-						TOUCHF(fcb) = tcount;			/* Touch it so we will skip it next time */
+						TOUCHFI(s, fcb, ix) = tcount;			/* Touch it so we will skip it next time */
 
 						/* Compute the range of output values this cell covers */
 						for (f = 0; f < fdi; f++)	/* Init output min/max */
@@ -6151,9 +6506,29 @@ if (prop != NULL) {
 		}
 	}
 
-	if (s->rev.rev_valid == 0 && di > 1) {
+	add_rev_instance(s);
+	s->rev.rev_valid = 1;
+
+#ifdef DEBUG
+	if (fdi > 1) printf("%d cells in rev nn list\n",cellinrevlist);
+	if (fdi > 1) printf("%d fwd cells in rev nn list\n",fwdcells);
+	if (cellinrevlist > 1) printf("Avg list size = %f\n",(double)fwdcells/cellinrevlist);
+#endif
+
+	DBG(("init_revaccell finished\n"));
+}
+
+/* Account for a newly valid set of rev acceleration structures */
+/* in the global rev cache memory apportionment. */
+static void add_rev_instance(
+rspl *s
+) {
+	if (s->rev.rev_valid == 0 && s->di > 1) {
 		rev_struct *rsi;
-		size_t ram_portion = g_avail_ram;
+		size_t ram_portion;
+
+		pfor_lock();
+		ram_portion = g_avail_ram;
 
 		/* Add into linked list */
 		s->rev.next = g_rev_instances;
@@ -6166,6 +6541,8 @@ if (prop != NULL) {
 			revcache *rc = rsi->cache;
 
 			rsi->max_sz = ram_portion;
+			if (rsi->concur && rsi != &s->rev)
+				continue;		/* Will reduce itself */
 			while (rc->nunlocked > 0 && rsi->sz > rsi->max_sz) {
 				if (decrease_revcache(rc) == 0)
 					break;
@@ -6180,16 +6557,8 @@ if (prop != NULL) {
 			                    g_no_rev_cache_instances,
 								g_no_rev_cache_instances > 1 ? "s" : "",
 			                    (unsigned long)ram_portion/1000000);
+		pfor_unlock();
 	}
-	s->rev.rev_valid = 1;
-
-#ifdef DEBUG
-	if (fdi > 1) printf("%d cells in rev nn list\n",cellinrevlist);
-	if (fdi > 1) printf("%d fwd cells in rev nn list\n",fwdcells);
-	if (cellinrevlist > 1) printf("Avg list size = %f\n",(double)fwdcells/cellinrevlist);
-#endif
-
-	DBG(("init_revaccell finished\n"));
 }
 
 /* Invalidate the reverse acceleration structures (section Two) */
@@ -6197,34 +6566,24 @@ static void invalidate_revaccell(
 rspl *s		/* Pointer to rspl grid */
 ) {
 	int e, di = s->di;
-	int **rpp, *rp;
 
 	/* Invalidate the whole rev cache (Third section) */
 	invalidate_revcache(s->rev.cache);
 
-	/* Free up the contents of rev.rev[] and rev.nnrev[] */
-	if (s->rev.rev != NULL) {
-		for (rpp = s->rev.rev; rpp < (s->rev.rev + s->rev.no); rpp++) {
-			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
-				free(*rpp);
-				*rpp = NULL;
-			}
-		}
-	}
-	if (s->rev.nnrev != NULL) {
-		for (rpp = s->rev.nnrev; rpp < (s->rev.nnrev + s->rev.no); rpp++) {
-			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
-				free(*rpp);
-				*rpp = NULL;
-			}
-		}
-	}
+	/* Free up the contents of rev.rev[] and rev.nnrev[]. */
+	/* (Lists may be shared, so every reference must be cleared, */
+	/*  not just the last one.) */
+	if (s->rev.rev != NULL)
+		revacc_free_lists(s, s->rev.rev);
+	if (s->rev.nnrev != NULL)
+		revacc_free_lists(s, s->rev.nnrev);
 
 	if (di > 1 && s->rev.rev_valid) {
 		rev_struct *rsi, **rsp;
-		size_t ram_portion = g_avail_ram;
+		size_t ram_portion;
+
+		pfor_lock();
+		ram_portion = g_avail_ram;
 
 		/* Remove it from the linked list */
 		for (rsp = &g_rev_instances; *rsp != NULL; rsp = &((*rsp)->next)) {
@@ -6249,6 +6608,7 @@ rspl *s		/* Pointer to rspl grid */
 								g_no_rev_cache_instances > 1 ? "s" : "",
 			                    (unsigned long)ram_portion/1000000);
 		}
+		pfor_unlock();
 	}
 	s->rev.rev_valid = 0;
 }
@@ -6390,6 +6750,7 @@ rspl *s
 	/* Figure out how much RAM we can use for the rev cache. */
 	/* (We compute this for each rev instance, to account for any VM */
 	/* limit changes due to intervening allocations) */
+	pfor_lock();
 	if (di > 1 || g_avail_ram == 0) {
 	#ifdef NT 
 		{
@@ -6532,10 +6893,33 @@ rspl *s
 			g_avail_ram = (size_t)(0.95 * max_vmem);
 			fprintf(stdout,"%cARGYLL_REV_CACHE_MULT * RAM trimmed to %lu Mbytes to allow for VM limit\n",cr_char,(unsigned long)g_avail_ram/1000000);
 		}
+		g_dflt_avail_ram = g_avail_ram;
+
+		/* Check for an explicit limit, either set by rspl_set_rev_cache_max() */
+		/* or by environment variable */
+		if (g_rev_cache_max == 0 && (ev = getenv("ARGYLL_REV_CACHE_MAX_MB")) != NULL) {
+			double mb;
+			mb = atof(ev);
+			if (mb >= 1.0) {
+				mb *= 1000000.0;		/* Same Mbytes as reported */
+				if (mb > (double)(((size_t)0)-1))
+					mb = (double)(((size_t)0)-1);
+				g_rev_cache_max = (size_t)mb;
+			}
+		}
+		if (g_rev_cache_max != 0) {
+			g_avail_ram = g_rev_cache_max;
+			if (max_vmem != 0 && g_avail_ram > max_vmem) {
+				g_avail_ram = (size_t)(0.95 * max_vmem);
+				if (repsr == 0)
+					fprintf(stdout,"%cRev cache maximum trimmed to %lu Mbytes to allow for VM limit\n",cr_char,(unsigned long)g_avail_ram/1000000);
+			}
+		}
 	}
 
 	/* Default - this will get aportioned as more instances appear */
 	s->rev.max_sz = g_avail_ram;
+	pfor_unlock();
 
 	DBG(("reverse cache max memory = %d Mbytes\n",s->rev.max_sz/1000000));
 	if (s->verbose && repsr == 0) {
@@ -6559,6 +6943,366 @@ rspl *s
 	DBG(("make_rev finished\n"));
 }
 
+/* ====================================================== */
+/* Reverse acceleration structure persistence.            */
+
+/* The rev.rev[] and rev.nnrev[] lists can take a long time to */
+/* compute for high dimension grids, so allow them to be saved */
+/* and re-loaded. The file is keyed by a hash of everything */
+/* the lists depend on: the fwd grid output values and setup, */
+/* the effective ink limit values and the reverse grid setup. */
+
+#define REVACC_MAGIC "ArgyllRAC"	/* File magic number */
+#define REVACC_VERSION 1			/* File format version */
+
+/* FNV-1a 64 bit hash accumulation */
+static ORD64 revacc_hash_add(ORD64 h, void *buf, size_t len) {
+	unsigned char *bp = (unsigned char *)buf;
+
+	for (; len > 0; len--, bp++) {
+		h ^= (ORD64)*bp;
+		h *= (ORD64)0x100000001b3;
+	}
+	return h;
+}
+
+/* Compute the content hash of everything the rev acceleration */
+/* structures depend on. rev First section must be initialised. */
+static ORD64 revacc_hash(
+rspl *s
+) {
+	ORD64 h = (ORD64)0xcbf29ce484222325;
+	int i, di = s->di, fdi = s->fdi;
+	int lim = (s->rev.sb != NULL && s->limiten);
+	float *gp;
+
+	fill_limitv(s);
+
+	h = revacc_hash_add(h, &di, sizeof(int));
+	h = revacc_hash_add(h, &fdi, sizeof(int));
+	h = revacc_hash_add(h, s->g.res, di * sizeof(int));
+	h = revacc_hash_add(h, s->g.l, di * sizeof(double));
+	h = revacc_hash_add(h, s->g.w, di * sizeof(double));
+	h = revacc_hash_add(h, &s->rev.fastsetup, sizeof(int));
+	h = revacc_hash_add(h, &s->rev.res, sizeof(int));
+	h = revacc_hash_add(h, s->rev.gl, fdi * sizeof(double));
+	h = revacc_hash_add(h, s->rev.gw, fdi * sizeof(double));
+	h = revacc_hash_add(h, &lim, sizeof(int));
+	if (lim)
+		h = revacc_hash_add(h, &s->limitv, sizeof(double));
+
+	for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
+		h = revacc_hash_add(h, gp, fdi * sizeof(float));
+		if (lim)
+			h = revacc_hash_add(h, gp-1, sizeof(float));
+	}
+	return h;
+}
+
+/* Pointer to list + first grid index it was found at, used to identify shared lists */
+typedef struct {
+	int *rp;
+	int ix;
+} revacc_shr;
+
+/* Write one of the rev[] or nnrev[] list arrays. Return nz on error. */
+static int revacc_write_lists(
+rspl *s,
+FILE *fp,
+int **lists
+) {
+	int i, j, nsh = 0;
+	revacc_shr *shr = NULL;
+
+	/* Lists may be shared (reference count > 1), so record the first */
+	/* grid index of each shared list, sorted by address. */
+	for (i = 0; i < s->rev.no; i++) {
+		if (lists[i] != NULL && lists[i][2] > 1)
+			nsh++;
+	}
+	if (nsh > 0) {
+		if ((shr = (revacc_shr *) malloc(nsh * sizeof(revacc_shr))) == NULL)
+			return 1;
+		for (j = i = 0; i < s->rev.no; i++) {
+			if (lists[i] != NULL && lists[i][2] > 1) {
+				shr[j].rp = lists[i];
+				shr[j].ix = i;
+				j++;
+			}
+		}
+#define HEAP_COMPARE(A,B) ((A).rp < (B).rp || ((A).rp == (B).rp && (A).ix < (B).ix))
+		HEAPSORT(revacc_shr, shr, nsh);
+#undef HEAP_COMPARE
+	}
+
+	/* Each entry is written as 0 for NULL, -(ix+1) for a reference to */
+	/* a list first written at grid index ix, or the list length */
+	/* followed by the list. */
+	for (i = 0; i < s->rev.no; i++) {
+		int *rp = lists[i];
+		int code;
+
+		if (rp == NULL) {
+			code = 0;
+		} else {
+			code = rp[1] - 3;
+
+			if (rp[2] > 1) {
+				int lo = 0, hi = nsh-1;
+
+				/* Binary search for the first entry with this address */
+				while (lo < hi) {
+					int mid = (lo + hi)/2;
+					if (shr[mid].rp < rp)
+						lo = mid + 1;
+					else
+						hi = mid;
+				}
+				if (shr[lo].ix != i)
+					code = -(shr[lo].ix + 1);
+			}
+		}
+		if (fwrite(&code, sizeof(int), 1, fp) != 1)
+			goto write_error;
+		if (code > 0 && fwrite(rp + 3, sizeof(int), code, fp) != (size_t)code)
+			goto write_error;
+	}
+	free(shr);
+	return 0;
+
+  write_error:;
+	free(shr);
+	return 1;
+}
+
+/* Read one of the rev[] or nnrev[] list arrays. Return nz on error. */
+/* Any lists read are left in place on error, so that they will be */
+/* freed by the caller. */
+static int revacc_read_lists(
+rspl *s,
+FILE *fp,
+int **lists
+) {
+	int i;
+
+	for (i = 0; i < s->rev.no; i++) {
+		int code, *rp;
+
+		if (fread(&code, sizeof(int), 1, fp) != 1)
+			return 1;
+
+		if (code == 0)
+			continue;
+
+		if (code < 0) {					/* Shared list */
+			code = -code - 1;
+			if (code >= i || (rp = lists[code]) == NULL)
+				return 1;
+			rp[2]++;
+			lists[i] = rp;
+			continue;
+		}
+
+		if (code > s->g.no)			/* Sanity check */
+			return 1;
+		if ((rp = (int *) rev_malloc(s, (code + 4) * sizeof(int))) == NULL)
+			error("rspl malloc failed - rev.grid entry");
+		INCSZ(s, (code + 4) * sizeof(int));
+		lists[i] = rp;
+		rp[0] = code + 4;		/* Allocation */
+		rp[1] = code + 3;		/* Next free Cell */
+		rp[2] = 1;				/* Reference count */
+		rp[code + 3] = -1;		/* End marker */
+		if (fread(rp + 3, sizeof(int), code, fp) != (size_t)code)
+			return 1;
+	}
+	return 0;
+}
+
+/* Free the contents of a rev[] or nnrev[] list array */
+static void revacc_free_lists(
+rspl *s,
+int **lists
+) {
+	int **rpp, *rp;
+
+	for (rpp = lists; rpp < (lists + s->rev.no); rpp++) {
+		if ((rp = *rpp) != NULL && --rp[2] <= 0) {
+			DECSZ(s, rp[0] * sizeof(int));
+			free(*rpp);
+		}
+		*rpp = NULL;
+	}
+}
+
+/* Write the (valid) acceleration structures to the given file. */
+/* Return nz on error */
+static int save_revaccell(
+rspl *s,
+char *fname,
+ORD64 hash
+) {
+	FILE *fp;
+	int hd[6];
+
+	if ((fp = fopen(fname,"wb")) == NULL)
+		return 1;
+
+	/* Header. Native word sizes and byte order are used, */
+	/* and the size/order check value makes sure that a file */
+	/* written on a different type of machine won't be used. */
+	hd[0] = REVACC_VERSION;
+	hd[1] = (int)(sizeof(int) * 0x100 + sizeof(ORD64) * 0x10000 + 0x01020304);
+	hd[2] = s->di;
+	hd[3] = s->fdi;
+	hd[4] = s->rev.res;
+	hd[5] = s->rev.no;
+
+	if (fwrite(REVACC_MAGIC, 1, sizeof(REVACC_MAGIC), fp) != sizeof(REVACC_MAGIC)
+	 || fwrite(hd, sizeof(int), 6, fp) != 6
+	 || fwrite(&hash, sizeof(ORD64), 1, fp) != 1
+	 || revacc_write_lists(s, fp, s->rev.rev)
+	 || revacc_write_lists(s, fp, s->rev.nnrev)) {
+		fclose(fp);
+		remove(fname);
+		return 1;
+	}
+	if (fclose(fp) != 0) {
+		remove(fname);
+		return 1;
+	}
+	return 0;
+}
+
+/* Read the acceleration structures from the given file, if it */
+/* matches the given hash. Return nz if not loaded. */
+static int load_revaccell(
+rspl *s,
+char *fname,
+ORD64 hash
+) {
+	FILE *fp;
+	char magic[sizeof(REVACC_MAGIC)];
+	int hd[6];
+	ORD64 fhash;
+
+	if (s->rev.rev_valid)			/* Free any existing structures */
+		invalidate_revaccell(s);
+
+	if ((fp = fopen(fname,"rb")) == NULL)
+		return 1;
+
+	if (fread(magic, 1, sizeof(REVACC_MAGIC), fp) != sizeof(REVACC_MAGIC)
+	 || strncmp(magic, REVACC_MAGIC, sizeof(REVACC_MAGIC)) != 0
+	 || fread(hd, sizeof(int), 6, fp) != 6
+	 || hd[0] != REVACC_VERSION
+	 || hd[1] != (int)(sizeof(int) * 0x100 + sizeof(ORD64) * 0x10000 + 0x01020304)
+	 || hd[2] != s->di
+	 || hd[3] != s->fdi
+	 || hd[4] != s->rev.res
+	 || hd[5] != s->rev.no
+	 || fread(&fhash, sizeof(ORD64), 1, fp) != 1
+	 || fhash != hash) {
+		DBG(("rev accelleration file '%s' doesn't match\n",fname));
+		fclose(fp);
+		return 1;
+	}
+
+	if (revacc_read_lists(s, fp, s->rev.rev)
+	 || revacc_read_lists(s, fp, s->rev.nnrev)) {
+		DBG(("rev accelleration file '%s' is corrupt\n",fname));
+		fclose(fp);
+		revacc_free_lists(s, s->rev.rev);
+		revacc_free_lists(s, s->rev.nnrev);
+		return 1;
+	}
+	fclose(fp);
+
+	/* Make sure the current cell cache doesn't refer to old ink limit values */
+	invalidate_revcache(s->rev.cache);
+
+	add_rev_instance(s);
+	s->rev.rev_valid = 1;
+
+	return 0;
+}
+
+/* Initialise the rev Second section acceleration information, */
+/* using a cached copy if ARGYLL_REV_ACC_CACHE_DIR is set and */
+/* a matching file exists there. If the structures are computed, */
+/* they are saved to the cache directory. */
+static void get_revaccell(
+rspl *s
+) {
+	char *ev, *fname = NULL;
+	ORD64 hash = 0;
+
+	if (s->di > 1 && (ev = getenv("ARGYLL_REV_ACC_CACHE_DIR")) != NULL && ev[0] != '\000') {
+		hash = revacc_hash(s);
+
+		if ((fname = malloc(strlen(ev) + 40)) == NULL)
+			error("rspl malloc failed - rev accel. file name");
+		sprintf(fname, "%s/rspl_%016llx.rac", ev, (unsigned long long)hash);
+
+		if (load_revaccell(s, fname, hash) == 0) {
+			if (s->verbose)
+				fprintf(stdout, "%cLoaded rev accelleration structures from '%s'\n",cr_char,fname);
+			free(fname);
+			return;
+		}
+	}
+
+	init_revaccell(s);
+
+	if (fname != NULL) {
+		if (save_revaccell(s, fname, hash) != 0) {
+			if (s->verbose)
+				fprintf(stdout, "%cFailed to save rev accelleration structures to '%s'\n",cr_char,fname);
+		}
+		free(fname);
+	}
+}
+
+/* Save the reverse acceleration structures to a file, */
+/* creating them first if necessary. Return nz on error. */
+static int rev_save_accel_rspl(
+rspl *s,			/* this */
+char *fname			/* File to save to */
+) {
+	/* This is a restricted size function */
+	if (s->di > MXRI)
+		error("rspl: rev_save_accel can't handle di = %d",s->di);
+	if (s->fdi > MXRO)
+		error("rspl: rev_save_accel can't handle fdi = %d",s->fdi);
+
+	if (s->rev.inited == 0)
+		make_rev(s);
+	if (s->rev.rev_valid == 0)
+		init_revaccell(s);
+
+	return save_revaccell(s, fname, revacc_hash(s));
+}
+
+/* Load the reverse acceleration structures from a file */
+/* saved by rev_save_accel(). Return nz if the file can't be read, */
+/* or doesn't match the current grid and ink limit setup, */
+/* in which case the structures will be created on demand as usual. */
+static int rev_load_accel_rspl(
+rspl *s,			/* this */
+char *fname			/* File to load from */
+) {
+	/* This is a restricted size function */
+	if (s->di > MXRI)
+		error("rspl: rev_load_accel can't handle di = %d",s->di);
+	if (s->fdi > MXRO)
+		error("rspl: rev_load_accel can't handle fdi = %d",s->fdi);
+
+	if (s->rev.inited == 0)
+		make_rev(s);
+
+	return load_revaccell(s, fname, revacc_hash(s));
+}
+
 /* ====================================================== */
 
 #if defined(DEBUG1) || defined(DEBUG2)
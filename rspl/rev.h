@@ -238,6 +238,8 @@ struct _cell {
 #define REV_MAX_MEM_RATIO2 0.4		/* 0.4 Proportion of rest of Ram to use */
 									/* rev as a fraction of the System RAM. */
 #define HASH_FILL_RATIO 3			/* 3 Ratio of entries to hash size */
+									/* (The RAM ratios can be overridden at runtime by */
+									/*  rspl_set_rev_cache_max() or ARGYLL_REV_CACHE_MAX_MB) */
 
 /* The structure where cells are allocated and cached. */
 
@@ -332,6 +334,7 @@ struct _schbase {
 	cell **lclist;		/* Sorted list of pointers to candidate cells */
 
 	int pauxcell;		/* Indexe of previous call solution cell, -1 if not relevant */
+	int pclipcell;		/* Indexe of previous call clipn solution cell, -1 if not relevant */
 	int plmaxcell;		/* Indexe of previous call solution cell, -1 if not relevant */
 	int plmincell;		/* Indexe of previous call solution cell, -1 if not relevant */
 
@@ -365,6 +368,26 @@ struct _stats {
 }; typedef struct _stats stats;
 #endif /* STATS */
 
+/* ----------------------------------------- */
+/* Always available, low overhead reverse cache counters. */
+/* (STATS above provides more detail, broken down by operation) */
+struct _rev_stats {
+	ORD64 searchcalls;	/* Number of top level searches */
+	ORD64 chits;		/* Cells hit in cache */
+	ORD64 cmiss;		/* Cells missed in cache */
+	ORD64 sinited1;		/* Simplexes initialised to base level */
+	ORD64 sinited2;		/* Simplexes initialised to 2nd level (LU or SVD) */
+	ORD64 sinited4;		/* Simplexes initialised to 4th level (locus) */
+	ORD64 sinited5;		/* Simplexes initialised to 5th level (auxiliary LU or SVD) */
+	ORD64 chunked;		/* Times a search ran out of cache and was processed in chunks */
+
+	/* These are filled in by rev_get_stats() */
+	size_t sz;			/* Current memory allocated by rev */
+	size_t max_sz;		/* Current memory limit for this instance */
+	size_t avail_ram;	/* Total memory limit shared by all instances */
+	int ninst;			/* Number of instances sharing avail_ram */
+}; typedef struct _rev_stats rev_stats;
+
 /* ----------------------------------------- */
 /* Reverse info stored in main rspl function */
 struct _rev_struct {
@@ -375,6 +398,8 @@ struct _rev_struct {
 	int inited;			/* Non-zero if first section has been initialised */
 						/* All other sections depend on this. */
 	int fastsetup;		/* Flag - NZ if fast setup at cost of slow throughput */
+	int concur;			/* Flag - NZ if this may be used from a different thread to other */
+						/* instances (see dup()), so only its own lookups may trim its cache */
 
 	struct _rev_struct *next;	/* Linked list of instances sharing memory */
 	size_t max_sz;		/* Maximum size permitted */
@@ -422,6 +447,7 @@ struct _rev_struct {
 #ifdef STATS
 	stats st[5];	/* Set of stats info indexed by enum ops */
 #endif	/* STATS */
+	rev_stats cnt;		/* Always available counters */
 
 	int primsecwarn;	/* Not primary or secondary warning has been issued */
 
@@ -440,6 +466,9 @@ int sdi);					/* Sub-simplex dimensionality (range 0 - di) */
 void rspl_free_ssimplex_info(struct _rspl *s,
 ssxinfo *xip);		/* Pointer to sub-simplex info structure */
 
+/* Setup the reverse information of a dup() d of s */
+void rev_dup(struct _rspl *d, struct _rspl *s);
+
 #endif /* RSPL_REV_H */
 
 
@@ -90,10 +90,11 @@ float *in
 
 void usage(void) {
 	fprintf(stderr,"Benchmark rspl reverse, Version %s\n",ARGYLL_VERSION_STR);
-	fprintf(stderr,"usage: revbench [-f fwdres] [-r revres] [-v level] iccin iccout\n");
+	fprintf(stderr,"usage: revbench [-f fwdres] [-r revres] [-m MB] [-v level] iccin iccout\n");
 	fprintf(stderr," -v            Verbose\n");
 	fprintf(stderr," -f res        Set forward grid res\n");
 	fprintf(stderr," -r res        Set reverse test res\n");
+	fprintf(stderr," -m MB         Set reverse cache memory limit in Mbytes (1000000 bytes)\n");
 	exit(1);
 }
 
@@ -145,6 +146,11 @@ main(int argc, char *argv[]) {
 				if (na == NULL) usage();
 				rres = atoi(na);
 			}
+			else if (argv[fa][1] == 'm' || argv[fa][1] == 'M') {
+				fa = nfa;
+				if (na == NULL) usage();
+				rspl_set_rev_cache_max((size_t)(atof(na) * 1000000.0));
+			}
 			else 
 				usage();
 		} else
@@ -169,7 +175,6 @@ main(int argc, char *argv[]) {
 		int ops = 0;
 		double secs;
 		rpsh counter;
-		unsigned rcount;
 		int ii[10];
 		int f, rgres[MXDO];
 
@@ -205,15 +210,15 @@ main(int argc, char *argv[]) {
 		printf("Forward resolution %d\n",clutres);
 		printf("Reverse resolution %d\n",rres);
 
-#ifdef DOCHECK
-		if ((check = (char *)calloc(1, rcount)) == NULL)
-			error("Malloc of check array\n");
-#endif /* DOCHECK */
-
 		for (f = 0; f < FDI; f++)
 			rgres[f] = rres;
 
-		rcount = rpsh_init(&counter, FDI, (unsigned int *)rgres, ii);	/* Initialise counter */
+		rpsh_init(&counter, FDI, (unsigned int *)rgres, ii);	/* Initialise counter */
+
+#ifdef DOCHECK
+		if ((check = (char *)calloc(1, counter.count)) == NULL)
+			error("Malloc of check array\n");
+#endif /* DOCHECK */
 		
 		stime = clock();
 
@@ -287,8 +292,9 @@ main(int argc, char *argv[]) {
 		ttime = clock() - stime;
 		secs = (double)ttime/CLOCKS_PER_SEC;
 		printf("Done - %d ops in %f seconds, rate = %f ops/sec\n",ops, secs,ops/secs);
+		rss->rev_print_stats(rss, stdout);
 #ifdef DOCHECK
-		for (j = 0; j < rcount; j++) {
+		for (j = 0; j < counter.count; j++) {
 			if (check[j] != 1) {
 				printf("~~CHeck error at %d\n",j);
 			}
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <math.h>
 #include <time.h>
@@ -53,6 +54,7 @@
 /* Implemeted in this file: */
 rspl *new_rspl(int flags, int di, int fdi);
 static void free_rspl(rspl *s);
+static rspl *dup_rspl(rspl *s);
 static void init_grid(rspl *s);
 static void free_grid(rspl *s);
 static void get_in_range(rspl *s, double *min, double *max);
@@ -68,8 +70,13 @@ int is_mono(rspl *s);
 static int set_rspl(rspl *s, int flags, void *cbctx,
                         void (*func)(void *cbctx, double *out, double *in),
                         datai glow, datai ghigh, int gres[MXDI], datao vlow, datao vhigh);
+static int set_rspl_mt(rspl *s, int flags, int nctx, void **cbctxs,
+                        void (*func)(void *cbctx, double *out, double *in),
+                        datai glow, datai ghigh, int gres[MXDI], datao vlow, datao vhigh);
 static int re_set_rspl(struct _rspl *s, int flags, void *cbntx,
                         void (*func)(void *cbntx, double *out, double *in));
+static int re_set_rspl_mt(struct _rspl *s, int flags, int nctx, void **cbctxs,
+                        void (*func)(void *cbntx, double *out, double *in));
 static void scan_rspl(struct _rspl *s, int flags, void *cbntx,
                         void (*func)(void *cbntx, double *out, double *in));
 static int tune_value(struct _rspl *s, co *p);
@@ -83,6 +90,7 @@ extern void free_data(rspl *s);
 /* Implemented in rev.c: */
 void init_rev(rspl *s);
 void free_rev(rspl *s);
+void rev_dup(rspl *d, rspl *s);
 
 /* Implemented in gam.c: */
 void init_gam(rspl *s);
@@ -96,6 +104,9 @@ void free_spline(rspl *s);
 int opt_rspl_imp(struct _rspl *s, int flags, int tdi, int adi, double **vdata,
 	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
 	void *fdata, datai glow, datai ghigh, int gres[MXDI], datao vlow, datao vhigh);
+int opt_rspl_mt_imp(struct _rspl *s, int flags, int tdi, int adi, double **vdata,
+	double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
+	int nfdata, void **fdatas, datai glow, datai ghigh, int gres[MXDI], datao vlow, datao vhigh);
 
 
 /* Convention is to use:
@@ -163,6 +174,7 @@ new_rspl(
 
 	/* Set pointers to methods in this file */
 	s->del           = free_rspl;
+	s->dup           = dup_rspl;
 	s->interp        = interp_rspl_sx;	/* Default to simplex interp */
 #ifdef NEVER
 #define USING_INTERP_NL
@@ -173,8 +185,11 @@ printf("!!!! rspl.c using interp_rspl_nl !!!!");
 	s->set_rspl      = set_rspl;
 	s->scan_rspl     = scan_rspl;
 	s->re_set_rspl   = re_set_rspl;
+	s->set_rspl_mt   = set_rspl_mt;
+	s->re_set_rspl_mt = re_set_rspl_mt;
 	s->tune_value    = tune_value;
 	s->opt_rspl      = opt_rspl_imp;
+	s->opt_rspl_mt   = opt_rspl_mt_imp;
 	s->filter_rspl   = filter_rspl;
 	s->get_in_range  = get_in_range;
 	s->get_out_range = get_out_range;
@@ -195,8 +210,7 @@ static void free_rspl(rspl *s) {
 	free_rev(s);		/* Free any reverse lookup data */
 	free_gam(s);		/* Free any grid data */
 	free_grid(s);		/* Free any grid data */
-
-	/* Free spline interpolation data ~~~~ */
+	free_spline(s);		/* Free spline interpolation data */
 
 	/* Free structure */
 	for (e = 0; e < s->di; e++) {
@@ -210,6 +224,51 @@ static void free_rspl(rspl *s) {
 	free((void *) s);
 }
 
+/* Return a duplicate that shares the grid of s, */
+/* but has its own touch flags and reverse state. */
+static rspl *dup_rspl(rspl *s) {
+	rspl *d;
+	int *hi, *fhi;
+
+	if (s->spline.spline != 0)		/* Can't share grid tangent expansion */
+		return NULL;
+
+	d = new_rspl(RSPL_NOFLAGS, s->di, s->fdi);
+
+	d->debug   = s->debug;
+	d->verbose = s->verbose;
+	d->smooth  = s->smooth;
+	d->symdom  = s->symdom;
+	memcpy(d->avgdev, s->avgdev, sizeof(d->avgdev));
+
+	/* Data ranges are used to setup the reverse grid */
+	memcpy(d->d.vl, s->d.vl, sizeof(datao));
+	memcpy(d->d.vw, s->d.vw, sizeof(datao));
+	memcpy(d->d.va, s->d.va, sizeof(datao));
+
+	/* Copy the grid setup and point at the shared grid */
+	hi = d->g.hi;
+	fhi = d->g.fhi;
+	d->g = s->g;
+	d->g.hi = hi;
+	d->g.fhi = fhi;
+	memcpy(d->g.hi, s->g.hi, sizeof(int) * (1 << s->di));
+	memcpy(d->g.fhi, s->g.fhi, sizeof(int) * (1 << s->di));
+	memset(d->g.ipos, 0, sizeof(d->g.ipos));	/* Only used for fitting */
+	d->g.alloc = NULL;			/* Not ours to free */
+	d->g.touch = 0;
+	if ((d->g.tflags = (unsigned int *) calloc(s->g.no, sizeof(unsigned int))) == NULL)
+		error("rspl malloc failed - dup touch flags");
+	d->interp = s->interp;
+
+	if (s->spline.ncells > 0)
+		d->set_spline_lean(d, s->spline.ncells);
+
+	rev_dup(d, s);		/* Ink limit and reverse setup */
+
+	return d;
+}
+
 /* ======================================================== */
 /* Allocate rspl grid data, and initialise grid associated stuff */
 void
@@ -224,6 +283,11 @@ alloc_grid(rspl *s) {
 	fprintf(stderr,"rspl allocating grid res %s\n",icmPiv(di, s->g.res));
 #endif
 
+	if (s->g.tflags != NULL) {	/* No longer sharing a grid */
+		free(s->g.tflags);
+		s->g.tflags = NULL;
+	}
+
 	/* Compute total number of elements in the grid */
 	for (gno = 1, e = 0; e < di; gno *= s->g.res[e], e++)
 		;
@@ -279,6 +343,9 @@ alloc_grid(rspl *s) {
 		EC_INC(gc);
 	}
 	s->g.limitv_cached = 0;		/* No limit values are current cached */
+
+	s->spline.spline = 0;		/* New grid has no tangent information */
+	spline_grid_changed(s);
 }
 
 /* Init grid related elements of rspl */
@@ -292,6 +359,8 @@ static void
 free_grid(rspl *s) {
 	if (s->g.alloc != NULL)
 		free((void *)s->g.alloc);
+	if (s->g.tflags != NULL)
+		free(s->g.tflags);
 }
 
 /* ============================================ */
@@ -407,8 +476,12 @@ rspl *s
 	if ((tg = ++s->g.touch) == 0) {
 
 		/* We have to reset all the cell flags to zero before we roll over */
-		for (gp = s->g.a, ep = s->g.a + s->g.no * s->g.pss; gp < ep; gp += s->g.pss) {
-			TOUCHF(gp) = 0;
+		if (s->g.tflags != NULL) {
+			memset(s->g.tflags, 0, sizeof(unsigned int) * s->g.no);
+		} else {
+			for (gp = s->g.a, ep = s->g.a + s->g.no * s->g.pss; gp < ep; gp += s->g.pss) {
+				TOUCHF(gp) = 0;
+			}
 		}
 		tg = ++s->g.touch;		/* return 1 */
 	}
@@ -867,6 +940,213 @@ rspl *s
 }
 
 /* ============================================ */
+/* Set or scan the grid using a per grid point function. */
+/* To make use of multiple processors, the grid is partitioned */
+/* into jobs that are executed using pfor(). Each thread calls */
+/* func() with its own context from cbctxs[thread index]. */
+
+/* Context for set/scan grid jobs */
+typedef struct {
+	rspl *s;
+	void **cbctxs;		/* Per thread callback contexts */
+	void (*func)(void *cbctx, double *out, double *in);
+	int change;			/* 0 = scan, 1 = re-set from existing values, 2 = set */
+	float *cc;			/* RSPL_SET_APXLS cell center values, NULL if not used */
+	double cw;			/* RSPL_SET_APXLS weight for each cell corner */
+	int sdi;			/* Number of dimensions traversed within each job, */
+						/* the remaining dimensions are the job index. */
+	int cres[MXDI];		/* Node or cell resolution of each dimension */
+	int njobs;			/* Number of jobs */
+} setjob;
+
+/* Setup a job partition over the given resolution for nthr threads. */
+/* If nthr <= 1 the whole grid is a single job. */
+static void setjob_part(setjob *p, int *cres, int nthr) {
+	rspl *s = p->s;
+	int e;
+
+	for (e = 0; e < s->di; e++)
+		p->cres[e] = cres[e];
+	p->sdi = s->di;
+	p->njobs = 1;
+
+	/* Aim for a few jobs per thread, for load balancing */
+	if (nthr > 1) {
+		while (p->sdi > 0 && p->njobs < (4 * nthr)) {
+			p->sdi--;
+			p->njobs *= p->cres[p->sdi];
+		}
+	}
+}
+
+/* Set the starting coordinate of job ix */
+static void setjob_start(setjob *p, int ix, int *gc) {
+	int e;
+
+	for (e = 0; e < p->sdi; e++)
+		gc[e] = 0;
+	for (; e < p->s->di; e++) {
+		gc[e] = ix % p->cres[e];
+		ix /= p->cres[e];
+	}
+}
+
+/* Increment the coordinate within a job. Return nz when done */
+static int setjob_inc(setjob *p, int *gc) {
+	int e;
+
+	for (e = 0; e < p->sdi; e++) {
+		if (++gc[e] < p->cres[e])
+			return 0;
+		gc[e] = 0;
+	}
+	return 1;
+}
+
+/* Set or scan the grid points of one job using func() */
+static void setjob_func(void *cntx, int thix, int ix) {
+	setjob *p = (setjob *)cntx;
+	rspl *s = p->s;
+	void *cbctx = p->cbctxs[thix];
+	int e, f;
+	rpsh counter;		/* Pseudo-hilbert counter */
+	int gc[MXDI];		/* Grid index value */
+	float *gp;			/* Pointer to grid data */
+	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
+	double ov[MXDO];
+
+	setjob_start(p, ix, gc);
+
+	/* To make this clut function cache friendly, we use the pseudo-hilbert */
+	/* count sequence. This keeps each point close to the last in the */
+	/* multi-dimensional space. */
+	if (p->sdi > 0)
+		rpsh_init(&counter, p->sdi, (unsigned int *)p->cres, gc);	/* Initialise counter */
+	for (;;) {
+
+		/* Compute grid pointer and input sample values */
+		gp = s->g.a;	/* Base of grid data */
+		for (e = 0; e < s->di; e++) { 				/* Input tables */
+			gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
+			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
+			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
+		}
+
+		/* Give the function the existing output values */
+		if (p->change < 2) {
+			for (f = 0; f < s->fdi; f++) 	/* Output chans */
+				ov[f] = gp[f];
+		}
+
+		/* Let function scan the input and output values, or */
+		/* Apply incolor -> outcolor, or oldoutcolor->outcolor function we want to represent */
+		p->func(cbctx, ov, iv);
+
+		if (p->change) {		/* Put new output values back */
+			for (f = 0; f < s->fdi; f++) 	/* Output chans */
+				gp[f] = (float)ov[f];
+		}
+
+		/* For RSPL_SET_APXLS, get the center of the cell values as well. */
+		if (p->cc != NULL) {
+			float *ccp;
+
+			ccp = p->cc;
+			for (e = 0; e < s->di; e++) { 				/* Input tables */
+				if (gc[e] >=  (s->g.res[e]-1))
+					break;								/* No center for outer row */
+				iv[e] = s->g.l[e] + (gc[e] + 0.5) * s->g.w[e];	/* Input sample values */
+				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
+			}
+
+			if (e >= s->di) {			/* Not outer row */
+				/* Apply incolor -> outcolor function we want to represent */
+				p->func(cbctx, ov, iv);
+
+				for (f = 0; f < s->fdi; f++) { 	/* Output chans */
+					ccp[f] = (float)ov[f];		/* Set output value */
+				}
+			}
+		}
+
+		/* Increment counter */
+		if (p->sdi <= 0 || rpsh_inc(&counter, gc))
+			break;
+	}
+}
+
+/* RSPL_SET_APXLS: compute the linear interpolated error to the actual */
+/* cell center values for one job of cells. */
+static void setjob_apxls_err(void *cntx, int thix, int ix) {
+	setjob *p = (setjob *)cntx;
+	rspl *s = p->s;
+	int e, f, j;
+	int gc[MXDI];		/* Cell index value */
+	float *gp;			/* Pointer to grid data */
+	float *ccp;			/* Pointer to cell center data */
+
+	setjob_start(p, ix, gc);
+	do {
+		gp = s->g.a;	/* Base of grid data */
+		ccp = p->cc;	/* Base of center data */
+		for (e = 0; e < s->di; e++) { 				/* Input tables */
+			gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
+			ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
+		}
+
+		for (f = 0; f < s->fdi; f++) { 	/* Output chans */
+			double sum = 0.0;
+
+			for (j = 0; j < (1 << s->di); j++) /* For corners of cube */
+				sum += (gp + s->g.fhi[j])[f];
+			sum *= p->cw;			/* Interpolated value */
+			ccp[f] -= sum;		/* Correction to actual value */
+
+			/* Average half the error to cube corners */
+			ccp[f] *= 0.5 * p->cw;	/* Distribution fraction */
+		}
+	} while (setjob_inc(p, gc) == 0);
+}
+
+/* RSPL_SET_APXLS: add the center error of the surrounding cells */
+/* to each grid node of one job. */
+/* Don't distribute error to edge nodes since there may */
+/* an expectation that they have precicely set values */
+/* (ie. white and black points) */
+static void setjob_apxls_dist(void *cntx, int thix, int ix) {
+	setjob *p = (setjob *)cntx;
+	rspl *s = p->s;
+	int e, f, j;
+	int gc[MXDI];		/* Grid index value */
+	float *gp;			/* Pointer to grid data */
+	float *ccp;			/* Pointer to cell center data */
+
+	setjob_start(p, ix, gc);
+	do {
+		for (e = 0; e < s->di; e++) {
+			if (gc[e] == 0 || gc[e] >= (s->g.res[e]-1))
+				break;
+		}
+		if (e < s->di)		/* Edge node */
+			continue;
+
+		gp = s->g.a;	/* Base of grid data */
+		ccp = p->cc;	/* Base of center data */
+		for (e = 0; e < s->di; e++) { 				/* Input tables */
+			gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
+			ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
+		}
+
+		/* The node is corner j of the cell at -j */
+		for (j = 0; j < (1 << s->di); j++) {
+			float *cp = ccp - s->g.hi[j] * s->fdi;
+
+			for (f = 0; f < s->fdi; f++) 		/* Output chans */
+				gp[f] += cp[f];
+		}
+	} while (setjob_inc(p, gc) == 0);
+}
+
 /* Initialize the grid from a provided function. By default the grid */
 /* values are set to exactly the value returned by func(), unless the */
 /* RSPL_SET_APXLS flag is set, in which case an attempt is made to have */
@@ -876,11 +1156,13 @@ rspl *s
 /* Grid index values are supplied "under" in[] at *((int*)&iv[-e-1]), */
 /* but if RSPL_SET_APXLS is set, the grid index will be the base of */
 /* the cell the center point is sampled from every second sample. */
+/* Up to nctx threads are used, func() being called with cbctxs[thread index]. */
 /* Return non-monotonic status */
-static int set_rspl(
+static int set_rspl_imp(
 	struct _rspl *s,/* this */
 	int flags,		/* Combination of flags */
-	void *cbctx,	/* Opaque function context */
+	int nctx,		/* Number of callback contexts */
+	void **cbctxs,	/* Per thread opaque function contexts */
 	void (*func)(void *cbctx, double *out, double *in),		/* Function to set from */
 	datai glow,		/* Grid low scale - will expand to enclose data, NULL = default 0.0 */
 	datai ghigh,	/* Grid high scale - will expand to enclose data, NULL = default 1.0 */
@@ -888,13 +1170,10 @@ static int set_rspl(
 	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
 	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
 ) {
-	int e, f, j;
-	rpsh counter;		/* Pseudo-hilbert counter */
-	int gc[MXDI];		/* Grid index value */
-	float *gp;			/* Pointer to grid data */
-	float *cc = NULL;			/* Pointer to cell center data */
-	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
-	double ov[MXDO];
+	int e, f;
+	int nthr;			/* Number of threads to use */
+	int cres[MXDI];		/* Cell resolution */
+	setjob job;
 
 	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
 		s->verbose = 1;
@@ -948,272 +1227,133 @@ static int set_rspl(
 	/* Allocate the grid data */
 	alloc_grid(s);
 
+	job.s = s;
+	job.cbctxs = cbctxs;
+	job.func = func;
+	job.change = 2;
+	job.cc = NULL;
+	job.cw = 1.0/(double)(1 << s->di);		/* Weight for each cube corner */
+
 	/* Allocate space for cell center value lookup */
 	if (flags & RSPL_SET_APXLS) {
-		if ((cc = (float *)malloc(sizeof(float) * s->g.no * s->fdi)) == NULL)
+		if ((job.cc = (float *)malloc(sizeof(float) * s->g.no * s->fdi)) == NULL)
 			error("rspl malloc failed - center cell points");
 	}
 
-	/* Reset output min/max */
-	for (f = 0; f < s->fdi; f++) {
-		s->g.fmin[f] = 1e30;
-		s->g.fmax[f] = -1e30;
-		s->g.fminx[f] = -1;
-		s->g.fmaxx[f] = -1;
-	}
+	nthr = pfor_nthreads();
+	if (nctx < nthr)
+		nthr = nctx;
 
 	/* Set the grid points value from the provided function */
-
-	/* To make this clut function cache friendly, we use the pseudo-hilbert */
-	/* count sequence. This keeps each point close to the last in the */
-	/* multi-dimensional space. */ 
-	rpsh_init(&counter, s->di, (unsigned int *)gres, gc);	/* Initialise counter */
-	for (;;) {
-
-		/* Compute grid pointer and input sample values */
-		gp = s->g.a;	/* Base of grid data */
-		for (e = 0; e < s->di; e++) { 				/* Input tables */
-			gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
-			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
-			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
-		}
-
-		/* Apply incolor -> outcolor function we want to represent */
-		func(cbctx, ov, iv);
-
-		for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-			gp[f] = (float)ov[f];		/* Set output value */
-			if (s->g.fmin[f] > gp[f]) {
-				 s->g.fmin[f] = gp[f];
-				 s->g.fminx[f] = (gp - s->g.a)/s->g.pss;
-			}
-			if (s->g.fmax[f] < gp[f]) {
-				 s->g.fmax[f] = gp[f];
-				 s->g.fmaxx[f] = (gp - s->g.a)/s->g.pss;
-			}
-		}
-
-		/* For RSPL_SET_APXLS, get the center of the cell values as well. */
-		if (cc != NULL) {
-			float *ccp;
-
-			ccp = cc;
-			for (e = 0; e < s->di; e++) { 				/* Input tables */
-				if (gc[e] >=  (gres[e]-1))
-					break;								/* No center for outer row */
-				iv[e] = s->g.l[e] + (gc[e] + 0.5) * s->g.w[e];	/* Input sample values */
-				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
-			}
-	
-			if (e >= s->di) {			/* Not outer row */
-				/* Apply incolor -> outcolor function we want to represent */
-				func(cbctx, ov, iv);
-	
-				for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-					ccp[f] = (float)ov[f];		/* Set output value */
-				}
-			}
-		}
-
-		/* Increment counter */
-		if (rpsh_inc(&counter, gc))
-			break;
-	}
+	setjob_part(&job, s->g.res, nthr);
+	pfor(job.njobs, nthr, (void *)&job, setjob_func);
 
 	/* For RSPL_SET_APXLS, deal with cell center value, aproximate least squares adjustment */
-	if (cc != NULL) {
-		int ee;
-		double cw = 1.0/(double)(1 << s->di);		/* Weight for each cube corner */
-		float *ccp;
-
-		for (e = 0; e < s->di; e++)
-			gc[e] = 0;	/* init coords */
+	if (job.cc != NULL) {
 
 		/* Compute linear interpolated error to actual cell center value */
-		for (ee = 0; ee < s->di;) {
-
-			gp = s->g.a;	/* Base of grid data */
-			ccp = cc;		/* Base of center data */
-			for (e = 0; e < s->di; e++) { 				/* Input tables */
-				gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
-				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
-			}
-
-			for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-				double sum = 0.0;
-		
-				for (j = 0; j < (1 << s->di); j++) /* For corners of cube */
-					sum += (gp + s->g.fhi[j])[f];
-				sum *= cw;			/* Interpolated value */
-				ccp[f] -= sum;		/* Correction to actual value */
-
-				/* Average half the error to cube corners */
-				ccp[f] *= 0.5 * cw;	/* Distribution fraction */
-			}
-
-			/* Increment coord */
-			for (ee = 0; ee < s->di; ee++) {
-				if (++gc[ee] < (gres[ee]-1))		/* Don't go through upper edge */
-					break;	/* No carry */
-				gc[ee] = 0;
-			}
-		}
-		
 		for (e = 0; e < s->di; e++)
-			gc[e] = 0;	/* init coords */
+			cres[e] = s->g.res[e]-1;		/* Don't go through upper edge */
+		setjob_part(&job, cres, pfor_nthreads());
+		pfor(job.njobs, 0, (void *)&job, setjob_apxls_err);
 
 		/* Distribute the center error to the cell corners */
-		for (ee = 0; ee < s->di;) {
-
-			gp = s->g.a;	/* Base of grid data */
-			ccp = cc;		/* Base of center data */
-			for (e = 0; e < s->di; e++) { 				/* Input tables */
-				gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
-				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
-			}
-
-			for (j = 0; j < (1 << s->di); j++) { /* For corners of cube */
-				double sc = 1.0;		/* Scale factor for non-edge nodes */
-
-				/* Don't distribute error to edge nodes since there may */
-				/* an expectation that they have precicely set values */
-				/* (ie. white and black points) */
-				for (e = 0; e < s->di; e++) {
-					if ((gc[e] == 0 && (j & (1 << e)) == 0)
-					 || (gc[e] == ((gres[e]-2)) && (j & (1 << e)) != 0))
-						sc *= 0.0;
-				}
-
-				for (f = 0; f < s->fdi; f++) { 		/* Output chans */
-					double vv;
-					vv = (gp + s->g.fhi[j])[f];		/* Current value */
-					vv += sc * cc[f];				/* Correction */
-					(gp + s->g.fhi[j])[f] = vv;
-					if (s->g.fmin[f] > vv) {
-						s->g.fmin[f] = vv;
-						s->g.fminx[f] = (gp + s->g.fhi[j] - s->g.a)/s->g.pss;
-					}
-					if (s->g.fmax[f] < vv) {
-						s->g.fmax[f] = vv;
-						s->g.fmaxx[f] = (gp + s->g.fhi[j] - s->g.a)/s->g.pss;
-					}
-				}
-			}
-
-			/* Increment coord */
-			for (ee = 0; ee < s->di; ee++) {
-				if (++gc[ee] < (gres[ee]-1))		/* Don't go through upper edge */
-					break;	/* No carry */
-				gc[ee] = 0;
-			}
-		}
+		setjob_part(&job, s->g.res, pfor_nthreads());
+		pfor(job.njobs, 0, (void *)&job, setjob_apxls_dist);
 
-		free((void *)cc);
+		free((void *)job.cc);
 	}
 
-	/* Compute overall output scale */
-	for (s->g.fscale = 0.0, f = 0; f < s->fdi; f++) {
-		double tt = s->g.fmax[f] - s->g.fmin[f];
-		s->g.fscale += tt * tt;
-	}
-	s->g.fscale = sqrt(s->g.fscale);
-
-	s->g.fminmax_valid = 1;		/* Now is valid */
+	/* Compute output min/max and overall output scale */
+	s->g.fminmax_valid = 0;
+	get_out_range(s, NULL, NULL);
 
 	/* Return non-mono check */
 	return is_mono(s);
 }
 
+/* Initialize the grid from a provided function. */
+/* (See set_rspl_imp() above for details) */
+/* Return non-monotonic status */
+static int set_rspl(
+	struct _rspl *s,/* this */
+	int flags,		/* Combination of flags */
+	void *cbctx,	/* Opaque function context */
+	void (*func)(void *cbctx, double *out, double *in),		/* Function to set from */
+	datai glow,		/* Grid low scale - will expand to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will expand to enclose data, NULL = default 1.0 */
+	int gres[MXDI],	/* Spline grid resolution for each dimension */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+) {
+	return set_rspl_imp(s, flags, 1, &cbctx, func, glow, ghigh, gres, vlow, vhigh);
+}
+
+/* Initialize the grid from a provided function using multiple threads. */
+/* (See set_rspl_imp() above for details) */
+/* Return non-monotonic status */
+static int set_rspl_mt(
+	struct _rspl *s,/* this */
+	int flags,		/* Combination of flags */
+	int nctx,		/* Number of callback contexts */
+	void **cbctxs,	/* Per thread opaque function contexts */
+	void (*func)(void *cbctx, double *out, double *in),		/* Function to set from */
+	datai glow,		/* Grid low scale - will expand to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will expand to enclose data, NULL = default 1.0 */
+	int gres[MXDI],	/* Spline grid resolution for each dimension */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+) {
+	if (nctx < 1 || cbctxs == NULL)
+		error("rspl: set_rspl_mt needs at least one callback context");
+	return set_rspl_imp(s, flags, nctx, cbctxs, func, glow, ghigh, gres, vlow, vhigh);
+}
+
 /* ============================================ */
 /* Scan or change each grid point in the rspl. */
+/* Up to nctx threads are used, func() being called with cbctxs[thread index]. */
 static int scan_set_rspl(
 struct _rspl *s,	/* this */
 int flags,		/* Combination of flags */
-void *cbctx,	/* Opaque function context */
+int nctx,		/* Number of callback contexts */
+void **cbctxs,	/* Per thread opaque function contexts */
 void (*func)(void *cbntx, double *out, double *in), /* Function to get/set from */
 int change		/* Flag - nz means change values, 0 means scan values */
 ) {
-	int e, f;
-	rpsh counter;		/* Pseudo-hilbert counter */
-	int gc[MXDI];		/* Grid index value */
-	float *gp;			/* Pointer to grid data */
-	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
-	double ov[MXDO];
+	int nthr;			/* Number of threads to use */
+	setjob job;
 
 	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
 		s->verbose = 1;
 	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
 		s->verbose = 0;
 
-	if (change) {
-		/* Reset output min/max */
-		for (f = 0; f < s->fdi; f++) {
-			s->g.fmin[f] = 1e30;
-			s->g.fmax[f] = -1e30;
-			s->g.fminx[f] = -1;
-			s->g.fmaxx[f] = -1;
-		}
-	}
+	nthr = pfor_nthreads();
+	if (nctx < nthr)
+		nthr = nctx;
 
 	/* Set the grid points value from the provided function */
 	/* Give the function both the grid position and the existing output values */
-
-	/* To make this clut function cache friendly, we use the pseudo-hilbert */
-	/* count sequence. This keeps each point close to the last in the */
-	/* multi-dimensional space. */ 
-	rpsh_init(&counter, s->di, (unsigned int *)s->g.res, gc);	/* Initialise counter */
-	for (;;) {
-
-		/* Compute grid pointer and input sample values */
-		gp = s->g.a;	/* Base of grid data */
-		for (e = 0; e < s->di; e++) { 				/* Input tables */
-			gp += s->g.fci[e] * gc[e];				/* Grid value pointer */
-			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
-			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
-		}
-
-		for (f = 0; f < s->fdi; f++) 	/* Output chans */
-			ov[f] = gp[f];
-
-		/* Let function scan the input and output values, or */
-		/* Apply incolor -> outcolor, or oldoutcolor->outcolor function we want to represent */
-		func(cbctx, ov, iv);
-
-		if (change) {		/* Put new output values back */
-			for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-				gp[f] = (float)ov[f];
-				if (s->g.fmin[f] > gp[f]) {
-					 s->g.fmin[f] = gp[f];
-					 s->g.fminx[f] = (gp - s->g.a)/s->g.pss;
-				}
-				if (s->g.fmax[f] < gp[f]) {
-					 s->g.fmax[f] = gp[f];
-					 s->g.fmaxx[f] = (gp - s->g.a)/s->g.pss;
-				}
-			}
-		}
-
-		/* Increment counter */
-		if (rpsh_inc(&counter, gc))
-			break;
-	}
+	job.s = s;
+	job.cbctxs = cbctxs;
+	job.func = func;
+	job.change = change ? 1 : 0;
+	job.cc = NULL;
+	setjob_part(&job, s->g.res, nthr);
+	pfor(job.njobs, nthr, (void *)&job, setjob_func);
 
 	if (change == 0) {
 		return 0;
 	}
 
-	/* Compute overall output scale */
-	for (s->g.fscale = 0.0, f = 0; f < s->fdi; f++) {
-		double tt = s->g.fmax[f] - s->g.fmin[f];
-		s->g.fscale += tt * tt;
-	}
-	s->g.fscale = sqrt(s->g.fscale);
-
-	s->g.fminmax_valid = 1;		/* Now is valid */
+	/* Compute output min/max and overall output scale */
+	s->g.fminmax_valid = 0;
+	get_out_range(s, NULL, NULL);
 
 	/* Invalidate various things */
 	free_data(s);		/* Free any scattered data */
 	free_rev(s);		/* Free any reverse lookup data */
+	spline_grid_changed(s);
 
 	/* Return non-mono check */
 	return is_mono(s);
@@ -1228,7 +1368,21 @@ int flags,		/* Combination of flags */
 void *cbctx,	/* Opaque function context */
 void (*func)(void *cbntx, double *out, double *in) /* Function to set from */
 ) {
-	return scan_set_rspl(s, flags, cbctx, func, 1);
+	return scan_set_rspl(s, flags, 1, &cbctx, func, 1);
+}
+
+/* Multi-threaded version of re_set_rspl(). func() is called with */
+/* the context cbctxs[thread index], using up to nctx threads. */
+static int re_set_rspl_mt(
+struct _rspl *s,	/* this */
+int flags,		/* Combination of flags */
+int nctx,		/* Number of callback contexts */
+void **cbctxs,	/* Per thread opaque function contexts */
+void (*func)(void *cbntx, double *out, double *in) /* Function to set from */
+) {
+	if (nctx < 1 || cbctxs == NULL)
+		error("rspl: re_set_rspl_mt needs at least one callback context");
+	return scan_set_rspl(s, flags, nctx, cbctxs, func, 1);
 }
 
 /* Scan the rspl grid point locations and values. Grid index values are */
@@ -1239,7 +1393,7 @@ int flags,		/* Combination of flags */
 void *cbctx,	/* Opaque function context */
 void (*func)(void *cbntx, double *out, double *in) /* Function to get from */
 ) {
-	scan_set_rspl(s, flags, cbctx, func, 0);
+	scan_set_rspl(s, flags, 1, &cbctx, func, 0);
 }
 
 
@@ -1387,6 +1541,7 @@ co *p							/* Target value */
 			}
 		}
 	}
+	spline_grid_changed(s);
 	return rv;
 }
 
@@ -1527,6 +1682,7 @@ void (*func)(void *cbntx, float **out, double *in, int cvi) /* Function to set f
 	/* Invalidate various things */
 	free_data(s);		/* Free any scattered data */
 	free_rev(s);		/* Free any reverse lookup data */
+	spline_grid_changed(s);
 }
 
 
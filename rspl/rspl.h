@@ -35,7 +35,14 @@
 # define MXDIDO MXDO
 #endif
 
-/* RESTRICTED SIZE Limits, used for reverse, spline and scattered interpolation */
+/* RESTRICTED SIZE Limits, used for reverse, spline and scattered interpolation. */
+/* (The fit_rspl methods fall back to a sparse multilevel B-spline */
+/*  fit for inputs beyond MXRI, up to MXDI, that is then used to set */
+/*  the usual dense grid, so only modest resolutions are practical. */
+/*  The smooth, avgdev, ipos and weak default function arguments and */
+/*  the RSPL_AUTOSMOOTH and RSPL_SYMDOMAIN flags aren't supported by */
+/*  this fit and are a fatal error. Reverse interpolation is still */
+/*  limited to MXRI inputs.) */
 
 #define MXRI 4			/* Maximum input dimensionality */
 #define MXRO 10			/* Maximum output dimensionality (Is not fully tested!!!) */
@@ -103,6 +110,13 @@ typedef struct {
 	float wgt;
 } magic_data;
 
+/* Lean Hermite interpolation cell cache entry */
+typedef struct {
+	int ix;			/* Cube base grid offset in floats, -1 if unused */
+	unsigned int lu;	/* Last used stamp */
+	float *t;		/* Tangency info [2^di corners][2^di di combs.][fdi] */
+} spline_cell;
+
 #include "rev.h"			/* Reverse interpolation defintions */
 #include "gam.h"			/* Gamut defintions */
 
@@ -111,7 +125,7 @@ typedef struct {
 	int niters;		/* Number of multigrid itterations needed */
 	int **ires; 	/* Resolution for each itteration and dimension */
 	void **mgtmps[MXRO]; /* Store pointers to re-usable mgtmp when incremental */
-					/* (These don't seem to be used anymore. was incremental removed ?) */
+					/* (Not used - see refit_rspl() for incremental re-fitting) */
 } it_info;
 
 /* Structure for final resolution multi-dimensional regularized spline data */
@@ -202,6 +216,10 @@ struct _rspl {
 		/* Macro to access touched flag. Arguments are a pointer to base grid point. */
 #define TOUCHF(fp) (*((unsigned int *)((fp)-3)))
 
+		/* Touched flag of grid point ix with base pointer fp, */
+		/* allowing for the private flags of a dup(). */
+#define TOUCHFI(s, fp, ix) (*((s)->g.tflags != NULL ? &(s)->g.tflags[ix] : &TOUCHF(fp)))
+
 		/* Grid array offset lookups - in floats */
 		int ci[MXDI];		/* Grid coordinate increments for each dimension */
 		int fci[MXDI];		/* Grid coordinate increments for each dimension in floats */
@@ -212,6 +230,8 @@ struct _rspl {
 		int a_fhi[DEF2MXDI];/* Default allocation for *hi */
 
 		unsigned int touch;	/* Cell touched flag count */
+		unsigned int *tflags;	/* If not NULL, touched flags [no] used instead of TOUCHF(), */
+							/* because g.a is shared with another rspl (see dup()) */
 	} g;
 
 
@@ -228,6 +248,9 @@ struct _rspl {
 		int spline;		/* Non-zero if spline data is present in g.a */
 						/* Changes from float g.a[res ^ di][fdi+G_XTRA], offset by G_XTRA, */
 						/* to float g.a[res ^ di][(2^di * fdi)+G_XTRA], offset by G_XTRA, */
+		int ncells;		/* Non-zero if lean, number of entries in cells[] */
+		spline_cell *cells;	/* Lean mode cache of cell tangency info */
+		unsigned int stamp;	/* Last used stamp counter */
 	} spline;
 
 	/* Gamut support */
@@ -241,6 +264,17 @@ struct _rspl {
 	/* Free ourselves */
 	void (*del)(struct _rspl *ss);
 
+	/* Return a duplicate that shares this rspl's grid, so that the two can */
+	/* do lookups (including reverse lookups) from different threads at once. */
+	/* The duplicate has its own reverse lookup cache and search state, */
+	/* and the same ink limit. Any ink limit values are computed, and any */
+	/* compact grid is converted to float, before duplicating. Valid reverse */
+	/* acceleration structures are shared rather than re-computed. */
+	/* Neither rspl should be re-set, re-limited or splined while the */
+	/* duplicate exists, and the duplicate must be deleted first. */
+	/* Return NULL if the grid has been expanded by spline interpolation. */
+	struct _rspl *(*dup)(struct _rspl *ss);
+
 	/* Combination lags used by various functions */
 #define RSPL_NOFLAGS      0x0000
 #define RSPL_AUTOSMOOTH   0x0001	/* Automatically determin local optimal avgdev smoothing */
@@ -318,6 +352,8 @@ struct _rspl {
 
 	/* Initialise from scattered data, with weak default function. */
 	/* RESTRICTED SIZE */
+	/* The output planes are fitted in parallel, so func() may be called */
+	/* from several threads at once, and must be re-entrant. */
 	/* Return non-zero if result is non-monotonic */
 	int
 	(*fit_rspl_df)(
@@ -344,6 +380,8 @@ struct _rspl {
 
 	/* Initialise from scattered data, with per point weighting and weak default function. */
 	/* RESTRICTED SIZE */
+	/* The output planes are fitted in parallel, so func() may be called */
+	/* from several threads at once, and must be re-entrant. */
 	/* Return non-zero if result is non-monotonic */
 	int
 	(*fit_rspl_w_df)(
@@ -368,6 +406,31 @@ struct _rspl {
 		void (*func)(void *cbntx, double *out, double *in)		/* Function to set from */
 	);
 
+	/* Add to or replace the scattered data points of an rspl that has been */
+	/* initialised by one of the fit_rspl methods, and re-fit starting from */
+	/* the current grid values. Only the final resolution is solved, so this */
+	/* is much faster than a complete fit when only a few points change. */
+	/* A point with exactly the same position as an existing point replaces it. */
+	/* The points must lie within the existing grid range. RESTRICTED SIZE */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*refit_rspl)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		co *d,			/* Array holding position and function values of data points */
+		int ndp			/* Number of data points */
+	);
+
+	/* Same as refit_rspl, with per point weighting. RESTRICTED SIZE */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*refit_rspl_w)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		cow *d,			/* Array holding position, function and weight values of data points */
+		int ndp			/* Number of data points */
+	);
+
 	/* Initialize the grid from a provided function. By default the grid */
 	/* values are set to exactly the value returned by func(), unless the */
 	/* RSPL_SET_APXLS flag is set, in which case an attempt is made to have */
@@ -401,6 +464,35 @@ struct _rspl {
 		void (*func)(void *cbntx, double *out, double *in) /* Function to set from */
 	);
 
+	/* Multi-threaded versions of set_rspl() and re_set_rspl(). */
+	/* The grid is partitioned into slabs that are set by up to nctx */
+	/* threads, func() being called with the context cbctxs[thread index]. */
+	/* func() must therefore be safe to call from several threads at once */
+	/* as long as each uses its own context. The number of threads used */
+	/* is also limited by pfor_nthreads() (see ARGYLL_NTHREADS). */
+	int
+	(*set_rspl_mt)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		int nctx,		/* Number of callback contexts, >= 1 */
+		void **cbctxs,	/* Per thread opaque function contexts */
+		void (*func)(void *cbntx, double *out, double *in),		/* Function to set from */
+		datai glow,		/* Grid low scale - will expand to enclose data, NULL = default 0.0 */
+		datai ghigh,	/* Grid high scale - will expand to enclose data, NULL = default 1.0 */
+		int gres[MXDI],	/* Spline grid resolution */
+		datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+		datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+	);
+
+	int
+	(*re_set_rspl_mt)(
+		struct _rspl *s,/* this */
+		int flags,		/* Combination of flags (not used) */
+		int nctx,		/* Number of callback contexts, >= 1 */
+		void **cbctxs,	/* Per thread opaque function contexts */
+		void (*func)(void *cbntx, double *out, double *in) /* Function to set from */
+	);
+
 	/* Scan the rspl grid point locations and values. Grid index values are */
 	/* supplied "under" in[] at *((int*)&iv[-e-1]) */
 	/* Return non-monotonic status. */
@@ -437,6 +529,28 @@ struct _rspl {
 		datao vhigh		/* Data value high normalize - NULL = default 1.0 */
 	);
 
+	/* Multi-threaded version of opt_rspl(). Points that don't share */
+	/* surrounders are optimised in parallel by up to nfdata threads, */
+	/* func() being called with fdatas[thread index]. The result is */
+	/* the same for any number of threads. */
+	int (*opt_rspl_mt)(
+		struct _rspl *s,/* this */
+		int flags,		/* Combination of flags */
+		int tdi,		/* Dimensionality of target data */
+		int adi,		/* Additional grid point data allowance */
+		double **vdata,	/* di^2 array of function, target and additional values to init */
+						/* array corners with. */
+		double (*func)(void *fdata, double *inout, double *surav, int first, double *cw),
+						/* Optimisation function */
+		int nfdata,		/* Number of per thread function contexts, >= 1 */
+		void **fdatas,	/* Opaque data needed by function for each thread */
+		datai glow,		/* Grid low scale - NULL = default 0.0 */
+		datai ghigh,	/* Grid high scale - NULL = default 1.0 */
+		int gres[MXDI],	/* Spline grid resolution */
+		datao vlow,		/* Data value low normalize - NULL = default 0.0 */
+		datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+	);
+
 	/* Filter the existing values using the surrounding 3x3 cells. */
 	/* Grid index values are supplied "under" in[] */
 	void
@@ -474,6 +588,16 @@ struct _rspl {
 		struct _rspl *s,	/* this */
 		co *p);				/* Input and output values */
 
+	/* Make spline_interp() compute the tangents of each cell it uses, */
+	/* keeping the last ncells in a cache, rather than expanding every */
+	/* grid point to 2^di * fdi values. ncells <= 0 restores the default. */
+	/* The cell cache is updated by spline_interp(), so a lean rspl */
+	/* must not be shared between threads - use dup() for each thread. */
+	/* Return nz if the grid has already been expanded. */
+	int (*set_spline_lean)(
+		struct _rspl *s,	/* this */
+		int ncells);		/* Number of cells to cache */
+
 
 	/* ------------------------------- */
 	/* Create a surface gamut representation. */
@@ -488,6 +612,20 @@ struct _rspl {
 		void *cntxb						/* Context for function */
 	);
 
+	/* Same as comp_gamut, but the grid surface vertex values are computed in */
+	/* parallel by up to nctxf threads, with outf() called with cntxfs[thread index]. */
+	/* Return NZ on error */
+	int (*comp_gamut_mt)(struct _rspl *s,
+		double *cent,		/* Optional center of gamut [fdi], default center of out range */
+		double *scale,		/* Optional Scale of output values in vector to center [fdi] */
+							/*               default 1.0 */
+		void (*outf)(void *cntxf, double *out, double *in),	/* Optional rspl val -> output value */
+		int nctxf,						/* Number of per thread contexts for function, >= 1 */
+		void **cntxfs,					/* Per thread contexts for function */
+		void (*outb)(void *cntxb, double *out, double *in),	/* Optional output value -> rspl val */
+		void *cntxb						/* Context for function */
+	);
+
 	/* ------------------------------- */
 
 	/* Set the ink limit information for any reverse interpolation. */
@@ -539,6 +677,21 @@ struct _rspl {
 							/* input space solutions in cpp[0..retval-1].p[], and */
 							/* (possibly) clipped target values in cpp[0].v[] */
 
+	/* Do reverse interpolation of a set of targets. This has the same effect as calling */
+	/* rev_interp() for each target, but orders the searches for locality in the output */
+	/* space, improving cache use and the re-use of previous solution cells. */
+	/* Target i is given and its solutions returned in cpp[i * mxsoln .. i * mxsoln + mxsoln-1] */
+	/* and its rev_interp() return value is returned in rvs[i]. RESTRICTED SIZE */
+	void (*rev_interp_n)(
+		struct _rspl *s,	/* this */
+		int flags,			/* Hint flag */
+		int mxsoln,			/* Maximum number of solutions allowed for each target */
+		int *auxm,			/* Array of di mask flags, !=0 for valid auxliaries (NULL if no aux) */
+		double (*cdir)[MXRO],	/* Array of npts clip vectors - NULL if not used */
+		int npts,			/* Number of targets */
+		co *cpp,			/* Array of npts * mxsoln targets and solutions */
+		int *rvs);			/* Return array of npts rev_interp() return values */
+
 	/* Do reverse search for the locus of the auxiliary input values given a target output. */
 	/* Return 1 on finding a valid solution, and 0 if no solutions are found. RESTRICTED SIZE */
 	int (*rev_locus)(
@@ -561,6 +714,40 @@ struct _rspl {
 		double max[][MXRI]	/* Array of max[MXRI] to hold return segment maximum values. */
 	);
 
+	/* Save the reverse lookup acceleration structures to a file, */
+	/* creating them if they haven't been created yet. The file is */
+	/* keyed by a hash of the grid values and ink limit settings. */
+	/* Return nz on error. RESTRICTED SIZE */
+	int (*rev_save_accel)(
+		struct _rspl *s,	/* this */
+		char *fname);		/* File name to save to */
+
+	/* Load the reverse lookup acceleration structures from a file */
+	/* created by rev_save_accel(), so that they don't need to be re-computed. */
+	/* Return nz if the file can't be read or doesn't match the current */
+	/* grid and ink limit settings. Any ink limit should be set before calling this. */
+	/* (If the environment variable ARGYLL_REV_ACC_CACHE_DIR is set, this */
+	/*  is done automatically using a file in that directory.) RESTRICTED SIZE */
+	int (*rev_load_accel)(
+		struct _rspl *s,	/* this */
+		char *fname);		/* File name to load from */
+
+	/* Return a copy of the reverse cache counters and memory usage. */
+	void (*rev_get_stats)(
+		struct _rspl *s,	/* this */
+		rev_stats *st);		/* Return the counters */
+
+	/* Reset the reverse cache counters */
+	void (*rev_reset_stats)(
+		struct _rspl *s);	/* this */
+
+	/* Print the reverse cache counters and memory usage. */
+	/* (If the environment variable ARGYLL_REV_CACHE_STATS is set, */
+	/*  this is done automatically to stdout when the rspl is deleted.) */
+	void (*rev_print_stats)(
+		struct _rspl *s,	/* this */
+		FILE *fp);			/* Where to print to */
+
 
 	/* ------------------------------- */
 
@@ -597,6 +784,15 @@ struct _rspl {
 /* Create a new, empty rspl object */
 rspl *new_rspl(int flags, int di, int fdi);	/* Input and output dimentiality */
 
+/* Set the maximum total memory to be used by all rspl reverse caches, */
+/* overriding the default proportion of system RAM (and ARGYLL_REV_CACHE_MULT). */
+/* maxsz = 0 restores the default. The ARGYLL_REV_CACHE_MAX_MB environment */
+/* variable can also be used to set this. Existing caches are trimmed to the new limit. */
+void rspl_set_rev_cache_max(size_t maxsz);
+
+/* Return the current maximum total memory to be used by the reverse caches */
+size_t rspl_get_rev_cache_max(void);
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Utility functions */
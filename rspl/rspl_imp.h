@@ -23,5 +23,9 @@
 #define BALLEV 0.8		/* Balance level of adjusted points */
 #define RADF 0.01		/* Radius factor of nme influence */
 
+/* Note that grid values have changed, so that any cached */
+/* spline tangent information is stale. Implemented in spline.c */
+void spline_grid_changed(rspl *s);
+
 #define RSPL_IMP_H
 #endif /* RSPL_IMP_H */
@@ -0,0 +1,559 @@
+
+/************************************************/
+/* Benchmark suite for RSPL                     */
+/************************************************/
+
+/* Author: Argyll CMS contributors
+ * Date:   18/10/2026
+ * Derived from revbench.c by Graeme Gill
+ *
+ * Copyright 2026 Argyll CMS contributors
+ * Portions Copyright 1999 - 2000 Graeme W. Gill (revbench.c)
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Times the main rspl operations over a sweep of input/output
+ * dimensions, grid resolutions and ink limiting:
+ *
+ *   set_rspl, set_rspl_mt, fit_rspl, interp, comp_gamut,
+ *   rev_setup, and rev_interp in exact, clip, aux and locus modes.
+ *
+ * Results are written as JSON, one record per test, giving
+ * the wall clock time, points per second and the growth of the
+ * resident set size during the test (peak less starting RSS,
+ * Linux only, -1 elsewhere). Everything is deterministic
+ * and nothing is interactive, so it can be run unattended and
+ * the output compared between builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined (NT)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#ifdef UNIX
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include "copyright.h"
+#include "aconfig.h"
+#include "numlib.h"
+#include "rspl.h"
+
+#define NIP 10			/* Number of rev solutions allowed */
+#define LIMITFRAC 0.75	/* Ink limit as a fraction of di */
+#define DEF_ONAME "rsplbench.json"	/* Default output file name */
+
+/* Dimension combinations to test */
+static struct {
+	int di, fdi;
+} dims[] = {
+	{ 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 1 }, { 3, 3 }, { 3, 10 },
+	{ 4, 1 }, { 4, 3 }, { 4, 10 }
+};
+
+/* Grid resolutions to test for each input dimension. */
+/* Quick mode only does the first one. */
+static int gress[MXRI+1][2] = {
+	{ 0, 0 }, { 33, 257 }, { 17, 65 }, { 17, 33 }, { 9, 17 }
+};
+
+/* ---------------------------------------------------- */
+
+/* Return the wall clock time in seconds */
+static double wall_time(void) {
+#if defined (NT)
+	LARGE_INTEGER freq, val;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&val);
+	return (double)val.QuadPart/(double)freq.QuadPart;
+#endif
+#ifdef UNIX
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1e6;
+#endif
+}
+
+#ifdef __linux__
+/* Return the value of a /proc/self/status KB field, -1 if not known */
+static long status_kb(char *name) {
+	FILE *fp;
+	char buf[200];
+	size_t len = strlen(name);
+	long rv = -1;
+
+	if ((fp = fopen("/proc/self/status", "r")) == NULL)
+		return -1;
+	while (fgets(buf, 200, fp) != NULL) {
+		if (strncmp(buf, name, len) == 0 && buf[len] == ':') {
+			rv = atol(buf + len + 1);
+			break;
+		}
+	}
+	fclose(fp);
+	return rv;
+}
+#endif
+
+static long case_rss = -1;		/* RSS at the start of the test, -1 if unknown */
+
+/* Note the start of a test, and return the wall clock time. */
+/* The peak RSS is reset so that the test's own peak can be found. */
+static double case_start(void) {
+#ifdef __linux__
+	FILE *fp;
+
+	case_rss = -1;
+	if ((fp = fopen("/proc/self/clear_refs", "w")) != NULL) {
+		int ok = fputs("5", fp) >= 0;			/* Reset VmHWM */
+		if (fclose(fp) == 0 && ok)
+			case_rss = status_kb("VmRSS");
+	}
+#endif
+	return wall_time();
+}
+
+/* Return the growth in RSS during the test, in KB, -1 if not known. */
+static long case_rss_kb(void) {
+#ifdef __linux__
+	long peak;
+
+	if (case_rss < 0 || (peak = status_kb("VmHWM")) < 0)
+		return -1;
+	return peak > case_rss ? peak - case_rss : 0;
+#else
+	return -1;
+#endif
+}
+
+/* Return the peak resident set size of the process so far in KB, */
+/* -1 if not known. */
+static long peak_rss_kb(void) {
+#ifdef UNIX
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return -1;
+#ifdef __APPLE__
+	return ru.ru_maxrss/1024;		/* OS X returns bytes */
+#else
+	return ru.ru_maxrss;
+#endif
+#else
+	return -1;
+#endif
+}
+
+/* ---------------------------------------------------- */
+
+typedef struct {
+	int di, fdi;
+} fcntx;
+
+/* A smooth, monotonic di -> fdi device like function. */
+/* Each output is dominated by one input, with some */
+/* cross coupling and a non-linearity. */
+static void func(void *cntx, double *out, double *in) {
+	fcntx *p = (fcntx *)cntx;
+	int e, f;
+
+	for (f = 0; f < p->fdi; f++) {
+		double sw = 0.0, tt = 0.0;
+
+		for (e = 0; e < p->di; e++) {
+			double w = (e == (f % p->di)) ? 4.0 : 1.0 + 0.1 * ((e + f) % 3);
+			tt += w * in[e];
+			sw += w;
+		}
+		tt /= sw;
+		if (tt < 0.0)
+			tt = 0.0;
+		out[f] = 1.0 - pow(tt, 0.8 + 0.1 * (f % 3));
+	}
+}
+
+/* Sum of inputs ink limit function */
+static double limitf(void *cntx, double *in) {
+	fcntx *p = (fcntx *)cntx;
+	double ov;
+	int e;
+
+	for (ov = 0.0, e = 0; e < p->di; e++)
+		ov += in[e];
+	return ov;
+}
+
+/* ---------------------------------------------------- */
+
+static FILE *jfp;			/* JSON output */
+static int nres = 0;		/* Number of results output */
+static int verb = 0;
+static char *filt = NULL;	/* Test name filter */
+
+/* Return nz if the test is to be run */
+static int dotest(char *name) {
+	return filt == NULL || strstr(name, filt) != NULL;
+}
+
+/* Output one JSON result record */
+static void result(char *test, int di, int fdi, int res, int ilimit,
+                   int npts, double secs) {
+	double rate = secs > 0.0 ? npts/secs : 0.0;
+
+	fprintf(jfp,"%s    { \"test\": \"%s\", \"di\": %d, \"fdi\": %d, \"res\": %d, \"inklimit\": %s,"
+	        " \"npts\": %d, \"secs\": %.6f, \"pts_per_sec\": %.1f, \"rss_growth_kb\": %ld }",
+	        nres > 0 ? ",\n" : "", test, di, fdi, res, ilimit ? "true" : "false",
+	        npts, secs, rate, case_rss_kb());
+	fflush(jfp);
+	nres++;
+
+	if (verb)
+		fprintf(stderr,"%-12s di %d fdi %2d res %4d%s: %8d pts in %9.4f secs = %12.1f pts/sec\n",
+		        test, di, fdi, res, ilimit ? " limit" : "", npts, secs, rate);
+}
+
+/* Create an rspl set from func() */
+static rspl *new_set(fcntx *fc, int res) {
+	rspl *s;
+	int e, gres[MXDI];
+
+	for (e = 0; e < fc->di; e++)
+		gres[e] = res;
+	s = new_rspl(RSPL_NOFLAGS, fc->di, fc->fdi);
+	s->set_rspl(s, 0, (void *)fc, func, NULL, NULL, gres, NULL, NULL);
+	return s;
+}
+
+/* Time the grid creation operations */
+static void bench_set(fcntx *fc, int res, int quick) {
+	int e, gres[MXDI];
+	double stime;
+	rspl *s;
+
+	for (e = 0; e < fc->di; e++)
+		gres[e] = res;
+
+	if (dotest("set_rspl")) {
+		s = new_rspl(RSPL_NOFLAGS, fc->di, fc->fdi);
+		stime = case_start();
+		s->set_rspl(s, 0, (void *)fc, func, NULL, NULL, gres, NULL, NULL);
+		result("set_rspl", fc->di, fc->fdi, res, 0, s->g.no, wall_time() - stime);
+		s->del(s);
+	}
+
+	if (dotest("set_rspl_mt")) {
+		void *cbctxs[PFOR_MAXTHR];
+		int i;
+
+		for (i = 0; i < PFOR_MAXTHR; i++)
+			cbctxs[i] = (void *)fc;
+		s = new_rspl(RSPL_NOFLAGS, fc->di, fc->fdi);
+		stime = case_start();
+		s->set_rspl_mt(s, 0, PFOR_MAXTHR, cbctxs, func, NULL, NULL, gres, NULL, NULL);
+		result("set_rspl_mt", fc->di, fc->fdi, res, 0, s->g.no, wall_time() - stime);
+		s->del(s);
+	}
+
+	if (dotest("fit_rspl")) {
+		int i, npts;
+		co *tp;
+
+		s = new_rspl(RSPL_NOFLAGS, fc->di, fc->fdi);
+
+		/* Aim for a few points per grid cell, up to a limit */
+		for (npts = 1, e = 0; e < fc->di; e++)
+			npts *= res;
+		npts *= 2;
+		if (npts > (quick ? 5000 : 20000))
+			npts = quick ? 5000 : 20000;
+
+		if ((tp = (co *)malloc(sizeof(co) * npts)) == NULL)
+			error("Malloc of %d test points failed",npts);
+		for (i = 0; i < npts; i++) {
+			for (e = 0; e < fc->di; e++)
+				tp[i].p[e] = d_rand(0.0, 1.0);
+			func((void *)fc, tp[i].v, tp[i].p);
+		}
+		stime = case_start();
+		s->fit_rspl(s, 0, tp, npts, NULL, NULL, gres, NULL, NULL, 1.0, NULL, NULL);
+		result("fit_rspl", fc->di, fc->fdi, res, 0, npts, wall_time() - stime);
+		free(tp);
+		s->del(s);
+	}
+}
+
+/* Time forward interpolation */
+static void bench_interp(rspl *s, fcntx *fc, int res, int quick) {
+	int i, e, npts = quick ? 20000 : 200000;
+	double stime, cs = 0.0;
+	co *tp;
+
+	if (!dotest("interp"))
+		return;
+
+	if ((tp = (co *)malloc(sizeof(co) * npts)) == NULL)
+		error("Malloc of %d test points failed",npts);
+	for (i = 0; i < npts; i++) {
+		for (e = 0; e < fc->di; e++)
+			tp[i].p[e] = d_rand(0.0, 1.0);
+	}
+
+	stime = case_start();
+	for (i = 0; i < npts; i++) {
+		s->interp(s, &tp[i]);
+		cs += tp[i].v[0];
+	}
+	result("interp", fc->di, fc->fdi, res, 0, npts, wall_time() - stime);
+	if (cs == -1.0)			/* Make sure the work isn't optimised away */
+		printf("Impossible\n");
+	free(tp);
+}
+
+/* Time gamut surface computation */
+static void bench_gamut(rspl *s, fcntx *fc, int res) {
+	double stime;
+
+	if (!dotest("comp_gamut"))
+		return;
+
+	if (fc->fdi != 3 || fc->di < fc->fdi)
+		return;
+
+	stime = case_start();
+	if (s->comp_gamut(s, NULL, NULL, NULL, NULL, NULL, NULL) != 0)
+		error("comp_gamut failed, di %d, fdi %d, res %d",fc->di,fc->fdi,res);
+	result("comp_gamut", fc->di, fc->fdi, res, 0, s->g.no, wall_time() - stime);
+}
+
+/* Reverse interpolation modes */
+#define REV_EXACT 0
+#define REV_CLIP  1
+#define REV_AUX   2
+#define REV_LOCUS 3
+
+static char *revnames[4] = { "rev_exact", "rev_clip", "rev_aux", "rev_locus" };
+
+/* Time reverse interpolation in the given mode */
+static void bench_rev(rspl *s, fcntx *fc, int res, int ilimit, int mode, int quick) {
+	int i, e, f, npts = quick ? 200 : 2000;
+	int flags = 0, auxm[MXDI];
+	double stime, limitv = LIMITFRAC * fc->di;
+	co *tp, *sp;
+
+	if (!dotest(revnames[mode]))
+		return;
+
+	/* Exact needs a square function, aux and locus need auxiliaries */
+	if (mode == REV_EXACT && fc->fdi != fc->di)
+		return;
+	if ((mode == REV_AUX || mode == REV_LOCUS) && fc->fdi >= fc->di)
+		return;
+
+	/* Searches get much slower as the solution locus dimension increases */
+	npts >>= 2 * (fc->di - fc->fdi);
+	if (npts < 10)
+		npts = 10;
+
+	for (e = 0; e < fc->di; e++)
+		auxm[e] = e >= fc->fdi ? 1 : 0;
+
+	if (mode == REV_CLIP)
+		flags = RSPL_NEARCLIP;
+	else if (mode == REV_AUX)
+		flags = RSPL_EXACTAUX;
+	else if (mode == REV_LOCUS)
+		flags = RSPL_AUXLOCUS;
+
+	if ((tp = (co *)malloc(sizeof(co) * npts)) == NULL)
+		error("Malloc of %d test points failed",npts);
+
+	/* Create targets from in gamut points, or out of gamut for clip */
+	for (i = 0; i < npts; i++) {
+		double sum = 0.0;
+
+		for (e = 0; e < fc->di; e++) {
+			tp[i].p[e] = d_rand(0.0, 1.0);
+			sum += tp[i].p[e];
+		}
+		if (ilimit && sum > limitv) {		/* Bring within ink limit */
+			for (e = 0; e < fc->di; e++)
+				tp[i].p[e] *= limitv/sum;
+		}
+		s->interp(s, &tp[i]);
+
+		if (mode == REV_CLIP) {
+			for (f = 0; f < fc->fdi; f++)
+				tp[i].v[f] = 0.5 + 1.4 * (tp[i].v[f] - 0.5);
+		} else if (mode == REV_LOCUS) {
+			for (e = fc->fdi; e < fc->di; e++)
+				tp[i].p[e] = 0.5;
+		}
+	}
+	if ((sp = (co *)malloc(sizeof(co) * NIP)) == NULL)
+		error("Malloc of %d solutions failed",NIP);
+
+	stime = case_start();
+	for (i = 0; i < npts; i++) {
+		int rv;
+
+		sp[0] = tp[i];
+		rv = s->rev_interp(s, flags, NIP, mode >= REV_AUX ? auxm : NULL, NULL, sp);
+		if (verb > 1 && (rv & RSPL_NOSOLNS) == 0)
+			fprintf(stderr,"%s got no solution for target %d\n",revnames[mode],i);
+	}
+	result(revnames[mode], fc->di, fc->fdi, res, ilimit, npts, wall_time() - stime);
+	free(sp);
+	free(tp);
+}
+
+/* Time the reverse setup, and each reverse mode */
+static void bench_revs(rspl *s, fcntx *fc, int res, int quick) {
+	int ilimit, mode;
+
+	if (fc->fdi > fc->di)
+		return;
+
+	for (ilimit = 0; ilimit < 2; ilimit++) {
+
+		/* Ink limit is only meaningful for 3 or more inputs */
+		if (ilimit && fc->di < 3)
+			break;
+
+		/* (This also resets the reverse information) */
+		s->rev_set_limit(s, ilimit ? limitf : NULL, (void *)fc, LIMITFRAC * fc->di);
+
+		if (dotest("rev_setup")) {
+			double stime;
+			co tp[NIP];
+			int e;
+
+			for (e = 0; e < fc->di; e++)
+				tp[0].p[e] = 0.2;
+			s->interp(s, &tp[0]);
+			stime = case_start();
+			s->rev_interp(s, RSPL_NEARCLIP, NIP, NULL, NULL, tp);
+			result("rev_setup", fc->di, fc->fdi, res, ilimit, 1, wall_time() - stime);
+		}
+
+		for (mode = REV_EXACT; mode <= REV_LOCUS; mode++)
+			bench_rev(s, fc, res, ilimit, mode, quick);
+	}
+}
+
+/* ---------------------------------------------------- */
+
+void usage(void) {
+	fprintf(stderr,"Benchmark rspl operations, Version %s\n",ARGYLL_VERSION_STR);
+	fprintf(stderr,"usage: rsplbench [-q] [-v level] [-t test] [-o file.json]\n");
+	fprintf(stderr," -q            Quick run, smaller sweep and point counts\n");
+	fprintf(stderr," -v level      Print progress to stderr\n");
+	fprintf(stderr," -t test       Only run tests whose name contains the given string\n");
+	fprintf(stderr," -o file.json  Write results to file (default %s)\n",DEF_ONAME);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	int fa,nfa;				/* argument we're looking at */
+	int quick = 0;
+	char *oname = DEF_ONAME;
+	int i, j, nres_di;
+	double stime;
+
+	error_program = argv[0];
+
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-')	{	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage();
+
+			/* Verbosity */
+			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V') {
+				verb = 1;
+				if (na != NULL && na[0] >= '0' && na[0] <= '9') {
+					verb = atoi(na);
+					fa = nfa;
+				}
+			}
+			else if (argv[fa][1] == 'q' || argv[fa][1] == 'Q') {
+				quick = 1;
+			}
+			else if (argv[fa][1] == 't' || argv[fa][1] == 'T') {
+				fa = nfa;
+				if (na == NULL) usage();
+				filt = na;
+			}
+			else if (argv[fa][1] == 'o' || argv[fa][1] == 'O') {
+				fa = nfa;
+				if (na == NULL) usage();
+				oname = na;
+			}
+			else
+				usage();
+		} else
+			break;
+	}
+
+	/* (Some rspl debug output goes to stdout, so use a file) */
+	if ((jfp = fopen(oname, "w")) == NULL)
+		error("Unable to open output file '%s'",oname);
+
+	fprintf(jfp,"{\n  \"benchmark\": \"rsplbench\",\n  \"version\": \"%s\",\n"
+	            "  \"quick\": %s,\n  \"nthreads\": %d,\n  \"results\": [\n",
+	            ARGYLL_VERSION_STR, quick ? "true" : "false", pfor_nthreads());
+
+	stime = wall_time();
+	nres_di = quick ? 1 : 2;
+
+	for (i = 0; i < (sizeof(dims)/sizeof(dims[0])); i++) {
+		fcntx fc;
+
+		fc.di = dims[i].di;
+		fc.fdi = dims[i].fdi;
+
+		for (j = 0; j < nres_di; j++) {
+			int res = gress[fc.di][j];
+			rspl *s;
+
+			bench_set(&fc, res, quick);
+
+			s = new_set(&fc, res);
+			bench_interp(s, &fc, res, quick);
+			bench_gamut(s, &fc, res);
+			bench_revs(s, &fc, res, quick);
+			s->del(s);
+		}
+	}
+
+	fprintf(jfp,"\n  ],\n  \"total_secs\": %.3f,\n  \"peak_rss_kb\": %ld\n}\n",
+	        wall_time() - stime, peak_rss_kb());
+
+	if (fclose(jfp) != 0)
+		error("Error closing output file '%s'",oname);
+
+	return 0;
+}
@@ -121,6 +121,7 @@
 #include "rspl_imp.h"
 #include "numlib.h"
 #include "counters.h"	/* Counter macros */
+#include "mlbs.h"		/* Sparse multilevel B-splines */
 
 #undef DEBUG			/* Print contents of solution setup etc. */
 #undef DEBUG_PROGRESS	/* Print progress of acheiving tollerance target */
@@ -184,6 +185,9 @@ extern void alloc_grid(rspl *s);
 
 extern int is_mono(rspl *s);
 
+/* Implemented in rev.c: */
+extern void free_rev(rspl *s);
+
 /* Convention is to use:
    i to index grid points u.a
    n to index data points d.a
@@ -394,6 +398,119 @@ it_info *ii
 }
 
 
+/* Callback to set rspl grid values from an mlbs */
+static void set_from_mlbs(void *cbctx, double *out, double *in) {
+	mlbs *p = (mlbs *)cbctx;
+	co tp;
+	int e, f;
+
+	for (e = 0; e < p->di; e++)
+		tp.p[e] = in[e];
+
+	if (p->lookup(p, &tp))
+		error("rspl: internal, set_from_mlbs failed!");
+
+	for (f = 0; f < p->fdi; f++)
+		out[f] = tp.v[f];
+}
+
+/* A dense res^di scattered data fit gets too big beyond MXRI inputs, */
+/* so fit a sparse multilevel B-spline to the data instead, */
+/* and then set the rspl grid from it. (The smoothness is set */
+/* by the B-spline resolution, so the smooth and avgdev factors, */
+/* ipos[] and the weak default function aren't supported, */
+/* and fit_rspl_imp() rejects them.) */
+/* Return non-zero if non-monotonic */
+static int
+fit_rspl_mlbs(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	void *d,		/* Array holding position and function values of data points */
+	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
+	int dno,		/* Number of data points */
+	datai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
+	int gres[MXDI],	/* Spline grid resolution */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
+) {
+	int di = s->di, fdi = s->fdi;
+	int i, e, f;
+	int bres, tres, nthr, rv;
+	double gl[MXDI], gh[MXDI];
+	void *ctxs[PFOR_MAXTHR];
+	coww *pts;
+	mlbs *p;
+
+	if (dno < 1)
+		error("rspl: fit with di = %d needs scattered data",di);
+
+	/* Convert the data points to the mlbs format */
+	if ((pts = (coww *)malloc(sizeof(coww) * dno)) == NULL)
+		error("rspl malloc failed - mlbs data points");
+
+	for (i = 0; i < dno; i++) {
+		if (dtp == 0) {
+			co *dp = (co *)d + i;
+			for (e = 0; e < di; e++)
+				pts[i].p[e] = dp->p[e];
+			for (f = 0; f < fdi; f++) {
+				pts[i].v[f] = dp->v[f];
+				pts[i].w[f] = 1.0;
+			}
+		} else if (dtp == 1) {
+			cow *dp = (cow *)d + i;
+			for (e = 0; e < di; e++)
+				pts[i].p[e] = dp->p[e];
+			for (f = 0; f < fdi; f++) {
+				pts[i].v[f] = dp->v[f];
+				pts[i].w[f] = dp->w;
+			}
+		} else {
+			coww *dp = (coww *)d + i;
+			for (e = 0; e < di; e++)
+				pts[i].p[e] = dp->p[e];
+			for (f = 0; f < fdi; f++) {
+				pts[i].v[f] = dp->v[f];
+				pts[i].w[f] = dp->w[f];
+			}
+		}
+	}
+
+	for (bres = 0, e = 0; e < di; e++) {
+		gl[e] = glow == NULL ? 0.0 : glow[e];
+		gh[e] = ghigh == NULL ? 1.0 : ghigh[e];
+		if (gres[e] < 2)
+			error("rspl: grid res must be >= 2!");
+		if (gres[e] > bres)
+			bres = gres[e];
+	}
+
+	/* Make the final B-Spline resolution about half the rspl resolution, */
+	/* since each B-spline basis function spans 4 latice cells. */
+	for (tres = 2; (2 * tres) < bres; tres = 2 * tres -1)
+		;
+
+	/* Create multilevel B-Spline fit. (This expands gl[] & gh[] to enclose the data) */
+	p = new_mlbs(di, fdi, tres, pts, dno, gl, gh, 0.0);
+	free(pts);
+
+	if (s->verbose)
+		printf("Sparse B-spline fit of %d points used %d latice points\n",dno,p->nent);
+
+	/* Create rspl grid points by looking up the B-Spline values. */
+	/* mlbs lookup is read only, so all the threads can share it. */
+	nthr = pfor_nthreads();
+	for (i = 0; i < nthr; i++)
+		ctxs[i] = (void *)p;
+	rv = s->set_rspl_mt(s, 0, nthr, ctxs, set_from_mlbs, p->l, p->h, gres, vlow, vhigh);
+
+	/* Don't need B-Spline any more */
+	p->del(p);
+
+	return rv;
+}
+
 /* Initialise the regular spline from scattered data */
 /* Return non-zero if non-monotonic */
 static int
@@ -403,11 +520,11 @@ fit_rspl_imp(
 	void *d,		/* Array holding position and function values of data points */
 	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
 	int dno,		/* Number of data points */
-	ratai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
-	ratai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
+	datai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
 	int gres[MXDI],	/* Spline grid resolution */
-	ratao vlow,		/* Data value low normalize, NULL = default 0.0 */
-	ratao vhigh,	/* Data value high normalize - NULL = default 1.0 */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh,	/* Data value high normalize - NULL = default 1.0 */
 	double smooth,	/* Smoothing factor, 0.0 = default 1.0 */
 					/* (if -ve, overides optimised smoothing, and sets raw smoothing */
 					/*  typically between 1e-7 .. 1e-1) */
@@ -439,8 +556,6 @@ printf("~1 rspl: flags = 0x%x\n",flags);
 #endif
 
 	/* This is a restricted size function */
-	if (di > MXRI)
-		error("rspl: fit can't handle di = %d",di);
 	if (fdi > MXRO)
 		error("rspl: fit can't handle fdi = %d",fdi);
 
@@ -453,6 +568,14 @@ printf("~1 rspl: flags = 0x%x\n",flags);
 	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
 		s->verbose = 0;
 
+	/* Use a sparse fit beyond the restricted size */
+	if (di > MXRI) {
+		if ((smooth != 0.0 && smooth != 1.0) || avgdev != NULL || ipos != NULL || dfunc != NULL
+		 || (flags & (RSPL_AUTOSMOOTH | RSPL_SYMDOMAIN)))
+			error("rspl: smoothing, avgdev, ipos, default function and auto smoothing aren't supported by the sparse fit for di = %d",di);
+		return fit_rspl_mlbs(s, flags, d, dtp, dno, glow, ghigh, gres, vlow, vhigh);
+	}
+
 	s->ausm = (flags & RSPL_AUTOSMOOTH) ? 1 : 0;		/* Enable auto smoothing */
 	s->symdom = (flags & RSPL_SYMDOMAIN) ? 1 : 0;	/* Turn on symetric smoothness with gres */
 
@@ -709,6 +832,124 @@ cj_arrays *ta	/* Temporary array */
 	return m;
 }
 
+/* Fit plane job context */
+typedef struct {
+	rspl *s;
+	int warm;			/* nz to re-solve final resolution from current grid values */
+	cj_arrays *ta;		/* cj_line temporary arrays for each thread */
+} fitpjob;
+
+/* Fit the grid to the data for one output plane */
+static void fit_plane_job(void *cntx, int thix, int f) {
+	fitpjob *j = (fitpjob *)cntx;
+	rspl *s = j->s;
+	cj_arrays *ta = &j->ta[thix];
+	int i;
+	float *gp;
+	mgtmp *m = NULL;
+
+	if (j->warm) {
+		/* Re-solve at the final resolution, starting with the current solution */
+		m = new_mgtmp(s, s->g.res, s->smooth, s->avgdev[f], f, 0);
+		setup_solve(m, NULL);
+
+		for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
+			m->q.x[i] = (double)gp[f];
+
+		solve_gres(m, ta, TOL, 1);
+
+		for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
+			gp[f] = (float)m->q.x[i];
+
+		free_mgtmp(m);
+		return;
+	}
+
+#ifdef NEVER		// ~~99 remove this
+	mgtmp *sm = NULL;		/* Auto smoothness map */
+
+	/* If auto smoothness, create smoothing map */
+	if (s->ausm) {
+		int res[MXDI];
+		int mxres[5] = { 0, 101, 51, 17, 11 };
+		int smres[5] = { 0, 12, 8, 6, 6 };
+ 
+		/* Set target resolution for initial fit */
+		for (e = 0; e < s->di; e++) {
+			res[e] = s->g.res[e]; 
+
+			if (res[e] > mxres[s->di])
+				res[e] = mxres[s->di];
+		}
+
+		/* Setup the number of itterations and resolution for each itteration */
+		set_it_info(s, res, &s->as_ii);
+
+printf("~1 s->smooth = %f, avgdev[f] = %f\n",s->smooth, s->avgdev[f]);
+
+		/* First pass fit with heavy smoothing */
+		m = fit_rspl_plane_imp(s, f, &s->as_ii, 1.0, 0.1, NULL, ta);
+
+printf("Initial high smoothing fit of output %d:\n",f);
+plot_mgtmp1(m);
+
+		/* Compute the fit error values from first pass */
+		comp_fit_errors(m);		/* Compute correction to data target values */
+
+		free_mgtmp(m);
+
+		/* Set target resolution for smoothness map */
+		for (e = 0; e < s->di; e++)
+			res[e] = smres[s->di];
+
+		set_it_info(s, res, &s->asm_ii);
+
+		/* Create smoothness map from fit errors */
+		sm = fit_rspl_plane_imp(s, -1, &s->asm_ii, -50000, 0.0, NULL, ta);
+//		sm = fit_rspl_plane_imp(s, -1, &s->asm_ii, 1000.0, 0.1, NULL, ta);
+printf("Smoothness map for output %d:\n",f);
+plot_mgtmp1(sm);
+	}
+#endif /* NEVER */
+
+	/* Fit data for this plane */
+	m = fit_rspl_plane_imp(s, f, &s->ii, s->smooth, s->avgdev[f], /* sm, */ ta);
+//printf("Final fit for output %d:\n",f);
+//plot_mgtmp1(m);
+
+	/* Transfer result in x[] to appropriate grid point value */
+	for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
+		gp[f] = (float)m->q.x[i];
+
+	free_mgtmp(m);			/* Free final resolution entry */
+
+//	if (sm != NULL)			/* Free smoothing map */
+//		free_mgtmp(sm);
+}
+
+/* Fit all the output planes, using a thread for each if possible */
+static void fit_planes(rspl *s, int warm) {
+	int i, nthr;
+	fitpjob j;
+
+	if ((nthr = pfor_nthreads()) > s->fdi)
+		nthr = s->fdi;
+
+	j.s = s;
+	j.warm = warm;
+	if ((j.ta = (cj_arrays *) calloc(nthr, sizeof(cj_arrays))) == NULL)
+		error("rspl malloc failed - cj_arrays");
+	for (i = 0; i < nthr; i++)
+		init_cj_arrays(&j.ta[i]);		/* Zero temporary arrays */
+
+	pfor(s->fdi, nthr, (void *)&j, fit_plane_job);
+
+	/* Free up cj_line temporary arrays */
+	for (i = 0; i < nthr; i++)
+		free_cj_arrays(&j.ta[i]);
+	free(j.ta);
+}
+
 /* Do the work of initialising from initial data points. */
 /* Return non-zero if non-monotonic */
 static int
@@ -719,9 +960,7 @@ add_rspl_imp(
 	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
 	int dno			/* Number of data points */
 ) {
-	int fdi = s->fdi;
 	int i, n, e, f;
-	cj_arrays ta;	/* cj_line temporary arrays */
 
 	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
 		s->verbose = 1;
@@ -784,8 +1023,6 @@ add_rspl_imp(
 	}
 	s->d.no = dno;
 
-	init_cj_arrays(&ta);		/* Zero temporary arrays */
-	
 	if (s->verbose && s->ausm) {
 #ifdef AUTOSM
 		printf("Doing automatic local smoothing optimization\n");
@@ -794,76 +1031,9 @@ add_rspl_imp(
 #endif
 	}
 
-	/* Do fit of grid to data for each output dimension */
-	for (f = 0; f < fdi; f++) {
-		float *gp;
-		mgtmp *m = NULL;
-
-#ifdef NEVER		// ~~99 remove this
-		mgtmp *sm = NULL;		/* Auto smoothness map */
-
-		/* If auto smoothness, create smoothing map */
-		if (s->ausm) {
-			int res[MXDI];
-			int mxres[5] = { 0, 101, 51, 17, 11 };
-			int smres[5] = { 0, 12, 8, 6, 6 };
- 
-			/* Set target resolution for initial fit */
-			for (e = 0; e < s->di; e++) {
-				res[e] = s->g.res[e]; 
-
-				if (res[e] > mxres[s->di])
-					res[e] = mxres[s->di];
-			}
-
-			/* Setup the number of itterations and resolution for each itteration */
-			set_it_info(s, res, &s->as_ii);
-
-printf("~1 s->smooth = %f, avgdev[f] = %f\n",s->smooth, s->avgdev[f]);
-
-			/* First pass fit with heavy smoothing */
-			m = fit_rspl_plane_imp(s, f, &s->as_ii, 1.0, 0.1, NULL, &ta);
-
-printf("Initial high smoothing fit of output %d:\n",f);
-plot_mgtmp1(m);
-
-			/* Compute the fit error values from first pass */
-			comp_fit_errors(m);		/* Compute correction to data target values */
-
-			free_mgtmp(m);
-
-			/* Set target resolution for smoothness map */
-			for (e = 0; e < s->di; e++)
-				res[e] = smres[s->di];
-
-			set_it_info(s, res, &s->asm_ii);
-
-			/* Create smoothness map from fit errors */
-			sm = fit_rspl_plane_imp(s, -1, &s->asm_ii, -50000, 0.0, NULL, &ta);
-//			sm = fit_rspl_plane_imp(s, -1, &s->asm_ii, 1000.0, 0.1, NULL, &ta);
-printf("Smoothness map for output %d:\n",f);
-plot_mgtmp1(sm);
-		}
-#endif /* NEVER */
-
-		/* Fit data for this plane */
-		m = fit_rspl_plane_imp(s, f, &s->ii, s->smooth, s->avgdev[f], /* sm, */ &ta);
-//printf("Final fit for output %d:\n",f);
-//plot_mgtmp1(m);
-
-		/* Transfer result in x[] to appropriate grid point value */
-		for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
-			gp[f] = (float)m->q.x[i];
-
-		free_mgtmp(m);			/* Free final resolution entry */
-
-//		if (sm != NULL)			/* Free smoothing map */
-//			free_mgtmp(sm);
-
-	}	/* Next output channel */
-
-	/* Free up cj_line temporary arrays */
-	free_cj_arrays(&ta);
+	/* Do fit of grid to data for each output dimension. */
+	/* Each output plane is independent, so fit them in parallel. */
+	fit_planes(s, 0);
 
 	/* Return non-mono check */
 	return is_mono(s);
@@ -877,11 +1047,11 @@ fit_rspl(
 	int flags,		/* Combination of flags */
 	co *d,			/* Array holding position and function values of data points */
 	int dno,		/* Number of data points */
-	ratai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
-	ratai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
+	datai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
 	int gres[MXDI],	/* Spline grid resolution */
-	ratao vlow,		/* Data value low normalize, NULL = default 0.0 */
-	ratao vhigh,	/* Data value high normalize - NULL = default 1.0 */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh,	/* Data value high normalize - NULL = default 1.0 */
 	double smooth,	/* Smoothing factor, nominal = 1.0 */
 	double avgdev[MXDO],
 	                /* Average Deviation of function values as proportion of function range. */
@@ -901,11 +1071,11 @@ fit_rspl_w(
 	int flags,		/* Combination of flags */
 	cow *d,			/* Array holding position, function and weight values of data points */
 	int dno,		/* Number of data points */
-	ratai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
-	ratai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
+	datai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
 	int gres[MXDI],		/* Spline grid resolution */
-	ratao vlow,		/* Data value low normalize, NULL = default 0.0 */
-	ratao vhigh,	/* Data value high normalize - NULL = default 1.0 */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh,	/* Data value high normalize - NULL = default 1.0 */
 	double smooth,	/* Smoothing factor, nominal = 1.0 */
 	double avgdev[MXDO],
 	                /* Average Deviation of function values as proportion of function range. */
@@ -925,11 +1095,11 @@ fit_rspl_ww(
 	int flags,		/* Combination of flags */
 	coww *d,		/* Array holding position, function and weight values of data points */
 	int dno,		/* Number of data points */
-	ratai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
-	ratai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
+	datai glow,		/* Grid low scale - will be expanded to enclose data, NULL = default 0.0 */
+	datai ghigh,	/* Grid high scale - will be expanded to enclose data, NULL = default 1.0 */
 	int gres[MXDI],		/* Spline grid resolution */
-	ratao vlow,		/* Data value low normalize, NULL = default 0.0 */
-	ratao vhigh,	/* Data value high normalize - NULL = default 1.0 */
+	datao vlow,		/* Data value low normalize, NULL = default 0.0 */
+	datao vhigh,	/* Data value high normalize - NULL = default 1.0 */
 	double smooth,	/* Smoothing factor, nominal = 1.0 */
 	double avgdev[MXDO],
 	                /* Average Deviation of function values as proportion of function range. */
@@ -995,6 +1165,135 @@ fit_rspl_w_df(
 	                    smooth, avgdev, ipos, weak, cbntx, func);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - -*/
+
+/* Add to or replace scattered data points of an existing fit, and */
+/* re-solve at the final resolution only, starting from the current */
+/* grid values. A new point with exactly the same position as an */
+/* existing point replaces it. The grid range, smoothness and weak */
+/* default function of the original fit are retained. */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl_imp(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	void *d,		/* Array holding position and function values of data points */
+	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *) */
+	int dno			/* Number of data points */
+) {
+	int di = s->di, fdi = s->fdi;
+	int i, n, e, f;
+	int ono = s->d.no;		/* Original number of points */
+	int nno;				/* New number of points */
+
+	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
+		s->verbose = 1;
+	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
+		s->verbose = 0;
+
+	if (s->d.a == NULL)
+		error("rspl: refit called on rspl that wasn't fitted to scattered data");
+
+	if (dno == 0)
+		return is_mono(s);
+
+	/* Make space for the worst case number of points */
+	if ((s->d.a = (rpnts *) realloc(s->d.a, sizeof(rpnts) * (ono + dno))) == NULL)
+		error("rspl malloc failed - data points");
+
+	/* Replace or append each point */
+	for (nno = ono, i = 0; i < dno; i++) {
+		double *p, *v, w = 1.0;
+
+		if (dtp == 0) {
+			co *dp = (co *)d;
+			p = dp[i].p;
+			v = dp[i].v;
+		} else {
+			cow *dp = (cow *)d;
+			p = dp[i].p;
+			v = dp[i].v;
+			w = dp[i].w;
+		}
+
+		for (e = 0; e < di; e++) {
+			if (p[e] < s->g.l[e] || p[e] > s->g.h[e])
+				error("rspl: refit data point %d outside grid %e <= %e <= %e",
+				                            i,s->g.l[e],p[e],s->g.h[e]);
+		}
+
+		/* See if it replaces an existing point */
+		for (n = 0; n < nno; n++) {
+			for (e = 0; e < di; e++) {
+				if (s->d.a[n].p[e] != p[e])
+					break;
+			}
+			if (e >= di)
+				break;
+		}
+		if (n >= nno)			/* New point */
+			nno++;
+
+		for (e = 0; e < di; e++)
+			s->d.a[n].p[e] = p[e];
+		for (f = 0; f < fdi; f++) {
+			s->d.a[n].v[f] = v[f];
+			s->d.a[n].k[f] = w;
+
+			/* Expand the data value range to cover the point */
+			if (v[f] < s->d.vl[f]) {
+				s->d.vw[f] += s->d.vl[f] - v[f];
+				s->d.vl[f] = v[f];
+			}
+			if (v[f] > (s->d.vl[f] + s->d.vw[f]))
+				s->d.vw[f] = v[f] - s->d.vl[f];
+		}
+	}
+	s->d.no = nno;
+
+	/* Re-compute average data value */
+	for (f = 0; f < fdi; f++) {
+		for (s->d.va[f] = 0.0, n = 0; n < nno; n++)
+			s->d.va[f] += s->d.a[n].v[f];
+		s->d.va[f] /= (double)nno;
+	}
+
+	/* Re-solve each output plane at the final resolution */
+	fit_planes(s, 1);
+
+	/* Invalidate things that depend on the grid values */
+	s->g.fminmax_valid = 0;
+	free_rev(s);
+	spline_grid_changed(s);
+
+	/* Return non-mono check */
+	return is_mono(s);
+}
+
+/* Add to or replace scattered data points, and refit. */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	co *d,			/* Array holding position and function values of data points */
+	int dno			/* Number of data points */
+) {
+	return refit_rspl_imp(s, flags, (void *)d, 0, dno);
+}
+
+/* Add to or replace scattered data points with weights, and refit. */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl_w(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	cow *d,			/* Array holding position, function and weight values of data points */
+	int dno			/* Number of data points */
+) {
+	return refit_rspl_imp(s, flags, (void *)d, 1, dno);
+}
+
 /* Init scattered data elements in rspl */
 void
 init_data(rspl *s) {
@@ -1005,6 +1304,8 @@ init_data(rspl *s) {
 	s->fit_rspl_ww   = fit_rspl_ww;
 	s->fit_rspl_df   = fit_rspl_df;
 	s->fit_rspl_w_df = fit_rspl_w_df;
+	s->refit_rspl    = refit_rspl;
+	s->refit_rspl_w  = refit_rspl_w;
 }
 
 /* Free the scattered data allocation */
@@ -32,6 +32,7 @@
 #include "numlib.h"
 
 int spline_interp_rspl(rspl *ss, co *cp);
+static int set_spline_lean(rspl *s, int ncells);
 
 #undef DEBUG
 
@@ -55,8 +56,27 @@ init_spline(rspl *s) {
 	s->spline.nm = 0;
 	s->spline.spline = 0;
 	s->spline.magic = NULL;
+	s->spline.ncells = 0;
+	s->spline.cells = NULL;
+	s->spline.stamp = 0;
 
 	s->spline_interp = spline_interp_rspl;
+	s->set_spline_lean = set_spline_lean;
+}
+
+/* Free the lean mode cell cache */
+static void free_spline_cells(rspl *s) {
+	int i;
+
+	if (s->spline.cells != NULL) {
+		for (i = 0; i < s->spline.ncells; i++) {
+			if (s->spline.cells[i].t != NULL)
+				free(s->spline.cells[i].t);
+		}
+		free(s->spline.cells);
+		s->spline.cells = NULL;
+	}
+	s->spline.ncells = 0;
 }
 
 /* Free up the spline interpolation info */
@@ -65,9 +85,67 @@ rspl *s		/* Pointer to rspl grid */
 ) {
 	if (s->spline.magic != NULL) {
 		free(s->spline.magic);
+		s->spline.magic = NULL;
 	}
 	s->spline.nm = 0;
 	s->spline.spline = 0;
+	free_spline_cells(s);
+}
+
+static void point_tang(rspl *s, float *gt, float *tp);
+
+/* Note that the grid values have changed, so that any */
+/* tangents in the expanded grid or the lean mode cell */
+/* cache are stale. Expanded tangents are re-computed in */
+/* place, so that the grid layout doesn't change. */
+void spline_grid_changed(
+rspl *s		/* Pointer to rspl grid */
+) {
+	int i;
+	float *gt;
+
+	for (i = 0; i < s->spline.ncells; i++)
+		s->spline.cells[i].ix = -1;
+
+	/* The values are the first fdi floats of each expanded grid point, */
+	/* and point_tang() only reads values, so this is safe to do in place. */
+	if (s->spline.spline) {
+		for (gt = s->g.a, i = 0; i < s->g.no; i++, gt += s->g.pss)
+			point_tang(s, gt, gt);
+	}
+}
+
+/* Select lean spline interpolation, in which the tangents of each */
+/* cell are computed when it is used, and kept in an LRU cache of */
+/* ncells cells, rather than being expanded into the whole grid. */
+/* ncells <= 0 restores the default of expanding the grid. */
+/* Return nz if the grid has already been expanded. */
+static int set_spline_lean(
+rspl *s,		/* Pointer to rspl grid */
+int ncells		/* Number of cells to cache */
+) {
+	int i;
+	int nct = (1 << s->di) * (1 << s->di) * s->fdi;	/* Floats per cell */
+
+	if (s->spline.spline)
+		return 1;
+
+	free_spline_cells(s);
+
+	if (ncells <= 0)
+		return 0;
+
+	if ((s->spline.cells = (spline_cell *) calloc(ncells, sizeof(spline_cell))) == NULL)
+		error("rspl malloc failed - spline cell cache");
+	s->spline.ncells = ncells;
+	for (i = 0; i < ncells; i++) {
+		s->spline.cells[i].ix = -1;
+		if ((s->spline.cells[i].t = (float *) malloc(sizeof(float) * nct)) == NULL)
+			error("rspl malloc failed - spline cell cache tangents");
+	}
+	s->spline.stamp = 0;
+
+	return 0;
 }
 
 /* ====================================================== */
@@ -82,122 +160,106 @@ static double hmagic[4][2][2] = {
 	{ { 2.0,  1.0}, {-2.0,  1.0} }
 };
 
-/* Allocate and initialize tangency information for each grid point */
-static void make_tang(
-rspl *s		/* Pointer to rspl grid */
+/* Compute the tangency information for the grid point gt, */
+/* (value and derivatives in each dimension combination) */
+/* using the plain grid. tp[] should have room for 2^di * fdi values. */
+static void point_tang(
+rspl *s,		/* Pointer to rspl grid */
+float *gt,		/* Grid point */
+float *tp		/* Returned [di combs.][fdi] values */
 ) {
-	int i,p,j;
 	int di  = s->di;
 	int fdi = s->fdi;
-	int nig = s->g.no;
-	float *tp;		/* Pointer to tangent values */
-	int nim, mix;	/* Number in magic, magic index */
-	float *tang_alloc, *tang;	/* Tangency info */
-	float *gt;		/* Working grid point */
-	
-//printf("~~make_tang called\n");
-	/* Organized as: tang[[grid]][di combs.][fdi] */
-	/* Allocate space for tangency info */
-	if ((tang_alloc = (float *) malloc(sizeof(float) * nig * (((1 << di) * fdi)+G_XTRA))) == NULL)
-		error("rspl malloc failed - tangecy points");
-	tang = tang_alloc + G_XTRA;	/* Offset for flags and non-mono error */
+	int ee;
 
-	/* For all grid points */
-	for (tp = tang, gt = s->g.a, i = 0; i < nig; i++, gt += s->g.pss, tp += G_XTRA) {
-		int ee;
-/* printf("\n~~ grid point %d\n",i); */
-
-		/* Look at surrounding grid points in combinations of +- 1 all dimensions */
-		for (ee = 0; ee < (1 << di); ee++) {
-			double av[MXRO];	/* average */
-			int nia = 0;		/* Number in average */
-			int f, ec;
-
-/* printf("Dim combo %d\n",ee); */
-			/* special case - base value */
-			if (ee == 0) { 
-				*((int *)(tp-2)) = *((int *)(gt-2));	/* Copy flags */
-				tp[-1] = gt[-1];						/* Copy ink limit function value */
-				for (f = 0; f < fdi; f++) {
-					*tp++ = gt[f];
-/* printf("Tang value out %d = %f\n",f,tp[-1]); */
-				}
-				continue;
-			}
+	/* Look at surrounding grid points in combinations of +- 1 all dimensions */
+	for (ee = 0; ee < (1 << di); ee++) {
+		double av[MXRO];	/* average */
+		int nia = 0;		/* Number in average */
+		int f, ec;
+
+		/* special case - base value */
+		if (ee == 0) { 
 			for (f = 0; f < fdi; f++)
-				av[f] = 0.0;	/* Init average */
-			/* For all surroundin grid points in this combination */
-			for (ec = 0; ec < (1 << di); ec++) {
-				int xo, io, sgn, e, ex;
-/* printf("~~checking out surrounding combo %d\n",ec); */
-				if (ec & ~ee) {
-/* printf("~~being skipped\n"); */
-					continue;	/* Skip invalid combo */
-				}
-				xo = io = 0;		/* Grid float offset */
-				sgn = 1;			/* Sign */
-				ex = 0;				/* Flag - No extrapolation */
-				for (e = 0; e < di; e++) {	/* For each dimension */
-/* printf("~~checking  dimension %d\n",e); */
-					if (!(ee & (1 << e))) {
-/* printf("~~dimension not active\n"); */
-						continue;	/* Dimension is not active */
-					}
-					if (ec & (1 << e)) {
-						/* If + dimension is valid */
-						if (((G_FL(gt,e) & 3) > 0) || (G_FL(gt,e) & 0x4)) {
-							int to = s->g.fci[e];	/* +1 in dimension */
-							io += to;				/* real/pivot point */
-							xo += to;				/* reflected point */
-						} else {
-							ex = 1;					/* Use extrapolation */
-							xo -= s->g.fci[e];		/* -1 in dimension */
-						}
+				*tp++ = gt[f];
+			continue;
+		}
+		for (f = 0; f < fdi; f++)
+			av[f] = 0.0;	/* Init average */
+		/* For all surroundin grid points in this combination */
+		for (ec = 0; ec < (1 << di); ec++) {
+			int xo, io, sgn, e, ex;
+			if (ec & ~ee)
+				continue;	/* Skip invalid combo */
+			xo = io = 0;		/* Grid float offset */
+			sgn = 1;			/* Sign */
+			ex = 0;				/* Flag - No extrapolation */
+			for (e = 0; e < di; e++) {	/* For each dimension */
+				if (!(ee & (1 << e)))
+					continue;	/* Dimension is not active */
+				if (ec & (1 << e)) {
+					/* If + dimension is valid */
+					if (((G_FL(gt,e) & 3) > 0) || (G_FL(gt,e) & 0x4)) {
+						int to = s->g.fci[e];	/* +1 in dimension */
+						io += to;				/* real/pivot point */
+						xo += to;				/* reflected point */
 					} else {
-						sgn = -sgn;			/* Reverse sign */
-						/* If - dimension is valid */
-						if (((G_FL(gt,e) & 3) > 0) || !(G_FL(gt,e) & 0x4)) {
-							int to = -s->g.fci[e];	/* -1 in dimension */
-							io += to;				/* real/pivot point */
-							xo += to;				/* reflected point */
-						} else {
-							ex = 1;					/* Use extrapolation */
-							xo += s->g.fci[e];		/* +1 in dimension */
-						}
+						ex = 1;					/* Use extrapolation */
+						xo -= s->g.fci[e];		/* -1 in dimension */
 					}
-				}
-				/* Add surrounding grid points value into the average */
-				if (!ex) {
-					for (f = 0; f < fdi; f++) 
-						av[f] += (double)sgn * gt[io + f];
-				} else {	/* Extrapolate point beyond edge */
-							/* Use an extrapolation that tries to maintain curvature */
-					for (f = 0; f < fdi; f++)  {
-						double v0,v1,v2;
-						v0 = gt[io + f];			/* Pivot point */
-						v1 = gt[xo + f];			/* Reflection of target in pivot */
-						v2 = gt[2 * xo - io + f];	/* Reflection +2 */
-						av[f] += (double)sgn * (3.0 * (v0 - v1) + v2);
+				} else {
+					sgn = -sgn;			/* Reverse sign */
+					/* If - dimension is valid */
+					if (((G_FL(gt,e) & 3) > 0) || !(G_FL(gt,e) & 0x4)) {
+						int to = -s->g.fci[e];	/* -1 in dimension */
+						io += to;				/* real/pivot point */
+						xo += to;				/* reflected point */
+					} else {
+						ex = 1;					/* Use extrapolation */
+						xo += s->g.fci[e];		/* +1 in dimension */
 					}
 				}
-				nia++;
 			}
-			for (f = 0; f < fdi; f++) {
-				*tp++ = (float)(av[f]/(double)nia);
-/* printf("Tang value out %d = %f, average of %d\n",f,tp[-1],nia); */
+			/* Add surrounding grid points value into the average */
+			if (!ex) {
+				for (f = 0; f < fdi; f++) 
+					av[f] += (double)sgn * gt[io + f];
+			} else {	/* Extrapolate point beyond edge */
+						/* Use an extrapolation that tries to maintain curvature */
+				for (f = 0; f < fdi; f++)  {
+					double v0,v1,v2;
+					v0 = gt[io + f];			/* Pivot point */
+					v1 = gt[xo + f];			/* Reflection of target in pivot */
+					v2 = gt[2 * xo - io + f];	/* Reflection +2 */
+					av[f] += (double)sgn * (3.0 * (v0 - v1) + v2);
+				}
 			}
-		}	/* Next dimension combination */
-	}	/* Next grid point */
+			nia++;
+		}
+		for (f = 0; f < fdi; f++)
+			*tp++ = (float)(av[f]/(double)nia);
+	}	/* Next dimension combination */
+}
+
+/* Create the hermite magic matrix if it doesn't exist */
+static void make_magic(
+rspl *s		/* Pointer to rspl grid */
+) {
+	int i,p,j;
+	int di  = s->di;
+	int fdi = s->fdi;
+	int nim, mix;	/* Number in magic, magic index */
+
+	if (s->spline.magic != NULL)
+		return;
 
 	/* Create a full sized hermite magic matrix */
 	/* Organized as: magic[4^di][2^di][2^di] */
 	/* = [param power combos][cube vertex index][di combos], */
 	/* but then only store non-zero weight values. */
 	for (i = 0, nim = 1; i < di; nim *= 10, i++);	/* Number of entries needed */
-	if (s->spline.magic == NULL) { /* Allocate space for magic matrix info */
-		if ((s->spline.magic = (magic_data *) malloc(sizeof(magic_data) * nim)) == NULL)
-			error("rspl malloc failed - hermite magic matrix data");
-	}
+	if ((s->spline.magic = (magic_data *) malloc(sizeof(magic_data) * nim)) == NULL)
+		error("rspl malloc failed - hermite magic matrix data");
 
 	mix = 0;
 	for (p = 0; p < (1 << (2 * di)); p++) {		/* For all combinations of parameter powers */
@@ -220,6 +282,35 @@ rspl *s		/* Pointer to rspl grid */
 	}
 	/* mix should == nim! */
 	s->spline.nm = nim;
+}
+
+/* Allocate and initialize tangency information for each grid point */
+static void make_tang(
+rspl *s		/* Pointer to rspl grid */
+) {
+	int i;
+	int di  = s->di;
+	int fdi = s->fdi;
+	int nig = s->g.no;
+	int tpss = (1 << di) * fdi + G_XTRA;	/* Tangent grid point spacing */
+	float *tp;		/* Pointer to tangent values */
+	float *tang_alloc, *tang;	/* Tangency info */
+	float *gt;		/* Working grid point */
+	
+	/* Organized as: tang[[grid]][di combs.][fdi] */
+	/* Allocate space for tangency info */
+	if ((tang_alloc = (float *) malloc(sizeof(float) * nig * tpss)) == NULL)
+		error("rspl malloc failed - tangecy points");
+	tang = tang_alloc + G_XTRA;	/* Offset for flags and non-mono error */
+
+	/* For all grid points */
+	for (tp = tang, gt = s->g.a, i = 0; i < nig; i++, gt += s->g.pss, tp += tpss) {
+		*((int *)(tp-2)) = *((int *)(gt-2));	/* Copy flags */
+		tp[-1] = gt[-1];						/* Copy ink limit function value */
+		point_tang(s, gt, tp);
+	}
+
+	make_magic(s);
 
 	/* Free basic grid info, and substitute tangency enhanced version */
 	/* ~~~~!! need to free any other structures in rspl that depend on */
@@ -231,15 +322,43 @@ rspl *s		/* Pointer to rspl grid */
 	s->g.a      = tang;
 
 	/* Adjust index tables */
-	s->g.pss = (1 << di) * fdi + G_XTRA;
+	s->g.pss = tpss;
 	for (i = 0; i < di; i++)
 		s->g.fci[i] = s->g.ci[i] * s->g.pss;	/* In floats */
 	for (i = 0; i < (1 << di); i++)
 		s->g.fhi[i] = s->g.hi[i] * s->g.pss;	/* In floats */
 
 	s->spline.spline = 1;
+}
+
+/* Return the tangency information for the cube with base grid */
+/* point gb, from the lean mode cell cache, computing it if needed. */
+/* Returns a pointer to [2^di corners][di combs.][fdi] values */
+static float *cell_tang(
+rspl *s,		/* Pointer to rspl grid */
+float *gb		/* Cube base grid point */
+) {
+	int i, ix = (int)(gb - s->g.a);
+	int nct = (1 << s->di) * s->fdi;	/* Floats per corner */
+	spline_cell *cp, *lp;
+
+	/* Look for it, and note the least recently used cell */
+	for (lp = cp = s->spline.cells; cp < &s->spline.cells[s->spline.ncells]; cp++) {
+		if (cp->ix == ix)
+			break;
+		if (cp->ix == -1 || (lp->ix != -1 && cp->lu < lp->lu))
+			lp = cp;
+	}
 
-//printf("~~make_tang finished\n");
+	if (cp >= &s->spline.cells[s->spline.ncells]) {	/* Not found, so replace LRU */
+		cp = lp;
+		for (i = 0; i < (1 << s->di); i++)
+			point_tang(s, gb + s->g.fhi[i], cp->t + i * nct);
+		cp->ix = ix;
+	}
+	cp->lu = ++s->spline.stamp;
+
+	return cp->t;
 }
 
 /* Do a Hermite spline smooth interpolation based on the finest grid */
@@ -268,7 +387,9 @@ co *cp			/* Input value and returned function value */
 	if (fdi > MXRO)
 		error("rspl: spline can't handle fdi = %d",fdi);
 
-	if (s->spline.spline == 0) 	/* Compute tangent info if it doesn't exist */
+	if (s->spline.ncells > 0) 	/* Lean mode, compute tangents of cell as needed */
+		make_magic(s);
+	else if (s->spline.spline == 0) 	/* Compute tangent info if it doesn't exist */
 		make_tang(s);
 
 	/* Locate grid base point, and position with base cube */
@@ -301,8 +422,14 @@ co *cp			/* Input value and returned function value */
 	}
 
 	/* Compute indexes into cube corners in tangent array */
-	for (i = 1; i < (1 << di); i++)
-		ga[i] = ga[0] + s->g.fhi[i];
+	if (s->spline.ncells > 0) {
+		float *ct = cell_tang(s, ga[0]);
+		for (i = 0; i < (1 << di); i++)
+			ga[i] = ct + i * (1 << di) * fdi;
+	} else {
+		for (i = 1; i < (1 << di); i++)
+			ga[i] = ga[0] + s->g.fhi[i];
+	}
 
 	/* Now compute the output values */
 	for (f = 0; f < fdi; f++)		/* Zero output value sums */
@@ -0,0 +1,258 @@
+
+/************************************************/
+/* Test the multilevel B-spline scattered       */
+/* data interpolation used by fit_rspl()        */
+/* for more than MXRI input dimensions.         */
+/************************************************/
+
+/* Author: Argyll CMS contributors
+ * Date:   18/10/2026
+ *
+ * Copyright 2026 Argyll CMS contributors
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Checks that the cubic B-spline basis weights are a partition
+ * of unity with the right knot values, that a fit is continuous
+ * across the knots of every level, that it reproduces a linear
+ * function and approximates a smooth one, and that fit_rspl()
+ * uses it to set an rspl with more than MXRI inputs.
+ * Exits with a non-zero status on failure.
+ */
+
+#include "mlbs.c"		/* For direct access to the static basis() */
+
+#define DI 5			/* Input dimensions */
+#define FDI 2			/* Output dimensions */
+#define NPTS 2000		/* Number of scattered data points */
+#define RES 9			/* Target resolution */
+#define GRES 9			/* rspl grid resolution */
+#define NTEST 2000		/* Number of test points */
+#define LIN_TOL 1e-6	/* Maximum linear function error */
+#define FIT_TOL 0.1		/* Maximum smooth function RMS error */
+
+/* Linear function */
+static void lfunc(double *out, double *in) {
+	int e;
+
+	out[0] = 0.1;
+	out[1] = 0.5;
+	for (e = 0; e < DI; e++) {
+		out[0] += 0.2 * (e + 1.0) * in[e];
+		out[1] -= 0.3 * (DI - e) * in[e];
+	}
+}
+
+/* Smooth function being fitted */
+static void func(double *out, double *in) {
+	int e;
+	double ss = 0.0;
+
+	for (e = 0; e < DI; e++)
+		ss += (e + 1.0) * in[e];
+	out[0] = sin(3.0 * ss/DI) + in[0] * in[0] * in[1];
+	out[1] = cos(2.0 * in[0]) * in[2] + in[3] * in[4] * in[4];
+}
+
+/* Create some scattered data points from a function */
+static coww *make_pts(void (*fn)(double *out, double *in)) {
+	int i, e, f;
+	coww *pts;
+
+	if ((pts = (coww *)malloc(NPTS * sizeof(coww))) == NULL)
+		error("Malloc of test points failed");
+
+	for (i = 0; i < NPTS; i++) {
+		for (e = 0; e < DI; e++)
+			pts[i].p[e] = d_rand(0.0, 1.0);
+		fn(pts[i].v, pts[i].p);
+		for (f = 0; f < FDI; f++)
+			pts[i].w[f] = 1.0;
+	}
+	return pts;
+}
+
+/* Fit a B-spline to points from a function */
+static mlbs *fit(void (*fn)(double *out, double *in)) {
+	double l[DI], h[DI];
+	coww *pts;
+	mlbs *p;
+	int e;
+
+	for (e = 0; e < DI; e++) {
+		l[e] = 0.0;
+		h[e] = 1.0;
+	}
+	pts = make_pts(fn);
+	if ((p = new_mlbs(DI, FDI, RES, pts, NPTS, l, h, 0.0)) == NULL)
+		error("new_mlbs failed");
+	free(pts);
+	return p;
+}
+
+/* Return the RMS error of a B-spline fit to a function */
+/* at random points, and the maximum error in *mxe */
+static double fit_err(mlbs *p, void (*fn)(double *out, double *in), double *mxe) {
+	int i, e, f;
+	double ss = 0.0;
+
+	*mxe = 0.0;
+	for (i = 0; i < NTEST; i++) {
+		co tp;
+		double v[FDI];
+
+		for (e = 0; e < DI; e++)
+			tp.p[e] = d_rand(0.0, 1.0);
+		p->lookup(p, &tp);
+		fn(v, tp.p);
+		for (f = 0; f < FDI; f++) {
+			double ee = fabs(tp.v[f] - v[f]);
+			ss += ee * ee;
+			if (ee > *mxe)
+				*mxe = ee;
+		}
+	}
+	return sqrt(ss/(NTEST * FDI));
+}
+
+/* Return the RMS error of an rspl fit_rspl() to a function */
+/* at random points, and the maximum error in *mxe */
+static double rspl_err(void (*fn)(double *out, double *in), double *mxe) {
+	int i, e, f, gres[MXDI];
+	double ss = 0.0;
+	coww *pts;
+	co *dp;
+	rspl *s;
+
+	pts = make_pts(fn);
+	if ((dp = (co *)malloc(NPTS * sizeof(co))) == NULL)
+		error("Malloc of test points failed");
+	for (i = 0; i < NPTS; i++) {
+		for (e = 0; e < DI; e++)
+			dp[i].p[e] = pts[i].p[e];
+		for (f = 0; f < FDI; f++)
+			dp[i].v[f] = pts[i].v[f];
+	}
+	free(pts);
+
+	for (e = 0; e < DI; e++)
+		gres[e] = GRES;
+	s = new_rspl(RSPL_NOFLAGS, DI, FDI);
+	s->fit_rspl(s, 0, dp, NPTS, NULL, NULL, gres, NULL, NULL, 0.0, NULL, NULL);
+	free(dp);
+
+	*mxe = 0.0;
+	for (i = 0; i < NTEST; i++) {
+		co tp;
+		double v[FDI];
+
+		for (e = 0; e < DI; e++)
+			tp.p[e] = d_rand(0.0, 1.0);
+		s->interp(s, &tp);
+		fn(v, tp.p);
+		for (f = 0; f < FDI; f++) {
+			double ee = fabs(tp.v[f] - v[f]);
+			ss += ee * ee;
+			if (ee > *mxe)
+				*mxe = ee;
+		}
+	}
+	s->del(s);
+	return sqrt(ss/(NTEST * FDI));
+}
+
+int main(int argc, char *argv[]) {
+	int i, e, f;
+	int fail = 0;
+	double b[4], bb[4], mxe, rms;
+	mlbs *p;
+
+	printf("Test of mlbs\n");
+
+	/* Partition of unity, and value at the knots */
+	for (mxe = 0.0, i = 0; i <= 1000; i++) {
+		double t = i/1000.0, sum = 0.0;
+		basis(b, t);
+		for (e = 0; e < 4; e++)
+			sum += b[e];
+		if (fabs(sum - 1.0) > mxe)
+			mxe = fabs(sum - 1.0);
+	}
+	printf("Basis partition of unity max error = %e\n",mxe);
+	if (mxe > 1e-12)
+		fail = 1;
+
+	basis(b, 0.0);
+	basis(bb, 1.0);
+	for (mxe = 0.0, e = 0; e < 4; e++) {
+		double ev0[4] = { 1.0/6.0, 4.0/6.0, 1.0/6.0, 0.0 };
+		double ev1[4] = { 0.0, 1.0/6.0, 4.0/6.0, 1.0/6.0 };
+		if (fabs(b[e] - ev0[e]) > mxe)
+			mxe = fabs(b[e] - ev0[e]);
+		if (fabs(bb[e] - ev1[e]) > mxe)
+			mxe = fabs(bb[e] - ev1[e]);
+	}
+	printf("Basis knot value max error = %e\n",mxe);
+	if (mxe > 1e-12)
+		fail = 1;
+
+	/* A linear function should be reproduced */
+	p = fit(lfunc);
+	rms = fit_err(p, lfunc, &mxe);
+	printf("Linear fit RMS error = %e, max = %e\n",rms,mxe);
+	if (mxe > LIN_TOL)
+		fail = 1;
+	p->del(p);
+
+	/* A smooth function should be approximated */
+	p = fit(func);
+	rms = fit_err(p, func, &mxe);
+	printf("Smooth fit RMS error = %e, max = %e\n",rms,mxe);
+	if (rms > FIT_TOL)
+		fail = 1;
+
+	/* 0.5 is a knot of every level after the first, so check */
+	/* that the fit doesn't jump there in each dimension. */
+	for (mxe = 0.0, i = 0; i < 200; i++) {
+		co c0, c1;
+		for (e = 0; e < DI; e++)
+			c0.p[e] = d_rand(0.0, 1.0);
+		for (e = 0; e < DI; e++) {
+			c1 = c0;
+			c0.p[e] = 0.5 - 1e-9;
+			c1.p[e] = 0.5 + 1e-9;
+			p->lookup(p, &c0);
+			p->lookup(p, &c1);
+			for (f = 0; f < FDI; f++) {
+				if (fabs(c0.v[f] - c1.v[f]) > mxe)
+					mxe = fabs(c0.v[f] - c1.v[f]);
+			}
+			c0.p[e] = d_rand(0.0, 1.0);
+		}
+	}
+	printf("Fit knot discontinuity max = %e\n",mxe);
+	if (mxe > 1e-6)
+		fail = 1;
+	p->del(p);
+
+	/* fit_rspl() should set the grid from the B-spline */
+	rms = rspl_err(lfunc, &mxe);
+	printf("Linear fit_rspl() RMS error = %e, max = %e\n",rms,mxe);
+	if (mxe > LIN_TOL)
+		fail = 1;
+
+	rms = rspl_err(func, &mxe);
+	printf("Smooth fit_rspl() RMS error = %e, max = %e\n",rms,mxe);
+	if (rms > FIT_TOL)
+		fail = 1;
+
+	if (fail) {
+		printf("Test failed\n");
+		return 1;
+	}
+	printf("Test passed\n");
+	return 0;
+}
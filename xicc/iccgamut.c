@@ -57,6 +57,7 @@ void usage(char *diag) {
 	fprintf(stderr," -v            Verbose\n");
 	fprintf(stderr," -d sres       Surface resolution details 1.0 - 50.0\n");
 	fprintf(stderr," -w            emit %s %s file as well as CGATS .gam file\n",vrml_format(),vrml_ext());
+	fprintf(stderr," -b            Write a binary .gam file, that is faster to load\n");
 	fprintf(stderr," -n            Don't add %s axes or white/black point\n",vrml_format());
 	fprintf(stderr," -k            Add %s markers for prim. & sec. \"cusp\" points\n",vrml_format());
 	fprintf(stderr,"               (Set env. ARGYLL_3D_DISP_FORMAT to VRML, X3D or X3DOM to change format)\n");
@@ -106,6 +107,7 @@ main(int argc, char *argv[]) {
 	int verb = 0;
 	int rv = 0;
 	int vrml = 0;
+	int binary = 0;
 	int doaxes = 1;
 	int docusps = 0;
 	double gamres = GAMRES;		/* Surface resolution */
@@ -249,6 +251,10 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V') {
 				verb = 1;
 			}
+			/* Binary .gam output */
+			else if (argv[fa][1] == 'b' || argv[fa][1] == 'B') {
+				binary = 1;
+			}
 			/* VRML output */
 			else if (argv[fa][1] == 'w' || argv[fa][1] == 'W') {
 				vrml = 1;
@@ -489,7 +495,7 @@ main(int argc, char *argv[]) {
 		if ((gam = luo->get_gamut(luo, gamres)) == NULL)
 			error ("%d, %s",xicco->errc, xicco->err);
 
-		if (gam->write_gam(gam, out_name))
+		if ((binary ? gam->write_bgam(gam, out_name) : gam->write_gam(gam, out_name)) != 0)
 			error ("write gamut failed on '%s'",out_name);
 
 		if (vrml) {
@@ -69,6 +69,7 @@ void usage(void) {
 	fprintf(stderr," -v            Verbose\n");
 	fprintf(stderr," -d sres       Surface resolution details 1.0 - 50.0\n");
 	fprintf(stderr," -w            emit %s %s file as well as CGATS .gam file\n",vrml_format(),vrml_ext());
+	fprintf(stderr," -b            Write a binary .gam file, that is faster to load\n");
 	fprintf(stderr," -n            Don't add %s axes or white/black point\n",vrml_format());
 	fprintf(stderr," -k            Add %s markers for prim. & sec. \"cusp\" points\n",vrml_format());
 	fprintf(stderr,"               (set env. ARGYLL_3D_DISP_FORMAT to VRML, X3D or X3DOM to change format)\n");
@@ -324,6 +325,282 @@ J_COLOR_SPACE cspace
 	return buf;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Parallel conversion of a block of image lines to PCS values. */
+/* Each line is converted by one of the worker threads, each of */
+/* which keeps a cache of the raw pixel values it has already */
+/* converted, so that the (expensive) lookup is mostly only done */
+/* once for each distinct pixel value. (Forward lookups only read */
+/* the lookup object, so the threads can share it.) */
+/* Repeated pixel values are then removed in line order, so that */
+/* the values added to the gamut don't depend on the number of threads. */
+
+#define BLOCK_PIXELS (1 << 18)		/* Target number of pixels in a block of lines */
+#define CACHE_BITS 16				/* log2 of per thread pixel cache size */
+#define CACHE_SIZE (1 << CACHE_BITS)
+#define SEEN_BITS 20				/* log2 of distinct pixel value set size */
+#define SEEN_SIZE (1 << SEEN_BITS)
+
+/* Hash index of a packed pixel value */
+#define PIXHASH(key, bits) ((unsigned int)(((key) * (ORD64)0x9e3779b97f4a7c15) >> (64 - (bits))))
+
+/* Per thread cache of converted pixel values */
+typedef struct {
+	ORD64 *key;				/* Packed raw pixel value */
+	double (*val)[3];		/* Converted value */
+	unsigned char *used;	/* Flag, entry is in use */
+	int nused;				/* Number of entries in use */
+	double nlookups;		/* Number of pixels actually converted */
+} pixcache;
+
+/* Block conversion context */
+typedef struct {
+	/* Pixel conversion */
+	int width;
+	int bitspersample, samplesperpixel;
+	int nchan;				/* Number of samples that are color */
+	int sign_mask;
+	void (*cvt)(double *out, double *in);	/* TIFF conversion function, NULL if none */
+	icxLuBase *luo;			/* Lookup object, NULL if Lab */
+	icColorSpaceSignature outs;	/* luo output space */
+	icc *icco;
+	icxcam *cam;			/* CAM for Lab TIFF to Jab, NULL if none */
+	int pack;				/* nz if pixel values fit in a key */
+
+	/* Block */
+	int nlines;				/* Maximum number of lines in block */
+	size_t linesize;		/* Bytes per line */
+	unsigned char *inbuf;	/* [nlines][linesize] raw pixel values */
+	ORD64 *key;				/* [nlines][width] packed pixel values if pack */
+	double (*out)[3];		/* [nlines][width] PCS values */
+	double (*lmin)[3], (*lmax)[3];	/* [nlines] range of each lines values */
+
+	int nthr;				/* Number of worker threads */
+	pixcache *pc;			/* [nthr] */
+
+	/* Set of pixel values already added */
+	ORD64 *skey;
+	unsigned char *sused;
+	int snused;
+} pixblock;
+
+/* Setup a pixblock for the given image. */
+/* (The pixel conversion members must be set first) */
+static void init_pixblock(pixblock *p, size_t linesize) {
+	int i;
+
+	p->linesize = linesize;
+	if ((p->nlines = BLOCK_PIXELS/p->width) < 1)
+		p->nlines = 1;
+
+	/* Raw pixel values are used as the key if they fit */
+	p->pack = (p->nchan * p->bitspersample) <= 64;
+
+	if ((p->inbuf = (unsigned char *)malloc(p->nlines * linesize)) == NULL
+	 || (p->key = (ORD64 *)malloc((size_t)p->nlines * p->width * sizeof(ORD64))) == NULL
+	 || (p->out = (double (*)[3])malloc((size_t)p->nlines * p->width * sizeof(double [3]))) == NULL
+	 || (p->lmin = (double (*)[3])malloc(p->nlines * sizeof(double [3]))) == NULL
+	 || (p->lmax = (double (*)[3])malloc(p->nlines * sizeof(double [3]))) == NULL)
+		error("Malloc failed on input line block");
+
+	/* Allocate the caches the first time */
+	if (p->pc == NULL) {
+		p->nthr = pfor_nthreads();
+		if ((p->pc = (pixcache *)calloc(p->nthr, sizeof(pixcache))) == NULL)
+			error("Malloc failed on pixel caches");
+		for (i = 0; i < p->nthr; i++) {
+			if ((p->pc[i].key = (ORD64 *)malloc(CACHE_SIZE * sizeof(ORD64))) == NULL
+			 || (p->pc[i].val = (double (*)[3])malloc(CACHE_SIZE * sizeof(double [3]))) == NULL
+			 || (p->pc[i].used = (unsigned char *)malloc(CACHE_SIZE)) == NULL)
+				error("Malloc failed on pixel cache");
+		}
+		if ((p->skey = (ORD64 *)malloc(SEEN_SIZE * sizeof(ORD64))) == NULL
+		 || (p->sused = (unsigned char *)malloc(SEEN_SIZE)) == NULL)
+			error("Malloc failed on pixel value set");
+	}
+
+	/* The raw pixel values of each image may mean something different */
+	for (i = 0; i < p->nthr; i++) {
+		memset(p->pc[i].used, 0, CACHE_SIZE);
+		p->pc[i].nused = 0;
+	}
+	memset(p->sused, 0, SEEN_SIZE);
+	p->snused = 0;
+}
+
+/* Free the block buffers of a pixblock */
+static void free_pixblock(pixblock *p) {
+	free(p->inbuf);
+	free(p->key);
+	free(p->out);
+	free(p->lmin);
+	free(p->lmax);
+	p->inbuf = NULL;
+	p->key = NULL;
+	p->out = NULL;
+	p->lmin = p->lmax = NULL;
+}
+
+/* Free the caches of a pixblock */
+static void free_pixcaches(pixblock *p) {
+	int i;
+
+	for (i = 0; i < p->nthr; i++) {
+		free(p->pc[i].key);
+		free(p->pc[i].val);
+		free(p->pc[i].used);
+	}
+	free(p->pc);
+	p->pc = NULL;
+	free(p->skey);
+	free(p->sused);
+	p->skey = NULL;
+	p->sused = NULL;
+}
+
+/* Convert line ix of the block. Called by pfor() */
+static void conv_line(void *cntx, int thix, int ix) {
+	pixblock *p = (pixblock *)cntx;
+	pixcache *pc = &p->pc[thix];
+	unsigned char *inbuf = p->inbuf + ix * p->linesize;
+	ORD64 *lkey = p->key + (size_t)ix * p->width;
+	double (*lout)[3] = p->out + (size_t)ix * p->width;
+	double *lmin = p->lmin[ix], *lmax = p->lmax[ix];
+	int x, i;
+
+	lmin[0] = lmin[1] = lmin[2] = 1e6;
+	lmax[0] = lmax[1] = lmax[2] = -1e6;
+
+	for (x = 0; x < p->width; x++) {
+		double in[MAX_CHAN], out[MAX_CHAN];
+		ORD64 key = 0;
+		unsigned int hix = 0;
+		int rv;
+
+		/* See if we've already converted this pixel value */
+		if (p->pack) {
+			if (p->bitspersample == 8) {
+				for (i = 0; i < p->nchan; i++)
+					key = (key << 8) | inbuf[x * p->samplesperpixel + i];
+			} else {
+				for (i = 0; i < p->nchan; i++)
+					key = (key << 16) | ((unsigned short *)inbuf)[x * p->samplesperpixel + i];
+			}
+			lkey[x] = key;
+			for (hix = PIXHASH(key, CACHE_BITS); pc->used[hix]; hix = (hix + 1) & (CACHE_SIZE-1)) {
+				if (pc->key[hix] == key)
+					break;
+			}
+			if (pc->used[hix]) {
+				lout[x][0] = pc->val[hix][0];
+				lout[x][1] = pc->val[hix][1];
+				lout[x][2] = pc->val[hix][2];
+				continue;		/* Already in lmin/lmax */
+			}
+		}
+
+		if (p->bitspersample == 8) {
+			for (i = 0; i < p->samplesperpixel; i++) {
+				int v = inbuf[x * p->samplesperpixel + i];
+				if (p->sign_mask & (1 << i))		/* Treat input as signed */
+					v = (v & 0x80) ? v - 0x80 : v + 0x80;
+				in[i] = v/255.0;
+			}
+		} else {
+			for (i = 0; i < p->samplesperpixel; i++) {
+				int v = ((unsigned short *)inbuf)[x * p->samplesperpixel + i];
+				if (p->sign_mask & (1 << i))		/* Treat input as signed */
+					v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
+				in[i] = v/65535.0;
+			}
+		}
+		if (p->cvt != NULL) {	/* Undo TIFF encoding */
+			p->cvt(in, in);
+		}
+		/* ICC profile to convert RGB to Lab or Jab */
+		if (p->luo != NULL) {
+			if ((rv = p->luo->lookup(p->luo, out, in)) > 1)
+				error ("%d, %s",p->icco->errc,p->icco->err);
+			
+			if (p->outs == icSigXYZData) {	/* Convert to Lab */
+				icmXYZ2Lab(&p->icco->header->illuminant, out, out);
+			}
+		/* Lab TIFF - may need to convert to Jab */
+		} else if (p->cam != NULL) {
+			icmLab2XYZ(&icmD50, out, in);
+			p->cam->XYZ_to_cam(p->cam, out, out);
+
+		} else {
+			for (i = 0; i < p->samplesperpixel; i++)
+				out[i] = in[i];
+		}
+		pc->nlookups++;
+
+		for (i = 0; i < 3; i++) {
+			if (out[i] < lmin[i])
+				lmin[i] = out[i];
+			if (out[i] > lmax[i])
+				lmax[i] = out[i];
+			lout[x][i] = out[i];
+		}
+
+		/* Remember it, starting again if the cache is getting full */
+		if (p->pack) {
+			if (pc->nused >= (CACHE_SIZE/2)) {
+				memset(pc->used, 0, CACHE_SIZE);
+				pc->nused = 0;
+				hix = PIXHASH(key, CACHE_BITS);
+			}
+			pc->used[hix] = 1;
+			pc->key[hix] = key;
+			pc->val[hix][0] = out[0];
+			pc->val[hix][1] = out[1];
+			pc->val[hix][2] = out[2];
+			pc->nused++;
+		}
+	}
+}
+
+/* Move the PCS values of the first ny lines of the block whose pixel */
+/* values haven't been seen before to the start of out[], and return */
+/* the number of them. */
+static int distinct_pixels(pixblock *p, int ny) {
+	int n, j, npix = ny * p->width;
+	unsigned int hix;
+
+	if (!p->pack)
+		return npix;
+
+	for (n = j = 0; j < npix; j++) {
+		ORD64 key = p->key[j];
+
+		for (hix = PIXHASH(key, SEEN_BITS); p->sused[hix]; hix = (hix + 1) & (SEEN_SIZE-1)) {
+			if (p->skey[hix] == key)
+				break;
+		}
+		if (p->sused[hix])
+			continue;
+
+		/* Start again if the set is getting full */
+		if (p->snused >= (SEEN_SIZE/2)) {
+			memset(p->sused, 0, SEEN_SIZE);
+			p->snused = 0;
+			hix = PIXHASH(key, SEEN_BITS);
+		}
+		p->sused[hix] = 1;
+		p->skey[hix] = key;
+		p->snused++;
+
+		if (n != j) {
+			p->out[n][0] = p->out[j][0];
+			p->out[n][1] = p->out[j][1];
+			p->out[n][2] = p->out[j][2];
+		}
+		n++;
+	}
+	return n;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 int
 main(int argc, char *argv[]) {
@@ -334,11 +611,11 @@ main(int argc, char *argv[]) {
 	char *xl = NULL, out_name[MAXNAMEL+4+1] = { '\000' };	/* VRML/X3D output file */
 	int verb = 0;
 	int vrml = 0;
+	int binary = 0;
 	int doaxes = 1;
 	int docusps = 0;
 	int filter = 0;
 	double filtperc = 100.0;
-	int rv = 0;
 
 	icc *icco = NULL;
 	xicc *xicco = NULL;
@@ -368,7 +645,8 @@ main(int argc, char *argv[]) {
 	TIFFErrorHandler olderrh, oldwarnh;
 	TIFFErrorHandlerExt olderrhx, oldwarnhx;
 	TIFF *rh = NULL;
-	int x, y, width, height;					/* Size of image */
+	int x, y, ny, i, width, height;				/* Size of image */
+	int nout;									/* Number of values in block */
 	uint16 samplesperpixel, bitspersample;
 	uint16 pconfig, photometric, pmtc;
 	tdata_t *inbuf;
@@ -390,8 +668,11 @@ main(int argc, char *argv[]) {
 	gamut *gam;
 
 	double apcsmin[3], apcsmax[3];		/* Actual PCS range */
+	pixblock pb;						/* Block of lines being converted */
+	double npix = 0.0, ndist = 0.0;		/* Total number of pixels, distinct values */
 
 	error_program = argv[0];
+	memset((void *)&pb, 0, sizeof(pixblock));
 
 	if (argc < 2)
 		usage();
@@ -553,6 +834,10 @@ main(int argc, char *argv[]) {
 					usage();
 			}
 
+			/* Binary .gam output */
+			else if (argv[fa][1] == 'b' || argv[fa][1] == 'B') {
+				binary = 1;
+			}
 			/* VRML/X3D output */
 			else if (argv[fa][1] == 'w' || argv[fa][1] == 'W') {
 				vrml = 1;
@@ -979,15 +1264,25 @@ main(int argc, char *argv[]) {
 		}
 
 		/* - - - - - - - - - - - - - - - */
-		/* Process colors to translate */
-		/* (Should fix this to process a group of lines at a time ?) */
+		/* Process colors to translate, */
+		/* a block of lines at a time. */
+
+		pb.width = width;
+		pb.bitspersample = bitspersample;
+		pb.samplesperpixel = samplesperpixel;
+		pb.nchan = samplesperpixel - extrasamples;
+		pb.sign_mask = sign_mask;
+		pb.cvt = cvt;
+		pb.luo = luo;
+		pb.outs = outs;
+		pb.icco = icco;
+		pb.cam = cam;
 
 		if (rh != NULL)
-			inbuf  = _TIFFmalloc(TIFFScanlineSize(rh));
+			init_pixblock(&pb, TIFFScanlineSize(rh));
 		else {
 			inbpix = rj.output_width * rj.num_components;
-			if ((inbuf = (tdata_t *)malloc(inbpix)) == NULL)
-				error("Malloc failed on input line buffer");
+			init_pixblock(&pb, inbpix);
 
 			if (setjmp(jpeg_rerr.env)) {
 				/* Something went wrong with reading the file */
@@ -996,103 +1291,58 @@ main(int argc, char *argv[]) {
 			}
 		}
 
-		for (y = 0; y < height; y++) {
+		for (y = 0; y < height; y += ny) {
+			int ix;
 
-			/* Read in the next line */
-			if (rh) {
-				if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
-					error ("Failed to read TIFF line %d",y);
-			} else {
-				jpeg_read_scanlines(&rj, (JSAMPARRAY)&inbuf, 1);
-				if (iinv) {
-					unsigned char *cp, *ep = (unsigned char *)inbuf + inbpix;
-					for (cp = (unsigned char *)inbuf; cp < ep; cp++)
-						*cp = ~*cp;
-				}
-			}
+			if ((ny = height - y) > pb.nlines)
+				ny = pb.nlines;
 
-			/* Do floating point conversion */
-			for (x = 0; x < width; x++) {
-				int i;
-				double in[MAX_CHAN], out[MAX_CHAN];
-				
-//printf("~1 location %d,%d\n",x,y);
-				if (bitspersample == 8) {
-					for (i = 0; i < samplesperpixel; i++) {
-						int v = ((unsigned char *)inbuf)[x * samplesperpixel + i];
-//printf("~1 v[%d] = %d\n",i,v);
-						if (sign_mask & (1 << i))		/* Treat input as signed */
-							v = (v & 0x80) ? v - 0x80 : v + 0x80;
-//printf("~1 signed v[%d] = %d\n",i,v);
-						in[i] = v/255.0;
-//printf("~1 in[%d] = %f\n",i,in[i]);
-					}
+			/* Read in the next block of lines */
+			for (ix = 0; ix < ny; ix++) {
+				inbuf = (tdata_t *)(pb.inbuf + ix * pb.linesize);
+				if (rh) {
+					if (TIFFReadScanline(rh, inbuf, y + ix, 0) < 0)
+						error ("Failed to read TIFF line %d",y + ix);
 				} else {
-					for (i = 0; i < samplesperpixel; i++) {
-						int v = ((unsigned short *)inbuf)[x * samplesperpixel + i];
-//printf("~1 v[%d] = %d\n",i,v);
-						if (sign_mask & (1 << i))		/* Treat input as signed */
-							v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
-//printf("~1 signed v[%d] = %d\n",i,v);
-						in[i] = v/65535.0;
-//printf("~1 in[%d] = %f\n",i,in[i]);
+					jpeg_read_scanlines(&rj, (JSAMPARRAY)&inbuf, 1);
+					if (iinv) {
+						unsigned char *cp, *ep = (unsigned char *)inbuf + inbpix;
+						for (cp = (unsigned char *)inbuf; cp < ep; cp++)
+							*cp = ~*cp;
 					}
 				}
-				if (cvt != NULL) {	/* Undo TIFF encoding */
-					cvt(in, in);
-				}
-				/* ICC profile to convert RGB to Lab or Jab */
-				if (luo != NULL) {
-//printf("~1 RGB in value = %f %f %f\n",in[0],in[1],in[2]);
-					if ((rv = luo->lookup(luo, out, in)) > 1)
-						error ("%d, %s",icco->errc,icco->err);
-//printf("~1 after luo = %f %f %f\n",out[0],out[1],out[2]);
-					
-					if (outs == icSigXYZData) {	/* Convert to Lab */
-						icmXYZ2Lab(&icco->header->illuminant, out, out);
-//printf("~1 after XYZ2Lab = %f %f %f\n",out[0],out[1],out[2]);
-					}
-				/* Lab TIFF - may need to convert to Jab */
-				} else if (cam != NULL) {
-//printf("~1 Lab in value = %f %f %f\n",in[0],in[1],in[2]);
-					icmLab2XYZ(&icmD50, out, in);
-//printf("~1 XYZ = %f %f %f\n",out[0],out[1],out[2]);
-					cam->XYZ_to_cam(cam, out, out);
-//printf("~1 Jab = %f %f %f\n",out[0],out[1],out[2]);
+			}
 
-				} else {
-//printf("~1 Lab value = %f %f %f\n",in[0],in[1],in[2]);
-					for (i = 0; i < samplesperpixel; i++)
-						out[i] = in[i];
-				}
+			/* Do floating point conversion */
+			pfor(ny, pb.nthr, (void *)&pb, conv_line);
+			npix += (double)ny * width;
 
+			/* Add the results to the gamut in line order */
+			for (ix = 0; ix < ny; ix++) {
 				for (i = 0; i < 3; i++) {
-					if (out[i] < apcsmin[i]) {
-//printf("~1 new min %f\n",out[i]);
-						apcsmin[i] = out[i];
-					}
-					if (out[i] > apcsmax[i]) {
-//printf("~1 new max %f\n",out[i]);
-						apcsmax[i] = out[i];
-					}
+					if (pb.lmin[ix][i] < apcsmin[i])
+						apcsmin[i] = pb.lmin[ix][i];
+					if (pb.lmax[ix][i] > apcsmax[i])
+						apcsmax[i] = pb.lmax[ix][i];
 				}
-				if (filter)
-					add_fpixel(out);
-				else
-					gam->expand(gam, out);
+			}
+			if (filter) {		/* Filter needs every pixel */
+				for (x = 0; x < (ny * width); x++)
+					add_fpixel(pb.out[x]);
+			} else {
+				nout = distinct_pixels(&pb, ny);
+				gam->expand_n(gam, pb.out, nout);
+				ndist += nout;
 			}
 		}
 
 		/* Release buffers and close files */
+		free_pixblock(&pb);
 		if (rh != NULL) {
-			if (inbuf != NULL)
-				_TIFFfree(inbuf);
 			TIFFClose(rh); /* Close Input file */
 		} else {
 			jpeg_finish_decompress(&rj);
 			jpeg_destroy_decompress(&rj);
-			if (inbuf != NULL)
-				free(inbuf);
 			if (fclose(rf))
 				error("Error closing JPEG input file '%s'\n",in_name);
 		}
@@ -1103,8 +1353,18 @@ main(int argc, char *argv[]) {
 		}
 	}
 
-	if (verb)
+	if (verb) {
+		double nlookups = 0.0;
+
+		for (i = 0; i < pb.nthr; i++)
+			nlookups += pb.pc[i].nlookups;
+		printf("Converted %.0f of %.0f pixels using %d thread%s\n",
+		       nlookups, npix, pb.nthr, pb.nthr > 1 ? "s" : "");
+		if (!filter)
+			printf("Added %.0f distinct pixel values to the gamut\n",ndist);
 		printf("Actual PCS range = %f..%f, %f..%f. %f..%f\n\n", apcsmin[0], apcsmax[0], apcsmin[1], apcsmax[1], apcsmin[2], apcsmax[2]);
+	}
+	free_pixcaches(&pb);
 
 	if (filter)
 		del_filter();
@@ -1135,7 +1395,7 @@ main(int argc, char *argv[]) {
 		printf("Output Gamut file '%s'\n",out_name);
 
 	/* Create the VRML/X3D file */
-	if (gam->write_gam(gam,out_name))
+	if ((binary ? gam->write_bgam(gam, out_name) : gam->write_gam(gam, out_name)) != 0)
 		error ("write gamut failed on '%s'",out_name);
 
 	if (vrml) {
@@ -345,6 +345,7 @@ xicc *new_xicc(icc *picc);
 	struct _xicc    *pp;					/* Pointer to XICC we're a part of */		\
 	icmLuBase       *plu;					/* Pointer to icm Lu we are expanding */	\
 	int              flags;					/* Flags passed to get_luobj */				\
+	int              shared;				/* NZ if a clone sharing plu, cam etc. */	\
 	icmLookupFunc    func;					/* Function passed to get_luobj */			\
 	icRenderingIntent intent;				/* Effective/External Intent */				\
 											/* "in" and "out" are in reference to */	\
@@ -381,6 +382,16 @@ xicc *new_xicc(icc *picc);
 	/* Public: */																		\
 	void    (*del)(struct _icxLuBase *p);												\
 																						\
+	/* Return a new lookup object that does the same conversions, and that can */	\
+	/* be used at the same time as this one from another thread. The clone */		\
+	/* shares the fitted lookup data, but has its own reverse lookup caches and */	\
+	/* search state, so lookup() and inv_lookup() (and the component lookups) */	\
+	/* are thread safe as long as each thread uses its own object. */				\
+	/* Any lazily created lookup data is created before cloning. */					\
+	/* The clone must be deleted before the object it was cloned from. */			\
+	/* Return NULL on error, check xicc errc+err for reason */						\
+	struct _icxLuBase * (*clone)(struct _icxLuBase *p);								\
+																						\
 								/* Return Internal native colorspaces */				\
 	void    (*lutspaces) (struct _icxLuBase *p, icColorSpaceSignature *ins, int *inn,	\
 	                                        icColorSpaceSignature *outs, int *outn,		\
@@ -526,6 +537,8 @@ struct _icxLuLut {
 									/* (Only set by icxLu_comp_bk_point()) */
 	icxInk      ink;				/* inking details */
 	double Lmin, Lmax;				/* L min/max for inking rule */
+	int defsetup;					/* NZ if Lmin/Lmax and vector clip setup */
+									/* is deferred until the first reverse lookup */
 
 	/* Auxiliary parameter flags, non-zero for inputs that will be */
 	/* used as auxiliary parameters the rspl input */
@@ -925,14 +925,30 @@ main(int argc, char *argv[]) {
 		if (sptest) {
 			icxLuLut *clu;
 			double cent[3] = { 50.0, 0.0, 0.0 };
+			void **clus;		/* Per thread lookups */
+			int i, nthr;
 
 			if (luo->plu->ttype != icmLutType)
 				error("Special test only works on CLUT profiles");
 
 			clu = (icxLuLut *)luo;
 
-			clu->clutTable->comp_gamut(clu->clutTable, cent, NULL, spoutf, clu, spioutf, clu);
+			/* Give each thread computing the surface values its own lookup */
+			nthr = pfor_nthreads();
+			if ((clus = (void **)malloc(sizeof(void *) * nthr)) == NULL)
+				error("Malloc of thread lookups failed");
+			clus[0] = (void *)clu;
+			for (i = 1; i < nthr; i++) {
+				if ((clus[i] = (void *)luo->clone(luo)) == NULL)
+					error("Cloning lookup failed: %d, %s",icco->errc,icco->err);
+			}
+
+			clu->clutTable->comp_gamut_mt(clu->clutTable, cent, NULL, spoutf, nthr, clus,
+			                              spioutf, clu);
 			rspl_gam_plot(clu->clutTable, "sp_test.wrl", sptest-1);
+			for (i = 1; i < nthr; i++)
+				((icxLuBase *)clus[i])->del((icxLuBase *)clus[i]);
+			free(clus);
 			exit(0);
 		}
 #endif
@@ -189,6 +189,8 @@ static double icxLimitD(icxLuLut *p, double *in);		/* For input' */
 #define icxLimitD_void ((double (*)(void *, double *))icxLimitD)	/* Cast with void 1st arg */
 static double icxLimit(icxLuLut *p, double *in);		/* For input */
 static int icxLuLut_init_clut_camclip(icxLuLut *p);
+static int setup_clipv_icxLuLut(icxLuLut *p);
+static int icxLuLut_finish_setup(icxLuLut *p);
 
 /* Debug overall lookup */
 #ifdef DEBUG_OLUT
@@ -1009,6 +1011,9 @@ double *in		/* Function input values to invert (== clut output' values) */
 	double cdist = 0.0;	/* clip DE */
 	int crv = 0;		/* Return value - set to 1 if clipped */
 
+	if (p->defsetup && icxLuLut_finish_setup(p) != 0)
+		error("%d, %s",p->pp->errc, p->pp->err);
+
 	if (p->nearclip != 0)
 		flags |= RSPL_NEARCLIP;			/* Use nearest clipping rather than clip vector */
 
@@ -1822,18 +1827,96 @@ icxLuBase *pp
 			p->outputTable[i]->del(p->outputTable[i]);
 	}
 
-	if (p->plu != NULL)
-		p->plu->del(p->plu);
+	if (p->shared == 0) {		/* Not a clone */
+		if (p->plu != NULL)
+			p->plu->del(p->plu);
 
-	if (p->cam != NULL)
-		p->cam->del(p->cam);
+		if (p->cam != NULL)
+			p->cam->del(p->cam);
 
-	if (p->absxyzlu != NULL)
-		p->absxyzlu->del(p->absxyzlu);
+		if (p->absxyzlu != NULL)
+			p->absxyzlu->del(p->absxyzlu);
+	}
 
 	free(p);
 }
 
+/* Return a clone that shares the icm lookups and CAM, */
+/* and has duplicates of the rspls that share their grids. */
+static icxLuBase *
+icxLuLut_clone(
+icxLuBase *pp
+) {
+	icxLuLut *p = (icxLuLut *)pp;
+	icmLuLut *luluto = (icmLuLut *)p->plu;
+	icxLuLut *c;
+	double tin[MAX_CHAN], tout[MAX_CHAN];
+	int i;
+
+	/* Complete any lazy setup that would otherwise be done on first */
+	/* use, so that the shared icm lookups are only read by lookups. */
+	for (i = 0; i < MAX_CHAN; i++)
+		tin[i] = 0.0;
+	luluto->inv_input(luluto, tout, tin);
+	luluto->inv_output(luluto, tout, tin);
+
+	if (p->defsetup && icxLuLut_finish_setup(p) != 0)
+		return NULL;
+
+	if (p->camclip && p->nearclip && p->cclutTable == NULL
+	 && icxLuLut_init_clut_camclip(p) != 0)
+		return NULL;
+
+	if ((c = (icxLuLut *) malloc(sizeof(icxLuLut))) == NULL) {
+		p->pp->errc = 2;
+		sprintf(p->pp->err,"Malloc of icxLuLut clone failed");
+		return NULL;
+	}
+	*c = *p;
+	c->shared = 1;
+
+	for (i = 0; i < p->inputChan; i++)
+		c->inputTable[i] = c->revinputTable[i] = NULL;
+	c->clutTable = c->cclutTable = NULL;
+	for (i = 0; i < p->outputChan; i++)
+		c->outputTable[i] = NULL;
+
+	for (i = 0; i < p->inputChan; i++) {
+		if ((p->inputTable[i] != NULL
+		  && (c->inputTable[i] = p->inputTable[i]->dup(p->inputTable[i])) == NULL)
+		 || (p->revinputTable[i] != NULL
+		  && (c->revinputTable[i] = p->revinputTable[i]->dup(p->revinputTable[i])) == NULL))
+			break;
+	}
+	if (i < p->inputChan
+	 || (p->clutTable != NULL
+	  && (c->clutTable = p->clutTable->dup(p->clutTable)) == NULL)
+	 || (p->cclutTable != NULL
+	  && (c->cclutTable = p->cclutTable->dup(p->cclutTable)) == NULL)) {
+		p->pp->errc = 2;
+		sprintf(p->pp->err,"Duplicating rspl for icxLuLut clone failed");
+		c->del((icxLuBase *)c);
+		return NULL;
+	}
+	for (i = 0; i < p->outputChan; i++) {
+		if (p->outputTable[i] != NULL
+		 && (c->outputTable[i] = p->outputTable[i]->dup(p->outputTable[i])) == NULL) {
+			p->pp->errc = 2;
+			sprintf(p->pp->err,"Duplicating rspl for icxLuLut clone failed");
+			c->del((icxLuBase *)c);
+			return NULL;
+		}
+	}
+
+	/* The ink limit context is the icxLuLut using the rspl */
+	if (c->clutTable != NULL && c->clutTable->lcntx == (void *)p)
+		c->clutTable->lcntx = (void *)c;
+	if (c->cclutTable != NULL && c->cclutTable->lcntx == (void *)p)
+		c->cclutTable->lcntx = (void *)c;
+
+	return (icxLuBase *)c;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 static gamut *icxLuLutGamut(icxLuBase *plu, double detail); 
@@ -1854,6 +1937,7 @@ alloc_icxLuLut(
 	p->pp                = xicp;
 	p->plu               = plu;
 	p->del               = icxLuLut_free;
+	p->clone             = icxLuLut_clone;
 	p->lutspaces         = icxLutSpaces;
 	p->spaces            = icxLuSpaces;
 	p->get_native_ranges = icxLu_get_native_ranges;
@@ -1927,6 +2011,45 @@ alloc_icxLuLut(
 	return p;
 }
 
+/* Figure Lmin and Lmax for the icxKluma5 curve basis */
+static void
+setup_Lminmax_icxLuLut(
+icxLuLut *p			/* Object being initialised */
+) {
+	if (p->clutTable->di > p->clutTable->fdi) {	/* If K generation makes sense */
+		double wh[3], bk[3], kk[3];
+		int mergeclut;			/* Save/restore mergeclut value */
+
+		/* Get white/black in effective xlu PCS space */
+		p->efv_wh_bk_points((icxLuBase *)p, wh, bk, kk);
+
+		/* Convert from effective PCS (ie. Jab) to native XYZ or Lab PCS */
+		mergeclut = p->mergeclut;			/* Hack to be able to use inv_out_abs() */
+		p->mergeclut = 0;					/* if mergeclut is active. */
+		icxLuLut_inv_out_abs(p, wh, wh);
+		icxLuLut_inv_out_abs(p, bk, bk);
+		icxLuLut_inv_out_abs(p, kk, kk);
+		p->mergeclut = mergeclut;			/* Restore */
+
+		/* Convert to Lab PCS */
+		if (p->natos == icSigXYZData) {	/* Always do K rule in L space */
+			icmXYZ2Lab(&icmD50, wh, wh);
+			icmXYZ2Lab(&icmD50, bk, bk);
+			icmXYZ2Lab(&icmD50, kk, kk);
+		}
+		p->Lmax = 0.01 * wh[0];
+		if (p->ink.KonlyLmin != 0)
+			p->Lmin = 0.01 * kk[0];
+		else
+			p->Lmin = 0.01 * bk[0];
+	} else {
+
+		/* Some sane defaults */
+		p->Lmax = 1.0;
+		p->Lmin = 0.0;
+	}
+}
+
 /* Initialise the clut ink limiting and black */
 /* generation information. */
 /* return 0 or error code */
@@ -1986,33 +2109,8 @@ int       setLminmax	/* Figure the L locus for inking rule */
 	}
 
 	/* Figure Lmin and Lmax for icxKluma5 curve basis */
-	if (setLminmax
-	 && p->clutTable->di > p->clutTable->fdi) {	/* If K generation makes sense */
-		double wh[3], bk[3], kk[3];
-		int mergeclut;			/* Save/restore mergeclut value */
-
-		/* Get white/black in effective xlu PCS space */
-		p->efv_wh_bk_points((icxLuBase *)p, wh, bk, kk);
-
-		/* Convert from effective PCS (ie. Jab) to native XYZ or Lab PCS */
-		mergeclut = p->mergeclut;			/* Hack to be able to use inv_out_abs() */
-		p->mergeclut = 0;					/* if mergeclut is active. */
-		icxLuLut_inv_out_abs(p, wh, wh);
-		icxLuLut_inv_out_abs(p, bk, bk);
-		icxLuLut_inv_out_abs(p, kk, kk);
-		p->mergeclut = mergeclut;			/* Restore */
-
-		/* Convert to Lab PCS */
-		if (p->natos == icSigXYZData) {	/* Always do K rule in L space */
-			icmXYZ2Lab(&icmD50, wh, wh);
-			icmXYZ2Lab(&icmD50, bk, bk);
-			icmXYZ2Lab(&icmD50, kk, kk);
-		}
-		p->Lmax = 0.01 * wh[0];
-		if (p->ink.KonlyLmin != 0)
-			p->Lmin = 0.01 * kk[0];
-		else
-			p->Lmin = 0.01 * bk[0];
+	if (setLminmax) {
+		setup_Lminmax_icxLuLut(p);
 	} else {
 
 		/* Some sane defaults */
@@ -2029,7 +2127,8 @@ int       setLminmax	/* Figure the L locus for inking rule */
 /* return 0 or error code */
 static int
 setup_clip_icxLuLut(
-icxLuLut *p			/* Object being initialised */
+icxLuLut *p,		/* Object being initialised */
+int defer			/* NZ to leave vector clip setup to icxLuLut_finish_setup() */
 ) {
 	double tmin[MXDIDO], tmax[MXDIDO]; 
 	int i;
@@ -2077,116 +2176,151 @@ icxLuLut *p			/* Object being initialised */
 		p->clip.nearclip = 1;
 
 	} else {		/* Vector clip */
-		/* !!!! NOTE NOTE NOTE !!!! */
-		/* We should re-write this to avoid calling p->clutTable->rev_interp(), */
-		/* since this sets up all the rev acceleration tables for two calls, */
-		/* if this lut is being setup from scattered data, and never used */
-		/* for rev lookup */
-		icColorSpaceSignature clutos = p->natos;
-
-		fprintf(stderr, "!!!!! setup_clip_icxLuLut with vector clip - possibly unnecessary rev setup !!!!\n");
 		p->clip.nearclip = 0;
-		p->clip.LabLike = 0;
-		p->clip.fdi = p->clutTable->fdi;
-
-		switch(clutos) {
-			case icxSigJabData:
-			case icSigLabData: {
-				co pp;				/* Room for all the solutions found */
-				int nsoln;			/* Number of solutions found */
-				double cdir[MXDO];	/* Clip vector direction and length */
-
-				p->clip.LabLike = 1;
-
-				/* Find high clip target */
-				for (i = 0; i < p->inputChan; i++)
-					pp.p[i] = 0.0;					/* Set aux values */
-				pp.v[0] = 105.0; pp.v[1] = pp.v[2] = 0.0; 	/* PCS Target value */
-				cdir[0] = cdir[1] = cdir[2] = 0.0;	/* Clip Target */
-
-				p->inv_output(p, pp.v, pp.v);				/* Compensate for output curve */
-				p->inv_output(p, cdir, cdir);
-			
-				cdir[0] -= pp.v[0];							/* Clip vector */
-				cdir[1] -= pp.v[1];
-				cdir[2] -= pp.v[2];
-
-				/* PCS -> Device with clipping */
-				nsoln = p->clutTable->rev_interp(
-					p->clutTable, 	/* rspl object */
-					0,				/* No hint flags - might be in gamut, might vector clip */
-					1,			 	/* Maxumum solutions to return */
-					p->auxm, 		/* Auxiliary input targets */
-					cdir,			/* Clip vector direction and length */
-					&pp);			/* Input target and output solutions */
-									/* returned solutions in pp[0..retval-1].p[] */
-				nsoln &= RSPL_NOSOLNS;	/* Get number of solutions */
-
-				if (nsoln != 1) {
-					p->pp->errc = 2;
-					sprintf(p->pp->err,"Failed to find high clip target for Lab space");
-					return p->pp->errc;
-				}
+		if (!defer)
+			return setup_clipv_icxLuLut(p);
+	}
+	return 0;
+}
 
-				p->clip.ocent[0] = pp.v[0] - 0.001;					/* Got main target */
-				p->clip.ocent[1] = pp.v[1];
-				p->clip.ocent[2] = pp.v[2];
-
-				/* Find low clip target */
-				pp.v[0] = -5.0; pp.v[1] = pp.v[2] = 0.0; 	/* PCS Target value */
-				cdir[0] = 100.0; cdir[1] = cdir[2] = 0.0;	/* Clip Target */
-
-				p->inv_output(p, pp.v, pp.v);				/* Compensate for output curve */
-				p->inv_output(p, cdir, cdir);
-				cdir[0] -= pp.v[0];							/* Clip vector */
-				cdir[1] -= pp.v[1];
-				cdir[2] -= pp.v[2];
-
-				/* PCS -> Device with clipping */
-				nsoln = p->clutTable->rev_interp(
-					p->clutTable, 	/* rspl object */
-					RSPL_WILLCLIP,	/* Since there was no locus, we expect to have to clip */
-					1,			 	/* Maxumum solutions to return */
-					NULL, 			/* No auxiliary input targets */
-					cdir,			/* Clip vector direction and length */
-					&pp);			/* Input target and output solutions */
-									/* returned solutions in pp[0..retval-1].p[] */
-				nsoln &= RSPL_NOSOLNS;		/* Get number of solutions */
-				if (nsoln != 1) {
-					p->pp->errc = 2;
-					sprintf(p->pp->err,"Failed to find low clip target for Lab space");
-					return p->pp->errc;
-				}
+/* Compute the vector clip information relating to clut output gamut. */
+/* Because this uses p->clutTable->rev_interp(), it sets up all the rev */
+/* acceleration tables, so lookup objects leave it until the first */
+/* reverse lookup. */
+/* return 0 or error code */
+static int
+setup_clipv_icxLuLut(
+icxLuLut *p			/* Object being initialised */
+) {
+	icColorSpaceSignature clutos = p->natos;
+	double tmin[MXDIDO], tmax[MXDIDO]; 
+	int i;
 
-				p->clip.ocentv[0] = pp.v[0] + 0.001 - p->clip.ocent[0];	/* Raw line vector */
-				p->clip.ocentv[1] = pp.v[1] - p->clip.ocent[1];
-				p->clip.ocentv[2] = pp.v[2] - p->clip.ocent[2];
+	p->clip.nearclip = 0;
+	p->clip.LabLike = 0;
+	p->clip.fdi = p->clutTable->fdi;
 
-				/* Compute vectors length */
-				for (p->clip.ocentl = 0.0, i = 0; i < 3; i++)
-					p->clip.ocentl += p->clip.ocentv[i] * p->clip.ocentv[i];
-				p->clip.ocentl = sqrt(p->clip.ocentl);
-				if (p->clip.ocentl <= 1e-8)
-					p->clip.ocentl = 0.0;
+	switch(clutos) {
+		case icxSigJabData:
+		case icSigLabData: {
+			co pp;				/* Room for all the solutions found */
+			int nsoln;			/* Number of solutions found */
+			double cdir[MXDO];	/* Clip vector direction and length */
 
-				break;
-				}
-			case icSigXYZData:
-				// ~~~~~~1 need to add this.
+			p->clip.LabLike = 1;
 
-			default:
-				/* Do a crude approximation, that may not work. */
-				p->clutTable->get_out_range(p->clutTable, tmin, tmax);
-				for (i = 0; i < p->clutTable->fdi; i++) {
-					p->clip.ocent[i] = (tmin[i] + tmax[i])/2.0;
-				}
+			/* Find high clip target */
+			for (i = 0; i < p->inputChan; i++)
+				pp.p[i] = 0.0;					/* Set aux values */
+			pp.v[0] = 105.0; pp.v[1] = pp.v[2] = 0.0; 	/* PCS Target value */
+			cdir[0] = cdir[1] = cdir[2] = 0.0;	/* Clip Target */
+
+			p->inv_output(p, pp.v, pp.v);				/* Compensate for output curve */
+			p->inv_output(p, cdir, cdir);
+		
+			cdir[0] -= pp.v[0];							/* Clip vector */
+			cdir[1] -= pp.v[1];
+			cdir[2] -= pp.v[2];
+
+			/* PCS -> Device with clipping */
+			nsoln = p->clutTable->rev_interp(
+				p->clutTable, 	/* rspl object */
+				0,				/* No hint flags - might be in gamut, might vector clip */
+				1,			 	/* Maxumum solutions to return */
+				p->auxm, 		/* Auxiliary input targets */
+				cdir,			/* Clip vector direction and length */
+				&pp);			/* Input target and output solutions */
+								/* returned solutions in pp[0..retval-1].p[] */
+			nsoln &= RSPL_NOSOLNS;	/* Get number of solutions */
+
+			if (nsoln != 1) {
+				p->pp->errc = 2;
+				sprintf(p->pp->err,"Failed to find high clip target for Lab space");
+				return p->pp->errc;
+			}
+
+			p->clip.ocent[0] = pp.v[0] - 0.001;					/* Got main target */
+			p->clip.ocent[1] = pp.v[1];
+			p->clip.ocent[2] = pp.v[2];
+
+			/* Find low clip target */
+			pp.v[0] = -5.0; pp.v[1] = pp.v[2] = 0.0; 	/* PCS Target value */
+			cdir[0] = 100.0; cdir[1] = cdir[2] = 0.0;	/* Clip Target */
+
+			p->inv_output(p, pp.v, pp.v);				/* Compensate for output curve */
+			p->inv_output(p, cdir, cdir);
+			cdir[0] -= pp.v[0];							/* Clip vector */
+			cdir[1] -= pp.v[1];
+			cdir[2] -= pp.v[2];
+
+			/* PCS -> Device with clipping */
+			nsoln = p->clutTable->rev_interp(
+				p->clutTable, 	/* rspl object */
+				RSPL_WILLCLIP,	/* Since there was no locus, we expect to have to clip */
+				1,			 	/* Maxumum solutions to return */
+				NULL, 			/* No auxiliary input targets */
+				cdir,			/* Clip vector direction and length */
+				&pp);			/* Input target and output solutions */
+								/* returned solutions in pp[0..retval-1].p[] */
+			nsoln &= RSPL_NOSOLNS;		/* Get number of solutions */
+			if (nsoln != 1) {
+				p->pp->errc = 2;
+				sprintf(p->pp->err,"Failed to find low clip target for Lab space");
+				return p->pp->errc;
+			}
+
+			p->clip.ocentv[0] = pp.v[0] + 0.001 - p->clip.ocent[0];	/* Raw line vector */
+			p->clip.ocentv[1] = pp.v[1] - p->clip.ocent[1];
+			p->clip.ocentv[2] = pp.v[2] - p->clip.ocent[2];
+
+			/* Compute vectors length */
+			for (p->clip.ocentl = 0.0, i = 0; i < 3; i++)
+				p->clip.ocentl += p->clip.ocentv[i] * p->clip.ocentv[i];
+			p->clip.ocentl = sqrt(p->clip.ocentl);
+			if (p->clip.ocentl <= 1e-8)
 				p->clip.ocentl = 0.0;
-				break;
-		}
+
+			break;
+			}
+		case icSigXYZData:
+			// ~~~~~~1 need to add this.
+
+		default:
+			/* Do a crude approximation, that may not work. */
+			p->clutTable->get_out_range(p->clutTable, tmin, tmax);
+			for (i = 0; i < p->clutTable->fdi; i++) {
+				p->clip.ocent[i] = (tmin[i] + tmax[i])/2.0;
+			}
+			p->clip.ocentl = 0.0;
+			break;
 	}
 	return 0;
 }
 
+/* Do the part of the reverse lookup setup that a lookup object */
+/* leaves until it is first used for a reverse lookup, so that */
+/* forward only lookups don't pay for it. */
+/* return 0 or error code */
+static int
+icxLuLut_finish_setup(
+icxLuLut *p
+) {
+	int kch = p->kch;
+
+	if (p->defsetup == 0)
+		return 0;
+	p->defsetup = 0;
+
+	setup_Lminmax_icxLuLut(p);
+	p->kch = kch;		/* Lmin/Lmax are computed before setup_clip_icxLuLut() */
+						/* when not deferred, so it resets any kch they discover. */
+
+	if (p->clip.nearclip == 0)
+		return setup_clipv_icxLuLut(p);
+
+	return 0;
+}
+
 /* Function to pass to rspl to set secondary input/output transfer functions */
 static void
 icxLuLut_inout_func(
@@ -2467,18 +2601,21 @@ fprintf(stderr,"~1 Internal optimised 4D separations not yet implemented!\n");
 	/* Setup all the clipping, ink limiting and auxiliary stuff, */
 	/* in case a reverse call is used. Only do this if we know */
 	/* the reverse stuff isn't going to fail due to channel limits. */
+	/* The black point based inking range and any vector clip setup */
+	/* is left until the first reverse lookup. */
 	if (fnc != icmGamut && fnc != icmPreview
 	 && p->clutTable->within_restrictedsize(p->clutTable)) {
 
-		if (setup_ink_icxLuLut(p, ink, 1) != 0) {
+		if (setup_ink_icxLuLut(p, ink, 0) != 0) {
 			p->del((icxLuBase *)p);
 			return NULL;
 		}
 	
-		if (setup_clip_icxLuLut(p) != 0) {
+		if (setup_clip_icxLuLut(p, 1) != 0) {
 			p->del((icxLuBase *)p);
 			return NULL;
 		}
+		p->defsetup = 1;
 	}
 
 	return (icxLuBase *)p;
@@ -3821,7 +3958,7 @@ int                quality			/* Quality metric, 0..3 */
 	xf->del(xf);
 	xf = NULL;
 
-	if (setup_clip_icxLuLut(p) != 0) {
+	if (setup_clip_icxLuLut(p, 0) != 0) {
 		p->del((icxLuBase *)p);
 		return NULL;
 	}
@@ -197,12 +197,38 @@ static void
 icxLuMatrix_free(
 icxLuBase *p
 ) {
-	p->plu->del(p->plu);
-	if (p->cam != NULL)
-		p->cam->del(p->cam);
+	if (p->shared == 0) {		/* Not a clone */
+		p->plu->del(p->plu);
+		if (p->cam != NULL)
+			p->cam->del(p->cam);
+	}
 	free(p);
 }
 
+/* Return a clone that shares the icm lookup and CAM */
+static icxLuBase *
+icxLuMatrix_clone(
+icxLuBase *pp
+) {
+	icxLuMatrix *p = (icxLuMatrix *)pp;
+	icxLuMatrix *c;
+	double tin[3] = { 0.5, 0.5, 0.5 }, tout[3];
+
+	/* Make sure the icm reverse curve tables have been created, */
+	/* so that the shared icm lookup is only read by lookups. */
+	((icmLuMatrix *)p->plu)->bwd_curve((icmLuMatrix *)p->plu, tout, tin);
+
+	if ((c = (icxLuMatrix *) malloc(sizeof(icxLuMatrix))) == NULL) {
+		p->pp->errc = 2;
+		sprintf(p->pp->err,"Malloc of icxLuMatrix clone failed");
+		return NULL;
+	}
+	*c = *p;
+	c->shared = 1;
+
+	return (icxLuBase *)c;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Given a nominated output PCS (ie. Absolute, Jab etc.), convert it in the bwd */
 /* direction into a relative XYZ or Lab PCS value */
@@ -240,6 +266,7 @@ alloc_icxLuMatrix(
 	p->pp                = xicp;
 	p->plu               = plu;
 	p->del               = icxLuMatrix_free;
+	p->clone             = icxLuMatrix_clone;
 	p->lutspaces         = icxLutSpaces;
 	p->spaces            = icxLuSpaces;
 	p->get_native_ranges = icxLu_get_native_ranges;
@@ -165,12 +165,38 @@ static void
 icxLuMono_free(
 icxLuBase *p
 ) {
-	p->plu->del(p->plu);
-	if (p->cam != NULL)
-		p->cam->del(p->cam);
+	if (p->shared == 0) {		/* Not a clone */
+		p->plu->del(p->plu);
+		if (p->cam != NULL)
+			p->cam->del(p->cam);
+	}
 	free(p);
 }
 
+/* Return a clone that shares the icm lookup and CAM */
+static icxLuBase *
+icxLuMono_clone(
+icxLuBase *pp
+) {
+	icxLuMono *p = (icxLuMono *)pp;
+	icxLuMono *c;
+	double tin[1] = { 0.5 }, tout[1];
+
+	/* Make sure the icm reverse curve table has been created, */
+	/* so that the shared icm lookup is only read by lookups. */
+	((icmLuMono *)p->plu)->bwd_curve((icmLuMono *)p->plu, tout, tin);
+
+	if ((c = (icxLuMono *) malloc(sizeof(icxLuMono))) == NULL) {
+		p->pp->errc = 2;
+		sprintf(p->pp->err,"Malloc of icxLuMono clone failed");
+		return NULL;
+	}
+	*c = *p;
+	c->shared = 1;
+
+	return (icxLuBase *)c;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Given a nominated output PCS (ie. Absolute, Jab etc.), convert it in the bwd */
 /* direction into a relative XYZ or Lab PCS value */
@@ -216,6 +242,7 @@ int                   dir			/* 0 = fwd, 1 = bwd */
 	p->pp                = xicp;
 	p->plu               = plu;
 	p->del               = icxLuMono_free;
+	p->clone             = icxLuMono_clone;
 	p->lutspaces         = icxLutSpaces;
 	p->spaces            = icxLuSpaces;
 	p->get_native_ranges = icxLu_get_native_ranges;